@@ -13,6 +13,11 @@ msbuild /p:Configuration=Release`;Platform=x64`;OutDir=..\..\publish\ src\Magpie
 if ($LastExitCode -ne 0) {
 	throw '编译 Magpie.Core 失败'
 }
+# 生成预编译效果包
+msbuild /p:Configuration=Release`;Platform=x64`;BuildProjectReferences=false`;OutDir=..\..\publish\ src\EffectPacker
+if ($LastExitCode -ne 0) {
+	throw '编译 EffectPacker 失败'
+}
 msbuild /m /p:Configuration=Release`;Platform=x64`;BuildProjectReferences=false`;OutDir=..\..\publish\ src\Magpie
 if($LastExitCode -ne 0) {
 	throw '编译 Magpie 失败'
@@ -25,5 +30,6 @@ if ($LastExitCode -ne 0) {
 # 清理不需要的文件
 Set-Location .\publish\
 Remove-Item @("*.pdb", "*.lib", "*.exp", "*.winmd", "*.xml", "*.xbf", "dummy.*", "Microsoft.Web.WebView2.Core.dll")
-Remove-Item @("Microsoft.UI.Xaml", "Magpie.App") -Recurse
+Remove-Item @("EffectPacker.exe")
+Remove-Item @("Microsoft.UI.Xaml", "Magpie.App", "logs") -Recurse
 Remove-Item *.pri -Exclude resources.pri
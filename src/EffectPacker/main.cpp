@@ -0,0 +1,494 @@
+#include "pch.h"
+#include <Magpie.Core.h>
+#include "Logger.h"
+#include "StrUtils.h"
+#include "Utils.h"
+#include "Win32Utils.h"
+#include "CommonSharedConstants.h"
+
+using namespace Magpie::Core;
+
+// 常用的标志组合。内联变量的取值由用户决定，无法预编译
+static constexpr const uint32_t FLAGS_LIST[] = {
+	0,
+	EffectFlags::LastEffect,
+	EffectFlags::FP16,
+	EffectFlags::LastEffect | EffectFlags::FP16
+};
+
+static void ListEffects(std::vector<std::wstring>& result, std::wstring_view prefix = {}) {
+	WIN32_FIND_DATA findData{};
+	HANDLE hFind = Win32Utils::SafeHandle(FindFirstFileEx(
+		StrUtils::ConcatW(CommonSharedConstants::EFFECTS_DIR, prefix, L"*").c_str(),
+		FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH));
+	if (!hFind) {
+		Logger::Get().Win32Error("查找效果失败");
+		return;
+	}
+
+	do {
+		std::wstring_view fileName(findData.cFileName);
+		if (fileName == L"." || fileName == L"..") {
+			continue;
+		}
+
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			ListEffects(result, StrUtils::ConcatW(prefix, fileName, L"\\"));
+			continue;
+		}
+
+		if (!fileName.ends_with(L".hlsl")) {
+			continue;
+		}
+
+		result.emplace_back(StrUtils::ConcatW(prefix, fileName.substr(0, fileName.size() - 5)));
+	} while (FindNextFile(hFind, &findData));
+
+	FindClose(hFind);
+}
+
+struct CpuCheckCase {
+	const char* effectName;
+	float scale;
+	// 输出像素 (x, y) 的期望值
+	std::array<float, 4> (*expected)(const CpuTexture& input, uint32_t x, uint32_t y);
+	// 允许的误差，以 8 位颜色的单位计
+	float tolerance;
+};
+
+static std::array<float, 4> ExpectIdentity(const CpuTexture& input, uint32_t x, uint32_t y) {
+	return input.Load(x, y);
+}
+
+static std::array<float, 4> ExpectNearest2x(const CpuTexture& input, uint32_t x, uint32_t y) {
+	return input.Load(x / 2, y / 2);
+}
+
+// 在 CPU 上运行内置效果的参考实现并检查结果，不需要 GPU
+static int RunCpuCheck() {
+	// 使用默认参数时这些效果的结果都是已知的
+	static constexpr CpuCheckCase CASES[] = {
+		{ "Nearest", 2.0f, ExpectNearest2x, 0.0f },
+		{ "Bilinear", 1.0f, ExpectIdentity, 0.0f },
+		{ "ImageAdjustment", 1.0f, ExpectIdentity, 1.0f }
+	};
+
+	// 覆盖所有色相和亮度的渐变
+	CpuTexture input;
+	input.Create(EffectIntermediateTextureFormat::R8G8B8A8_UNORM, 640, 360);
+	for (uint32_t y = 0; y < input.height; ++y) {
+		for (uint32_t x = 0; x < input.width; ++x) {
+			input.Store(x, y, {
+				float(x) / (input.width - 1),
+				float(y) / (input.height - 1),
+				float((x + y) % 256) / 255,
+				1.0f
+			});
+		}
+	}
+
+	uint32_t failedCount = 0;
+	for (const CpuCheckCase& checkCase : CASES) {
+		EffectDesc desc;
+		desc.name = checkCase.effectName;
+		if (EffectCompiler::Compile(desc, EffectCompilerFlags::NoCache)) {
+			fmt::print(stderr, "{}: failed to compile\n", checkCase.effectName);
+			++failedCount;
+			continue;
+		}
+
+		EffectOption option;
+		option.scale = { checkCase.scale, checkCase.scale };
+
+		CpuEffectDrawer drawer;
+		if (!drawer.Initialize(desc, option, input, { (LONG)input.width, (LONG)input.height }) ||
+			!drawer.SetBuiltinKernels() || !drawer.Draw()) {
+			fmt::print(stderr, "{}: failed to run\n", checkCase.effectName);
+			++failedCount;
+			continue;
+		}
+
+		const CpuTexture& output = drawer.GetOutputTexture();
+		float maxError = 0.0f;
+		for (uint32_t y = 0; y < output.height; ++y) {
+			for (uint32_t x = 0; x < output.width; ++x) {
+				const std::array<float, 4> actual = output.Load(x, y);
+				const std::array<float, 4> expected = checkCase.expected(input, x, y);
+				for (int i = 0; i < 4; ++i) {
+					maxError = std::max(maxError, std::abs(actual[i] - expected[i]) * 255);
+				}
+			}
+		}
+
+		const bool passed = maxError <= checkCase.tolerance + 1e-3f;
+		if (!passed) {
+			++failedCount;
+		}
+		fmt::print("{}: {} (max error {:.2f}, {} us)\n", checkCase.effectName,
+			passed ? "ok" : "FAILED", maxError, drawer.GetPassTimings()[0]);
+	}
+
+	return failedCount ? 1 : 0;
+}
+
+struct TileDifferCheckCase {
+	// 修改这些像素
+	std::vector<POINT> changedPixels;
+	RECT expected;
+};
+
+// 比较 TileDiffer 的结果和已知的外接矩形，能创建 WARP 设备时也检查 GPUTileDiffer
+static int RunTileDifferCheck() {
+	// 尺寸不是块的整数倍，以检查边缘的块
+	constexpr uint32_t WIDTH = 100;
+	constexpr uint32_t HEIGHT = 70;
+	constexpr uint32_t PITCH = WIDTH * 4;
+
+	const TileDifferCheckCase CASES[] = {
+		{ {}, {} },
+		{ { { 0, 0 } }, { 0, 0, 16, 16 } },
+		{ { { 99, 69 } }, { 96, 64, 100, 70 } },
+		{ { { 17, 3 }, { 50, 40 } }, { 16, 0, 64, 48 } },
+		{ { { 15, 15 }, { 16, 16 } }, { 0, 0, 32, 32 } }
+	};
+
+	std::vector<uint8_t> prev(PITCH * HEIGHT);
+	for (size_t i = 0; i < prev.size(); ++i) {
+		prev[i] = uint8_t(i * 7 + i / PITCH * 13);
+	}
+
+	uint32_t failedCount = 0;
+	bool isWarpAvailable = true;
+	for (const TileDifferCheckCase& checkCase : CASES) {
+		std::vector<uint8_t> cur = prev;
+		for (const POINT& pt : checkCase.changedPixels) {
+			// 只改变一个通道
+			cur[pt.y * PITCH + pt.x * 4 + 1] ^= 0xFF;
+		}
+
+		auto printRect = [](const RECT& rect) {
+			return fmt::format("({},{},{},{})", rect.left, rect.top, rect.right, rect.bottom);
+		};
+
+		const RECT cpuRect = TileDiffer::Diff(cur.data(), prev.data(), WIDTH, HEIGHT, PITCH);
+		if (!EqualRect(&cpuRect, &checkCase.expected)) {
+			fmt::print(stderr, "TileDiffer: expected {}, got {}\n",
+				printRect(checkCase.expected), printRect(cpuRect));
+			++failedCount;
+		}
+
+		if (!isWarpAvailable) {
+			continue;
+		}
+
+		RECT gpuRect;
+		if (!TileDiffer::DiffOnWarp(cur.data(), prev.data(), WIDTH, HEIGHT, PITCH, gpuRect)) {
+			fmt::print("GPUTileDiffer: WARP unavailable, skipped\n");
+			isWarpAvailable = false;
+			continue;
+		}
+
+		if (!EqualRect(&gpuRect, &cpuRect)) {
+			fmt::print(stderr, "GPUTileDiffer: expected {}, got {}\n",
+				printRect(cpuRect), printRect(gpuRect));
+			++failedCount;
+		}
+	}
+
+	fmt::print("TileDiffer: {}\n", failedCount ? "FAILED" : "ok");
+	return failedCount ? 1 : 0;
+}
+
+struct GovernorCheckStep {
+	float gpuTime;
+	uint32_t count;
+	// 最后一个样本后的档位，之前的样本不应改变档位
+	uint32_t expectedLevel;
+};
+
+// 向 ResolutionGovernor 输入固定的样本序列，检查降档、升档和升档等待加倍的规则
+static int RunResolutionGovernorCheck() {
+	// 预算为 10ms，升档后估计的用时为当前的两倍，不超过 8ms 才有余量
+	static constexpr float LEVEL_COSTS[] = { 1.0f, 0.5f, 0.25f };
+	// 每次切换档位后的第一个样本被跳过，这里用 { 12.0f, 1, 当前档位 } 表示
+	static constexpr GovernorCheckStep STEPS[] = {
+		// 连续两个样本超出预算才降档
+		{ 12.0f, 1, 0 },
+		{ 3.5f, 1, 0 },
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		// 余量不足 20% 时不升档
+		{ 4.5f, 20, 1 },
+		// 连续 6 个有余量的样本后升档
+		{ 3.5f, 6, 0 },
+		{ 12.0f, 1, 0 },
+		// 升档后很快超出预算，降档并且下次升档的等待加倍
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 3.5f, 12, 0 },
+		{ 12.0f, 1, 0 },
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 3.5f, 24, 0 },
+		{ 12.0f, 1, 0 },
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 3.5f, 48, 0 },
+		{ 12.0f, 1, 0 },
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 3.5f, 96, 0 },
+		{ 12.0f, 1, 0 },
+		// 等待最多为 96 个样本
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 3.5f, 96, 0 },
+		{ 12.0f, 1, 0 },
+		// 最低的档位不再降档
+		{ 12.0f, 2, 1 },
+		{ 12.0f, 1, 1 },
+		{ 12.0f, 2, 2 },
+		{ 20.0f, 10, 2 }
+	};
+
+	ResolutionGovernor governor;
+	governor.Initialize(10.0f, LEVEL_COSTS);
+
+	uint32_t failedCount = 0;
+	for (uint32_t i = 0; i < std::size(STEPS); ++i) {
+		const GovernorCheckStep& step = STEPS[i];
+		const uint32_t prevLevel = governor.GetLevel();
+
+		for (uint32_t j = 0; j < step.count; ++j) {
+			const bool changed = governor.Update(step.gpuTime);
+			const bool isLast = j + 1 == step.count;
+			if (changed != (isLast && step.expectedLevel != prevLevel)) {
+				fmt::print(stderr, "ResolutionGovernor: step {} sample {}: unexpected {}\n",
+					i, j, changed ? "level change" : "no level change");
+				++failedCount;
+				break;
+			}
+		}
+
+		if (governor.GetLevel() != step.expectedLevel) {
+			fmt::print(stderr, "ResolutionGovernor: step {}: expected level {}, got {}\n",
+				i, step.expectedLevel, governor.GetLevel());
+			++failedCount;
+			// 之后的步骤都依赖这一步的结果
+			break;
+		}
+	}
+
+	fmt::print("ResolutionGovernor: {}\n", failedCount ? "FAILED" : "ok");
+	return failedCount ? 1 : 0;
+}
+
+struct AliasCheckAdd {
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t firstPass;
+	uint32_t lastPass;
+	bool isPersistent;
+	uint32_t expectedIdx;
+};
+
+struct AliasCheckCase {
+	const char* name;
+	std::vector<AliasCheckAdd> adds;
+	uint32_t expectedPhysicalCount;
+};
+
+// 检查 TextureAliasPlanner 为各种生命周期、格式和尺寸的纹理分配的物理纹理
+static int RunTextureAliasPlannerCheck() {
+	const AliasCheckCase CASES[] = {
+		{ "overlapping", {
+			{ 0, 64, 64, 0, 2, false, 0 },
+			{ 0, 64, 64, 1, 3, false, 1 },
+			{ 0, 64, 64, 2, 4, false, 2 }
+		}, 3 },
+		{ "disjoint", {
+			{ 0, 64, 64, 0, 1, false, 0 },
+			{ 0, 64, 64, 1, 3, false, 1 },
+			// 第一个物理纹理已空闲
+			{ 0, 64, 64, 2, 2, false, 0 },
+			{ 0, 64, 64, 3, 5, false, 0 },
+			{ 0, 64, 64, 4, 6, false, 1 }
+		}, 2 },
+		{ "format and size mismatch", {
+			{ 0, 64, 64, 0, 0, false, 0 },
+			{ 1, 64, 64, 1, 1, false, 1 },
+			{ 0, 65, 64, 2, 2, false, 2 },
+			{ 0, 64, 65, 3, 3, false, 3 },
+			{ 1, 64, 64, 4, 4, false, 1 },
+			{ 0, 64, 64, 5, 5, false, 0 }
+		}, 4 },
+		{ "persistent", {
+			{ 0, 64, 64, 0, 0, true, 0 },
+			// 生命周期不重叠，但跨帧保留的纹理不共享
+			{ 0, 64, 64, 1, 1, false, 1 },
+			{ 0, 64, 64, 0, 0, true, 2 },
+			{ 0, 64, 64, 2, 2, false, 1 }
+		}, 3 }
+	};
+
+	uint32_t failedCount = 0;
+	for (const AliasCheckCase& checkCase : CASES) {
+		TextureAliasPlanner planner;
+		uint64_t logicalBytes = 0;
+		uint32_t physicalCount = 0;
+		uint64_t physicalBytes = 0;
+		bool passed = true;
+
+		for (const AliasCheckAdd& add : checkCase.adds) {
+			const uint64_t bytes = uint64_t(add.width) * add.height * 4;
+			const uint32_t idx = planner.Add(add.format, add.width, add.height,
+				bytes, add.firstPass, add.lastPass, add.isPersistent);
+			if (idx != add.expectedIdx) {
+				fmt::print(stderr, "TextureAliasPlanner: {}: expected physical texture {}, got {}\n",
+					checkCase.name, add.expectedIdx, idx);
+				passed = false;
+				break;
+			}
+
+			logicalBytes += bytes;
+			if (idx == physicalCount) {
+				++physicalCount;
+				physicalBytes += bytes;
+			}
+		}
+
+		if (passed) {
+			passed = planner.GetPhysicalCount() == checkCase.expectedPhysicalCount
+				&& planner.GetLogicalBytes() == logicalBytes
+				&& planner.GetPhysicalBytes() == physicalBytes;
+			if (!passed) {
+				fmt::print(stderr, "TextureAliasPlanner: {}: wrong physical count or bytes\n", checkCase.name);
+			}
+		}
+
+		if (!passed) {
+			++failedCount;
+		}
+	}
+
+	fmt::print("TextureAliasPlanner: {}\n", failedCount ? "FAILED" : "ok");
+	return failedCount ? 1 : 0;
+}
+
+// 一个重的效果和几个轻的效果组成的混合链
+static constexpr const char* BENCH_CHAIN[] = {
+	"ACNet",
+	"Bicubic",
+	"Lanczos",
+	"Jinc",
+	"Deband",
+	"ImageAdjustment"
+};
+
+// 不使用缓存编译 BENCH_CHAIN，返回用时（微秒），失败时返回 -1
+static int CompileBenchChain(bool parallelEffects, bool serialPasses) {
+	const uint32_t nEffect = (uint32_t)std::size(BENCH_CHAIN);
+	const uint32_t flags = EffectCompilerFlags::NoCache | (serialPasses ? EffectCompilerFlags::Serial : 0);
+	std::atomic<uint32_t> failedCount = 0;
+
+	auto compileEffect = [&](uint32_t id) {
+		EffectDesc desc;
+		desc.name = BENCH_CHAIN[id];
+		if (EffectCompiler::Compile(desc, flags)) {
+			++failedCount;
+		}
+	};
+
+	int duration = Utils::Measure([&]() {
+		if (parallelEffects) {
+			Win32Utils::RunParallel(compileEffect, nEffect);
+		} else {
+			for (uint32_t id = 0; id < nEffect; ++id) {
+				compileEffect(id);
+			}
+		}
+	});
+
+	return failedCount ? -1 : duration;
+}
+
+// 比较混合链的三种编译方式，每种运行 3 次取最短用时
+static int RunCompileBench() {
+	struct BenchMode {
+		const char* name;
+		bool parallelEffects;
+		bool serialPasses;
+	};
+	const BenchMode MODES[] = {
+		{ "serial", false, true },
+		{ "parallel effects only", true, true },
+		{ "shared scheduler", true, false }
+	};
+
+	for (const BenchMode& mode : MODES) {
+		int best = std::numeric_limits<int>::max();
+		for (int i = 0; i < 3; ++i) {
+			const int duration = CompileBenchChain(mode.parallelEffects, mode.serialPasses);
+			if (duration < 0) {
+				fmt::print(stderr, "CompileBench: failed, see logs\\effect_packer.log\n");
+				return 1;
+			}
+			best = std::min(best, duration);
+		}
+
+		fmt::print("CompileBench: {}: {:.1f} ms\n", mode.name, best / 1000.0f);
+	}
+
+	return 0;
+}
+
+// 用法：EffectPacker <效果包路径>
+// 在构建 Effects 后运行，工作目录中需有 effects 文件夹
+// EffectPacker --cpu-check 在 CPU 上运行内置效果的参考实现和其他自检，用于没有 GPU 的环境中的回归测试
+// EffectPacker --bench-compile 测量混合链的编译用时，工作目录中同样需有 effects 文件夹
+int wmain(int argc, wchar_t* argv[]) {
+	if (argc != 2) {
+		fmt::print(stderr, "Usage: EffectPacker <pack path>\n");
+		fmt::print(stderr, "       EffectPacker --cpu-check\n");
+		fmt::print(stderr, "       EffectPacker --bench-compile\n");
+		return 1;
+	}
+
+	Logger& logger = Logger::Get();
+	logger.Initialize(spdlog::level::info, "logs\\effect_packer.log", 100000, 1);
+	LoggerHelper::Initialize(logger);
+
+	if (argv[1] == std::wstring_view(L"--cpu-check")) {
+		// 运行所有检查，有一项失败即返回 1
+		int ret = RunCpuCheck();
+		ret |= RunTileDifferCheck();
+		ret |= RunResolutionGovernorCheck();
+		ret |= RunTextureAliasPlannerCheck();
+		return ret;
+	}
+
+	if (argv[1] == std::wstring_view(L"--bench-compile")) {
+		return RunCompileBench();
+	}
+
+	std::vector<std::wstring> effectNames;
+	ListEffects(effectNames);
+	if (effectNames.empty()) {
+		fmt::print(stderr, "EffectPacker: no effects found\n");
+		return 1;
+	}
+
+	uint32_t ret = 0;
+	int duration = Utils::Measure([&]() {
+		ret = EffectCompiler::BuildPack(effectNames, FLAGS_LIST, argv[1]);
+	});
+
+	if (ret) {
+		fmt::print(stderr, "EffectPacker: failed, see logs\\effect_packer.log\n");
+		return 1;
+	}
+
+	fmt::print("EffectPacker: packed {} effects in {:.1f} s\n", effectNames.size(), duration / 1e6f);
+	return 0;
+}
@@ -35,6 +35,7 @@ SamplerState sam;
 //!PASS 1
 //!STYLE PS
 //!IN INPUT
+//!RADIUS 2
 
 
 float weight(float x) {
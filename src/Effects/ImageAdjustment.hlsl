@@ -97,6 +97,8 @@ SamplerState sam;
 //!PASS 1
 //!STYLE PS
 //!IN INPUT
+//!RADIUS 0
+//!PER_PIXEL
 
 float3 RGBtoHSV(float3 c) {
     float4 K = float4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
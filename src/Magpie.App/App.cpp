@@ -28,6 +28,7 @@
 #include <CoreWindow.h>
 #include <Magpie.Core.h>
 #include "EffectsService.h"
+#include "EffectWarmupService.h"
 #include "UpdateService.h"
 #include "LocalizationService.h"
 
@@ -102,11 +103,13 @@ StartUpOptions App::Initialize(int) {
 	ShortcutService::Get().Initialize();
 	MagService::Get().Initialize();
 	UpdateService::Get().Initialize();
+	EffectWarmupService::Get().Initialize();
 
 	return result;
 }
 
 void App::Uninitialize() {
+	EffectWarmupService::Get().Uninitialize();
 	MagService::Get().Uninitialize();
 	// 不显示托盘图标的情况下关闭主窗口仍会在后台驻留数秒，推测和 XAML Islands 有关
 	// 这里提前取消热键注册，这样关闭 Magpie 后立即重新打开不会注册热键失败
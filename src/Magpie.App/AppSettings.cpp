@@ -508,6 +508,10 @@ bool AppSettings::_Save(const _AppSettingsData& data) noexcept {
 	writer.Bool(data._isAllowScalingMaximized);
 	writer.Key("simulateExclusiveFullscreen");
 	writer.Bool(data._isSimulateExclusiveFullscreen);
+	writer.Key("dynamicResolution");
+	writer.Bool(data._isDynamicResolution);
+	writer.Key("framePacing");
+	writer.Bool(data._isFramePacing);
 	writer.Key("alwaysRunAsAdmin");
 	writer.Bool(data._isAlwaysRunAsAdmin);
 	writer.Key("showTrayIcon");
@@ -647,6 +651,8 @@ void AppSettings::_LoadSettings(const rapidjson::GenericObject<true, rapidjson::
 	JsonHelper::ReadBool(root, "warningsAreErrors", _isWarningsAreErrors);
 	JsonHelper::ReadBool(root, "allowScalingMaximized", _isAllowScalingMaximized);
 	JsonHelper::ReadBool(root, "simulateExclusiveFullscreen", _isSimulateExclusiveFullscreen);
+	JsonHelper::ReadBool(root, "dynamicResolution", _isDynamicResolution);
+	JsonHelper::ReadBool(root, "framePacing", _isFramePacing);
 	if (!JsonHelper::ReadBool(root, "alwaysRunAsAdmin", _isAlwaysRunAsAdmin, true)) {
 		// v0.10.0-preview1 使用 alwaysRunAsElevated
 		JsonHelper::ReadBool(root, "alwaysRunAsElevated", _isAlwaysRunAsAdmin);
@@ -55,6 +55,8 @@ struct _AppSettingsData {
 	bool _isWarningsAreErrors = false;
 	bool _isAllowScalingMaximized = false;
 	bool _isSimulateExclusiveFullscreen = false;
+	bool _isDynamicResolution = false;
+	bool _isFramePacing = false;
 	bool _isInlineParams = false;
 	bool _isShowTrayIcon = true;
 	bool _isAutoRestore = false;
@@ -248,6 +250,24 @@ public:
 		SaveAsync();
 	}
 
+	bool IsDynamicResolution() const noexcept {
+		return _isDynamicResolution;
+	}
+
+	void IsDynamicResolution(bool value) noexcept {
+		_isDynamicResolution = value;
+		SaveAsync();
+	}
+
+	bool IsFramePacing() const noexcept {
+		return _isFramePacing;
+	}
+
+	void IsFramePacing(bool value) noexcept {
+		_isFramePacing = value;
+		SaveAsync();
+	}
+
 	Profile& DefaultProfile() noexcept {
 		return _defaultProfile;
 	}
@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "EffectWarmupService.h"
+#include "AppSettings.h"
+#include "EffectsService.h"
+#include "ScalingMode.h"
+#include "Profile.h"
+#include "StrUtils.h"
+#include "Logger.h"
+#include "Utils.h"
+
+using namespace Magpie::Core;
+
+namespace winrt::Magpie::App {
+
+void EffectWarmupService::Initialize() {
+	AppSettings& settings = AppSettings::Get();
+	if (settings.IsDisableEffectCache()) {
+		// 编译结果不会被保存
+		return;
+	}
+
+	// AppSettings 不是线程安全的，因此在主线程中收集需要编译的效果
+	std::vector<_Job> jobs;
+	// 不内联参数时编译结果只和名字与标志有关，用于去除重复
+	phmap::flat_hash_set<std::wstring> addedKeys;
+	// 内联参数时每组参数各有一个编译结果，但磁盘缓存中每个效果只保留有限的几个，
+	// 超出后预热的结果会互相淘汰，每次启动都要重新编译，因此只预热靠前的配置
+	phmap::flat_hash_map<std::wstring, uint32_t> inlineVariantCounts;
+
+	const DownscalingEffect& downscalingEffect = settings.DownscalingEffect();
+	const bool isInlineParams = settings.IsInlineParams();
+
+	auto addJob = [&](const EffectOption& option, bool isLastEffect) {
+		uint32_t flags = option.flags;
+		if (isInlineParams) {
+			flags |= EffectOptionFlags::InlineParams;
+		}
+
+		std::wstring key = StrUtils::ConcatW(option.name, isLastEffect ? L"|1|" : L"|0|", std::to_wstring(flags));
+		if (flags & EffectOptionFlags::InlineParams) {
+			if (++inlineVariantCounts[key] > EffectCompiler::MAX_CACHED_VARIANTS) {
+				return;
+			}
+		} else if (!addedKeys.emplace(std::move(key)).second) {
+			return;
+		}
+
+		_Job& job = jobs.emplace_back();
+		job.option = option;
+		job.option.flags = flags;
+		job.isLastEffect = isLastEffect;
+	};
+
+	auto addProfile = [&](const Profile& profile) {
+		if (profile.scalingMode < 0 || profile.scalingMode >= (int)settings.ScalingModes().size()) {
+			return;
+		}
+
+		const std::vector<EffectOption>& effects = settings.ScalingModes()[profile.scalingMode].effects;
+		for (size_t i = 0; i < effects.size(); ++i) {
+			const bool isLastEffect = i + 1 == effects.size();
+			addJob(effects[i], isLastEffect);
+
+			// 需要降采样时最后一个效果不再是最后一个，见 Renderer::_BuildEffects
+			if (isLastEffect && !downscalingEffect.name.empty()) {
+				addJob(effects[i], false);
+			}
+		}
+	};
+
+	// 优先编译默认配置使用的效果
+	addProfile(settings.DefaultProfile());
+	for (const Profile& profile : settings.Profiles()) {
+		addProfile(profile);
+	}
+
+	if (jobs.empty()) {
+		return;
+	}
+
+	if (!downscalingEffect.name.empty()) {
+		EffectOption option;
+		option.name = downscalingEffect.name;
+		option.parameters = downscalingEffect.parameters;
+		option.flags = EffectOptionFlags::InlineParams;
+		addJob(option, true);
+	}
+
+	uint32_t compileFlags = EffectCompilerFlags::Serial;
+	if (settings.IsWarningsAreErrors()) {
+		compileFlags |= EffectCompilerFlags::WarningsAreErrors;
+	}
+
+	_warmupThread = std::thread(&EffectWarmupService::_WarmupThreadProc, this, std::move(jobs), compileFlags);
+}
+
+void EffectWarmupService::Uninitialize() {
+	if (!_warmupThread.joinable()) {
+		return;
+	}
+
+	_isCancelled = true;
+	IsPaused(false);
+
+	// 正在进行的编译无法中断，最多等待一个效果编译完成
+	_warmupThread.join();
+}
+
+void EffectWarmupService::IsPaused(bool value) noexcept {
+	_isPaused = value;
+	if (!value) {
+		_isPaused.notify_one();
+	}
+}
+
+void EffectWarmupService::_WarmupThreadProc(std::vector<_Job> jobs, uint32_t compileFlags) noexcept {
+	// 降低 CPU、IO 和内存优先级，只使用空闲的计算资源
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+	// 需要知道效果是否存在
+	EffectsService::Get().WaitForInitialize();
+
+	uint32_t compiledCount = 0;
+	int duration = Utils::Measure([&]() {
+		// 逐个编译，通道也在本线程上串行编译，不占用多个核心，也不会被渲染线程等待时取走
+		for (const _Job& job : jobs) {
+			_isPaused.wait(true);
+			if (_isCancelled) {
+				break;
+			}
+
+			if (!EffectsService::Get().GetEffect(job.option.name)) {
+				continue;
+			}
+
+			EffectDesc desc;
+			desc.name = StrUtils::UTF16ToUTF8(job.option.name);
+			// 将文件夹分隔符统一为 '\'，和 Renderer 相同
+			for (char& c : desc.name) {
+				if (c == '/') {
+					c = '\\';
+				}
+			}
+
+			desc.flags = job.isLastEffect ? EffectFlags::LastEffect : 0;
+			if (job.option.flags & EffectOptionFlags::InlineParams) {
+				desc.flags |= EffectFlags::InlineParams;
+			}
+			if (job.option.flags & EffectOptionFlags::FP16) {
+				desc.flags |= EffectFlags::FP16;
+			}
+
+			// 已缓存时直接返回
+			if (EffectCompiler::Compile(desc, compileFlags, &job.option.parameters)) {
+				Logger::Get().Warn(StrUtils::Concat("预热 ", desc.name, " 失败"));
+			} else {
+				++compiledCount;
+			}
+		}
+	});
+
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+
+	Logger::Get().Info(fmt::format("预热效果缓存完成，成功 {}/{} 个，用时 {} 毫秒",
+		compiledCount, jobs.size(), duration / 1000.0f));
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <Magpie.Core.h>
+
+namespace winrt::Magpie::App {
+
+// 在后台预先编译配置文件用到的效果，使缓存为空时（如更新后）首次缩放也能立即开始
+// 编译结果由 EffectCacheManager 保存，已缓存的效果会直接命中，因此只有缺失的变体会被编译
+class EffectWarmupService {
+public:
+	static EffectWarmupService& Get() noexcept {
+		static EffectWarmupService instance;
+		return instance;
+	}
+
+	EffectWarmupService(const EffectWarmupService&) = delete;
+	EffectWarmupService(EffectWarmupService&&) = delete;
+
+	// 必须在主线程调用，AppSettings 需已初始化
+	void Initialize();
+
+	// 取消尚未开始的编译并等待后台线程退出
+	void Uninitialize();
+
+	// 缩放时暂停，以免和 Renderer 争夺 CPU
+	void IsPaused(bool value) noexcept;
+
+private:
+	struct _Job {
+		::Magpie::Core::EffectOption option;
+		bool isLastEffect = false;
+	};
+
+	EffectWarmupService() = default;
+
+	void _WarmupThreadProc(std::vector<_Job> jobs, uint32_t compileFlags) noexcept;
+
+	std::thread _warmupThread;
+	std::atomic<bool> _isCancelled = false;
+	std::atomic<bool> _isPaused = false;
+};
+
+}
@@ -8,6 +8,7 @@
 #include "ScalingMode.h"
 #include "Logger.h"
 #include "EffectsService.h"
+#include "EffectWarmupService.h"
 
 using namespace ::Magpie::Core;
 using namespace winrt;
@@ -196,6 +197,9 @@ void MagService::_Settings_IsAutoRestoreChanged(bool) {
 }
 
 fire_and_forget MagService::_MagRuntime_IsRunningChanged(bool isRunning) {
+	// 缩放时暂停预热，在切换线程前设置以尽快生效
+	EffectWarmupService::Get().IsPaused(isRunning);
+
 	co_await _dispatcher;
 
 	if (isRunning) {
@@ -314,6 +318,8 @@ bool MagService::_StartScale(HWND hWnd, const Profile& profile) {
 	options.IsWarningsAreErrors(settings.IsWarningsAreErrors());
 	options.IsAllowScalingMaximized(settings.IsAllowScalingMaximized());
 	options.IsSimulateExclusiveFullscreen(settings.IsSimulateExclusiveFullscreen());
+	options.IsDynamicResolution(settings.IsDynamicResolution());
+	options.IsFramePacing(settings.IsFramePacing());
 
 	_isAutoScaling = profile.isAutoScale;
 	_magRuntime->Run(hWnd, options);
@@ -197,6 +197,36 @@ void SettingsViewModel::IsSimulateExclusiveFullscreen(bool value) noexcept {
 	_propertyChangedEvent(*this, PropertyChangedEventArgs(L"IsSimulateExclusiveFullscreen"));
 }
 
+bool SettingsViewModel::IsDynamicResolution() const noexcept {
+	return AppSettings::Get().IsDynamicResolution();
+}
+
+void SettingsViewModel::IsDynamicResolution(bool value) noexcept {
+	AppSettings& settings = AppSettings::Get();
+
+	if (settings.IsDynamicResolution() == value) {
+		return;
+	}
+
+	settings.IsDynamicResolution(value);
+	_propertyChangedEvent(*this, PropertyChangedEventArgs(L"IsDynamicResolution"));
+}
+
+bool SettingsViewModel::IsFramePacing() const noexcept {
+	return AppSettings::Get().IsFramePacing();
+}
+
+void SettingsViewModel::IsFramePacing(bool value) noexcept {
+	AppSettings& settings = AppSettings::Get();
+
+	if (settings.IsFramePacing() == value) {
+		return;
+	}
+
+	settings.IsFramePacing(value);
+	_propertyChangedEvent(*this, PropertyChangedEventArgs(L"IsFramePacing"));
+}
+
 bool SettingsViewModel::IsInlineParams() const noexcept {
 	return AppSettings::Get().IsInlineParams();
 }
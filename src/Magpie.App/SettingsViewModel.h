@@ -50,6 +50,12 @@ struct SettingsViewModel : SettingsViewModelT<SettingsViewModel> {
 	bool IsSimulateExclusiveFullscreen() const noexcept;
 	void IsSimulateExclusiveFullscreen(bool value) noexcept;
 
+	bool IsDynamicResolution() const noexcept;
+	void IsDynamicResolution(bool value) noexcept;
+
+	bool IsFramePacing() const noexcept;
+	void IsFramePacing(bool value) noexcept;
+
 	bool IsInlineParams() const noexcept;
 	void IsInlineParams(bool value) noexcept;
 
@@ -0,0 +1,174 @@
+#include "pch.h"
+#include "CSStateTracker.h"
+
+namespace Magpie::Core {
+
+static ID3D11Resource* GetViewResource(ID3D11View* view) noexcept {
+	if (!view) {
+		return nullptr;
+	}
+
+	// 视图持有资源的引用，因此无需保留这里的引用
+	winrt::com_ptr<ID3D11Resource> resource;
+	view->GetResource(resource.put());
+	return resource.get();
+}
+
+// 返回 views 中和 cache 不同的范围，没有不同时 first 为 views.size()
+template <typename T, size_t N>
+static std::pair<uint32_t, uint32_t> FindChangedRange(std::span<T* const> views, const std::array<T*, N>& cache) noexcept {
+	assert(views.size() <= N);
+
+	uint32_t first = (uint32_t)views.size();
+	uint32_t last = 0;
+	for (uint32_t i = 0; i < (uint32_t)views.size(); ++i) {
+		if (views[i] != cache[i]) {
+			first = std::min(first, i);
+			last = i + 1;
+		}
+	}
+	return { first, last };
+}
+
+void CSStateTracker::Reset() noexcept {
+	_shader = nullptr;
+	_constantBuffers.fill(nullptr);
+	_samplers.fill(nullptr);
+	_srvs.fill(nullptr);
+	_srvResources.fill(nullptr);
+	_srvCount = 0;
+	_uavs.fill(nullptr);
+	_uavResources.fill(nullptr);
+	_uavCount = 0;
+}
+
+void CSStateTracker::SetShader(ID3D11ComputeShader* shader) noexcept {
+	if (_shader == shader) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	_shader = shader;
+	_d3dDC->CSSetShader(shader, nullptr, 0);
+	++_stats.calls;
+}
+
+void CSStateTracker::SetConstantBuffer(UINT slot, ID3D11Buffer* buffer) noexcept {
+	if (_constantBuffers[slot] == buffer) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	_constantBuffers[slot] = buffer;
+	_d3dDC->CSSetConstantBuffers(slot, 1, &buffer);
+	++_stats.calls;
+}
+
+void CSStateTracker::SetSamplers(std::span<ID3D11SamplerState* const> samplers) noexcept {
+	const auto [first, last] = FindChangedRange(samplers, _samplers);
+	if (first >= last) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	std::copy(samplers.begin() + first, samplers.begin() + last, _samplers.begin() + first);
+	_d3dDC->CSSetSamplers(first, last - first, samplers.data() + first);
+	++_stats.calls;
+}
+
+void CSStateTracker::SetShaderResources(std::span<ID3D11ShaderResourceView* const> srvs) noexcept {
+	const auto [first, last] = FindChangedRange(srvs, _srvs);
+	if (first >= last) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	for (uint32_t i = first; i < last; ++i) {
+		if (srvs[i] == _srvs[i]) {
+			continue;
+		}
+
+		_srvs[i] = srvs[i];
+		_srvResources[i] = GetViewResource(srvs[i]);
+
+		// 仍作为 UAV 绑定的资源无法作为 SRV 绑定
+		if (_srvResources[i]) {
+			for (uint32_t j = 0; j < _uavCount; ++j) {
+				if (_uavResources[j] == _srvResources[i]) {
+					_UnbindUnorderedAccessView(j);
+				}
+			}
+		}
+	}
+
+	_srvCount = std::max(_srvCount, last);
+	_d3dDC->CSSetShaderResources(first, last - first, srvs.data() + first);
+	++_stats.calls;
+}
+
+void CSStateTracker::SetUnorderedAccessViews(std::span<ID3D11UnorderedAccessView* const> uavs) noexcept {
+	const auto [first, last] = FindChangedRange(uavs, _uavs);
+	if (first >= last) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	for (uint32_t i = first; i < last; ++i) {
+		if (uavs[i] == _uavs[i]) {
+			continue;
+		}
+
+		_uavs[i] = uavs[i];
+		_uavResources[i] = GetViewResource(uavs[i]);
+
+		// 绑定 UAV 时 D3D 会将作为 SRV 绑定的同一资源置空，这里显式解绑以保持缓存一致
+		if (_uavResources[i]) {
+			for (uint32_t j = 0; j < _srvCount; ++j) {
+				if (_srvResources[j] == _uavResources[i]) {
+					_UnbindShaderResource(j);
+				}
+			}
+		}
+	}
+
+	_uavCount = std::max(_uavCount, last);
+	_d3dDC->CSSetUnorderedAccessViews(first, last - first, uavs.data() + first, nullptr);
+	++_stats.calls;
+}
+
+void CSStateTracker::UnbindUnorderedAccessViews() noexcept {
+	if (_uavCount == 0) {
+		++_stats.elidedCalls;
+		return;
+	}
+
+	static ID3D11UnorderedAccessView* const NULL_UAVS[D3D11_1_UAV_SLOT_COUNT]{};
+	_d3dDC->CSSetUnorderedAccessViews(0, _uavCount, NULL_UAVS, nullptr);
+	++_stats.calls;
+
+	std::fill_n(_uavs.begin(), _uavCount, nullptr);
+	std::fill_n(_uavResources.begin(), _uavCount, nullptr);
+	_uavCount = 0;
+}
+
+void CSStateTracker::_UnbindShaderResource(UINT slot) noexcept {
+	ID3D11ShaderResourceView* srv = nullptr;
+	_d3dDC->CSSetShaderResources(slot, 1, &srv);
+	++_stats.calls;
+	++_stats.hazardUnbinds;
+
+	_srvs[slot] = nullptr;
+	_srvResources[slot] = nullptr;
+}
+
+void CSStateTracker::_UnbindUnorderedAccessView(UINT slot) noexcept {
+	ID3D11UnorderedAccessView* uav = nullptr;
+	_d3dDC->CSSetUnorderedAccessViews(slot, 1, &uav, nullptr);
+	++_stats.calls;
+	++_stats.hazardUnbinds;
+
+	_uavs[slot] = nullptr;
+	_uavResources[slot] = nullptr;
+}
+
+}
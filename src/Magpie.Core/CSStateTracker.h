@@ -0,0 +1,77 @@
+#pragma once
+
+namespace Magpie::Core {
+
+// 缓存计算着色器阶段的绑定，省去和当前状态相同的 CSSet* 调用
+// 所有对计算着色器阶段的绑定都应通过它进行。绑定 SRV 和 UAV 时只解绑真正冲突的槽位
+class CSStateTracker {
+public:
+	CSStateTracker() = default;
+	CSStateTracker(const CSStateTracker&) = delete;
+	CSStateTracker(CSStateTracker&&) = delete;
+
+	void Initialize(ID3D11DeviceContext* d3dDC) noexcept {
+		_d3dDC = d3dDC;
+	}
+
+	ID3D11DeviceContext* GetD3DDC() const noexcept {
+		return _d3dDC;
+	}
+
+	// 在 ID3D11DeviceContext::ClearState 或 ExecuteCommandList 之后调用
+	void Reset() noexcept;
+
+	void SetShader(ID3D11ComputeShader* shader) noexcept;
+
+	void SetConstantBuffer(UINT slot, ID3D11Buffer* buffer) noexcept;
+
+	// 以下均从 0 号槽位开始绑定，之后的槽位保持不变
+	void SetSamplers(std::span<ID3D11SamplerState* const> samplers) noexcept;
+
+	// 如果某个资源仍作为 UAV 绑定，先解绑这个 UAV
+	void SetShaderResources(std::span<ID3D11ShaderResourceView* const> srvs) noexcept;
+
+	// 如果某个资源仍作为 SRV 绑定，先解绑这个 SRV
+	void SetUnorderedAccessViews(std::span<ID3D11UnorderedAccessView* const> uavs) noexcept;
+
+	// 解绑所有 UAV，如在将 UAV 的资源用于其他阶段前
+	void UnbindUnorderedAccessViews() noexcept;
+
+	struct Stats {
+		// 实际发出的 CSSet* 调用
+		uint64_t calls = 0;
+		// 因和当前状态相同而省去的调用
+		uint64_t elidedCalls = 0;
+		// 其中为解决读写冲突而解绑的调用
+		uint64_t hazardUnbinds = 0;
+	};
+
+	const Stats& GetStats() const noexcept {
+		return _stats;
+	}
+
+private:
+	void _UnbindShaderResource(UINT slot) noexcept;
+
+	void _UnbindUnorderedAccessView(UINT slot) noexcept;
+
+	ID3D11DeviceContext* _d3dDC = nullptr;
+
+	ID3D11ComputeShader* _shader = nullptr;
+	std::array<ID3D11Buffer*, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT> _constantBuffers{};
+	std::array<ID3D11SamplerState*, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT> _samplers{};
+
+	// 同时记录视图对应的资源以检测读写冲突
+	std::array<ID3D11ShaderResourceView*, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> _srvs{};
+	std::array<ID3D11Resource*, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> _srvResources{};
+	// 之后的槽位均为空
+	uint32_t _srvCount = 0;
+
+	std::array<ID3D11UnorderedAccessView*, D3D11_1_UAV_SLOT_COUNT> _uavs{};
+	std::array<ID3D11Resource*, D3D11_1_UAV_SLOT_COUNT> _uavResources{};
+	uint32_t _uavCount = 0;
+
+	Stats _stats;
+};
+
+}
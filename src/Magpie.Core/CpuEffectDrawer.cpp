@@ -0,0 +1,421 @@
+#include "pch.h"
+#include "CpuEffectDrawer.h"
+#include "EffectDrawer.h"
+#include "MagOptions.h"
+#include "Logger.h"
+#include "StrUtils.h"
+#include "Utils.h"
+#include "Win32Utils.h"
+#include <bit>
+
+#pragma push_macro("_UNICODE")
+// Conan 的 muparser 不含 UNICODE 支持
+#undef _UNICODE
+#pragma warning(push)
+#pragma warning(disable: 4310)	// 类型强制转换截断常量值
+#include <muParser.h>
+#pragma warning(pop)
+#pragma pop_macro("_UNICODE")
+
+
+namespace Magpie::Core {
+
+// 将 float 的尾数舍入到 mantissaBits 位，用于模拟半精度等浮点格式
+// 不处理指数范围，对参考实现而言已经足够
+static float RoundMantissa(float value, uint32_t mantissaBits) noexcept {
+	const uint32_t shift = 23 - mantissaBits;
+	uint32_t bits = std::bit_cast<uint32_t>(value);
+	bits = (bits + (1u << (shift - 1))) & ~((1u << shift) - 1);
+	return std::bit_cast<float>(bits);
+}
+
+static float QuantizeUNorm(float value, float maxValue) noexcept {
+	return std::roundf(std::clamp(value, 0.0f, 1.0f) * maxValue) / maxValue;
+}
+
+static float QuantizeSNorm(float value, float maxValue) noexcept {
+	return std::roundf(std::clamp(value, -1.0f, 1.0f) * maxValue) / maxValue;
+}
+
+static float Quantize(EffectIntermediateTextureFormat format, uint32_t channel, float value) noexcept {
+	switch (format) {
+	case EffectIntermediateTextureFormat::R16G16B16A16_FLOAT:
+	case EffectIntermediateTextureFormat::R16G16_FLOAT:
+	case EffectIntermediateTextureFormat::R16_FLOAT:
+		return RoundMantissa(value, 10);
+	case EffectIntermediateTextureFormat::R11G11B10_FLOAT:
+		return RoundMantissa(std::max(value, 0.0f), channel == 2 ? 5 : 6);
+	case EffectIntermediateTextureFormat::R16G16B16A16_UNORM:
+	case EffectIntermediateTextureFormat::R16G16_UNORM:
+	case EffectIntermediateTextureFormat::R16_UNORM:
+		return QuantizeUNorm(value, 65535.0f);
+	case EffectIntermediateTextureFormat::R16G16B16A16_SNORM:
+	case EffectIntermediateTextureFormat::R16G16_SNORM:
+	case EffectIntermediateTextureFormat::R16_SNORM:
+		return QuantizeSNorm(value, 32767.0f);
+	case EffectIntermediateTextureFormat::R10G10B10A2_UNORM:
+		return QuantizeUNorm(value, channel == 3 ? 3.0f : 1023.0f);
+	case EffectIntermediateTextureFormat::R8G8B8A8_UNORM:
+	case EffectIntermediateTextureFormat::R8G8_UNORM:
+	case EffectIntermediateTextureFormat::R8_UNORM:
+		return QuantizeUNorm(value, 255.0f);
+	case EffectIntermediateTextureFormat::R8G8B8A8_SNORM:
+	case EffectIntermediateTextureFormat::R8G8_SNORM:
+	case EffectIntermediateTextureFormat::R8_SNORM:
+		return QuantizeSNorm(value, 127.0f);
+	default:
+		return value;
+	}
+}
+
+static int ApplyAddress(int coord, int size, EffectSamplerAddressType addressType) noexcept {
+	if (addressType == EffectSamplerAddressType::Wrap) {
+		coord %= size;
+		return coord < 0 ? coord + size : coord;
+	} else {
+		return std::clamp(coord, 0, size - 1);
+	}
+}
+
+bool CpuTexture::Create(EffectIntermediateTextureFormat format_, uint32_t width_, uint32_t height_) noexcept {
+	if (width_ == 0 || height_ == 0) {
+		return false;
+	}
+
+	format = format_;
+	width = width_;
+	height = height_;
+	nChannel = EffectHelper::FORMAT_DESCS[(uint32_t)format].nChannel;
+	data.assign((size_t)width * height * nChannel, 0.0f);
+	return true;
+}
+
+std::array<float, 4> CpuTexture::Load(int x, int y) const noexcept {
+	x = std::clamp(x, 0, (int)width - 1);
+	y = std::clamp(y, 0, (int)height - 1);
+
+	std::array<float, 4> result{ 0.0f, 0.0f, 0.0f, 1.0f };
+	const float* texel = data.data() + ((size_t)y * width + x) * nChannel;
+	std::copy(texel, texel + nChannel, result.begin());
+	return result;
+}
+
+void CpuTexture::Store(uint32_t x, uint32_t y, const std::array<float, 4>& value) noexcept {
+	if (x >= width || y >= height) {
+		return;
+	}
+
+	float* texel = data.data() + ((size_t)y * width + x) * nChannel;
+	for (uint32_t i = 0; i < nChannel; ++i) {
+		texel[i] = Quantize(format, i, value[i]);
+	}
+}
+
+std::array<float, 4> CpuTexture::Sample(const EffectSamplerDesc& sampler, float u, float v) const noexcept {
+	if (sampler.filterType == EffectSamplerFilterType::Point) {
+		int x = (int)std::floor(u * width);
+		int y = (int)std::floor(v * height);
+		return Load(ApplyAddress(x, (int)width, sampler.addressType), ApplyAddress(y, (int)height, sampler.addressType));
+	}
+
+	const float fx = u * width - 0.5f;
+	const float fy = v * height - 0.5f;
+	const int x0 = (int)std::floor(fx);
+	const int y0 = (int)std::floor(fy);
+	const float wx = fx - x0;
+	const float wy = fy - y0;
+
+	const int xs[2] = {
+		ApplyAddress(x0, (int)width, sampler.addressType),
+		ApplyAddress(x0 + 1, (int)width, sampler.addressType)
+	};
+	const int ys[2] = {
+		ApplyAddress(y0, (int)height, sampler.addressType),
+		ApplyAddress(y0 + 1, (int)height, sampler.addressType)
+	};
+
+	const std::array<float, 4> c00 = Load(xs[0], ys[0]);
+	const std::array<float, 4> c10 = Load(xs[1], ys[0]);
+	const std::array<float, 4> c01 = Load(xs[0], ys[1]);
+	const std::array<float, 4> c11 = Load(xs[1], ys[1]);
+
+	std::array<float, 4> result;
+	for (int i = 0; i < 4; ++i) {
+		float top = c00[i] + (c10[i] - c00[i]) * wx;
+		float bottom = c01[i] + (c11[i] - c01[i]) * wx;
+		result[i] = top + (bottom - top) * wy;
+	}
+	return result;
+}
+
+bool CpuEffectDrawer::Initialize(
+	const EffectDesc& desc,
+	const EffectOption& option,
+	const CpuTexture& inputTex,
+	SIZE hostSize
+) {
+	_desc = desc;
+	_inputSize = { (LONG)inputTex.width, (LONG)inputTex.height };
+
+	if (!EffectDrawer::CalcOutputSize(desc, option, _inputSize, hostSize, _outputSize)) {
+		return false;
+	}
+
+	// 创建中间纹理
+	_ownedTextures.clear();
+	_ownedTextures.resize(desc.textures.size() + 1);
+	_textures.resize(desc.textures.size() + 1);
+	// INPUT 只会被读取
+	_textures[0] = const_cast<CpuTexture*>(&inputTex);
+
+	mu::Parser exprParser;
+	exprParser.DefineConst("INPUT_WIDTH", _inputSize.cx);
+	exprParser.DefineConst("INPUT_HEIGHT", _inputSize.cy);
+	exprParser.DefineConst("OUTPUT_WIDTH", _outputSize.cx);
+	exprParser.DefineConst("OUTPUT_HEIGHT", _outputSize.cy);
+
+	for (size_t i = 1; i < desc.textures.size(); ++i) {
+		const EffectIntermediateTextureDesc& texDesc = desc.textures[i];
+
+		if (!texDesc.source.empty()) {
+			// TextureLoader 依赖 D3D 设备
+			Logger::Get().Error(fmt::format("CPU 执行不支持从文件加载的纹理 {}", texDesc.name));
+			return false;
+		}
+
+		SIZE texSize{};
+		try {
+			exprParser.SetExpr(texDesc.sizeExpr.first);
+			texSize.cx = std::lround(exprParser.Eval());
+			exprParser.SetExpr(texDesc.sizeExpr.second);
+			texSize.cy = std::lround(exprParser.Eval());
+		} catch (const mu::ParserError& e) {
+			Logger::Get().Error(fmt::format("计算中间纹理尺寸 {} 失败：{}", e.GetExpr(), e.GetMsg()));
+			return false;
+		}
+
+		if (texSize.cx <= 0 || texSize.cy <= 0) {
+			Logger::Get().Error("非法的中间纹理尺寸");
+			return false;
+		}
+
+		if (!_ownedTextures[i].Create(texDesc.format, texSize.cx, texSize.cy)) {
+			Logger::Get().Error("创建纹理失败");
+			return false;
+		}
+		_textures[i] = &_ownedTextures[i];
+	}
+
+	// 最后一个效果输出到后缓冲区，它的格式也是 R8G8B8A8_UNORM
+	if (!_ownedTextures.back().Create(EffectIntermediateTextureFormat::R8G8B8A8_UNORM, _outputSize.cx, _outputSize.cy)) {
+		Logger::Get().Error("创建纹理失败");
+		return false;
+	}
+	_textures.back() = &_ownedTextures.back();
+
+	// 参数的处理和 EffectDrawer 相同，但总是提供给 kernel，无论是否内联
+	_params.resize(desc.params.size());
+	for (size_t i = 0; i < desc.params.size(); ++i) {
+		const EffectParameterDesc& paramDesc = desc.params[i];
+		auto it = option.parameters.find(StrUtils::UTF8ToUTF16(paramDesc.name));
+
+		if (paramDesc.constant.index() == 0) {
+			const EffectConstant<float>& constant = std::get<0>(paramDesc.constant);
+			float value = it == option.parameters.end() ? constant.defaultValue : it->second;
+			if (value < constant.minValue || value > constant.maxValue) {
+				Logger::Get().Error(fmt::format("参数 {} 的值非法", paramDesc.name));
+				return false;
+			}
+			_params[i].floatVal = value;
+		} else {
+			const EffectConstant<int>& constant = std::get<1>(paramDesc.constant);
+			int value = it == option.parameters.end() ? constant.defaultValue : (int)std::lroundf(it->second);
+			if (value < constant.minValue || value > constant.maxValue) {
+				Logger::Get().Error(fmt::format("参数 {} 的值非法", paramDesc.name));
+				return false;
+			}
+			_params[i].intVal = value;
+		}
+	}
+
+	_kernels.clear();
+	_kernels.resize(desc.passes.size());
+	_passTimings.clear();
+	_passTimings.resize(desc.passes.size());
+	_frameCount = 0;
+
+	return true;
+}
+
+void CpuEffectDrawer::SetPassKernel(uint32_t passIdx, CpuPassKernel kernel) noexcept {
+	assert(passIdx < _kernels.size());
+	_kernels[passIdx] = std::move(kernel);
+}
+
+// 和 PS 风格的通道相同，pos 为输出像素中心的纹理坐标
+template <typename Fn>
+static void ForEachPixel(const CpuPassContext& ctx, const RECT& tile, Fn&& fn) {
+	CpuTexture& outputTex = *ctx.outputs[0];
+	const float ptX = 1.0f / outputTex.width;
+	const float ptY = 1.0f / outputTex.height;
+
+	for (LONG y = tile.top; y < tile.bottom; ++y) {
+		for (LONG x = tile.left; x < tile.right; ++x) {
+			outputTex.Store(x, y, fn((x + 0.5f) * ptX, (y + 0.5f) * ptY));
+		}
+	}
+}
+
+// Nearest 和 Bilinear 只有一个通道，区别只在采样器
+static void SampleKernel(const CpuPassContext& ctx, const RECT& tile) {
+	const EffectSamplerDesc& sampler = ctx.desc->samplers[0];
+	const CpuTexture& inputTex = *ctx.inputs[0];
+
+	ForEachPixel(ctx, tile, [&](float u, float v) {
+		return inputTex.Sample(sampler, u, v);
+	});
+}
+
+static float Frac(float value) noexcept {
+	return value - std::floor(value);
+}
+
+// 和 ImageAdjustment.hlsl 中的 RGBtoHSV 逐行对应
+static std::array<float, 3> RGBtoHSV(const std::array<float, 4>& c) noexcept {
+	constexpr float K[4] = { 0.0f, -1.0f / 3.0f, 2.0f / 3.0f, -1.0f };
+	const std::array<float, 4> p = c[1] < c[2] ?
+		std::array<float, 4>{ c[2], c[1], K[3], K[2] } : std::array<float, 4>{ c[1], c[2], K[0], K[1] };
+	const std::array<float, 4> q = c[0] < p[0] ?
+		std::array<float, 4>{ p[0], p[1], p[3], c[0] } : std::array<float, 4>{ c[0], p[1], p[2], p[0] };
+
+	const float d = q[0] - std::min(q[3], q[1]);
+	constexpr float e = 1.0e-10f;
+	return { std::abs(q[2] + (q[3] - q[1]) / (6.0f * d + e)), d / (q[0] + e), q[0] };
+}
+
+static std::array<float, 3> HSVtoRGB(const std::array<float, 3>& c) noexcept {
+	constexpr float K[4] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f, 3.0f };
+	std::array<float, 3> result;
+	for (int i = 0; i < 3; ++i) {
+		const float p = std::abs(Frac(c[0] + K[i]) * 6.0f - K[3]);
+		result[i] = c[2] * (K[0] + (std::clamp(p - K[0], 0.0f, 1.0f) - K[0]) * c[1]);
+	}
+	return result;
+}
+
+bool CpuEffectDrawer::SetBuiltinKernels() {
+	if (_desc.name == "Nearest" || _desc.name == "Bilinear") {
+		SetPassKernel(0, SampleKernel);
+		return true;
+	}
+
+	if (_desc.name == "ImageAdjustment") {
+		// 按名字查找参数，参数的顺序变化不影响结果
+		static constexpr std::array PARAM_NAMES = {
+			"targetGamma", "monitorGamma", "saturation", "luminance", "contrast",
+			"brightBoost", "blackLevel", "r", "g", "b"
+		};
+		std::array<uint32_t, PARAM_NAMES.size()> paramIdx{};
+		for (size_t i = 0; i < PARAM_NAMES.size(); ++i) {
+			auto it = std::find_if(_desc.params.begin(), _desc.params.end(),
+				[&](const EffectParameterDesc& param) { return param.name == PARAM_NAMES[i]; });
+			if (it == _desc.params.end()) {
+				Logger::Get().Error(fmt::format("{} 缺少参数 {}", _desc.name, PARAM_NAMES[i]));
+				return false;
+			}
+			paramIdx[i] = uint32_t(it - _desc.params.begin());
+		}
+
+		SetPassKernel(0, [paramIdx](const CpuPassContext& ctx, const RECT& tile) {
+			float p[PARAM_NAMES.size()];
+			for (size_t i = 0; i < PARAM_NAMES.size(); ++i) {
+				p[i] = ctx.params[paramIdx[i]].floatVal;
+			}
+			const auto [targetGamma, monitorGamma, saturation, luminance, contrast,
+				brightBoost, blackLevel, r, g, b] = p;
+
+			const EffectSamplerDesc& sampler = ctx.desc->samplers[0];
+			const CpuTexture& inputTex = *ctx.inputs[0];
+
+			ForEachPixel(ctx, tile, [&](float u, float v) {
+				std::array<float, 3> hsv = RGBtoHSV(inputTex.Sample(sampler, u, v));
+				hsv[1] *= saturation;
+				hsv[2] *= luminance;
+				std::array<float, 3> color = HSVtoRGB(hsv);
+
+				const float channelScale[3] = { r, g, b };
+				std::array<float, 4> result{ 0.0f, 0.0f, 0.0f, 1.0f };
+				for (int i = 0; i < 3; ++i) {
+					float c = std::clamp(color[i], 0.0f, 1.0f);
+					c = std::clamp((c - 0.5f) * contrast + 0.5f + brightBoost, 0.0f, 1.0f);
+					c = std::clamp((c - blackLevel) / (1 - blackLevel), 0.0f, 1.0f);
+					c = std::pow(c, targetGamma / monitorGamma);
+					result[i] = c * channelScale[i];
+				}
+				return result;
+			});
+		});
+		return true;
+	}
+
+	return false;
+}
+
+bool CpuEffectDrawer::Draw() {
+	for (uint32_t i = 0; i < _desc.passes.size(); ++i) {
+		if (!_kernels[i]) {
+			Logger::Get().Error(fmt::format("{} 的通道 {} 没有 CPU 实现", _desc.name, i + 1));
+			return false;
+		}
+
+		const EffectPassDesc& passDesc = _desc.passes[i];
+
+		CpuPassContext ctx;
+		ctx.desc = &_desc;
+		ctx.passIdx = i;
+		ctx.inputSize = _inputSize;
+		ctx.outputSize = _outputSize;
+		ctx.params = { _params.data(), _params.size() };
+		ctx.frameCount = _frameCount;
+
+		for (uint32_t idx : passDesc.inputs) {
+			ctx.inputs.push_back(_textures[idx]);
+		}
+		if (passDesc.outputs.empty()) {
+			// 最后一个通道输出到 OUTPUT
+			ctx.outputs.push_back(_textures.back());
+		} else {
+			for (uint32_t idx : passDesc.outputs) {
+				ctx.outputs.push_back(_textures[idx]);
+			}
+		}
+
+		// 按 blockSize 分块，和 Dispatch 的线程组一一对应
+		const uint32_t blockWidth = std::max(passDesc.blockSize.first, 1u);
+		const uint32_t blockHeight = std::max(passDesc.blockSize.second, 1u);
+		const CpuTexture& outputTex = *ctx.outputs[0];
+		const uint32_t blocksX = (outputTex.width + blockWidth - 1) / blockWidth;
+		const uint32_t blocksY = (outputTex.height + blockHeight - 1) / blockHeight;
+
+		const CpuPassKernel& kernel = _kernels[i];
+		_passTimings[i] = Utils::Measure([&]() {
+			// 每行线程组作为一个任务
+			Win32Utils::RunParallel([&](uint32_t row) {
+				RECT tile;
+				tile.top = LONG(row * blockHeight);
+				tile.bottom = (LONG)std::min((row + 1) * blockHeight, outputTex.height);
+
+				for (uint32_t col = 0; col < blocksX; ++col) {
+					tile.left = LONG(col * blockWidth);
+					tile.right = (LONG)std::min((col + 1) * blockWidth, outputTex.width);
+					kernel(ctx, tile);
+				}
+			}, blocksY);
+		});
+	}
+
+	++_frameCount;
+	return true;
+}
+
+}
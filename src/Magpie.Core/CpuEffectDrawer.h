@@ -0,0 +1,102 @@
+#pragma once
+#include "ExportHelper.h"
+#include "EffectDesc.h"
+#include "EffectHelper.h"
+#include "SmallVector.h"
+#include <functional>
+
+namespace Magpie::Core {
+
+struct EffectOption;
+
+// CPU 上的纹理，每个像素存储 nChannel 个 float
+// 写入时按格式量化，以尽可能接近 GPU 上的结果
+struct API_DECLSPEC CpuTexture {
+	bool Create(EffectIntermediateTextureFormat format_, uint32_t width_, uint32_t height_) noexcept;
+
+	// 坐标越界时钳位，缺失的通道和 D3D 一样补为 (0, 0, 0, 1)
+	std::array<float, 4> Load(int x, int y) const noexcept;
+
+	void Store(uint32_t x, uint32_t y, const std::array<float, 4>& value) noexcept;
+
+	// 模拟 SampleLevel(sam, uv, 0)
+	std::array<float, 4> Sample(const EffectSamplerDesc& sampler, float u, float v) const noexcept;
+
+	EffectIntermediateTextureFormat format = EffectIntermediateTextureFormat::UNKNOWN;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t nChannel = 0;
+	std::vector<float> data;
+};
+
+// 传给 CpuPassKernel 的上下文，和着色器中可访问的资源对应
+struct CpuPassContext {
+	const EffectDesc* desc = nullptr;
+	// 从 0 开始
+	uint32_t passIdx = 0;
+	SmallVector<const CpuTexture*> inputs;
+	SmallVector<CpuTexture*> outputs;
+	SIZE inputSize{};
+	SIZE outputSize{};
+	// 顺序和 desc->params 相同
+	std::span<const EffectHelper::Constant32> params;
+	uint32_t frameCount = 0;
+};
+
+// 着色器无法在 CPU 上执行，每个通道需提供等价的 C++ 实现
+// tile 为 outputs[0] 上的区域，大小为通道的 blockSize，可能在多个线程上同时调用
+using CpuPassKernel = std::function<void(const CpuPassContext& ctx, const RECT& tile)>;
+
+// EffectDrawer 的 CPU 版本，不需要 D3D 设备，用于在没有 GPU 的环境中进行回归测试和基准测试
+// 用法和 EffectDrawer 相同，上一个效果的输出纹理作为下一个效果的输入即可组成效果链
+class API_DECLSPEC CpuEffectDrawer {
+public:
+	CpuEffectDrawer() = default;
+	CpuEffectDrawer(const CpuEffectDrawer&) = delete;
+	CpuEffectDrawer(CpuEffectDrawer&&) = default;
+
+	// hostSize 用于计算 Fit 和 Fill 缩放的输出尺寸
+	bool Initialize(
+		const EffectDesc& desc,
+		const EffectOption& option,
+		const CpuTexture& inputTex,
+		SIZE hostSize
+	);
+
+	void SetPassKernel(uint32_t passIdx, CpuPassKernel kernel) noexcept;
+
+	// 为内置效果设置参考实现，目前支持 Nearest、Bilinear 和 ImageAdjustment。不支持时返回 false
+	bool SetBuiltinKernels();
+
+	bool Draw();
+
+	const EffectDesc& GetDesc() const noexcept {
+		return _desc;
+	}
+
+	const CpuTexture& GetOutputTexture() const noexcept {
+		return _ownedTextures.back();
+	}
+
+	// 上次 Draw 中每个通道的耗时，单位为微秒
+	std::span<const int> GetPassTimings() const noexcept {
+		return { _passTimings.data(), _passTimings.size() };
+	}
+
+private:
+	EffectDesc _desc;
+
+	// 第一个为 INPUT，最后一个为 OUTPUT，INPUT 不属于此对象
+	std::vector<CpuTexture> _ownedTextures;
+	SmallVector<CpuTexture*> _textures;
+
+	SmallVector<EffectHelper::Constant32> _params;
+	SmallVector<CpuPassKernel> _kernels;
+	SmallVector<int> _passTimings;
+
+	SIZE _inputSize{};
+	SIZE _outputSize{};
+	uint32_t _frameCount = 0;
+};
+
+}
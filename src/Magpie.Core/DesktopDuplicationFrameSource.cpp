@@ -68,9 +68,28 @@ static winrt::com_ptr<IDXGIOutput1> GetDXGIOutput(HMONITOR hMonitor) {
 	return nullptr;
 }
 
+struct EnumMonitorParam {
+	RECT frameRect{};
+	SmallVector<HMONITOR> monitors;
+	// 显示器覆盖的源窗口面积，显示器间不会重叠
+	LONGLONG coveredArea = 0;
+};
+
+static BOOL CALLBACK EnumMonitorProc(HMONITOR hMonitor, HDC, LPRECT monitorRect, LPARAM data) {
+	EnumMonitorParam& param = *(EnumMonitorParam*)data;
+
+	RECT intersection;
+	if (IntersectRect(&intersection, monitorRect, &param.frameRect)) {
+		param.monitors.push_back(hMonitor);
+		param.coveredArea += LONGLONG(intersection.right - intersection.left) * (intersection.bottom - intersection.top);
+	}
+
+	return TRUE;
+}
+
 DesktopDuplicationFrameSource::~DesktopDuplicationFrameSource() {
-	_exiting = true;
-	WaitForSingleObject(_hDDPThread, 1000);
+	_StopPipeline();
+	_StopOutputThreads();
 }
 
 bool DesktopDuplicationFrameSource::Initialize() {
@@ -85,14 +104,67 @@ bool DesktopDuplicationFrameSource::Initialize() {
 		return false;
 	}
 
-	HWND hwndSrc = MagApp::Get().GetHwndSrc();
+	if (!_UpdateSrcFrameRect()) {
+		Logger::Get().Error("_UpdateSrcFrameRect 失败");
+		return false;
+	}
 
-	HMONITOR hMonitor = MonitorFromWindow(hwndSrc, MONITOR_DEFAULTTONEAREST);
+	HMONITOR hMonitor = MonitorFromWindow(MagApp::Get().GetHwndSrc(), MONITOR_DEFAULTTONEAREST);
 	if (!hMonitor) {
 		Logger::Get().Win32Error("MonitorFromWindow 失败");
 		return false;
 	}
 
+	// 跨越多个显示器时不移动源窗口
+	SmallVector<HMONITOR> spannedMonitors = _GetSpannedMonitors();
+	if (spannedMonitors.empty() && !_CenterInMonitor(hMonitor)) {
+		return false;
+	}
+
+	if (!_InitializePipeline(
+		DXGI_FORMAT_B8G8R8A8_UNORM,
+		_srcFrameRect.right - _srcFrameRect.left,
+		_srcFrameRect.bottom - _srcFrameRect.top
+	)) {
+		Logger::Get().Error("_InitializePipeline 失败");
+		return false;
+	}
+
+	if (!spannedMonitors.empty()) {
+		if (_InitializeSpanning(spannedMonitors)) {
+			Logger::Get().Info(fmt::format("源窗口跨越 {} 个显示器", spannedMonitors.size()));
+		} else {
+			// 移动源窗口不改变尺寸，纹理仍然可用
+			Logger::Get().Error("捕获多个显示器失败，回落到捕获单个显示器");
+			_outputs.clear();
+			spannedMonitors.clear();
+
+			if (!_CenterInMonitor(hMonitor)) {
+				return false;
+			}
+		}
+	}
+
+	if (spannedMonitors.empty() && !_AddOutput(hMonitor)) {
+		return false;
+	}
+
+	// 使全屏窗口无法被捕获到
+	if (!SetWindowDisplayAffinity(MagApp::Get().GetHwndHost(), WDA_EXCLUDEFROMCAPTURE)) {
+		Logger::Get().Win32Error("SetWindowDisplayAffinity 失败");
+		return false;
+	}
+
+	if (!_StartPipeline()) {
+		Logger::Get().Error("_StartPipeline 失败");
+		return false;
+	}
+
+	Logger::Get().Info("DesktopDuplicationFrameSource 初始化完成");
+	return true;
+}
+
+bool DesktopDuplicationFrameSource::_CenterInMonitor(HMONITOR hMonitor) {
 	MONITORINFO mi{};
 	mi.cbSize = sizeof(mi);
 	if (!GetMonitorInfo(hMonitor, &mi)) {
@@ -100,7 +172,7 @@ bool DesktopDuplicationFrameSource::Initialize() {
 		return false;
 	}
 
-	if (!_CenterWindowIfNecessary(hwndSrc, mi.rcWork)) {
+	if (!_CenterWindowIfNecessary(MagApp::Get().GetHwndSrc(), mi.rcWork)) {
 		Logger::Get().Error("居中源窗口失败");
 		return false;
 	}
@@ -110,280 +182,342 @@ bool DesktopDuplicationFrameSource::Initialize() {
 		return false;
 	}
 
-	auto& dr = MagApp::Get().GetDeviceResources();
+	return true;
+}
 
-	_output = dr.CreateTexture2D(
-		DXGI_FORMAT_B8G8R8A8_UNORM,
-		_srcFrameRect.right - _srcFrameRect.left,
-		_srcFrameRect.bottom - _srcFrameRect.top,
-		D3D11_BIND_SHADER_RESOURCE
-	);
-	if (!_output) {
-		Logger::Get().Error("创建 Texture2D 失败");
-		return false;
+SmallVector<HMONITOR> DesktopDuplicationFrameSource::_GetSpannedMonitors() const {
+	EnumMonitorParam param;
+	param.frameRect = _srcFrameRect;
+	if (!EnumDisplayMonitors(NULL, NULL, EnumMonitorProc, (LPARAM)&param)) {
+		Logger::Get().Win32Error("EnumDisplayMonitors 失败");
+		return {};
 	}
 
-	// 创建共享纹理
-	_sharedTex = dr.CreateTexture2D(
-		DXGI_FORMAT_B8G8R8A8_UNORM,
-		_srcFrameRect.right - _srcFrameRect.left,
-		_srcFrameRect.bottom - _srcFrameRect.top,
-		D3D11_BIND_SHADER_RESOURCE,
-		D3D11_USAGE_DEFAULT,
-		D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX
-	);
-	if (!_sharedTex) {
-		Logger::Get().Error("创建 Texture2D 失败");
-		return false;
+	if (param.monitors.size() <= 1) {
+		return {};
 	}
 
-	_sharedTexMutex = _sharedTex.try_as<IDXGIKeyedMutex>();
-	if (!_sharedTexMutex) {
-		Logger::Get().Error("检索 IDXGIKeyedMutex 失败");
-		return false;
+	// 源窗口有部分不在任何显示器上则无法捕获，仍移到一个显示器中
+	const LONGLONG frameArea = LONGLONG(_srcFrameRect.right - _srcFrameRect.left)
+		* (_srcFrameRect.bottom - _srcFrameRect.top);
+	if (param.coveredArea != frameArea) {
+		return {};
 	}
 
-	winrt::com_ptr<IDXGIResource> sharedDxgiRes = _sharedTex.try_as<IDXGIResource>();
-	if (!sharedDxgiRes) {
-		Logger::Get().Error("检索 IDXGIResource 失败");
-		return false;
-	}
+	return std::move(param.monitors);
+}
 
-	HANDLE hSharedTex = NULL;
-	HRESULT hr = sharedDxgiRes->GetSharedHandle(&hSharedTex);
-	if (FAILED(hr)) {
-		Logger::Get().Error("GetSharedHandle 失败");
+bool DesktopDuplicationFrameSource::_AddOutput(HMONITOR hMonitor) {
+	MONITORINFO mi{};
+	mi.cbSize = sizeof(mi);
+	if (!GetMonitorInfo(hMonitor, &mi)) {
+		Logger::Get().Win32Error("GetMonitorInfo 失败");
 		return false;
 	}
 
-	if (!_InitializeDdpD3D(hSharedTex)) {
-		Logger::Get().Error("初始化 D3D 失败");
+	RECT part;
+	if (!IntersectRect(&part, &mi.rcMonitor, &_srcFrameRect)) {
+		Logger::Get().Error("源窗口不在显示器上");
 		return false;
 	}
 
-	winrt::com_ptr<IDXGIOutput1> output = GetDXGIOutput(hMonitor);
-	if (!output) {
+	winrt::com_ptr<IDXGIOutput1> dxgiOutput = GetDXGIOutput(hMonitor);
+	if (!dxgiOutput) {
 		Logger::Get().Error("无法找到 IDXGIOutput");
 		return false;
 	}
 
-	hr = output->DuplicateOutput(_ddpD3dDevice.get(), _outputDup.put());
+	_DuplicatedOutput& output = _outputs.emplace_back();
+
+	HRESULT hr = dxgiOutput->DuplicateOutput(_captureD3DDevice.get(), output.dup.put());
 	if (FAILED(hr)) {
 		Logger::Get().ComError("DuplicateOutput 失败", hr);
+		_outputs.pop_back();
 		return false;
 	}
 
-	// 计算源窗口客户区在该屏幕上的位置，用于计算新帧是否有更新
-	_srcClientInMonitor = {
-		_srcFrameRect.left - mi.rcMonitor.left,
-		_srcFrameRect.top - mi.rcMonitor.top,
-		_srcFrameRect.right - mi.rcMonitor.left,
-		_srcFrameRect.bottom - mi.rcMonitor.top
-	};
+	output.hMonitor = hMonitor;
+	// 计算源窗口在该屏幕上的位置，用于计算新帧是否有更新
+	output.srcRect = part;
+	OffsetRect(&output.srcRect, -mi.rcMonitor.left, -mi.rcMonitor.top);
+	output.destPos = { part.left - _srcFrameRect.left, part.top - _srcFrameRect.top };
+	return true;
+}
 
-	_frameInMonitor = {
-		(UINT)_srcClientInMonitor.left,
-		(UINT)_srcClientInMonitor.top,
-		0,
-		(UINT)_srcClientInMonitor.right,
-		(UINT)_srcClientInMonitor.bottom,
-		1
-	};
+bool DesktopDuplicationFrameSource::_InitializeSpanning(const SmallVector<HMONITOR>& monitors) {
+	for (HMONITOR hMonitor : monitors) {
+		if (!_AddOutput(hMonitor)) {
+			return false;
+		}
+	}
 
-	// 使全屏窗口无法被捕获到
-	if (!SetWindowDisplayAffinity(MagApp::Get().GetHwndHost(), WDA_EXCLUDEFROMCAPTURE)) {
-		Logger::Get().Win32Error("SetWindowDisplayAffinity 失败");
+	// 多个线程使用捕获设备
+	winrt::com_ptr<ID3D11Multithread> multithread = _captureD3DDC.try_as<ID3D11Multithread>();
+	if (!multithread) {
+		Logger::Get().Error("检索 ID3D11Multithread 失败");
+		return false;
+	}
+	multithread->SetMultithreadProtected(TRUE);
+
+	D3D11_TEXTURE2D_DESC desc{};
+	desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	desc.Width = _srcFrameRect.right - _srcFrameRect.left;
+	desc.Height = _srcFrameRect.bottom - _srcFrameRect.top;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	HRESULT hr = _captureD3DDevice->CreateTexture2D(&desc, nullptr, _atlas.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("创建 Texture2D 失败", hr);
 		return false;
 	}
 
-
-	_hDDPThread = CreateThread(nullptr, 0, _DDPThreadProc, this, 0, nullptr);
-	if (!_hDDPThread) {
+	_atlasUpdatedEvent.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	if (!_atlasUpdatedEvent) {
+		Logger::Get().Win32Error("CreateEvent 失败");
 		return false;
 	}
 
-	Logger::Get().Info("DesktopDuplicationFrameSource 初始化完成");
+	// 线程持有 _outputs 中元素的引用，此后不能再修改 _outputs
+	_outputsWithoutFrame = (uint32_t)_outputs.size();
+	_exitingOutputs.store(false, std::memory_order_relaxed);
+	for (_DuplicatedOutput& output : _outputs) {
+		_outputThreads.emplace_back(&DesktopDuplicationFrameSource::_OutputThreadProc, this, std::ref(output));
+	}
+
 	return true;
 }
 
-
-FrameSourceBase::UpdateState DesktopDuplicationFrameSource::Update() {
-	UINT newFrameState = _newFrameState.load();
-	if (newFrameState == 2) {
-		// 第一帧之前不渲染
-		return UpdateState::Waiting;
-	} else if (newFrameState == 0) {
-		return UpdateState::NoUpdate;
+void DesktopDuplicationFrameSource::_StopOutputThreads() noexcept {
+	_exitingOutputs.store(true, std::memory_order_relaxed);
+	for (std::thread& thread : _outputThreads) {
+		thread.join();
 	}
+	_outputThreads.clear();
+}
 
-	// 不必等待，当 newFrameState 变化时 DDP 线程已将锁释放
-	HRESULT hr = _sharedTexMutex->AcquireSync(1, 0);
-	if (hr == static_cast<HRESULT>(WAIT_TIMEOUT)) {
-		return UpdateState::Waiting;
+bool DesktopDuplicationFrameSource::_RecreateDuplication(_DuplicatedOutput& output) {
+	// 失效的 IDXGIOutputDuplication 无需释放帧
+	output.dup = nullptr;
+	output.isFrameAcquired = false;
+
+	winrt::com_ptr<IDXGIOutput1> dxgiOutput = GetDXGIOutput(output.hMonitor);
+	if (!dxgiOutput) {
+		Logger::Get().Error("无法找到 IDXGIOutput");
+		return false;
 	}
 
+	HRESULT hr = dxgiOutput->DuplicateOutput(_captureD3DDevice.get(), output.dup.put());
 	if (FAILED(hr)) {
-		Logger::Get().ComError("AcquireSync 失败", hr);
-		return UpdateState::Error;
+		Logger::Get().ComError("DuplicateOutput 失败", hr);
+		return false;
 	}
 
-	_newFrameState.store(0);
-
-	MagApp::Get().GetDeviceResources().GetD3DDC()->CopyResource(_output.get(), _sharedTex.get());
-
-	_sharedTexMutex->ReleaseSync(0);
-
-	return UpdateState::NewFrame;
+	output.isFullFrameNeeded = true;
+	Logger::Get().Info("已重新创建 IDXGIOutputDuplication");
+	return true;
 }
 
-bool DesktopDuplicationFrameSource::_InitializeDdpD3D(HANDLE hSharedTex) {
-	UINT createDeviceFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
-	if (DeviceResources::IsDebugLayersAvailable()) {
-		// 在 DEBUG 配置启用调试层
-		createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
-	}
-
-	D3D_FEATURE_LEVEL featureLevels[] = {
-		D3D_FEATURE_LEVEL_11_1,
-		D3D_FEATURE_LEVEL_11_0
-	};
-	UINT nFeatureLevels = ARRAYSIZE(featureLevels);
-
-	// 使用和 Renderer 相同的图像适配器以避免 GPU 间的纹理拷贝
-	HRESULT hr = D3D11CreateDevice(
-		MagApp::Get().GetDeviceResources().GetGraphicsAdapter(),
-		D3D_DRIVER_TYPE_UNKNOWN,
-		nullptr,
-		createDeviceFlags,
-		featureLevels,
-		nFeatureLevels,
-		D3D11_SDK_VERSION,
-		_ddpD3dDevice.put(),
-		nullptr,
-		_ddpD3dDC.put()
-	);
+void DesktopDuplicationFrameSource::_OnDuplicationError(_DuplicatedOutput& output, const char* msg, HRESULT hr) {
+	Logger::Get().ComError(msg, hr);
 
-	if (FAILED(hr)) {
-		Logger::Get().ComError("D3D11CreateDevice 失败", hr);
-		return false;
+	if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET) {
+		_ReportCaptureError();
+		return;
 	}
 
-	// 获取共享纹理
-	hr = _ddpD3dDevice->OpenSharedResource(hSharedTex, IID_PPV_ARGS(_ddpSharedTex.put()));
-	if (FAILED(hr)) {
-		Logger::Get().ComError("OpenSharedResource 失败", hr);
-		return false;
+	// 切换到安全桌面时可能持续数秒无法捕获，更久则认为无法恢复
+	static constexpr uint32_t MAX_FAILURES = 20;
+	if (++output.failureCount > MAX_FAILURES) {
+		Logger::Get().Error("多次重试后仍无法捕获显示器");
+		_ReportCaptureError();
+		return;
 	}
 
-	_ddpSharedTexMutex = _ddpSharedTex.try_as<IDXGIKeyedMutex>();
-	if (!_ddpSharedTexMutex) {
-		Logger::Get().Error("检索 IDXGIKeyedMutex 失败");
-		return false;
+	// 桌面切换、显示模式改变等情况下访问丢失，需重新创建
+	if (hr == DXGI_ERROR_ACCESS_LOST && _RecreateDuplication(output)) {
+		return;
 	}
 
-	return true;
+	// 退避以免调用方忙等，最长约一秒
+	Sleep(std::min(10u << output.failureCount, 1000u));
 }
 
-DWORD WINAPI DesktopDuplicationFrameSource::_DDPThreadProc(LPVOID lpThreadParameter) {
-	DesktopDuplicationFrameSource& that = *(DesktopDuplicationFrameSource*)lpThreadParameter;
+winrt::com_ptr<ID3D11Resource> DesktopDuplicationFrameSource::_AcquireOutputFrame(_DuplicatedOutput& output) {
+	if (!output.dup) {
+		// 上次重新创建失败
+		if (!_RecreateDuplication(output)) {
+			_OnDuplicationError(output, "重新创建 IDXGIOutputDuplication 失败", E_FAIL);
+			return nullptr;
+		}
+	}
+
+	if (output.isFrameAcquired) {
+		output.dup->ReleaseFrame();
+		output.isFrameAcquired = false;
+	}
 
+	// 超时以便及时退出
 	DXGI_OUTDUPL_FRAME_INFO info{};
 	winrt::com_ptr<IDXGIResource> dxgiRes;
-	SmallVector<uint8_t, 0> dupMetaData;
+	HRESULT hr = output.dup->AcquireNextFrame(100, &info, dxgiRes.put());
+	if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+		return nullptr;
+	}
 
-	while (!that._exiting.load()) {
-		if (dxgiRes) {
-			that._outputDup->ReleaseFrame();
-		}
-		HRESULT hr = that._outputDup->AcquireNextFrame(500, &info, dxgiRes.put());
-		if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-			continue;
+	if (FAILED(hr)) {
+		_OnDuplicationError(output, "AcquireNextFrame 失败", hr);
+		return nullptr;
+	}
+	output.isFrameAcquired = true;
+	output.failureCount = 0;
+
+	if (info.AccumulatedFrames > 1) {
+		// 上次释放帧后屏幕更新了多次，系统已将它们合并
+		_AddDroppedFrames(info.AccumulatedFrames - 1);
+	}
+
+	// 检索 move rects 和 dirty rects
+	// 这些区域如果和源窗口有重叠则表明画面有变化
+	output.changedRects.clear();
+	if (info.TotalMetadataBufferSize) {
+		if (info.TotalMetadataBufferSize > output.metaData.size()) {
+			output.metaData.resize(info.TotalMetadataBufferSize);
 		}
 
+		UINT bufSize = info.TotalMetadataBufferSize;
+
+		// move rects
+		hr = output.dup->GetFrameMoveRects(bufSize, (DXGI_OUTDUPL_MOVE_RECT*)output.metaData.data(), &bufSize);
 		if (FAILED(hr)) {
-			Logger::Get().ComError("AcquireNextFrame 失败", hr);
-			continue;
+			_OnDuplicationError(output, "GetFrameMoveRects 失败", hr);
+			return nullptr;
 		}
 
-		bool noUpdate = true;
-
-		// 检索 move rects 和 dirty rects
-		// 这些区域如果和窗口客户区有重叠则表明画面有变化
-		if (info.TotalMetadataBufferSize) {
-			if (info.TotalMetadataBufferSize > dupMetaData.size()) {
-				dupMetaData.resize(info.TotalMetadataBufferSize);
+		UINT nRect = bufSize / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+		for (UINT i = 0; i < nRect; ++i) {
+			const DXGI_OUTDUPL_MOVE_RECT& rect = ((DXGI_OUTDUPL_MOVE_RECT*)output.metaData.data())[i];
+			RECT intersection;
+			if (IntersectRect(&intersection, &output.srcRect, &rect.DestinationRect)) {
+				output.changedRects.push_back(intersection);
 			}
+		}
 
-			UINT bufSize = info.TotalMetadataBufferSize;
+		// dirty rects
+		bufSize = info.TotalMetadataBufferSize;
+		hr = output.dup->GetFrameDirtyRects(bufSize, (RECT*)output.metaData.data(), &bufSize);
+		if (FAILED(hr)) {
+			_OnDuplicationError(output, "GetFrameDirtyRects 失败", hr);
+			return nullptr;
+		}
 
-			// move rects
-			hr = that._outputDup->GetFrameMoveRects(bufSize, (DXGI_OUTDUPL_MOVE_RECT*)dupMetaData.data(), &bufSize);
-			if (FAILED(hr)) {
-				Logger::Get().ComError("GetFrameMoveRects 失败", hr);
-				continue;
+		nRect = bufSize / sizeof(RECT);
+		for (UINT i = 0; i < nRect; ++i) {
+			const RECT& rect = ((RECT*)output.metaData.data())[i];
+			RECT intersection;
+			if (IntersectRect(&intersection, &output.srcRect, &rect)) {
+				output.changedRects.push_back(intersection);
 			}
+		}
+	}
 
-			UINT nRect = bufSize / sizeof(DXGI_OUTDUPL_MOVE_RECT);
-			for (UINT i = 0; i < nRect; ++i) {
-				const DXGI_OUTDUPL_MOVE_RECT& rect = ((DXGI_OUTDUPL_MOVE_RECT*)dupMetaData.data())[i];
-				if (Win32Utils::CheckOverlap(that._srcClientInMonitor, rect.DestinationRect)) {
-					noUpdate = false;
-					break;
-				}
-			}
+	if (output.isFullFrameNeeded && info.LastPresentTime.QuadPart != 0) {
+		// 之前的变化没有被接收
+		output.isFullFrameNeeded = false;
+		output.changedRects.clear();
+		output.changedRects.push_back(output.srcRect);
+	}
 
-			if (noUpdate) {
-				bufSize = info.TotalMetadataBufferSize;
-
-				// dirty rects
-				hr = that._outputDup->GetFrameDirtyRects(bufSize, (RECT*)dupMetaData.data(), &bufSize);
-				if (FAILED(hr)) {
-					Logger::Get().ComError("GetFrameDirtyRects 失败", hr);
-					continue;
-				}
-
-				nRect = bufSize / sizeof(RECT);
-				for (UINT i = 0; i < nRect; ++i) {
-					const RECT& rect = ((RECT*)dupMetaData.data())[i];
-					if (Win32Utils::CheckOverlap(that._srcClientInMonitor, rect)) {
-						noUpdate = false;
-						break;
-					}
-				}
-			}
-		}
+	if (output.changedRects.empty()) {
+		return nullptr;
+	}
 
-		if (noUpdate) {
-			continue;
-		}
+	winrt::com_ptr<ID3D11Resource> d3dRes = dxgiRes.try_as<ID3D11Resource>();
+	if (!d3dRes) {
+		Logger::Get().Error("从 IDXGIResource 检索 ID3D11Resource 失败");
+		_ReportCaptureError();
+		return nullptr;
+	}
 
-		winrt::com_ptr<ID3D11Resource> d3dRes = dxgiRes.try_as<ID3D11Resource>();
-		if (!d3dRes) {
-			Logger::Get().Error("从 IDXGIResource 检索 ID3D11Resource 失败");
-			continue;
-		}
+	return d3dRes;
+}
 
-		hr = that._ddpSharedTexMutex->AcquireSync(0, 100);
-		while (hr == static_cast<HRESULT>(WAIT_TIMEOUT)) {
-			if (that._exiting.load()) {
-				return 0;
-			}
+void DesktopDuplicationFrameSource::_CopyChangedRects(_DuplicatedOutput& output, ID3D11Resource* frame) {
+	// 只复制变化的区域，重叠的区域可能被复制多次
+	std::scoped_lock lk(_atlasMutex);
+
+	for (const RECT& rect : output.changedRects) {
+		const D3D11_BOX box = { (UINT)rect.left, (UINT)rect.top, 0, (UINT)rect.right, (UINT)rect.bottom, 1 };
+		const LONG destX = output.destPos.x + rect.left - output.srcRect.left;
+		const LONG destY = output.destPos.y + rect.top - output.srcRect.top;
+		_captureD3DDC->CopySubresourceRegion(_atlas.get(), 0, destX, destY, 0, frame, 0, &box);
 
-			hr = that._ddpSharedTexMutex->AcquireSync(0, 100);
+		const RECT destRect = { destX, destY, destX + rect.right - rect.left, destY + rect.bottom - rect.top };
+		UnionRect(&_atlasDirtyRect, &_atlasDirtyRect, &destRect);
+	}
+
+	if (!output.isFirstFrameCopied) {
+		output.isFirstFrameCopied = true;
+		--_outputsWithoutFrame;
+	}
+}
+
+void DesktopDuplicationFrameSource::_OutputThreadProc(_DuplicatedOutput& output) noexcept {
+	// 出错后捕获线程也将退出，不再重试
+	while (!_exitingOutputs.load(std::memory_order_relaxed) && !_IsCaptureFailed()) {
+		winrt::com_ptr<ID3D11Resource> frame = _AcquireOutputFrame(output);
+		if (frame) {
+			_CopyChangedRects(output, frame.get());
+			SetEvent(_atlasUpdatedEvent.get());
 		}
+	}
+}
 
-		if (FAILED(hr)) {
-			Logger::Get().ComError("AcquireSync 失败", hr);
-			continue;
+bool DesktopDuplicationFrameSource::_CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) {
+	if (_outputs.size() == 1) {
+		// 只有一个显示器时直接复制到目标纹理
+		_DuplicatedOutput& output = _outputs[0];
+		winrt::com_ptr<ID3D11Resource> frame = _AcquireOutputFrame(output);
+		if (!frame) {
+			return false;
 		}
 
+		// 环形缓冲区中的纹理内容较旧，需复制整个源窗口
+		const D3D11_BOX box = {
+			(UINT)output.srcRect.left,
+			(UINT)output.srcRect.top,
+			0,
+			(UINT)output.srcRect.right,
+			(UINT)output.srcRect.bottom,
+			1
+		};
+		_captureD3DDC->CopySubresourceRegion(target, 0, 0, 0, 0, frame.get(), 0, &box);
+
+		// 转换到 _output 的坐标系，跳过的帧中变化的区域由 PipelinedFrameSourceBase 合并
+		dirtyRect = {};
+		for (const RECT& rect : output.changedRects) {
+			UnionRect(&dirtyRect, &dirtyRect, &rect);
+		}
+		OffsetRect(&dirtyRect, -output.srcRect.left, -output.srcRect.top);
+		return true;
+	}
+
+	// 超时以便及时退出
+	if (WaitForSingleObject(_atlasUpdatedEvent.get(), 100) != WAIT_OBJECT_0) {
+		return false;
+	}
+
+	std::scoped_lock lk(_atlasMutex);
 
-		that._ddpD3dDC->CopySubresourceRegion(that._ddpSharedTex.get(), 0, 0, 0, 0, d3dRes.get(), 0, &that._frameInMonitor);
-		that._ddpSharedTexMutex->ReleaseSync(1);
-		that._newFrameState.store(1);
+	if (_outputsWithoutFrame > 0 || IsRectEmpty(&_atlasDirtyRect)) {
+		return false;
 	}
 
-	return 0;
+	_captureD3DDC->CopyResource(target, _atlas.get());
+	dirtyRect = _atlasDirtyRect;
+	_atlasDirtyRect = {};
+	return true;
 }
 
 }
@@ -1,19 +1,20 @@
 #pragma once
-#include "FrameSourceBase.h"
+#include "PipelinedFrameSourceBase.h"
+#include "SmallVector.h"
+#include "Win32Utils.h"
 
 namespace Magpie::Core {
 
 // 使用 Desktop Duplication API 捕获窗口
-// 在单独的线程中接收屏幕帧以避免丢帧
-class DesktopDuplicationFrameSource : public FrameSourceBase {
+// 在捕获线程中接收屏幕帧，渲染较慢时也总是接收最新的帧
+// 源窗口跨越多个显示器时每个显示器使用一个线程，各自将变化的部分复制到拼合纹理
+class DesktopDuplicationFrameSource : public PipelinedFrameSourceBase {
 public:
 	DesktopDuplicationFrameSource() {};
 	virtual ~DesktopDuplicationFrameSource();
 
 	bool Initialize() override;
 
-	UpdateState Update() override;
-
 	bool IsScreenCapture() override {
 		return true;
 	}
@@ -31,33 +32,69 @@ protected:
 		return true;
 	}
 
-private:
-	bool _InitializeDdpD3D(HANDLE hSharedTex);
-
-	static DWORD WINAPI _DDPThreadProc(LPVOID lpThreadParameter);
-
-	winrt::com_ptr<IDXGIOutputDuplication> _outputDup;
+	bool _CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) override;
 
-	HANDLE _hDDPThread = NULL;
-	std::atomic<bool> _exiting = false;
-	// 0: 等待新帧
-	// 1: 新帧到达
-	// 2: 等待第一帧
-	std::atomic<UINT> _newFrameState = 2;
-
-	// DDP 线程使用的 D3D 设备
-	winrt::com_ptr<ID3D11Device> _ddpD3dDevice;
-	winrt::com_ptr<ID3D11DeviceContext> _ddpD3dDC;
-
-	// 这些均指向同一个纹理
-	// 用于在 D3D Device 间同步对该纹理的访问
-	winrt::com_ptr<ID3D11Texture2D> _sharedTex;
-	winrt::com_ptr<IDXGIKeyedMutex> _sharedTexMutex;
-	winrt::com_ptr<ID3D11Texture2D> _ddpSharedTex;
-	winrt::com_ptr<IDXGIKeyedMutex> _ddpSharedTexMutex;
-
-	RECT _srcClientInMonitor{};
-	D3D11_BOX _frameInMonitor{};
+private:
+	struct _DuplicatedOutput {
+		winrt::com_ptr<IDXGIOutputDuplication> dup;
+		HMONITOR hMonitor = NULL;
+		// 源窗口在此显示器上的部分，坐标系为显示器
+		RECT srcRect{};
+		// 这部分在帧中的位置
+		POINT destPos{};
+
+		// 以下只在接收此显示器的线程中访问
+		// 帧在下次 AcquireNextFrame 前释放，这样 DWM 可以更早地合并更新
+		bool isFrameAcquired = false;
+		bool isFirstFrameCopied = false;
+		// 新创建的 IDXGIOutputDuplication 的第一帧需完整复制
+		bool isFullFrameNeeded = true;
+		// 连续失败的次数，用于退避
+		uint32_t failureCount = 0;
+		SmallVector<uint8_t, 0> metaData;
+		// 和 srcRect 重叠的 move rects 和 dirty rects，已裁剪到 srcRect
+		SmallVector<RECT> changedRects;
+	};
+
+	// 源窗口超出显示器的工作区时移到中央
+	bool _CenterInMonitor(HMONITOR hMonitor);
+
+	// 源窗口被显示器完全覆盖且跨越多个显示器时返回所有和源窗口相交的显示器，否则为空
+	SmallVector<HMONITOR> _GetSpannedMonitors() const;
+
+	bool _AddOutput(HMONITOR hMonitor);
+
+	bool _InitializeSpanning(const SmallVector<HMONITOR>& monitors);
+
+	// 接收显示器的下一帧，画面有变化时返回帧，变化的区域保存在 output.changedRects
+	winrt::com_ptr<ID3D11Resource> _AcquireOutputFrame(_DuplicatedOutput& output);
+
+	bool _RecreateDuplication(_DuplicatedOutput& output);
+
+	// 访问丢失时重新创建 IDXGIOutputDuplication，其他错误退避后重试，无法恢复时报告错误
+	void _OnDuplicationError(_DuplicatedOutput& output, const char* msg, HRESULT hr);
+
+	void _CopyChangedRects(_DuplicatedOutput& output, ID3D11Resource* frame);
+
+	void _OutputThreadProc(_DuplicatedOutput& output) noexcept;
+
+	void _StopOutputThreads() noexcept;
+
+	SmallVector<_DuplicatedOutput, 1> _outputs;
+
+	// 以下只在跨越多个显示器时使用
+	std::vector<std::thread> _outputThreads;
+	std::atomic<bool> _exitingOutputs = false;
+	// 有显示器的新帧复制到拼合纹理后设置
+	Win32Utils::ScopedHandle _atlasUpdatedEvent;
+	// 保护拼合纹理和 _atlasDirtyRect
+	Win32Utils::SRWMutex _atlasMutex;
+	// 帧的完整画面，各显示器的线程只复制变化的部分
+	winrt::com_ptr<ID3D11Texture2D> _atlas;
+	// 上次发布后拼合纹理中变化的区域
+	RECT _atlasDirtyRect{};
+	// 尚未收到第一帧的显示器数量，收到所有显示器的第一帧前不发布
+	uint32_t _outputsWithoutFrame = 0;
 };
 
 }
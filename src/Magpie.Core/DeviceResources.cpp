@@ -83,6 +83,7 @@ winrt::com_ptr<ID3D11Texture2D> DeviceResources::CreateTexture2D(
 void DeviceResources::BeginFrame() {
 	WaitForSingleObjectEx(_frameLatencyWaitableObject.get(), 1000, TRUE);
 	_d3dDC->ClearState();
+	_csStateTracker.Reset();
 }
 
 void DeviceResources::EndFrame() {
@@ -244,6 +245,7 @@ bool DeviceResources::_TryCreateD3DDevice(IDXGIAdapter1* adapter) noexcept {
 		Logger::Get().Error("获取 ID3D11DeviceContext1 失败");
 		return false;
 	}
+	_csStateTracker.Initialize(_d3dDC.get());
 
 	_dxgiDevice = _d3dDevice.try_as<IDXGIDevice4>();
 	if (!_dxgiDevice) {
@@ -356,6 +358,8 @@ bool DeviceResources::_CreateSwapChain() {
 }
 
 bool DeviceResources::GetShaderResourceView(ID3D11Texture2D* texture, ID3D11ShaderResourceView** result) {
+	std::scoped_lock lk(_viewsMutex);
+
 	auto it = _srvMap.find(texture);
 	if (it != _srvMap.end()) {
 		*result = it->second.get();
@@ -374,6 +378,8 @@ bool DeviceResources::GetShaderResourceView(ID3D11Texture2D* texture, ID3D11Shad
 }
 
 bool DeviceResources::GetUnorderedAccessView(ID3D11Texture2D* texture, ID3D11UnorderedAccessView** result) {
+	std::scoped_lock lk(_viewsMutex);
+
 	auto it = _uavMap.find(texture);
 	if (it != _uavMap.end()) {
 		*result = it->second.get();
@@ -397,6 +403,8 @@ bool DeviceResources::GetUnorderedAccessView(ID3D11Texture2D* texture, ID3D11Uno
 }
 
 bool DeviceResources::GetRenderTargetView(ID3D11Texture2D* texture, ID3D11RenderTargetView** result) {
+	std::scoped_lock lk(_viewsMutex);
+
 	auto it = _rtvMap.find(texture);
 	if (it != _rtvMap.end()) {
 		*result = it->second.get();
@@ -414,7 +422,17 @@ bool DeviceResources::GetRenderTargetView(ID3D11Texture2D* texture, ID3D11Render
 	}
 }
 
+void DeviceResources::ReleaseViews(ID3D11Texture2D* texture) noexcept {
+	std::scoped_lock lk(_viewsMutex);
+
+	_rtvMap.erase(texture);
+	_srvMap.erase(texture);
+	_uavMap.erase(texture);
+}
+
 bool DeviceResources::GetSampler(D3D11_FILTER filterMode, D3D11_TEXTURE_ADDRESS_MODE addressMode, ID3D11SamplerState** result) {
+	std::scoped_lock lk(_viewsMutex);
+
 	auto key = std::make_pair(filterMode, addressMode);
 	auto it = _samMap.find(key);
 	if (it != _samMap.end()) {
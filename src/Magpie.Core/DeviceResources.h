@@ -1,5 +1,6 @@
 #pragma once
 #include "Win32Utils.h"
+#include "CSStateTracker.h"
 #include <parallel_hashmap/phmap.h>
 
 namespace Magpie::Core {
@@ -32,6 +33,9 @@ public:
 
 	bool GetUnorderedAccessView(ID3D11Texture2D* texture, ID3D11UnorderedAccessView** result);
 
+	// 释放缓存的视图，纹理在 DeviceResources 销毁前不再使用时调用，否则视图使纹理无法释放
+	void ReleaseViews(ID3D11Texture2D* texture) noexcept;
+
 	ID3D11Device5* GetD3DDevice() const noexcept { return _d3dDevice.get(); }
 	D3D_FEATURE_LEVEL GetFeatureLevel() const noexcept { return _featureLevel; }
 	ID3D11DeviceContext4* GetD3DDC() const noexcept { return _d3dDC.get(); }
@@ -40,6 +44,8 @@ public:
 	IDXGIFactory7* GetDXGIFactory() const noexcept { return _dxgiFactory.get(); }
 	IDXGIDevice4* GetDXGIDevice() const noexcept { return _dxgiDevice.get(); }
 	IDXGIAdapter4* GetGraphicsAdapter() const noexcept { return _graphicsAdapter.get(); }
+	// 计算着色器阶段的绑定都应通过它进行
+	CSStateTracker& GetCSStateTracker() noexcept { return _csStateTracker; }
 
 	void BeginFrame();
 
@@ -58,6 +64,7 @@ private:
 	winrt::com_ptr<IDXGIAdapter4> _graphicsAdapter;
 	winrt::com_ptr<ID3D11Device5> _d3dDevice;
 	winrt::com_ptr<ID3D11DeviceContext4> _d3dDC;
+	CSStateTracker _csStateTracker;
 
 	Win32Utils::ScopedHandle _frameLatencyWaitableObject;
 	bool _supportTearing = false;
@@ -65,6 +72,8 @@ private:
 
 	winrt::com_ptr<ID3D11Texture2D> _backBuffer;
 
+	// 动态分辨率切换档位时在后台线程中创建效果，渲染线程同时使用视图
+	Win32Utils::SRWMutex _viewsMutex;
 	phmap::flat_hash_map<ID3D11Texture2D*, winrt::com_ptr<ID3D11RenderTargetView>> _rtvMap;
 	phmap::flat_hash_map<ID3D11Texture2D*, winrt::com_ptr<ID3D11ShaderResourceView>> _srvMap;
 	phmap::flat_hash_map<ID3D11Texture2D*, winrt::com_ptr<ID3D11UnorderedAccessView>> _uavMap;
@@ -65,14 +65,17 @@ bool DwmSharedSurfaceFrameSource::Initialize() {
 		1
 	};
 
-	_output = MagApp::Get().GetDeviceResources().CreateTexture2D(
+	if (!_InitializePipeline(
 		DXGI_FORMAT_B8G8R8A8_UNORM,
 		frameRect.right - frameRect.left,
-		frameRect.bottom - frameRect.top,
-		D3D11_BIND_SHADER_RESOURCE
-	);
-	if (!_output) {
-		Logger::Get().Error("创建 Texture2D 失败");
+		frameRect.bottom - frameRect.top
+	)) {
+		Logger::Get().Error("_InitializePipeline 失败");
+		return false;
+	}
+
+	if (!_StartPipeline()) {
+		Logger::Get().Error("_StartPipeline 失败");
 		return false;
 	}
 
@@ -80,28 +83,34 @@ bool DwmSharedSurfaceFrameSource::Initialize() {
 	return true;
 }
 
-FrameSourceBase::UpdateState DwmSharedSurfaceFrameSource::Update() {
+bool DwmSharedSurfaceFrameSource::_CaptureFrame(ID3D11Texture2D* target, RECT&) {
+	// 共享表面只在 DWM 合成后改变，以合成的频率捕获
+	if (FAILED(DwmFlush())) {
+		Sleep(1);
+	}
+
 	HANDLE sharedTextureHandle = NULL;
 	if (!_dwmGetDxSharedSurface(MagApp::Get().GetHwndSrc(),
 		&sharedTextureHandle, nullptr, nullptr, nullptr, nullptr)
 		|| !sharedTextureHandle
 		) {
 		Logger::Get().Win32Error("DwmGetDxSharedSurface 失败");
-		return UpdateState::Error;
+		_ReportCaptureError();
+		return false;
 	}
 
 	winrt::com_ptr<ID3D11Texture2D> sharedTexture;
-	HRESULT hr = MagApp::Get().GetDeviceResources().GetD3DDevice()
-		->OpenSharedResource(sharedTextureHandle, IID_PPV_ARGS(&sharedTexture));
+	HRESULT hr = _captureD3DDevice->OpenSharedResource(sharedTextureHandle, IID_PPV_ARGS(&sharedTexture));
 	if (FAILED(hr)) {
 		Logger::Get().ComError("OpenSharedResource 失败", hr);
-		return UpdateState::Error;
+		_ReportCaptureError();
+		return false;
 	}
 
-	MagApp::Get().GetDeviceResources().GetD3DDC()
-		->CopySubresourceRegion(_output.get(), 0, 0, 0, 0, sharedTexture.get(), 0, &_frameInWnd);
+	_captureD3DDC->CopySubresourceRegion(target, 0, 0, 0, 0, sharedTexture.get(), 0, &_frameInWnd);
 
-	return UpdateState::NewFrame;
+	// DwmGetDxSharedSurface 总是返回最新的画面，大部分时候和上一帧相同，由渲染线程比较
+	return true;
 }
 
 }
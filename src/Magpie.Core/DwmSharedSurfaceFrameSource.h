@@ -1,17 +1,17 @@
 #pragma once
-#include "FrameSourceBase.h"
+#include "PipelinedFrameSourceBase.h"
 
 namespace Magpie::Core {
 
-class DwmSharedSurfaceFrameSource : public FrameSourceBase {
+class DwmSharedSurfaceFrameSource : public PipelinedFrameSourceBase {
 public:
 	DwmSharedSurfaceFrameSource() {}
-	virtual ~DwmSharedSurfaceFrameSource() {}
+	virtual ~DwmSharedSurfaceFrameSource() {
+		_StopPipeline();
+	}
 
 	bool Initialize() override;
 
-	UpdateState Update() override;
-
 	bool IsScreenCapture() override {
 		return false;
 	}
@@ -29,6 +29,8 @@ protected:
 		return false;
 	}
 
+	bool _CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) override;
+
 private:
 	using _DwmGetDxSharedSurfaceFunc = bool(
 		HWND hWnd,
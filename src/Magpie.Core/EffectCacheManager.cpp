@@ -1,240 +1,616 @@
 #include "pch.h"
 #include "EffectCacheManager.h"
-#include <regex>
+#include "EffectCompiler.h"
 #include "StrUtils.h"
 #include "Logger.h"
 #include "CommonSharedConstants.h"
-#include <d3dcompiler.h>
 #include "Utils.h"
-#include "YasHelper.h"
-
-namespace yas::detail {
-
-// winrt::com_ptr<ID3DBlob>
-template<std::size_t F>
-struct serializer<
-	type_prop::not_a_fundamental,
-	ser_case::use_internal_serializer,
-	F,
-	winrt::com_ptr<ID3DBlob>
-> {
-	template<typename Archive>
-	static Archive& save(Archive& ar, const winrt::com_ptr<ID3DBlob>& blob) {
-		uint32_t size = (uint32_t)blob->GetBufferSize();
-		ar& size;
-
-		ar.write(blob->GetBufferPointer(), size);
-
-		return ar;
-	}
-
-	template<typename Archive>
-	static Archive& load(Archive& ar, winrt::com_ptr<ID3DBlob>& blob) {
-		uint32_t size = 0;
-		ar& size;
-		HRESULT hr = D3DCreateBlob(size, blob.put());
-		if (FAILED(hr)) {
-			Logger::Get().ComError("D3DCreateBlob 失败", hr);
-			throw new std::exception();
-		}
+#include "FlatEffectCache.h"
+#include <map>
+
+namespace Magpie::Core {
+
+// 缓存版本
+// 当缓存文件结构有更改时更新它，使旧缓存失效
+static constexpr const uint32_t EFFECT_CACHE_VERSION = 17;
+
+// 按内容寻址的 CSO，文件名为内容的哈希，不同效果和变体间共享
+static constexpr const wchar_t* BLOBS_DIR = L"cache\\blobs\\";
 
-		ar.read(blob->GetBufferPointer(), size);
+// 由 EffectPacker 在构建时生成
+static constexpr const wchar_t* PACK_PATH = L"effects\\precompiled.pack";
 
-		return ar;
+
+static std::wstring GetLinearEffectName(std::wstring_view effectName) {
+	std::wstring result(effectName);
+	for (wchar_t& c : result) {
+		if (c == L'\\') {
+			c = L'#';
+		}
 	}
-};
+	return result;
+}
 
+static std::wstring GetCacheKey(std::wstring_view linearEffectName, std::wstring_view hash, UINT flags) {
+	// 缓存文件的命名：{效果名}_{标志位（16进制）}{哈希}
+	return fmt::format(L"{}_{:01x}{}", linearEffectName, flags & 0xf, hash);
 }
 
-namespace Magpie::Core {
+static std::wstring GetCacheFileName(std::wstring_view linearEffectName, std::wstring_view hash, UINT flags) {
+	return StrUtils::ConcatW(CommonSharedConstants::CACHE_DIR, GetCacheKey(linearEffectName, hash, flags));
+}
 
-template<typename Archive>
-void serialize(Archive& ar, EffectParameterDesc& o) {
-	ar& o.name& o.label& o.constant;
+// 内存缓存中的大小主要是 CSO
+static size_t GetDescSize(const EffectDesc& desc) noexcept {
+	size_t size = sizeof(EffectDesc);
+	for (const EffectPassDesc& passDesc : desc.passes) {
+		size += sizeof(EffectPassDesc);
+		if (passDesc.cso) {
+			size += passDesc.cso->GetBufferSize();
+		}
+	}
+	return size;
 }
 
-template<typename Archive>
-void serialize(Archive& ar, EffectIntermediateTextureDesc& o) {
-	ar& o.format& o.name& o.source& o.sizeExpr;
+void EffectCacheManager::_AddToMemCache(const std::wstring& cacheFileName, const EffectDesc& desc) {
+	if (uint32_t count = _memCache.Insert(cacheFileName, std::make_shared<const EffectDesc>(desc), GetDescSize(desc))) {
+		Logger::Get().Info(fmt::format("已从内存缓存中淘汰 {} 个效果", count));
+	}
 }
 
-template<typename Archive>
-void serialize(Archive& ar, EffectSamplerDesc& o) {
-	ar& o.filterType& o.addressType& o.name;
+bool EffectCacheManager::_LoadFromMemCache(const std::wstring& cacheFileName, EffectDesc& desc) {
+	std::shared_ptr<const EffectDesc> cachedDesc;
+	if (!_memCache.Find(cacheFileName, cachedDesc)) {
+		return false;
+	}
+
+	// 在锁外复制
+	desc = *cachedDesc;
+	Logger::Get().Info(StrUtils::Concat("已读取缓存 ", StrUtils::UTF16ToUTF8(cacheFileName)));
+	return true;
 }
 
-template<typename Archive>
-void serialize(Archive& ar, EffectPassDesc& o) {
-	ar& o.cso& o.inputs& o.outputs& o.numThreads[0] & o.numThreads[1] & o.numThreads[2] & o.blockSize& o.desc& o.isPSStyle;
+static std::wstring GetBlobFileName(uint64_t blobId) {
+	return fmt::format(L"{}{:016x}", BLOBS_DIR, blobId);
 }
 
-template<typename Archive>
-void serialize(Archive& ar, EffectDesc& o) {
-	ar& o.name& o.outSizeExpr& o.params& o.textures& o.samplers& o.passes& o.flags;
+// 先写入临时文件再重命名，进程意外退出时不会留下不完整的缓存
+static bool WriteFileAtomic(const std::wstring& fileName, const void* buffer, size_t bufferSize) {
+	std::wstring tempFileName = fmt::format(L"{}.{}.tmp", fileName, GetCurrentThreadId());
+	if (!Win32Utils::WriteFile(tempFileName.c_str(), buffer, bufferSize)) {
+		return false;
+	}
+
+	if (!MoveFileEx(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		Logger::Get().Win32Error("MoveFileEx 失败");
+		DeleteFile(tempFileName.c_str());
+		return false;
+	}
+
+	return true;
 }
 
-static constexpr const uint32_t MAX_CACHE_COUNT = 127;
+// 以只读方式映射整个文件，最后一个引用释放时取消映射
+// 允许映射期间删除文件，以免妨碍缓存整理
+static std::shared_ptr<const BYTE> MapFile(const wchar_t* fileName, size_t& size) {
+	Win32Utils::ScopedHandle hFile(Win32Utils::SafeHandle(CreateFile2(
+		fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, OPEN_EXISTING, nullptr)));
+	if (!hFile) {
+		Logger::Get().Win32Error(StrUtils::Concat("打开文件 ", StrUtils::UTF16ToUTF8(fileName), " 失败"));
+		return nullptr;
+	}
 
-// 缓存版本
-// 当缓存文件结构有更改时更新它，使旧缓存失效
-static constexpr const uint32_t EFFECT_CACHE_VERSION = 12;
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(hFile.get(), &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > UINT32_MAX) {
+		return nullptr;
+	}
 
+	// 视图会保持对映射对象的引用，无需保留句柄
+	Win32Utils::ScopedHandle hMapping(CreateFileMapping(hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (!hMapping) {
+		Logger::Get().Win32Error("CreateFileMapping 失败");
+		return nullptr;
+	}
 
-static std::wstring GetLinearEffectName(std::wstring_view effectName) {
-	std::wstring result(effectName);
-	for (wchar_t& c : result) {
-		if (c == L'\\') {
-			c = L'#';
-		}
+	const BYTE* view = (const BYTE*)MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		Logger::Get().Win32Error("MapViewOfFile 失败");
+		return nullptr;
 	}
-	return result;
+
+	size = (size_t)fileSize.QuadPart;
+	return std::shared_ptr<const BYTE>(view, [](const BYTE* p) {
+		UnmapViewOfFile(p);
+	});
 }
 
-static std::wstring GetCacheFileName(std::wstring_view linearEffectName, std::wstring_view hash, UINT flags) {
-	// 缓存文件的命名：{效果名}_{标志位（16进制）}{哈希}
-	return fmt::format(L"{}{}_{:01x}{}", CommonSharedConstants::CACHE_DIR, linearEffectName, flags & 0xf, hash);
+// 直接引用映射的文件，CSO 无需复制便可传给 CreateComputeShader。内容是只读的
+struct MappedBlob : winrt::implements<MappedBlob, ID3DBlob> {
+	MappedBlob(std::shared_ptr<const BYTE> view, const BYTE* data, size_t size) noexcept
+		: _view(std::move(view)), _data(data), _size(size) {}
+
+	LPVOID STDMETHODCALLTYPE GetBufferPointer() noexcept override {
+		return (LPVOID)_data;
+	}
+
+	SIZE_T STDMETHODCALLTYPE GetBufferSize() noexcept override {
+		return _size;
+	}
+
+private:
+	std::shared_ptr<const BYTE> _view;
+	const BYTE* _data;
+	size_t _size;
+};
+
+// 索引文件保存 EffectDesc 和每个通道的 blob ID，在映射的内存上直接读取
+static bool ReadIndexFile(const wchar_t* fileName, EffectDesc& desc, std::vector<uint64_t>& blobIds) {
+	size_t size = 0;
+	std::shared_ptr<const BYTE> view = MapFile(fileName, size);
+	if (!view) {
+		return false;
+	}
+
+	if (!FlatEffectCache::Read(std::span(view.get(), size), EFFECT_CACHE_VERSION, desc, blobIds)) {
+		Logger::Get().Error("缓存格式错误");
+		return false;
+	}
+
+	return true;
 }
 
-void EffectCacheManager::_AddToMemCache(const std::wstring& cacheFileName, const EffectDesc& desc) {
-	std::scoped_lock lk(_srwMutex);
+static bool LoadBlob(uint64_t blobId, winrt::com_ptr<ID3DBlob>& blob) {
+	size_t size = 0;
+	std::shared_ptr<const BYTE> view = MapFile(GetBlobFileName(blobId).c_str(), size);
+	if (!view) {
+		return false;
+	}
 
-	_memCache[cacheFileName] = { desc, ++_lastAccess };
+	const BYTE* data = view.get();
+	blob.copy_from(winrt::make_self<MappedBlob>(std::move(view), data, size).get());
+	return true;
+}
 
-	if (_memCache.size() > MAX_CACHE_COUNT) {
-		assert(_memCache.size() == MAX_CACHE_COUNT + 1);
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// 预编译效果包
+// 
+// 格式：PackHeader | PackEntry[entryCount]（按 key 排序）| PackBlob[blobCount]（按 id 排序）| 数据
+// 数据中保存 key、FlatEffectCache 格式的索引和 CSO，偏移均相对于文件开头
+// 
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// "MPFP"
+static constexpr const uint32_t PACK_MAGIC = 0x5046504d;
+
+struct PackHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t blobCount;
+	uint64_t fileSize;
+};
 
-		// 清理一半较旧的内存缓存
-		std::array<uint32_t, MAX_CACHE_COUNT + 1> access{};
-		std::transform(_memCache.begin(), _memCache.end(), access.begin(),
-			[](const auto& pair) {return pair.second.second; });
+struct PackEntry {
+	// 和缓存文件名相同，UTF-8 编码
+	uint32_t keyOffset;
+	uint32_t keySize;
+	uint32_t indexOffset;
+	uint32_t indexSize;
+};
 
-		auto midIt = access.begin() + access.size() / 2;
-		std::nth_element(access.begin(), midIt, access.end());
-		const uint32_t mid = *midIt;
+struct PackBlob {
+	uint64_t id;
+	uint32_t offset;
+	uint32_t size;
+};
 
-		for (auto it = _memCache.begin(); it != _memCache.end();) {
-			if (it->second.second < mid) {
-				it = _memCache.erase(it);
-			} else {
-				++it;
-			}
+static bool IsInRange(size_t size, uint64_t offset, uint64_t count) noexcept {
+	return offset <= size && count <= size - offset;
+}
+
+void EffectCacheManager::_OpenPack() {
+	size_t size = 0;
+	std::shared_ptr<const BYTE> view;
+	if (Win32Utils::FileExists(PACK_PATH)) {
+		view = MapFile(PACK_PATH, size);
+	}
+	if (!view) {
+		return;
+	}
+
+	const PackHeader* header = (const PackHeader*)view.get();
+	if (size < sizeof(PackHeader) || header->magic != PACK_MAGIC || header->fileSize != size) {
+		Logger::Get().Error("预编译效果包格式错误");
+		return;
+	}
+
+	if (header->version != EFFECT_CACHE_VERSION) {
+		// 效果包来自其他版本，不能使用
+		Logger::Get().Warn("预编译效果包版本不匹配");
+		return;
+	}
+
+	const uint64_t tablesSize = (uint64_t)header->entryCount * sizeof(PackEntry)
+		+ (uint64_t)header->blobCount * sizeof(PackBlob);
+	if (!IsInRange(size, sizeof(PackHeader), tablesSize)) {
+		Logger::Get().Error("预编译效果包格式错误");
+		return;
+	}
+
+	_packView = std::move(view);
+	_packSize = size;
+
+	Logger::Get().Info(fmt::format("已加载预编译效果包，包含 {} 个效果", header->entryCount));
+}
+
+bool EffectCacheManager::_LoadFromPack(std::string_view key, EffectDesc& desc) {
+	std::call_once(_packOnceFlag, &EffectCacheManager::_OpenPack, this);
+
+	if (!_packView) {
+		return false;
+	}
+
+	const BYTE* data = _packView.get();
+	const PackHeader& header = *(const PackHeader*)data;
+	const std::span<const PackEntry> entries((const PackEntry*)(data + sizeof(PackHeader)), header.entryCount);
+	const std::span<const PackBlob> blobs((const PackBlob*)(entries.data() + entries.size()), header.blobCount);
+
+	const auto getKey = [&](const PackEntry& entry) {
+		return IsInRange(_packSize, entry.keyOffset, entry.keySize)
+			? std::string_view((const char*)data + entry.keyOffset, entry.keySize) : std::string_view();
+	};
+
+	auto entryIt = std::lower_bound(entries.begin(), entries.end(), key,
+		[&](const PackEntry& entry, std::string_view k) { return getKey(entry) < k; });
+	if (entryIt == entries.end() || getKey(*entryIt) != key) {
+		return false;
+	}
+
+	std::vector<uint64_t> blobIds;
+	if (!IsInRange(_packSize, entryIt->indexOffset, entryIt->indexSize)
+		|| !FlatEffectCache::Read(std::span(data + entryIt->indexOffset, entryIt->indexSize), EFFECT_CACHE_VERSION, desc, blobIds)) {
+		Logger::Get().Error("预编译效果包格式错误");
+		return false;
+	}
+
+	for (size_t i = 0; i < blobIds.size(); ++i) {
+		auto blobIt = std::lower_bound(blobs.begin(), blobs.end(), blobIds[i],
+			[](const PackBlob& blob, uint64_t id) { return blob.id < id; });
+		if (blobIt == blobs.end() || blobIt->id != blobIds[i] || !IsInRange(_packSize, blobIt->offset, blobIt->size)) {
+			Logger::Get().Error("预编译效果包格式错误");
+			return false;
 		}
 
-		Logger::Get().Info("已清理内存缓存");
+		desc.passes[i].cso.copy_from(winrt::make_self<MappedBlob>(_packView, data + blobIt->offset, blobIt->size).get());
 	}
+
+	return true;
 }
 
-bool EffectCacheManager::_LoadFromMemCache(const std::wstring& cacheFileName, EffectDesc& desc) {
-	std::scoped_lock lk(_srwMutex);
+bool EffectCacheManager::SavePack(std::span<const EffectPackEntry> entries, const wchar_t* packPath) {
+	// (key, 索引)
+	std::vector<std::pair<std::string, std::vector<BYTE>>> indices;
+	indices.reserve(entries.size());
+	// id -> CSO
+	std::map<uint64_t, ID3DBlob*> blobs;
+
+	for (const EffectPackEntry& entry : entries) {
+		std::vector<uint64_t> blobIds;
+		blobIds.reserve(entry.desc.passes.size());
+		for (const EffectPassDesc& passDesc : entry.desc.passes) {
+			const uint64_t blobId = Utils::HashData(
+				std::span((const BYTE*)passDesc.cso->GetBufferPointer(), passDesc.cso->GetBufferSize()));
+			blobIds.push_back(blobId);
+			blobs.emplace(blobId, passDesc.cso.get());
+		}
 
-	auto it = _memCache.find(cacheFileName);
-	if (it != _memCache.end()) {
-		desc = it->second.first;
-		it->second.second = ++_lastAccess;
-		Logger::Get().Info(StrUtils::Concat("已读取缓存 ", StrUtils::UTF16ToUTF8(cacheFileName)));
-		return true;
+		auto& [key, index] = indices.emplace_back();
+		key = StrUtils::UTF16ToUTF8(GetCacheKey(GetLinearEffectName(entry.effectName), entry.hash, entry.desc.flags));
+		FlatEffectCache::Write(entry.desc, blobIds, EFFECT_CACHE_VERSION, index);
 	}
-	return false;
+
+	std::sort(indices.begin(), indices.end(),
+		[](const auto& l, const auto& r) { return l.first < r.first; });
+
+	std::vector<BYTE> buf(sizeof(PackHeader) + sizeof(PackEntry) * indices.size() + sizeof(PackBlob) * blobs.size());
+
+	// 按 8 字节对齐追加数据，FlatEffectCache 需要对齐
+	const auto append = [&](const void* src, size_t size) {
+		buf.resize((buf.size() + 7) & ~size_t(7));
+		const uint32_t offset = (uint32_t)buf.size();
+		buf.insert(buf.end(), (const BYTE*)src, (const BYTE*)src + size);
+		return offset;
+	};
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		const auto& [key, index] = indices[i];
+
+		PackEntry entry{};
+		entry.keyOffset = append(key.data(), key.size());
+		entry.keySize = (uint32_t)key.size();
+		entry.indexOffset = append(index.data(), index.size());
+		entry.indexSize = (uint32_t)index.size();
+		std::memcpy(buf.data() + sizeof(PackHeader) + sizeof(PackEntry) * i, &entry, sizeof(entry));
+	}
+
+	// std::map 已按 id 排序
+	size_t blobIdx = 0;
+	for (const auto& [id, cso] : blobs) {
+		PackBlob blob{};
+		blob.id = id;
+		blob.offset = append(cso->GetBufferPointer(), cso->GetBufferSize());
+		blob.size = (uint32_t)cso->GetBufferSize();
+		std::memcpy(buf.data() + sizeof(PackHeader) + sizeof(PackEntry) * indices.size() + sizeof(PackBlob) * blobIdx,
+			&blob, sizeof(blob));
+		++blobIdx;
+	}
+
+	if (buf.size() > UINT32_MAX) {
+		Logger::Get().Error("预编译效果包过大");
+		return false;
+	}
+
+	PackHeader header{};
+	header.magic = PACK_MAGIC;
+	header.version = EFFECT_CACHE_VERSION;
+	header.entryCount = (uint32_t)indices.size();
+	header.blobCount = (uint32_t)blobs.size();
+	header.fileSize = buf.size();
+	std::memcpy(buf.data(), &header, sizeof(header));
+
+	if (!WriteFileAtomic(packPath, buf.data(), buf.size())) {
+		Logger::Get().Error("保存预编译效果包失败");
+		return false;
+	}
+
+	Logger::Get().Info(fmt::format("已保存预编译效果包，包含 {} 个效果和 {} 个 CSO，共 {} 字节",
+		indices.size(), blobs.size(), buf.size()));
+	return true;
 }
 
 bool EffectCacheManager::Load(std::wstring_view effectName, std::wstring_view hash, EffectDesc& desc) {
 	assert(!effectName.empty() && !hash.empty());
 
-	std::wstring cacheFileName = GetCacheFileName(GetLinearEffectName(effectName), hash, desc.flags);
+	std::wstring linearEffectName = GetLinearEffectName(effectName);
+	std::wstring cacheFileName = GetCacheFileName(linearEffectName, hash, desc.flags);
 
 	if (_LoadFromMemCache(cacheFileName, desc)) {
 		return true;
 	}
 
+	// 读取失败时 desc 应保持不变，调用者将用它编译
+	EffectDesc loadedDesc;
+
+	// 其次是预编译效果包。哈希包含源码，因此修改过的效果不会命中
+	if (_LoadFromPack(StrUtils::UTF16ToUTF8(GetCacheKey(linearEffectName, hash, desc.flags)), loadedDesc)) {
+		_AddToMemCache(cacheFileName, loadedDesc);
+		desc = std::move(loadedDesc);
+		Logger::Get().Info(StrUtils::Concat("已从预编译效果包读取 ", StrUtils::UTF16ToUTF8(cacheFileName)));
+		return true;
+	}
+
+	// 不需要和整理同步，文件被删除时读取失败，重新编译即可
 	if (!Win32Utils::FileExists(cacheFileName.c_str())) {
 		return false;
 	}
 
-	std::vector<BYTE> buf;
-	if (!Win32Utils::ReadFile(cacheFileName.c_str(), buf) || buf.empty()) {
+	loadedDesc = {};
+	std::vector<uint64_t> blobIds;
+	if (!ReadIndexFile(cacheFileName.c_str(), loadedDesc, blobIds)) {
 		return false;
 	}
 
-	try {
-		yas::mem_istream mi(buf.data(), buf.size());
-		yas::binary_iarchive<yas::mem_istream, yas::binary> ia(mi);
-
-		ia& desc;
-	} catch (...) {
-		Logger::Get().Error("反序列化失败");
-		desc = {};
-		return false;
+	for (size_t i = 0; i < blobIds.size(); ++i) {
+		if (!LoadBlob(blobIds[i], loadedDesc.passes[i].cso)) {
+			Logger::Get().Error(fmt::format("读取 Pass{} 的 CSO 失败", i + 1));
+			return false;
+		}
 	}
 
-	_AddToMemCache(cacheFileName, desc);
+	_AddToMemCache(cacheFileName, loadedDesc);
+	desc = std::move(loadedDesc);
 
 	Logger::Get().Info(StrUtils::Concat("已读取缓存 ", StrUtils::UTF16ToUTF8(cacheFileName)));
 	return true;
 }
 
 void EffectCacheManager::Save(std::wstring_view effectName, std::wstring_view hash, const EffectDesc& desc) {
-	std::wstring linearEffectName = GetLinearEffectName(effectName);
+	std::wstring cacheFileName = GetCacheFileName(GetLinearEffectName(effectName), hash, desc.flags);
+
+	std::vector<uint64_t> blobIds;
+	blobIds.reserve(desc.passes.size());
+	for (const EffectPassDesc& passDesc : desc.passes) {
+		blobIds.push_back(Utils::HashData(
+			std::span((const BYTE*)passDesc.cso->GetBufferPointer(), passDesc.cso->GetBufferSize())));
+	}
 
 	std::vector<BYTE> buf;
-	buf.reserve(4096);
-	
-	try {
-		yas::vector_ostream os(buf);
-		yas::binary_oarchive<yas::vector_ostream<BYTE>, yas::binary> oa(os);
+	FlatEffectCache::Write(desc, blobIds, EFFECT_CACHE_VERSION, buf);
 
-		oa& desc;
-	} catch (...) {
-		Logger::Get().Error("序列化 EffectDesc 失败");
-		return;
-	}
+	{
+		// 防止整理时删除刚写入还未被索引引用的 blob
+		std::scoped_lock lk(_diskMutex);
 
-	if (!Win32Utils::DirExists(CommonSharedConstants::CACHE_DIR)) {
-		if (!CreateDirectory(CommonSharedConstants::CACHE_DIR, nullptr)) {
-			Logger::Get().Win32Error("创建 cache 文件夹失败");
+		if (!Win32Utils::CreateDir(BLOBS_DIR, true)) {
+			Logger::Get().Error("创建 cache 文件夹失败");
 			return;
 		}
-	} else {
-		// 删除所有该效果（flags 相同）的缓存
-		std::wregex regex(fmt::format(L"^{}_{:01x}[0-9,a-f]{{16}}$", linearEffectName, desc.flags & 0xf),
-			std::wregex::optimize | std::wregex::nosubs);
-
-		WIN32_FIND_DATA findData{};
-		HANDLE hFind = Win32Utils::SafeHandle(FindFirstFileEx(
-			StrUtils::ConcatW(CommonSharedConstants::CACHE_DIR, L"*").c_str(),
-			FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH));
-		if (hFind) {
-			do {
-				// 缓存文件名至少有 19 个字符
-				// {Name}_{1}{16}
-				if (StrUtils::StrLen(findData.cFileName) < 19) {
-					continue;
-				}
-
-				// 正则匹配文件名
-				if (!std::regex_match(findData.cFileName, regex)) {
-					continue;
-				}
-
-				if (!DeleteFile(StrUtils::ConcatW(CommonSharedConstants::CACHE_DIR, findData.cFileName).c_str())) {
-					Logger::Get().Win32Error(StrUtils::Concat("删除缓存文件 ",
-						StrUtils::UTF16ToUTF8(findData.cFileName), " 失败"));
-				}
-			} while (FindNextFile(hFind, &findData));
-
-			FindClose(hFind);
-		} else {
-			Logger::Get().Win32Error("查找缓存文件失败");
+
+		for (size_t i = 0; i < blobIds.size(); ++i) {
+			std::wstring blobFileName = GetBlobFileName(blobIds[i]);
+			if (Win32Utils::FileExists(blobFileName.c_str())) {
+				// 内容相同，无需再次写入
+				continue;
+			}
+
+			ID3DBlob* cso = desc.passes[i].cso.get();
+			if (!WriteFileAtomic(blobFileName, cso->GetBufferPointer(), cso->GetBufferSize())) {
+				Logger::Get().Error("保存 CSO 失败");
+				return;
+			}
 		}
-	}
 
-	std::wstring cacheFileName = GetCacheFileName(linearEffectName, hash, desc.flags);
-	if (!Win32Utils::WriteFile(cacheFileName.c_str(), buf.data(), buf.size())) {
-		Logger::Get().Error("保存缓存失败");
+		if (!WriteFileAtomic(cacheFileName, buf.data(), buf.size())) {
+			Logger::Get().Error("保存缓存失败");
+			return;
+		}
 	}
 
 	_AddToMemCache(cacheFileName, desc);
 
 	Logger::Get().Info(StrUtils::Concat("已保存缓存 ", StrUtils::UTF16ToUTF8(cacheFileName)));
+
+	// 旧缓存由后台整理删除，不阻塞保存
+	_ScheduleCompaction();
+}
+
+void EffectCacheManager::_ScheduleCompaction() noexcept {
+	if (_isCompactionPending.exchange(true)) {
+		// 尚未开始的整理会处理这次保存
+		return;
+	}
+
+	if (!TrySubmitThreadpoolCallback(
+		[](PTP_CALLBACK_INSTANCE, PVOID context) {
+			((EffectCacheManager*)context)->_Compact();
+		},
+		this,
+		nullptr
+	)) {
+		Logger::Get().Win32Error("TrySubmitThreadpoolCallback 失败");
+		_isCompactionPending.store(false);
+	}
+}
+
+static bool IsHexString(std::wstring_view str) noexcept {
+	return std::all_of(str.begin(), str.end(), [](wchar_t c) {
+		return (c >= L'0' && c <= L'9') || (c >= L'a' && c <= L'f');
+	});
+}
+
+template<typename Fn>
+static void EnumerateFiles(const wchar_t* dir, const Fn& func) {
+	WIN32_FIND_DATA findData{};
+	HANDLE hFind = Win32Utils::SafeHandle(FindFirstFileEx(
+		StrUtils::ConcatW(dir, L"*").c_str(),
+		FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH));
+	if (!hFind) {
+		Logger::Get().Win32Error("查找缓存文件失败");
+		return;
+	}
+
+	do {
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			continue;
+		}
+
+		func(findData);
+	} while (FindNextFile(hFind, &findData));
+
+	FindClose(hFind);
+}
+
+static void DeleteCacheFile(const wchar_t* dir, const wchar_t* fileName) {
+	if (!DeleteFile(StrUtils::ConcatW(dir, fileName).c_str())) {
+		Logger::Get().Win32Error(StrUtils::Concat("删除缓存文件 ", StrUtils::UTF16ToUTF8(fileName), " 失败"));
+	}
+}
+
+void EffectCacheManager::_Compact() {
+	// 在整理开始前清除标记，整理期间的保存会触发新的整理
+	_isCompactionPending.store(false);
+
+	std::scoped_lock lk(_diskMutex);
+
+	uint32_t deletedIndexCount = 0;
+	uint32_t deletedBlobCount = 0;
+
+	// 每个效果（flags 相同）只保留最新的几个缓存。内联变量时不同配置的参数不同，同一效果有多个缓存，
+	// 预热会为每个配置编译一个，只保留一个会使它们互相淘汰
+	constexpr size_t MAX_INDICES_PER_EFFECT = EffectCompiler::MAX_CACHED_VARIANTS;
+	// {效果名}_{标志位} -> [(文件名, 修改时间)]
+	phmap::flat_hash_map<std::wstring, std::vector<std::pair<std::wstring, uint64_t>>> indices;
+	EnumerateFiles(CommonSharedConstants::CACHE_DIR, [&](const WIN32_FIND_DATA& findData) {
+		std::wstring_view fileName(findData.cFileName);
+
+		if (fileName.ends_with(L".tmp")) {
+			// 上次意外退出时遗留的临时文件
+			DeleteCacheFile(CommonSharedConstants::CACHE_DIR, findData.cFileName);
+			return;
+		}
+
+		// 缓存文件名至少有 19 个字符
+		// {Name}_{1}{16}
+		if (fileName.size() < 19 || fileName[fileName.size() - 18] != L'_'
+			|| !IsHexString(fileName.substr(fileName.size() - 17))) {
+			return;
+		}
+
+		const uint64_t writeTime = ((uint64_t)findData.ftLastWriteTime.dwHighDateTime << 32)
+			| findData.ftLastWriteTime.dwLowDateTime;
+
+		indices[std::wstring(fileName.substr(0, fileName.size() - 16))].emplace_back(fileName, writeTime);
+	});
+
+	// 收集仍被引用的 blob
+	phmap::flat_hash_set<uint64_t> referencedBlobs;
+	for (auto& [key, files] : indices) {
+		if (files.size() > MAX_INDICES_PER_EFFECT) {
+			// 删除较旧的
+			std::nth_element(files.begin(), files.begin() + MAX_INDICES_PER_EFFECT, files.end(),
+				[](const auto& l, const auto& r) { return l.second > r.second; });
+			for (size_t i = MAX_INDICES_PER_EFFECT; i < files.size(); ++i) {
+				DeleteCacheFile(CommonSharedConstants::CACHE_DIR, files[i].first.c_str());
+				++deletedIndexCount;
+			}
+			files.resize(MAX_INDICES_PER_EFFECT);
+		}
+
+		for (const auto& [fileName, writeTime] : files) {
+			std::wstring indexFileName = StrUtils::ConcatW(CommonSharedConstants::CACHE_DIR, fileName);
+
+			EffectDesc desc;
+			std::vector<uint64_t> blobIds;
+			if (!ReadIndexFile(indexFileName.c_str(), desc, blobIds)) {
+				// 旧版本或已损坏
+				DeleteCacheFile(CommonSharedConstants::CACHE_DIR, fileName.c_str());
+				++deletedIndexCount;
+				continue;
+			}
+
+			referencedBlobs.insert(blobIds.begin(), blobIds.end());
+		}
+	}
+
+	EnumerateFiles(BLOBS_DIR, [&](const WIN32_FIND_DATA& findData) {
+		std::wstring_view fileName(findData.cFileName);
+
+		if (fileName.size() != 16 || !IsHexString(fileName)
+			|| !referencedBlobs.contains(std::wcstoull(findData.cFileName, nullptr, 16))) {
+			DeleteCacheFile(BLOBS_DIR, findData.cFileName);
+			++deletedBlobCount;
+		}
+	});
+
+	Logger::Get().Info(fmt::format("缓存整理完成，删除了 {} 个索引和 {} 个 blob", deletedIndexCount, deletedBlobCount));
+}
+
+bool EffectCacheManager::LoadPass(uint64_t passHash, winrt::com_ptr<ID3DBlob>& cso) {
+	// CSO 创建后不会再修改，可以在多个 EffectDesc 间共享
+	return _passMemCache.Find(passHash, cso);
+}
+
+void EffectCacheManager::SavePass(uint64_t passHash, ID3DBlob* cso) {
+	assert(cso);
+
+	winrt::com_ptr<ID3DBlob> blob;
+	blob.copy_from(cso);
+
+	const size_t size = cso->GetBufferSize();
+	if (uint32_t count = _passMemCache.Insert(passHash, std::move(blob), size)) {
+		Logger::Get().Info(fmt::format("已从通道缓存中淘汰 {} 个通道", count));
+	}
 }
 
 static std::wstring HexHash(std::span<const BYTE> data) {
@@ -262,37 +638,63 @@ std::wstring EffectCacheManager::GetHash(
 	std::string_view source,
 	const phmap::flat_hash_map<std::wstring, float>* inlineParams
 ) {
-	std::string str;
-	str.reserve(source.size() + 256);
-	str = source;
+	// 先对源码求哈希，再和其他信息一起求哈希，无需复制源码
+	const uint64_t sourceHash = Utils::HashData(std::span((const BYTE*)source.data(), source.size()));
 
-	str.append(fmt::format("VERSION:{}\n", EFFECT_CACHE_VERSION));
+	std::string str = fmt::format("{:016x}VERSION:{}\n", sourceHash, EFFECT_CACHE_VERSION);
 	if (inlineParams) {
 		for (const auto& pair : *inlineParams) {
 			str.append(fmt::format("{}:{}\n", StrUtils::UTF16ToUTF8(pair.first), std::lroundf(pair.second * 10000)));
 		}
 	}
 
-	return HexHash(std::span((const BYTE*)source.data(), source.size()));
+	return HexHash(std::span((const BYTE*)str.data(), str.size()));
 }
 
-std::wstring EffectCacheManager::GetHash(std::string& source, const phmap::flat_hash_map<std::wstring, float>* inlineParams) {
-	size_t originSize = source.size();
+static bool IsIdentChar(char c) noexcept {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
 
-	source.reserve(originSize + 256);
+// 检查 name 是否作为完整的标识符出现在 source 中
+static bool ContainsIdentifier(std::string_view source, std::string_view name) noexcept {
+	for (size_t pos = source.find(name); pos != std::string_view::npos; pos = source.find(name, pos + 1)) {
+		if (pos > 0 && IsIdentChar(source[pos - 1])) {
+			continue;
+		}
 
-	source.append(fmt::format("VERSION:{}\n", EFFECT_CACHE_VERSION));
-	if (inlineParams) {
-		for (const auto& pair : *inlineParams) {
-			source.append(fmt::format("{}:{}\n", StrUtils::UTF16ToUTF8(pair.first), std::lroundf(pair.second * 10000)));
+		size_t end = pos + name.size();
+		if (end < source.size() && IsIdentChar(source[end])) {
+			continue;
 		}
+
+		return true;
 	}
 
-	std::wstring result = HexHash(std::span((const BYTE*)source.data(), source.size()));
-	source.resize(originSize);
-	return result;
+	return false;
 }
 
+uint64_t EffectCacheManager::GetPassHash(
+	std::string_view source,
+	std::string_view sourceName,
+	const std::vector<std::pair<std::string, std::string>>& macros,
+	bool warningsAreErrors
+) {
+	const uint64_t sourceHash = Utils::HashData(std::span((const BYTE*)source.data(), source.size()));
+
+	// 调试版本中 CSO 包含源文件名
+	std::string str = fmt::format("{:016x}{}\nVERSION:{}\nWAE:{}\n",
+		sourceHash, sourceName, EFFECT_CACHE_VERSION, warningsAreErrors);
+
+	// 源码未引用的宏不影响编译结果，这样内联变量只影响引用了它的通道
+	// 无法检查包含的文件，因此有 #include 时保留所有宏
+	const bool hasInclude = source.find("#include") != std::string_view::npos;
+	for (const auto& pair : macros) {
+		if (hasInclude || ContainsIdentifier(source, pair.first)) {
+			str.append(pair.first).append("=").append(pair.second).push_back('\n');
+		}
+	}
+
+	return Utils::HashData(std::span((const BYTE*)str.data(), str.size()));
 }
 
-#undef _LITTLE_ENDIAN
+}
@@ -2,9 +2,138 @@
 #include "Win32Utils.h"
 #include "EffectDesc.h"
 #include <parallel_hashmap/phmap.h>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
 
 namespace Magpie::Core {
 
+struct EffectMemCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	size_t count = 0;
+	size_t bytes = 0;
+};
+
+// 按字节数限制大小的内存缓存，Value 应是可廉价复制的共享指针
+// 使用 CLOCK 算法近似 LRU：命中时只设置访问标记，因此查找只需共享锁；插入和淘汰均摊 O(1)
+template<typename Key, typename Value>
+class EffectMemCache {
+public:
+	explicit EffectMemCache(size_t budget) noexcept : _budget(budget) {}
+
+	EffectMemCache(const EffectMemCache&) = delete;
+	EffectMemCache(EffectMemCache&&) = delete;
+
+	bool Find(const Key& key, Value& value) noexcept {
+		std::shared_lock lk(_srwMutex);
+
+		auto it = _map.find(key);
+		if (it == _map.end()) {
+			_misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		it->second->referenced.store(true, std::memory_order_relaxed);
+		value = it->second->value;
+
+		_hits.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// 返回淘汰的条目数。新条目不会被立即淘汰，即使它超出了预算
+	uint32_t Insert(const Key& key, Value value, size_t size) {
+		std::scoped_lock lk(_srwMutex);
+
+		auto it = _map.find(key);
+		if (it != _map.end()) {
+			_Entry& entry = *it->second;
+			_bytes = _bytes - entry.size + size;
+			entry.value = std::move(value);
+			entry.size = size;
+			entry.referenced.store(true, std::memory_order_relaxed);
+			return _Evict(it->second);
+		}
+
+		// 插入到指针之前，一轮扫描中最后才检查新条目
+		auto entryIt = _entries.emplace(_hand, key, std::move(value), size);
+		_map.emplace(key, entryIt);
+		_bytes += size;
+
+		return _Evict(entryIt);
+	}
+
+	EffectMemCacheStats GetStats() noexcept {
+		std::shared_lock lk(_srwMutex);
+
+		return {
+			_hits.load(std::memory_order_relaxed),
+			_misses.load(std::memory_order_relaxed),
+			_evictions,
+			_entries.size(),
+			_bytes
+		};
+	}
+
+private:
+	struct _Entry {
+		_Entry(const Key& key_, Value&& value_, size_t size_) : key(key_), value(std::move(value_)), size(size_) {}
+
+		Key key;
+		Value value;
+		size_t size;
+		std::atomic<bool> referenced = false;
+	};
+
+	using _EntryIt = typename std::list<_Entry>::iterator;
+
+	uint32_t _Evict(_EntryIt protectedIt) {
+		uint32_t count = 0;
+
+		while (_bytes > _budget && _entries.size() > 1) {
+			if (_hand == _entries.end()) {
+				_hand = _entries.begin();
+			}
+
+			if (_hand == protectedIt || _hand->referenced.exchange(false, std::memory_order_relaxed)) {
+				// 第二次机会
+				++_hand;
+				continue;
+			}
+
+			_bytes -= _hand->size;
+			_map.erase(_hand->key);
+			_hand = _entries.erase(_hand);
+			++count;
+		}
+
+		_evictions += count;
+		return count;
+	}
+
+	Win32Utils::SRWMutex _srwMutex;
+
+	// 环形扫描的顺序，节点的地址不会改变
+	std::list<_Entry> _entries;
+	_EntryIt _hand = _entries.end();
+	phmap::flat_hash_map<Key, _EntryIt> _map;
+
+	const size_t _budget;
+	size_t _bytes = 0;
+
+	std::atomic<uint64_t> _hits = 0;
+	std::atomic<uint64_t> _misses = 0;
+	uint64_t _evictions = 0;
+};
+
+struct EffectPackEntry {
+	std::wstring effectName;
+	// EffectCacheManager::GetHash 的结果
+	std::wstring hash;
+	EffectDesc desc;
+};
+
 class EffectCacheManager {
 public:
 	static EffectCacheManager& Get() noexcept {
@@ -17,30 +146,65 @@ public:
 
 	bool Load(std::wstring_view effectName, std::wstring_view hash, EffectDesc& desc);
 
+	// CSO 按内容保存在 cache\blobs 中，相同的 CSO 只保存一次。旧缓存在后台清理
 	void Save(std::wstring_view effectName, std::wstring_view hash, const EffectDesc& desc);
 
+	// 将 entries 写入预编译效果包，Load 会先查找它再查找磁盘缓存
+	bool SavePack(std::span<const EffectPackEntry> entries, const wchar_t* packPath);
+
 	// inlineParams 为内联变量，可以为空
-	// 接受 std::string& 的重载速度更快，且保证不修改 source
 	static std::wstring GetHash(
 		std::string_view source,
 		const phmap::flat_hash_map<std::wstring, float>* inlineParams = nullptr
 	);
-	static std::wstring GetHash(
-		std::string& source,
-		const phmap::flat_hash_map<std::wstring, float>* inlineParams = nullptr
+
+	// 通道级缓存，只保存在内存中。修改内联变量后未引用它的通道可以直接复用编译结果
+	bool LoadPass(uint64_t passHash, winrt::com_ptr<ID3DBlob>& cso);
+
+	void SavePass(uint64_t passHash, ID3DBlob* cso);
+
+	// source 为 GeneratePassSource 生成的完整源码，未在源码中出现的宏不参与计算
+	static uint64_t GetPassHash(
+		std::string_view source,
+		std::string_view sourceName,
+		const std::vector<std::pair<std::string, std::string>>& macros,
+		bool warningsAreErrors
 	);
 
+	EffectMemCacheStats GetMemCacheStats() noexcept {
+		return _memCache.GetStats();
+	}
+
+	EffectMemCacheStats GetPassMemCacheStats() noexcept {
+		return _passMemCache.GetStats();
+	}
+
 private:
 	EffectCacheManager() = default;
 
 	void _AddToMemCache(const std::wstring& cacheFileName, const EffectDesc& desc);
 	bool _LoadFromMemCache(const std::wstring& cacheFileName, EffectDesc& desc);
 
-	// 用于同步对 _memCache 的访问
-	Win32Utils::SRWMutex _srwMutex;
-	// cacheFileName -> (EffectDesc, lastAccess)
-	phmap::flat_hash_map<std::wstring, std::pair<EffectDesc, UINT>> _memCache;
-	UINT _lastAccess = 0;
+	void _OpenPack();
+	// key 为缓存文件名（不含文件夹）
+	bool _LoadFromPack(std::string_view key, EffectDesc& desc);
+
+	void _ScheduleCompaction() noexcept;
+	// 在线程池中执行，删除过时的索引和不再被引用的 blob
+	void _Compact();
+
+	// 缓存的 EffectDesc 不会被修改，命中时只复制指针
+	EffectMemCache<std::wstring, std::shared_ptr<const EffectDesc>> _memCache{ 64 * 1024 * 1024 };
+	EffectMemCache<uint64_t, winrt::com_ptr<ID3DBlob>> _passMemCache{ 32 * 1024 * 1024 };
+
+	// 首次使用时映射，此后只读
+	std::once_flag _packOnceFlag;
+	std::shared_ptr<const BYTE> _packView;
+	size_t _packSize = 0;
+
+	// 用于同步磁盘缓存的写入和整理
+	Win32Utils::SRWMutex _diskMutex;
+	std::atomic<bool> _isCompactionPending = false;
 };
 
 }
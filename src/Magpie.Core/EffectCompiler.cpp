@@ -1,23 +1,21 @@
 #include "pch.h"
 #include "EffectCompiler.h"
 #include "Utils.h"
-#include <bitset>
-#include <charconv>
 #include "EffectCacheManager.h"
 #include "StrUtils.h"
 #include "Logger.h"
 #include "CommonSharedConstants.h"
 #include <bit>	// std::has_single_bit
 #include "DirectXHelper.h"
+#include <d3dcompiler.h>	// D3DReflect
 #include "EffectHelper.h"
 #include "Win32Utils.h"
+#include "TaskScheduler.h"
 #include "EffectDesc.h"
+#include "EffectParser.h"
 
 namespace Magpie::Core {
 
-static const char* META_INDICATOR = "//!";
-
-
 class PassInclude : public ID3DInclude {
 public:
 	PassInclude(std::wstring_view localDir) : _localDir(localDir) {}
@@ -40,1010 +38,105 @@ public:
 		}
 
 		char* result = new char[file.size()];
-		std::memcpy(result, file.data(), file.size());
-
-		*ppData = result;
-		*pBytes = (UINT)file.size();
-
-		return S_OK;
-	}
-
-	HRESULT CALLBACK Close(LPCVOID pData) noexcept override {
-		delete[](char*)pData;
-		return S_OK;
-	}
-
-private:
-	std::wstring _localDir;
-};
-
-static UINT RemoveComments(std::string& source) {
-	// 确保以换行符结尾
-	if (source.back() != '\n') {
-		source.push_back('\n');
-	}
-
-	std::string result;
-	result.reserve(source.size());
-
-	int j = 0;
-	// 单独处理最后两个字符
-	for (size_t i = 0, end = source.size() - 2; i < end; ++i) {
-		if (source[i] == '/') {
-			if (source[i + 1] == '/' && source[i + 2] != '!') {
-				// 行注释
-				i += 2;
-
-				// 无需处理越界，因为必定以换行符结尾
-				while (source[i] != '\n') {
-					++i;
-				}
-
-				// 保留换行符
-				source[j++] = '\n';
-
-				continue;
-			} else if (source[i + 1] == '*') {
-				// 块注释
-				i += 2;
-
-				while (true) {
-					if (++i >= source.size()) {
-						// 未闭合
-						return 1;
-					}
-
-					if (source[i - 1] == '*' && source[i] == '/') {
-						break;
-					}
-				}
-
-				// 文件结尾
-				if (i >= source.size() - 2) {
-					source.resize(j);
-					return 0;
-				}
-
-				continue;
-			}
-		}
-
-		source[j++] = source[i];
-	}
-
-	// 无需复制最后的换行符
-	source[j++] = source[source.size() - 2];
-	source.resize(j);
-	return 0;
-}
-
-template<bool IncludeNewLine>
-static void RemoveLeadingBlanks(std::string_view& source) {
-	size_t i = 0;
-	for (; i < source.size(); ++i) {
-		if constexpr (IncludeNewLine) {
-			if (!StrUtils::isspace(source[i])) {
-				break;
-			}
-		} else {
-			char c = source[i];
-			if (c != ' ' && c != '\t') {
-				break;
-			}
-		}
-	}
-
-	source.remove_prefix(i);
-}
-
-template<bool AllowNewLine>
-static bool CheckNextToken(std::string_view& source, std::string_view token) {
-	RemoveLeadingBlanks<AllowNewLine>(source);
-
-	if (!source.starts_with(token)) {
-		return false;
-	}
-
-	source.remove_prefix(token.size());
-	return true;
-}
-
-template<bool AllowNewLine>
-static UINT GetNextToken(std::string_view& source, std::string_view& value) {
-	RemoveLeadingBlanks<AllowNewLine>(source);
-
-	if (source.empty()) {
-		return 2;
-	}
-
-	char cur = source[0];
-
-	if (StrUtils::isalpha(cur) || cur == '_') {
-		size_t j = 1;
-		for (; j < source.size(); ++j) {
-			cur = source[j];
-
-			if (!StrUtils::isalnum(cur) && cur != '_') {
-				break;
-			}
-		}
-
-		value = source.substr(0, j);
-		source.remove_prefix(j);
-		return 0;
-	}
-
-	if constexpr (AllowNewLine) {
-		return 1;
-	} else {
-		return cur == '\n' ? 2 : 1;
-	}
-}
-
-static bool CheckMagic(std::string_view& source) {
-	std::string_view token;
-	if (!CheckNextToken<true>(source, META_INDICATOR)) {
-		return false;
-	}
-
-	if (!CheckNextToken<false>(source, "MAGPIE")) {
-		return false;
-	}
-	if (!CheckNextToken<false>(source, "EFFECT")) {
-		return false;
-	}
-
-	if (GetNextToken<false>(source, token) != 2) {
-		return false;
-	}
-
-	if (source.empty()) {
-		return false;
-	}
-
-	return true;
-}
-
-static UINT GetNextString(std::string_view& source, std::string_view& value) {
-	RemoveLeadingBlanks<false>(source);
-	size_t pos = source.find('\n');
-
-	value = source.substr(0, pos);
-	StrUtils::Trim(value);
-	if (value.empty()) {
-		return 1;
-	}
-
-	source.remove_prefix(std::min(pos + 1, source.size()));
-	return 0;
-}
-
-template<typename T>
-static UINT GetNextNumber(std::string_view& source, T& value) {
-	RemoveLeadingBlanks<false>(source);
-
-	if (source.empty()) {
-		return 1;
-	}
-
-	const auto& result = std::from_chars(source.data(), source.data() + source.size(), value);
-	if ((int)result.ec) {
-		return 1;
-	}
-
-	// 解析成功
-	source.remove_prefix(result.ptr - source.data());
-	return 0;
-}
-
-static UINT GetNextExpr(std::string_view& source, std::string& expr) {
-	RemoveLeadingBlanks<false>(source);
-	size_t size = std::min(source.find('\n') + 1, source.size());
-
-	// 移除空白字符
-	expr.resize(size);
-
-	size_t j = 0;
-	for (size_t i = 0; i < size; ++i) {
-		char c = source[i];
-		if (!isspace(c)) {
-			expr[j++] = c;
-		}
-	}
-	expr.resize(j);
-
-	if (expr.empty()) {
-		return 1;
-	}
-
-	source.remove_prefix(size);
-	return 0;
-}
-
-static UINT ResolveHeader(std::string_view block, EffectDesc& desc, bool noCompile) {
-	// 必需的选项：VERSION
-	// 可选的选项：OUTPUT_WIDTH, OUTPUT_HEIGHT, USE_DYNAMIC, GENERIC_DOWNSCALER, BUILT_INT
-
-	std::bitset<6> processed;
-
-	std::string_view token;
-
-	while (true) {
-		if (!CheckNextToken<true>(block, META_INDICATOR)) {
-			break;
-		}
-
-		if (GetNextToken<false>(block, token)) {
-			return 1;
-		}
-		std::string t = StrUtils::ToUpperCase(token);
-
-		if (t == "VERSION") {
-			if (processed[0]) {
-				return 1;
-			}
-			processed[0] = true;
-
-			UINT version;
-			if (GetNextNumber(block, version)) {
-				return 1;
-			}
-
-			if (version != EffectCompiler::VERSION) {
-				return 1;
-			}
-
-			if (GetNextToken<false>(block, token) != 2) {
-				return 1;
-			}
-		} else if (t == "OUTPUT_WIDTH") {
-			if (processed[1]) {
-				return 1;
-			}
-			processed[1] = true;
-
-			if (GetNextExpr(block, desc.outSizeExpr.first)) {
-				return 1;
-			}
-		} else if (t == "OUTPUT_HEIGHT") {
-			if (processed[2]) {
-				return 1;
-			}
-			processed[2] = true;
-
-			if (GetNextExpr(block, desc.outSizeExpr.second)) {
-				return 1;
-			}
-		} else if (t == "USE_DYNAMIC") {
-			if (processed[3]) {
-				return 1;
-			}
-			processed[3] = true;
-
-			if (GetNextToken<false>(block, token) != 2) {
-				return 1;
-			}
-
-			desc.flags |= EffectFlags::UseDynamic;
-		} else if (t == "GENERIC_DOWNSCALER") {
-			if (processed[4]) {
-				return 1;
-			}
-			processed[4] = true;
-
-			if (GetNextToken<false>(block, token) != 2) {
-				return 1;
-			}
-
-			desc.flags |= EffectFlags::GenericDownscaler;
-		} else if (t == "SORT_NAME") {
-			if (processed[5]) {
-				return 1;
-			}
-			processed[5] = true;
-
-			std::string_view sortName;
-			if (GetNextString(block, sortName)) {
-				return 1;
-			}
-
-			if (noCompile) {
-				desc.sortName = sortName;
-			}
-		} else {
-			return 1;
-		}
-	}
-
-	// HEADER 块不含代码部分
-	if (GetNextToken<true>(block, token) != 2) {
-		return 1;
-	}
-
-	if (!processed[0] || processed[1] != processed[2]) {
-		return 1;
-	}
-
-	// GENERIC_DOWNSCALER 和 OUTPUT_WIDTH/OUTPUT_HEIGHT 冲突
-	if (processed[4] && processed[1]) {
-		return 1;
-	}
-
-	return 0;
-}
-
-static UINT ResolveParameter(std::string_view block, EffectDesc& desc) {
-	// 必需的选项：DEFAULT, MIN, MAX, STEP
-	// 可选的选项：LABEL
-
-	std::bitset<5> processed;
-
-	std::string_view token;
-
-	if (!CheckNextToken<true>(block, META_INDICATOR)) {
-		return 1;
-	}
-
-	if (!CheckNextToken<false>(block, "PARAMETER")) {
-		return 1;
-	}
-	if (GetNextToken<false>(block, token) != 2) {
-		return 1;
-	}
-
-	EffectParameterDesc& paramDesc = desc.params.emplace_back();
-
-	std::string_view defaultValue;
-	std::string_view minValue;
-	std::string_view maxValue;
-	std::string_view stepValue;
-
-	while (true) {
-		if (!CheckNextToken<true>(block, META_INDICATOR)) {
-			break;
-		}
-
-		if (GetNextToken<false>(block, token)) {
-			return 1;
-		}
-
-		std::string t = StrUtils::ToUpperCase(token);
-
-		if (t == "DEFAULT") {
-			if (processed[0]) {
-				return 1;
-			}
-			processed[0] = true;
-
-			if (GetNextString(block, defaultValue)) {
-				return 1;
-			}
-		} else if (t == "LABEL") {
-			if (processed[1]) {
-				return 1;
-			}
-			processed[1] = true;
-
-			std::string_view label;
-			if (GetNextString(block, label)) {
-				return 1;
-			}
-			paramDesc.label = label;
-		} else if (t == "MIN") {
-			if (processed[2]) {
-				return 1;
-			}
-			processed[2] = true;
-
-			if (GetNextString(block, minValue)) {
-				return 1;
-			}
-		} else if (t == "MAX") {
-			if (processed[3]) {
-				return 1;
-			}
-			processed[3] = true;
-
-			if (GetNextString(block, maxValue)) {
-				return 1;
-			}
-		} else if (t == "STEP") {
-			if (processed[4]) {
-				return 1;
-			}
-			processed[4] = true;
-
-			if (GetNextString(block, stepValue)) {
-				return 1;
-			}
-		} else {
-			return 1;
-		}
-	}
-
-	// 检查必选项
-	if (!processed[0] || !processed[2] || !processed[3] || !processed[4]) {
-		return 1;
-	}
-
-	// 代码部分
-	if (GetNextToken<true>(block, token)) {
-		return 1;
-	}
-
-	if (token == "float") {
-		EffectConstant<float>& constant = paramDesc.constant.emplace<0>();
-
-		if (GetNextNumber(defaultValue, constant.defaultValue)) {
-			return 1;
-		}
-		if (GetNextNumber(minValue, constant.minValue)) {
-			return 1;
-		}
-		if (GetNextNumber(maxValue, constant.maxValue)) {
-			return 1;
-		}
-		if (GetNextNumber(stepValue, constant.step)) {
-			return 1;
-		}
-
-		if (constant.defaultValue < constant.minValue || constant.maxValue < constant.defaultValue) {
-			return 1;
-		}
-	} else if (token == "int") {
-		EffectConstant<int>& constant = paramDesc.constant.emplace<1>();
-
-		if (GetNextNumber(defaultValue, constant.defaultValue)) {
-			return 1;
-		}
-		if (GetNextNumber(minValue, constant.minValue)) {
-			return 1;
-		}
-		if (GetNextNumber(maxValue, constant.maxValue)) {
-			return 1;
-		}
-		if (GetNextNumber(stepValue, constant.step)) {
-			return 1;
-		}
-
-		if (constant.defaultValue < constant.minValue || constant.maxValue < constant.defaultValue) {
-			return 1;
-		}
-	} else {
-		return 1;
-	}
-
-	if (GetNextToken<true>(block, token)) {
-		return 1;
-	}
-	paramDesc.name = token;
-
-	if (!CheckNextToken<true>(block, ";")) {
-		return 1;
-	}
-
-	if (GetNextToken<true>(block, token) != 2) {
-		return 1;
-	}
-
-	return 0;
-}
-
-
-static UINT ResolveTexture(std::string_view block, EffectDesc& desc) {
-	// 如果名称为 INPUT 不能有任何选项，含 SOURCE 时不能有任何其他选项
-	// 否则必需的选项：FORMAT
-	// 可选的选项：WIDTH, HEIGHT
-
-	EffectIntermediateTextureDesc& texDesc = desc.textures.emplace_back();
-
-	std::bitset<4> processed;
-
-	std::string_view token;
-
-	if (!CheckNextToken<true>(block, META_INDICATOR)) {
-		return 1;
-	}
-
-	if (!CheckNextToken<false>(block, "TEXTURE")) {
-		return 1;
-	}
-	if (GetNextToken<false>(block, token) != 2) {
-		return 1;
-	}
-
-	while (true) {
-		if (!CheckNextToken<true>(block, META_INDICATOR)) {
-			break;
-		}
-
-		if (GetNextToken<false>(block, token)) {
-			return 1;
-		}
-
-		std::string t = StrUtils::ToUpperCase(token);
-
-		if (t == "SOURCE") {
-			if (processed[0] || processed[2] || processed[3]) {
-				return 1;
-			}
-			processed[0] = true;
-
-			if (GetNextString(block, token)) {
-				return 1;
-			}
-
-			texDesc.source = token;
-		} else if (t == "FORMAT") {
-			if (processed[1]) {
-				return 1;
-			}
-			processed[1] = true;
-
-			if (GetNextString(block, token)) {
-				return 1;
-			}
-
-			using enum EffectIntermediateTextureFormat;
-
-			static auto formatMap = []() {
-				phmap::flat_hash_map<std::string, EffectIntermediateTextureFormat> result;
-
-				// UNKNOWN 不可用
-				constexpr size_t descCount = std::size(EffectHelper::FORMAT_DESCS) - 1;
-				result.reserve(descCount);
-				for (size_t i = 0; i < descCount; ++i) {
-					result.emplace(EffectHelper::FORMAT_DESCS[i].name, (EffectIntermediateTextureFormat)i);
-				}
-				return result;
-			}();
-
-			auto it = formatMap.find(std::string(token));
-			if (it == formatMap.end()) {
-				return 1;
-			}
-
-			texDesc.format = it->second;
-		} else if (t == "WIDTH") {
-			if (processed[0] || processed[2]) {
-				return 1;
-			}
-			processed[2] = true;
-
-			if (GetNextExpr(block, texDesc.sizeExpr.first)) {
-				return 1;
-			}
-		} else if (t == "HEIGHT") {
-			if (processed[0] || processed[3]) {
-				return 1;
-			}
-			processed[3] = true;
-
-			if (GetNextExpr(block, texDesc.sizeExpr.second)) {
-				return 1;
-			}
-		} else {
-			return 1;
-		}
-	}
-
-	// WIDTH 和 HEIGHT 必须成对出现
-	if (processed[2] != processed[3]) {
-		return 1;
-	}
-
-	// 代码部分
-	if (!CheckNextToken<true>(block, "Texture2D")) {
-		return 1;
-	}
-
-	if (GetNextToken<true>(block, token)) {
-		return 1;
-	}
-
-	if (token == "INPUT") {
-		if (processed[1] || processed[2]) {
-			return 1;
-		}
-
-		// INPUT 已为第一个元素
-		desc.textures.pop_back();
-	} else {
-		texDesc.name = token;
-	}
-
-	if (!CheckNextToken<true>(block, ";")) {
-		return 1;
-	}
-
-	if (GetNextToken<true>(block, token) != 2) {
-		return 1;
-	}
-
-	return 0;
-}
-
-static UINT ResolveSampler(std::string_view block, EffectDesc& desc) {
-	// 必选项：FILTER
-	// 可选项：ADDRESS
-
-	EffectSamplerDesc& samDesc = desc.samplers.emplace_back();
-
-	std::bitset<2> processed;
-
-	std::string_view token;
-
-	if (!CheckNextToken<true>(block, META_INDICATOR)) {
-		return 1;
-	}
-
-	if (!CheckNextToken<false>(block, "SAMPLER")) {
-		return 1;
-	}
-	if (GetNextToken<false>(block, token) != 2) {
-		return 1;
-	}
-
-	while (true) {
-		if (!CheckNextToken<true>(block, META_INDICATOR)) {
-			break;
-		}
-
-		if (GetNextToken<false>(block, token)) {
-			return 1;
-		}
-
-		std::string t = StrUtils::ToUpperCase(token);
-
-		if (t == "FILTER") {
-			if (processed[0]) {
-				return 1;
-			}
-			processed[0] = true;
-
-			if (GetNextString(block, token)) {
-				return 1;
-			}
-
-			std::string filter = StrUtils::ToUpperCase(token);
-
-			if (filter == "LINEAR") {
-				samDesc.filterType = EffectSamplerFilterType::Linear;
-			} else if (filter == "POINT") {
-				samDesc.filterType = EffectSamplerFilterType::Point;
-			} else {
-				return 1;
-			}
-		} else if (t == "ADDRESS") {
-			if (processed[1]) {
-				return 1;
-			}
-			processed[1] = true;
-
-			if (GetNextString(block, token)) {
-				return 1;
-			}
-
-			std::string filter = StrUtils::ToUpperCase(token);
-
-			if (filter == "CLAMP") {
-				samDesc.addressType = EffectSamplerAddressType::Clamp;
-			} else if (filter == "WRAP") {
-				samDesc.addressType = EffectSamplerAddressType::Wrap;
-			} else {
-				return 1;
-			}
-		} else {
-			return 1;
-		}
-	}
+		std::memcpy(result, file.data(), file.size());
 
-	if (!processed[0]) {
-		return 1;
-	}
+		*ppData = result;
+		*pBytes = (UINT)file.size();
 
-	// 代码部分
-	if (!CheckNextToken<true>(block, "SamplerState")) {
-		return 1;
+		return S_OK;
 	}
 
-	if (GetNextToken<true>(block, token)) {
-		return 1;
+	HRESULT CALLBACK Close(LPCVOID pData) noexcept override {
+		delete[](char*)pData;
+		return S_OK;
 	}
 
-	samDesc.name = token;
-
-	if (!CheckNextToken<true>(block, ";")) {
-		return 1;
-	}
+private:
+	std::wstring _localDir;
+};
 
-	if (GetNextToken<true>(block, token) != 2) {
-		return 1;
+static void LogDiagnostic(std::string_view effectName, const EffectParserDiagnostic& diag) {
+	if (diag.line == 0) {
+		Logger::Get().Error(fmt::format("{}: {}", effectName, diag.message));
+	} else {
+		Logger::Get().Error(fmt::format("{}({},{}): {}", effectName, diag.line, diag.column, diag.message));
 	}
-
-	return 0;
 }
 
-static UINT ResolveCommon(std::string_view& block) {
-	// 无选项
-
-	if (!CheckNextToken<true>(block, META_INDICATOR)) {
-		return 1;
-	}
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// 效果融合
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-	if (!CheckNextToken<false>(block, "COMMON")) {
-		return 1;
+// 只有一个 PS 样式的通道，没有中间纹理，输出尺寸和输入相同。是否只读取输入的当前像素由 PER_PIXEL 声明
+static bool IsPerPixelEffect(const EffectDesc& desc) noexcept {
+	if (!(desc.flags & EffectFlags::PerPixel)) {
+		return false;
 	}
 
-	if (CheckNextToken<true>(block, META_INDICATOR)) {
-		return 1;
+	if (desc.passes.size() != 1 || !desc.passes[0].isPSStyle || desc.textures.size() != 1) {
+		return false;
 	}
 
-	return 0;
+	return desc.outSizeExpr.first.empty()
+		|| (desc.outSizeExpr.first == "INPUT_WIDTH" && desc.outSizeExpr.second == "INPUT_HEIGHT");
 }
 
-static UINT ResolvePasses(
-	SmallVector<std::string_view>& blocks,
-	EffectDesc& desc
-) {
-	// 必选项：IN
-	// 可选项：OUT, BLOCK_SIZE, NUM_THREADS, STYLE
-	// STYLE 为 PS 时不能有 BLOCK_SIZE 或 NUM_THREADS
-
-	std::string_view token;
-
-	// 首先解析通道序号
-
-	// first 为 Pass 序号，second 为在 blocks 中的位置
-	SmallVector<std::pair<UINT, UINT>> passNumbers;
-	passNumbers.reserve(blocks.size());
-
-	for (UINT i = 0; i < blocks.size(); ++i) {
-		std::string_view& block = blocks[i];
-
-		if (!CheckNextToken<true>(block, META_INDICATOR)) {
-			return 1;
-		}
-
-		if (!CheckNextToken<false>(block, "PASS")) {
-			return 1;
-		}
-
-		UINT index;
-		if (GetNextNumber(block, index)) {
-			return 1;
-		}
-		if (GetNextToken<false>(block, token) != 2) {
-			return 1;
-		}
-
-		passNumbers.emplace_back(index, i);
+// 采样坐标无法从编译结果得知，这里检查通道除了光标只读取 INPUT，且没有 Load、Gather 等以其他方式读取纹理的指令
+static bool ValidatePerPixelPass(const EffectPassDesc& passDesc) {
+	winrt::com_ptr<ID3D11ShaderReflection> reflection;
+	HRESULT hr = D3DReflect(passDesc.cso->GetBufferPointer(),
+		passDesc.cso->GetBufferSize(), IID_PPV_ARGS(reflection.put()));
+	if (FAILED(hr)) {
+		Logger::Get().ComError("D3DReflect 失败", hr);
+		return false;
 	}
 
-	std::sort(
-		passNumbers.begin(),
-		passNumbers.end(),
-		[](const std::pair<UINT, UINT>& l, const std::pair<UINT, UINT>& r) {return l.first < r.first; }
-	);
-
-	SmallVector<std::string_view> temp = blocks;
-	for (UINT i = 0; i < blocks.size(); ++i) {
-		if (passNumbers[i].first != i + 1) {
-			// PASS 序号不连续
-			return 1;
-		}
-
-		blocks[i] = temp[passNumbers[i].second];
+	D3D11_SHADER_DESC shaderDesc;
+	hr = reflection->GetDesc(&shaderDesc);
+	if (FAILED(hr)) {
+		Logger::Get().ComError("GetDesc 失败", hr);
+		return false;
 	}
 
-	desc.passes.resize(blocks.size());
-
-	for (UINT i = 0; i < blocks.size(); ++i) {
-		std::string_view& block = blocks[i];
-		auto& passDesc = desc.passes[i];
-
-		// 用于检查输入和输出中重复的纹理
-		phmap::flat_hash_map<std::string_view, UINT> texNames;
-		texNames.reserve(desc.textures.size());
-		for (UINT j = 0; j < desc.textures.size(); ++j) {
-			texNames.emplace(desc.textures[j].name, j);
-		}
-
-		std::bitset<6> processed;
-
-		while (true) {
-			if (!CheckNextToken<true>(block, META_INDICATOR)) {
-				break;
-			}
-
-			if (GetNextToken<false>(block, token)) {
-				return 1;
-			}
-
-			std::string t = StrUtils::ToUpperCase(token);
-
-			if (t == "IN") {
-				if (processed[0]) {
-					return 1;
-				}
-				processed[0] = true;
-
-				std::string_view binds;
-				if (GetNextString(block, binds)) {
-					return 1;
-				}
-
-				for (std::string_view& input : StrUtils::Split(binds, ',')) {
-					StrUtils::Trim(input);
-
-					auto it = texNames.find(input);
-					if (it == texNames.end()) {
-						// 未找到纹理名称
-						return 1;
-					}
-
-					passDesc.inputs.push_back(it->second);
-					texNames.erase(it);
-				}
-			} else if (t == "OUT") {
-				if (processed[1]) {
-					return 1;
-				}
-				processed[1] = true;
-
-				std::string_view saves;
-				if (GetNextString(block, saves)) {
-					return 1;
-				}
-
-				SmallVector<std::string_view> outputs = StrUtils::Split(saves, ',');
-				if (outputs.size() > 8) {
-					// 最多 8 个输出
-					return 1;
-				}
-
-				for (std::string_view& output : outputs) {
-					StrUtils::Trim(output);
-
-					auto it = texNames.find(output);
-					if (it == texNames.end()) {
-						// 未找到纹理名称
-						return 1;
-					}
-
-					if (it->second == 0 || !desc.textures[it->second].source.empty()) {
-						// INPUT 和从文件读取的纹理不能作为输出
-						return 1;
-					}
-
-					passDesc.outputs.push_back(it->second);
-					texNames.erase(it);
-				}
-			} else if (t == "BLOCK_SIZE") {
-				if (processed[2]) {
-					return 1;
-				}
-				processed[2] = true;
-
-				std::string_view val;
-				if (GetNextString(block, val)) {
-					return 1;
-				}
-
-				SmallVector<std::string_view> split = StrUtils::Split(val, ',');
-				if (split.size() > 2) {
-					return 1;
-				}
-
-				UINT num;
-				if (GetNextNumber(split[0], num) || num == 0) {
-					return 1;
-				}
-
-				if (GetNextToken<false>(split[0], token) != 2) {
-					return false;
-				}
-
-				passDesc.blockSize.first = num;
-
-				// 如果只有一个数字，则它同时指定长和高
-				if (split.size() == 2) {
-					if (GetNextNumber(split[1], num) || num == 0) {
-						return 1;
-					}
-
-					if (GetNextToken<false>(split[1], token) != 2) {
-						return false;
-					}
-				}
-
-				passDesc.blockSize.second = num;
-			} else if (t == "NUM_THREADS") {
-				if (processed[3]) {
-					return 1;
-				}
-				processed[3] = true;
-
-				std::string_view val;
-				if (GetNextString(block, val)) {
-					return 1;
-				}
-
-				SmallVector<std::string_view> split = StrUtils::Split(val, ',');
-				if (split.size() > 3) {
-					return 1;
-				}
-
-				for (UINT j = 0; j < 3; ++j) {
-					UINT num = 1;
-					if (split.size() > j) {
-						if (GetNextNumber(split[j], num)) {
-							return 1;
-						}
-
-						if (GetNextToken<false>(split[j], token) != 2) {
-							return false;
-						}
-					}
-
-					passDesc.numThreads[j] = num;
-				}
-			} else if (t == "STYLE") {
-				if (processed[4]) {
-					return 1;
-				}
-				processed[4] = true;
-
-				std::string_view val;
-				if (GetNextString(block, val)) {
-					return 1;
-				}
-
-				if (val == "PS") {
-					passDesc.isPSStyle = true;
-					passDesc.blockSize.first = 16;
-					passDesc.blockSize.second = 16;
-					passDesc.numThreads = { 64,1,1 };
-				} else if (val != "CS") {
-					return 1;
-				}
-			} else if (t == "DESC") {
-				if (processed[5]) {
-					return 1;
-				}
-				processed[5] = true;
-
-				std::string_view val;
-				if (GetNextString(block, val)) {
-					return 1;
-				}
+	if (shaderDesc.TextureLoadInstructions || shaderDesc.TextureGatherInstructions
+		|| shaderDesc.TextureBiasInstructions || shaderDesc.TextureGradientInstructions
+		|| shaderDesc.TextureCompInstructions) {
+		return false;
+	}
 
-				StrUtils::Trim(val);
-				passDesc.desc = val;
-			} else {
-				return 1;
-			}
+	for (UINT i = 0; i < shaderDesc.BoundResources; ++i) {
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		hr = reflection->GetResourceBindingDesc(i, &bindDesc);
+		if (FAILED(hr)) {
+			Logger::Get().ComError("GetResourceBindingDesc 失败", hr);
+			return false;
 		}
 
-		if (passDesc.isPSStyle) {
-			if (processed[2] || processed[3]) {
-				return 1;
+		const std::string_view name = bindDesc.Name;
+		switch (bindDesc.Type) {
+		case D3D_SIT_CBUFFER:
+		case D3D_SIT_SAMPLER:
+			break;
+		case D3D_SIT_TEXTURE:
+			if (name != "INPUT" && name != "__CURSOR") {
+				return false;
 			}
-		} else {
-			if (!processed[2] || !processed[3]) {
-				return 1;
+			break;
+		case D3D_SIT_UAV_RWTYPED:
+			if (name != "__OUTPUT") {
+				return false;
 			}
-		}
-
-		if (passDesc.desc.empty()) {
-			passDesc.desc = fmt::format("Pass {}", i + 1);
+			break;
+		default:
+			return false;
 		}
 	}
 
-	return 0;
+	return true;
 }
 
-
 static UINT GeneratePassSource(
 	const EffectDesc& desc,
 	UINT passIdx,
@@ -1300,7 +393,7 @@ uint2 GetCursorPos() { return __cursorPos; }
 			if (isLastPass) {
 				result.append(fmt::format(R"([numthreads(64, 1, 1)]
 void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
-	uint2 gxy = Rmp8x8(tid.x) + (gid.xy << 4u){0};
+	uint2 gxy = Rmp8x8(tid.x) + ((gid.xy + __blockOffset) << 4u){0};
 	float2 pos = (gxy + 0.5f) * __outputPt;
 	float2 step = 8 * __outputPt;
 	
@@ -1332,7 +425,7 @@ void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
 			} else {
 				result.append(fmt::format(R"([numthreads(64, 1, 1)]
 void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
-	uint2 gxy = Rmp8x8(tid.x) + (gid.xy << 4u);
+	uint2 gxy = Rmp8x8(tid.x) + ((gid.xy + __blockOffset) << 4u);
 	if (gxy.x >= __pass{0}OutputSize.x || gxy.y >= __pass{0}OutputSize.y) {{
 		return;
 	}}
@@ -1369,7 +462,7 @@ void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
 
 			result.append(fmt::format(R"([numthreads(64, 1, 1)]
 void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
-	uint2 gxy = Rmp8x8(tid.x) + (gid.xy << 4u);
+	uint2 gxy = Rmp8x8(tid.x) + ((gid.xy + __blockOffset) << 4u);
 	if (gxy.x >= __pass{0}OutputSize.x || gxy.y >= __pass{0}OutputSize.y) {{
 		return;
 	}}
@@ -1418,9 +511,9 @@ void __M(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID) {{
 		std::string blockStartExpr;
 		if (passDesc.blockSize.first == passDesc.blockSize.second && std::has_single_bit(passDesc.blockSize.first)) {
 			UINT nShift = std::lroundf(std::log2f((float)passDesc.blockSize.first));
-			blockStartExpr = fmt::format("(gid.xy << {})", nShift);
+			blockStartExpr = fmt::format("((gid.xy + __blockOffset) << {})", nShift);
 		} else {
-			blockStartExpr = fmt::format("gid.xy * uint2({}, {})", passDesc.blockSize.first, passDesc.blockSize.second);
+			blockStartExpr = fmt::format("(gid.xy + __blockOffset) * uint2({}, {})", passDesc.blockSize.first, passDesc.blockSize.second);
 		}
 
 		result.append(fmt::format(R"([numthreads({}, {}, {})]
@@ -1438,7 +531,9 @@ static UINT CompilePasses(
 	uint32_t flags,
 	const SmallVector<std::string_view>& commonBlocks,
 	const SmallVector<std::string_view>& passBlocks,
-	const phmap::flat_hash_map<std::wstring, float>* inlineParams
+	const phmap::flat_hash_map<std::wstring, float>* inlineParams,
+	// #include 相对于此效果所在的文件夹
+	std::string_view includeEffectName
 ) {
 	////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//
@@ -1452,6 +547,8 @@ static UINT CompilePasses(
 	uint2 __cursorPos;
 	uint __cursorType;
 	uint __frameCount;
+	// 局部渲染时第一个线程组的位置
+	uint2 __blockOffset;
 };
 cbuffer __CB2 : register(b1) {
 	uint2 __inputSize;
@@ -1492,18 +589,24 @@ cbuffer __CB2 : register(b1) {
 		}
 	}
 
-	size_t delimPos = desc.name.find_last_of('\\');
+	size_t delimPos = includeEffectName.find_last_of('\\');
 	PassInclude passInclude(delimPos == std::string::npos 
 		? L"effects\\"
-		: L"effects\\" + StrUtils::UTF8ToUTF16(std::string_view(desc.name.c_str(), delimPos + 1)));
+		: L"effects\\" + StrUtils::UTF8ToUTF16(includeEffectName.substr(0, delimPos + 1)));
+
+	const bool noCache = flags & EffectCompilerFlags::NoCache;
 
-	// 并行生成代码和编译
-	Win32Utils::RunParallel([&](UINT id) {
-		std::string source;
-		std::vector<std::pair<std::string, std::string>> macros;
-		if (GeneratePassSource(desc, id + 1, cbHlsl, commonBlocks, passBlocks[id], inlineParams, source, macros)) {
+	const UINT passCount = (UINT)passBlocks.size();
+	const bool warningsAreErrors = flags & EffectCompilerFlags::WarningsAreErrors;
+
+	// 先生成所有通道的代码，以源码长度作为编译开销的估计
+	std::vector<std::string> sources(passCount);
+	std::vector<std::vector<std::pair<std::string, std::string>>> macrosList(passCount);
+	std::vector<uint64_t> costs(passCount);
+	for (UINT id = 0; id < passCount; ++id) {
+		if (GeneratePassSource(desc, id + 1, cbHlsl, commonBlocks, passBlocks[id], inlineParams, sources[id], macrosList[id])) {
 			Logger::Get().Error(fmt::format("生成 Pass{} 失败", id + 1));
-			return;
+			return 1;
 		}
 
 		if (flags & EffectCompilerFlags::SaveSources) {
@@ -1511,17 +614,55 @@ cbuffer __CB2 : register(b1) {
 				? fmt::format(L"{}{}.hlsl", CommonSharedConstants::SOURCES_DIR, StrUtils::UTF8ToUTF16(desc.name))
 				: fmt::format(L"{}{}_Pass{}.hlsl", CommonSharedConstants::SOURCES_DIR, StrUtils::UTF8ToUTF16(desc.name), id + 1);
 
-			if (!Win32Utils::WriteFile(fileName.c_str(), source.data(), source.size())) {
+			if (!Win32Utils::WriteFile(fileName.c_str(), sources[id].data(), sources[id].size())) {
 				Logger::Get().Error(fmt::format("保存 Pass{} 源码失败", id + 1));
 			}
 		}
 
-		if (!DirectXHelper::CompileComputeShader(source, "__M", desc.passes[id].cso.put(),
-			fmt::format("{}_Pass{}.hlsl", desc.name, id + 1).c_str(), &passInclude, macros, flags & EffectCompilerFlags::WarningsAreErrors)
-		) {
+		costs[id] = sources[id].size();
+	}
+
+	auto compilePass = [&](UINT id) {
+		const std::string& source = sources[id];
+		const std::vector<std::pair<std::string, std::string>>& macros = macrosList[id];
+		const std::string sourceName = fmt::format("{}_Pass{}.hlsl", desc.name, id + 1);
+
+		uint64_t passHash = 0;
+		if (!noCache) {
+			passHash = EffectCacheManager::GetPassHash(source, sourceName, macros, warningsAreErrors);
+			if (EffectCacheManager::Get().LoadPass(passHash, desc.passes[id].cso)) {
+				Logger::Get().Info(fmt::format("Pass{} 使用缓存", id + 1));
+				return;
+			}
+		}
+
+		bool success = true;
+		int duration = Utils::Measure([&]() {
+			success = DirectXHelper::CompileComputeShader(source, "__M", desc.passes[id].cso.put(),
+				sourceName.c_str(), &passInclude, macros, warningsAreErrors);
+		});
+
+		if (!success) {
 			Logger::Get().Error(fmt::format("编译 Pass{} 失败", id + 1));
+			return;
+		}
+
+		Logger::Get().Info(fmt::format("编译 {} 用时 {} 毫秒", sourceName, duration / 1000.0f));
+
+		if (!noCache) {
+			EffectCacheManager::Get().SavePass(passHash, desc.passes[id].cso.get());
 		}
-	}, (UINT)passBlocks.size());
+	};
+
+	if (flags & EffectCompilerFlags::Serial) {
+		// 任务队列中的任务会被等待中的线程取走，后台编译不能进入队列
+		for (UINT id = 0; id < passCount; ++id) {
+			compilePass(id);
+		}
+	} else {
+		// 并行编译。通道和其他效果的通道在同一个队列中，长的先编译
+		TaskScheduler::RunParallel(compilePass, passCount, costs);
+	}
 
 	// 检查编译结果
 	for (const EffectPassDesc& d : desc.passes) {
@@ -1534,10 +675,12 @@ cbuffer __CB2 : register(b1) {
 }
 
 
-uint32_t EffectCompiler::Compile(
+// hashOut 不为空时即使禁用了缓存也计算源码的哈希
+static uint32_t CompileImpl(
 	EffectDesc& desc,
 	uint32_t flags,
-	const phmap::flat_hash_map<std::wstring, float>* inlineParams
+	const phmap::flat_hash_map<std::wstring, float>* inlineParams,
+	std::wstring* hashOut
 ) {
 	bool noCompile = flags & EffectCompilerFlags::NoCompile;
 	bool noCache = noCompile || (flags & EffectCompilerFlags::NoCache);
@@ -1557,15 +700,16 @@ uint32_t EffectCompiler::Compile(
 	}
 
 	// 移除注释
-	if (RemoveComments(source)) {
-		Logger::Get().Error("删除注释失败");
+	EffectParserDiagnostic diag;
+	if (EffectParser::RemoveComments(source, &diag)) {
+		LogDiagnostic(desc.name, diag);
 		return 1;
 	}
 
 	std::wstring hash;
-	if (!noCache) {
+	if (!noCache || hashOut) {
 		hash = EffectCacheManager::GetHash(source, desc.flags & EffectFlags::InlineParams ? inlineParams : nullptr);
-		if (!hash.empty()) {
+		if (!noCache && !hash.empty()) {
 			if (EffectCacheManager::Get().Load(effectName, hash, desc)) {
 				// 已从缓存中读取
 				return 0;
@@ -1573,198 +717,257 @@ uint32_t EffectCompiler::Compile(
 		}
 	}
 
-	std::string_view sourceView(source);
-
-	// 检查头
-	if (!CheckMagic(sourceView)) {
-		Logger::Get().Error("检查 MagpieFX 头失败");
-		return 2;
+	EffectSourceBlocks blocks;
+	if (uint32_t ret = EffectParser::Parse(source, noCompile, desc, &blocks, &diag)) {
+		LogDiagnostic(desc.name, diag);
+		return ret;
 	}
 
-	enum class BlockType {
-		Header,
-		Parameter,
-		Texture,
-		Sampler,
-		Common,
-		Pass
-	};
-
-	std::string_view headerBlock;
-	SmallVector<std::string_view> paramBlocks;
-	SmallVector<std::string_view> textureBlocks;
-	SmallVector<std::string_view> samplerBlocks;
-	SmallVector<std::string_view> commonBlocks;
-	SmallVector<std::string_view> passBlocks;
-
-	BlockType curBlockType = BlockType::Header;
-	size_t curBlockOff = 0;
-
-	auto completeCurrentBlock = [&](size_t len, BlockType newBlockType) {
-		if (curBlockType == BlockType::Header) {
-			headerBlock = sourceView.substr(curBlockOff, len);
-		} else if (curBlockType == BlockType::Parameter) {
-			paramBlocks.push_back(sourceView.substr(curBlockOff, len));
-		} else if (!noCompile) {
-			switch (curBlockType) {
-			case BlockType::Texture:
-				textureBlocks.push_back(sourceView.substr(curBlockOff, len));
-				break;
-			case BlockType::Sampler:
-				samplerBlocks.push_back(sourceView.substr(curBlockOff, len));
-				break;
-			case BlockType::Common:
-				commonBlocks.push_back(sourceView.substr(curBlockOff, len));
-				break;
-			case BlockType::Pass:
-				passBlocks.push_back(sourceView.substr(curBlockOff, len));
-				break;
-			default:
-				assert(false);
-				break;
-			}
+	if (!noCompile) {
+		if (CompilePasses(desc, flags, blocks.commonBlocks, blocks.passBlocks, inlineParams, desc.name)) {
+			Logger::Get().Error("编译着色器失败");
+			return 1;
 		}
 
-		curBlockType = newBlockType;
-		curBlockOff += len;
-	};
-
-	bool newLine = true;
-	std::string_view t = sourceView;
-	while (t.size() > 5) {
-		if (newLine) {
-			// 包含换行符
-			size_t len = t.data() - sourceView.data() - curBlockOff + 1;
-
-			if (CheckNextToken<true>(t, META_INDICATOR)) {
-				std::string_view token;
-				if (GetNextToken<false>(t, token)) {
-					return 1;
-				}
-				std::string blockType = StrUtils::ToUpperCase(token);
-
-				if (blockType == "PARAMETER") {
-					completeCurrentBlock(len, BlockType::Parameter);
-				} else if (blockType == "TEXTURE") {
-					completeCurrentBlock(len, BlockType::Texture);
-				} else if (blockType == "SAMPLER") {
-					completeCurrentBlock(len, BlockType::Sampler);
-				} else if (blockType == "COMMON") {
-					completeCurrentBlock(len, BlockType::Common);
-				} else if (blockType == "PASS") {
-					completeCurrentBlock(len, BlockType::Pass);
-				}
-			}
+		// PER_PIXEL 由作者声明，这里排除能从编译结果中发现的错误
+		if ((desc.flags & EffectFlags::PerPixel)
+			&& (!IsPerPixelEffect(desc) || !ValidatePerPixelPass(desc.passes[0]))) {
+			Logger::Get().Warn(StrUtils::Concat(desc.name, " 声明了 PER_PIXEL 但不满足条件，不会被融合"));
+			desc.flags &= ~EffectFlags::PerPixel;
+		}
 
-			if (t.size() <= 5) {
-				break;
-			}
-		} else {
-			t.remove_prefix(1);
+		if (!noCache && !hash.empty()) {
+			EffectCacheManager::Get().Save(effectName, hash, desc);
 		}
+	}
 
-		newLine = t[0] == '\n';
+	if (hashOut) {
+		*hashOut = std::move(hash);
 	}
 
-	completeCurrentBlock(sourceView.size() - curBlockOff, BlockType::Header);
+	return 0;
+}
 
-	// 必须有 PASS 块
-	if (!noCompile && passBlocks.empty()) {
-		Logger::Get().Error("无 PASS 块");
-		return 1;
-	}
+uint32_t EffectCompiler::Compile(
+	EffectDesc& desc,
+	uint32_t flags,
+	const phmap::flat_hash_map<std::wstring, float>* inlineParams
+) {
+	return CompileImpl(desc, flags, inlineParams, nullptr);
+}
 
-	if (ResolveHeader(headerBlock, desc, noCompile)) {
-		Logger::Get().Error("解析 Header 块失败");
-		return 1;
+uint32_t EffectCompiler::CompileFused(
+	EffectDesc& desc,
+	std::span<const std::string> effectNames,
+	uint32_t flags,
+	const phmap::flat_hash_map<std::wstring, float>* inlineParams
+) {
+	assert(effectNames.size() >= 2 && !(flags & EffectCompilerFlags::NoCompile));
+
+	const bool noCache = flags & EffectCompilerFlags::NoCache;
+
+	desc.name.clear();
+	for (const std::string& effectName : effectNames) {
+		if (!desc.name.empty()) {
+			desc.name.push_back('+');
+		}
+		desc.name.append(effectName);
 	}
 
-	desc.params.clear();
-	for (size_t i = 0; i < paramBlocks.size(); ++i) {
-		if (ResolveParameter(paramBlocks[i], desc)) {
-			Logger::Get().Error(fmt::format("解析 Parameter#{} 块失败", i + 1));
+	const size_t count = effectNames.size();
+	std::vector<std::string> sources(count);
+	for (size_t i = 0; i < count; ++i) {
+		std::wstring fileName = StrUtils::ConcatW(
+			CommonSharedConstants::EFFECTS_DIR, StrUtils::UTF8ToUTF16(effectNames[i]), L".hlsl");
+		if (!Win32Utils::ReadTextFile(fileName.c_str(), sources[i]) || sources[i].empty()) {
+			Logger::Get().Error(StrUtils::Concat("读取 ", effectNames[i], " 失败"));
+			return 1;
+		}
+
+		EffectParserDiagnostic diag;
+		if (EffectParser::RemoveComments(sources[i], &diag)) {
+			LogDiagnostic(effectNames[i], diag);
 			return 1;
 		}
 	}
 
-	if (!noCompile) {
-		desc.textures.clear();
-		// 纹理第一个元素为 INPUT
-		{
-			auto& texDesc = desc.textures.emplace_back();
-			texDesc.name = "INPUT";
-			texDesc.format = EffectIntermediateTextureFormat::R8G8B8A8_UNORM;
-			texDesc.sizeExpr.first = "INPUT_WIDTH";
-			texDesc.sizeExpr.second = "INPUT_HEIGHT";
+	std::wstring cacheName = StrUtils::UTF8ToUTF16(desc.name);
+	std::wstring hash;
+	if (!noCache) {
+		std::string allSources;
+		for (const std::string& source : sources) {
+			allSources.append(source);
+			allSources.push_back('\0');
 		}
 
-		for (size_t i = 0; i < textureBlocks.size(); ++i) {
-			if (ResolveTexture(textureBlocks[i], desc)) {
-				Logger::Get().Error(fmt::format("解析 Texture#{} 块失败", i + 1));
-				return 1;
-			}
+		hash = EffectCacheManager::GetHash(allSources, desc.flags & EffectFlags::InlineParams ? inlineParams : nullptr);
+		if (!hash.empty() && EffectCacheManager::Get().Load(cacheName, hash, desc)) {
+			return 0;
 		}
+	}
 
-		desc.samplers.clear();
-		for (size_t i = 0; i < samplerBlocks.size(); ++i) {
-			if (ResolveSampler(samplerBlocks[i], desc)) {
-				Logger::Get().Error(fmt::format("解析 Sampler#{} 块失败", i + 1));
-				return 1;
-			}
+	std::vector<EffectDesc> descs(count);
+	std::vector<EffectSourceBlocks> blocksList(count);
+	for (size_t i = 0; i < count; ++i) {
+		descs[i].name = effectNames[i];
+		descs[i].flags = desc.flags & (EffectFlags::InlineParams | EffectFlags::FP16);
+
+		EffectParserDiagnostic diag;
+		if (EffectParser::Parse(sources[i], false, descs[i], &blocksList[i], &diag)) {
+			LogDiagnostic(effectNames[i], diag);
+			return 1;
 		}
 	}
 
-	{
-		// 确保没有重复的名字
-		phmap::flat_hash_set<std::string> names;
-		for (const auto& d : desc.params) {
-			if (names.find(d.name) != names.end()) {
-				Logger::Get().Error("标识符重复");
-				return 1;
-			}
-			names.insert(d.name);
+	// 检查能否融合
+	EffectDesc& producer = descs[0];
+	if (!producer.passes.back().isPSStyle) {
+		Logger::Get().Info(StrUtils::Concat("无法融合 ", desc.name, ": ", effectNames[0], " 的最后一个通道不是 PS 样式"));
+		return 1;
+	}
+
+	std::string_view producerDir;
+	if (size_t delimPos = effectNames[0].find_last_of('\\'); delimPos != std::string::npos) {
+		producerDir = std::string_view(effectNames[0]).substr(0, delimPos + 1);
+	}
+
+	phmap::flat_hash_set<std::string_view> names;
+	for (const EffectParameterDesc& param : producer.params) {
+		names.emplace(param.name);
+	}
+	for (const EffectSamplerDesc& sampler : producer.samplers) {
+		names.emplace(sampler.name);
+	}
+
+	for (size_t i = 1; i < count; ++i) {
+		// 调用者只融合单独编译时通过了检查的效果
+		if (!IsPerPixelEffect(descs[i])) {
+			Logger::Get().Info(StrUtils::Concat("无法融合 ", desc.name, ": ", effectNames[i], " 不是逐像素效果"));
+			return 1;
 		}
-		for (const auto& d : desc.textures) {
-			if (names.find(d.name) != names.end()) {
-				Logger::Get().Error("标识符重复");
+
+		// #include 相对于第一个效果的文件夹
+		std::string_view dir;
+		if (size_t delimPos = effectNames[i].find_last_of('\\'); delimPos != std::string::npos) {
+			dir = std::string_view(effectNames[i]).substr(0, delimPos + 1);
+		}
+		if (dir != producerDir && sources[i].find("#include") != std::string::npos) {
+			Logger::Get().Info(StrUtils::Concat("无法融合 ", desc.name, ": ", effectNames[i], " 包含其他文件"));
+			return 1;
+		}
+
+		for (const EffectParameterDesc& param : descs[i].params) {
+			if (!names.emplace(param.name).second) {
+				Logger::Get().Info(StrUtils::Concat("无法融合 ", desc.name, ": 参数 ", param.name, " 重名"));
 				return 1;
 			}
-			names.insert(d.name);
 		}
-		for (const auto& d : desc.samplers) {
-			if (names.find(d.name) != names.end()) {
-				Logger::Get().Error("标识符重复");
+		for (const EffectSamplerDesc& sampler : descs[i].samplers) {
+			if (!names.emplace(sampler.name).second) {
+				Logger::Get().Info(StrUtils::Concat("无法融合 ", desc.name, ": 采样器 ", sampler.name, " 重名"));
 				return 1;
 			}
-			names.insert(d.name);
 		}
 	}
 
-	if (!noCompile) {
-		for (size_t i = 0; i < commonBlocks.size(); ++i) {
-			if (ResolveCommon(commonBlocks[i])) {
-				Logger::Get().Error(fmt::format("解析 Common#{} 块失败", i + 1));
-				return 1;
-			}
-		}
+	// 合并，输出尺寸、中间纹理和通道均来自第一个效果
+	const uint32_t inputFlags = desc.flags;
+	const std::string fusedName = std::move(desc.name);
+	desc = std::move(producer);
+	desc.name = fusedName;
+	desc.flags = inputFlags | (desc.flags & EffectFlags::UseDynamic);
+	for (size_t i = 1; i < count; ++i) {
+		std::move(descs[i].params.begin(), descs[i].params.end(), std::back_inserter(desc.params));
+		std::move(descs[i].samplers.begin(), descs[i].samplers.end(), std::back_inserter(desc.samplers));
+		desc.flags |= descs[i].flags & EffectFlags::UseDynamic;
+	}
 
-		desc.passes.clear();
-		if (ResolvePasses(passBlocks, desc)) {
-			Logger::Get().Error("解析 Pass 块失败");
-			return 1;
-		}
+	// 生成融合后的最后一个通道。第一个效果的 PassN 和后面效果的 Pass1 被重命名，由新的 PassN 依次调用，
+	// 后面效果中的 INPUT 被替换为只有 SampleLevel 的对象，它返回上一个效果的结果。PER_PIXEL 保证采样坐标为 pos，
+	// 以其他方式使用 INPUT 会编译失败
+	const uint32_t lastPassIdx = (uint32_t)desc.passes.size();
+	const SmallVector<std::string_view>& producerPassBlocks = blocksList[0].passBlocks;
 
-		if (CompilePasses(desc, flags, commonBlocks, passBlocks, inlineParams)) {
-			Logger::Get().Error("编译着色器失败");
-			return 1;
-		}
+	std::string fusedBlock = fmt::format("#define Pass{} __MP_FUSED_PRODUCER\n", lastPassIdx);
+	fusedBlock.append(producerPassBlocks.back());
+	fusedBlock.append(fmt::format(R"(
+#undef Pass{}
 
-		if (!noCache && !hash.empty()) {
-			EffectCacheManager::Get().Save(effectName, hash, desc);
+static float4 __mpFusedInput;
+struct __MpFusedInputTex {{
+	float4 SampleLevel(SamplerState s, float2 uv, float level) {{ return __mpFusedInput; }}
+}};
+static __MpFusedInputTex __mpFusedInputTex;
+#define GetInputSize GetOutputSize
+#define GetInputPt GetOutputPt
+#define GetScale() float2(1, 1)
+
+)", lastPassIdx));
+
+	for (size_t i = 1; i < count; ++i) {
+		fusedBlock.append("#define INPUT __mpFusedInputTex\n");
+
+		for (std::string_view commonBlock : blocksList[i].commonBlocks) {
+			fusedBlock.append(commonBlock);
+			fusedBlock.push_back('\n');
 		}
+
+		fusedBlock.append(fmt::format("#define Pass1 __MP_FUSED_CONSUMER{}\n", i));
+		fusedBlock.append(blocksList[i].passBlocks[0]);
+		fusedBlock.append("\n#undef Pass1\n#undef INPUT\n\n");
+	}
+
+	fusedBlock.append(fmt::format("float4 Pass{}(float2 pos) {{\n\t__mpFusedInput = __MP_FUSED_PRODUCER(pos);\n", lastPassIdx));
+	for (size_t i = 1; i < count; ++i) {
+		fusedBlock.append(fmt::format("\t__mpFusedInput = __MP_FUSED_CONSUMER{}(pos);\n", i));
+	}
+	fusedBlock.append("\treturn __mpFusedInput;\n}\n");
+
+	SmallVector<std::string_view> passBlocks(producerPassBlocks.begin(), producerPassBlocks.end());
+	passBlocks.back() = fusedBlock;
+
+	// 编译失败时调用者应回退到不融合
+	if (CompilePasses(desc, flags, blocksList[0].commonBlocks, passBlocks, inlineParams, effectNames[0])) {
+		Logger::Get().Error(StrUtils::Concat("编译 ", desc.name, " 失败"));
+		return 1;
+	}
+
+	if (!noCache && !hash.empty()) {
+		EffectCacheManager::Get().Save(cacheName, hash, desc);
 	}
 
 	return 0;
 }
 
+uint32_t EffectCompiler::BuildPack(
+	const std::vector<std::wstring>& effectNames,
+	std::span<const uint32_t> flagsList,
+	const wchar_t* packPath
+) {
+	const uint32_t nFlags = (uint32_t)flagsList.size();
+	const uint32_t nJob = (uint32_t)effectNames.size() * nFlags;
+
+	std::vector<EffectPackEntry> entries(nJob);
+	std::atomic<uint32_t> failedCount = 0;
+
+	// 每个效果的每种标志组合都需要编译一次，不使用也不写入磁盘缓存
+	TaskScheduler::RunParallel([&](uint32_t id) {
+		EffectPackEntry& entry = entries[id];
+		entry.effectName = effectNames[id / nFlags];
+		entry.desc.name = StrUtils::UTF16ToUTF8(entry.effectName);
+		entry.desc.flags = flagsList[id % nFlags];
+
+		if (CompileImpl(entry.desc, EffectCompilerFlags::NoCache, nullptr, &entry.hash)) {
+			Logger::Get().Error(fmt::format("编译 {} (flags={:#x}) 失败", entry.desc.name, flagsList[id % nFlags]));
+			++failedCount;
+		}
+	}, nJob);
+
+	if (failedCount > 0) {
+		return 1;
+	}
+
+	return EffectCacheManager::Get().SavePack(entries, packPath) ? 0 : 1;
+}
+
 }
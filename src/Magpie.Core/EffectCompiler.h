@@ -12,6 +12,8 @@ struct EffectCompilerFlags {
 	static constexpr const uint32_t WarningsAreErrors = 0x4;
 	// 只解析输出尺寸和参数，供用户界面使用
 	static constexpr const uint32_t NoCompile = 0x8;
+	// 在当前线程上逐个编译通道，不向 TaskScheduler 提交任务，供后台预热使用
+	static constexpr const uint32_t Serial = 0x10;
 };
 
 struct API_DECLSPEC EffectCompiler {
@@ -22,8 +24,28 @@ struct API_DECLSPEC EffectCompiler {
 		const phmap::flat_hash_map<std::wstring, float>* inlineParams = nullptr
 	);
 
+	// 将多个效果融合为一个效果：后面的效果须有 EffectFlags::PerPixel，它们被内联到第一个效果的最后一个通道中，
+	// 省去中间纹理。调用者需填入 desc 中的 flags，name 由效果名以 '+' 连接而成。无法融合时返回非零值
+	static uint32_t CompileFused(
+		EffectDesc& desc,
+		std::span<const std::string> effectNames,
+		uint32_t flags,	// EffectCompilerFlags
+		const phmap::flat_hash_map<std::wstring, float>* inlineParams = nullptr
+	);
+
+	// 为 effects 文件夹中的效果生成预编译效果包，每个效果使用 flagsList 中的每种 EffectFlags 组合编译
+	// 供 EffectPacker 在构建时使用
+	static uint32_t BuildPack(
+		const std::vector<std::wstring>& effectNames,
+		std::span<const uint32_t> flagsList,
+		const wchar_t* packPath
+	);
+
 	// 当前 MagpieFX 版本
 	static constexpr UINT VERSION = 3;
+
+	// 磁盘缓存中每个效果（标志相同）最多保留的编译结果数。内联变量时不同的参数各有一个编译结果
+	static constexpr uint32_t MAX_CACHED_VARIANTS = 8;
 };
 
 }
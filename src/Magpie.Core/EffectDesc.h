@@ -75,6 +75,8 @@ struct EffectPassDesc {
 	std::array<uint32_t, 3> numThreads{};
 	std::pair<uint32_t, uint32_t> blockSize{};
 	std::string desc;
+	// 输出像素依赖的输入像素的最大距离，以输入纹理的像素为单位，用于局部渲染。-1 表示未知
+	int radius = -1;
 	bool isPSStyle = false;
 };
 
@@ -88,6 +90,8 @@ struct EffectFlags {
 	static constexpr const uint32_t UseDynamic = 0x10;
 	// 可作为通用的降采样效果
 	static constexpr const uint32_t GenericDownscaler = 0x20;
+	// 通道声明了 PER_PIXEL 且通过了检查：只有一个 PS 样式的通道且只读取输入的当前像素，可以融合进上一个效果
+	static constexpr const uint32_t PerPixel = 0x40;
 };
 
 struct EffectDesc {
@@ -6,9 +6,7 @@
 #include "DeviceResources.h"
 #include "TextureLoader.h"
 #include "StrUtils.h"
-#include "Renderer.h"
 #include "CursorManager.h"
-#include "GPUTimer.h"
 #include "EffectHelper.h"
 
 #pragma push_macro("_UNICODE")
@@ -23,12 +21,65 @@
 
 namespace Magpie::Core {
 
+static uint64_t GetTextureBytes(EffectIntermediateTextureFormat format, SIZE size) noexcept {
+	uint32_t bytesPerPixel = 4;
+	switch (format) {
+	case EffectIntermediateTextureFormat::R32G32B32A32_FLOAT:
+		bytesPerPixel = 16;
+		break;
+	case EffectIntermediateTextureFormat::R16G16B16A16_FLOAT:
+	case EffectIntermediateTextureFormat::R16G16B16A16_UNORM:
+	case EffectIntermediateTextureFormat::R16G16B16A16_SNORM:
+	case EffectIntermediateTextureFormat::R32G32_FLOAT:
+		bytesPerPixel = 8;
+		break;
+	case EffectIntermediateTextureFormat::R8G8_UNORM:
+	case EffectIntermediateTextureFormat::R8G8_SNORM:
+	case EffectIntermediateTextureFormat::R16_FLOAT:
+	case EffectIntermediateTextureFormat::R16_UNORM:
+	case EffectIntermediateTextureFormat::R16_SNORM:
+		bytesPerPixel = 2;
+		break;
+	case EffectIntermediateTextureFormat::R8_UNORM:
+	case EffectIntermediateTextureFormat::R8_SNORM:
+		bytesPerPixel = 1;
+		break;
+	}
+
+	return (uint64_t)size.cx * size.cy * bytesPerPixel;
+}
+
+// 创建效果读写的纹理，重建时优先复用上次创建的格式和尺寸相同的纹理
+static winrt::com_ptr<ID3D11Texture2D> CreateTexture(
+	DeviceResources& dr,
+	EffectTexturePool* texturePool,
+	DXGI_FORMAT format,
+	SIZE size
+) {
+	if (texturePool) {
+		std::vector<winrt::com_ptr<ID3D11Texture2D>>& recycled = texturePool->recycled;
+		for (auto it = recycled.begin(); it != recycled.end(); ++it) {
+			D3D11_TEXTURE2D_DESC desc;
+			(*it)->GetDesc(&desc);
+			if (desc.Format == format && desc.Width == (UINT)size.cx && desc.Height == (UINT)size.cy) {
+				winrt::com_ptr<ID3D11Texture2D> result = std::move(*it);
+				recycled.erase(it);
+				++texturePool->reusedCount;
+				return result;
+			}
+		}
+	}
+
+	return dr.CreateTexture2D(format, size.cx, size.cy, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS);
+}
+
 bool EffectDrawer::Initialize(
 	const EffectDesc& desc,
 	const EffectOption& option,
 	ID3D11Texture2D* inputTex,
 	RECT* outputRect,
-	RECT* virtualOutputRect
+	RECT* virtualOutputRect,
+	EffectTexturePool* texturePool
 ) {
 	_desc = desc;
 
@@ -51,51 +102,7 @@ bool EffectDrawer::Initialize(
 	exprParser.DefineConst("INPUT_HEIGHT", inputSize.cy);
 
 	SIZE outputSize{};
-
-	if (desc.outSizeExpr.first.empty()) {
-		switch (option.scalingType) {
-		case ScalingType::Normal:
-		{
-			outputSize.cx = std::lroundf(inputSize.cx * option.scale.first);
-			outputSize.cy = std::lroundf(inputSize.cy * option.scale.second);
-			break;
-		}
-		case ScalingType::Fit:
-		{
-			float fillScale = std::min(float(hostSize.cx) / inputSize.cx, float(hostSize.cy) / inputSize.cy);
-			outputSize.cx = std::lroundf(inputSize.cx * fillScale * option.scale.first);
-			outputSize.cy = std::lroundf(inputSize.cy * fillScale * option.scale.second);
-			break;
-		}
-		case ScalingType::Absolute:
-		{
-			outputSize.cx = std::lroundf(option.scale.first);
-			outputSize.cy = std::lroundf(option.scale.second);
-			break;
-		}
-		case ScalingType::Fill:
-		{
-			outputSize = hostSize;
-			break;
-		}
-		}
-	} else {
-		assert(!desc.outSizeExpr.second.empty());
-
-		try {
-			exprParser.SetExpr(desc.outSizeExpr.first);
-			outputSize.cx = std::lround(exprParser.Eval());
-
-			exprParser.SetExpr(desc.outSizeExpr.second);
-			outputSize.cy = std::lround(exprParser.Eval());
-		} catch (const mu::ParserError& e) {
-			Logger::Get().Error(fmt::format("计算输出尺寸 {} 失败：{}", e.GetExpr(), e.GetMsg()));
-			return false;
-		}
-	}
-
-	if (outputSize.cx <= 0 || outputSize.cy <= 0) {
-		Logger::Get().Error("非法的输出尺寸");
+	if (!CalcOutputSize(desc, option, inputSize, hostSize, outputSize)) {
 		return false;
 	}
 
@@ -115,6 +122,31 @@ bool EffectDrawer::Initialize(
 		}
 	}
 
+	// 中间纹理的生命周期，通道序号从 0 开始
+	SmallVector<std::pair<uint32_t, uint32_t>> lifetimes(desc.textures.size(), { UINT_MAX, 0 });
+	// 第一次使用时被读取的纹理需要保留上一帧的内容
+	SmallVector<bool> persistent(desc.textures.size(), false);
+	for (uint32_t i = 0; i < (uint32_t)desc.passes.size(); ++i) {
+		const EffectPassDesc& passDesc = desc.passes[i];
+		for (uint32_t idx : passDesc.inputs) {
+			if (lifetimes[idx].first == UINT_MAX) {
+				persistent[idx] = true;
+			}
+		}
+
+		for (uint32_t idx : passDesc.inputs) {
+			lifetimes[idx].first = std::min(lifetimes[idx].first, i);
+			lifetimes[idx].second = i;
+		}
+		for (uint32_t idx : passDesc.outputs) {
+			lifetimes[idx].first = std::min(lifetimes[idx].first, i);
+			lifetimes[idx].second = i;
+		}
+	}
+
+	// 可以共享的中间纹理，创建完其他纹理后按生命周期的开始排序分配
+	SmallVector<std::pair<size_t, SIZE>> pooledTextures;
+
 	// 创建中间纹理
 	// 第一个为 INPUT，最后一个为 OUTPUT
 	_textures.resize(desc.textures.size() + 1);
@@ -161,27 +193,70 @@ bool EffectDrawer::Initialize(
 				return false;
 			}
 
-			_textures[i] = dr.CreateTexture2D(
-				EffectHelper::FORMAT_DESCS[(UINT)texDesc.format].dxgiFormat,
-				texSize.cx,
-				texSize.cy,
-				D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS
-			);
+			if (texturePool) {
+				if (lifetimes[i].first == UINT_MAX) {
+					// 未被使用
+					persistent[i] = true;
+				}
+
+				if (!persistent[i]) {
+					pooledTextures.emplace_back(i, texSize);
+					continue;
+				}
+			}
+
+			_textures[i] = CreateTexture(dr, texturePool, EffectHelper::FORMAT_DESCS[(UINT)texDesc.format].dxgiFormat, texSize);
 			if (!_textures[i]) {
 				Logger::Get().Error("创建纹理失败");
 				return false;
 			}
+
+			if (texturePool) {
+				// 不共享，但仍需计入显存占用
+				texturePool->planner.Add((uint32_t)texDesc.format, texSize.cx, texSize.cy,
+					GetTextureBytes(texDesc.format, texSize), 0, 0, true);
+				texturePool->textures.push_back(_textures[i]);
+			}
+		}
+	}
+
+	if (!pooledTextures.empty()) {
+		std::sort(pooledTextures.begin(), pooledTextures.end(), [&](const auto& l, const auto& r) {
+			return lifetimes[l.first].first < lifetimes[r.first].first;
+		});
+
+		for (const auto& [i, texSize] : pooledTextures) {
+			const EffectIntermediateTextureDesc& texDesc = desc.textures[i];
+			const uint32_t physicalIdx = texturePool->planner.Add(
+				(uint32_t)texDesc.format,
+				texSize.cx,
+				texSize.cy,
+				GetTextureBytes(texDesc.format, texSize),
+				texturePool->passCount + lifetimes[i].first,
+				texturePool->passCount + lifetimes[i].second,
+				false
+			);
+
+			if (physicalIdx == texturePool->textures.size()) {
+				winrt::com_ptr<ID3D11Texture2D>& texture = texturePool->textures.emplace_back(CreateTexture(
+					dr, texturePool, EffectHelper::FORMAT_DESCS[(UINT)texDesc.format].dxgiFormat, texSize));
+				if (!texture) {
+					Logger::Get().Error("创建纹理失败");
+					return false;
+				}
+			}
+
+			_textures[i] = texturePool->textures[physicalIdx];
 		}
 	}
 
+	if (texturePool) {
+		texturePool->passCount += (uint32_t)desc.passes.size();
+	}
+
 	if (!isLastEffect) {
 		// 创建输出纹理
-		_textures.back() = dr.CreateTexture2D(
-			DXGI_FORMAT_R8G8B8A8_UNORM,
-			outputSize.cx,
-			outputSize.cy,
-			D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS
-		);
+		_textures.back() = CreateTexture(dr, texturePool, DXGI_FORMAT_R8G8B8A8_UNORM, outputSize);
 
 		if (!_textures.back()) {
 			Logger::Get().Error("创建纹理失败");
@@ -213,7 +288,7 @@ bool EffectDrawer::Initialize(
 		}
 
 		if (!passDesc.outputs.empty()) {
-			_uavs[i].resize(passDesc.outputs.size() * 2);
+			_uavs[i].resize(passDesc.outputs.size());
 			for (UINT j = 0; j < passDesc.outputs.size(); ++j) {
 				if (!dr.GetUnorderedAccessView(_textures[passDesc.outputs[j]].get(), &_uavs[i][j])) {
 					Logger::Get().Error("GetUnorderedAccessView 失败");
@@ -229,7 +304,7 @@ bool EffectDrawer::Initialize(
 			);
 		} else {
 			// 最后一个 pass 输出到 OUTPUT
-			_uavs[i].resize(2);
+			_uavs[i].resize(1);
 			if (!dr.GetUnorderedAccessView(_textures.back().get(), &_uavs[i][0])) {
 				Logger::Get().Error("GetUnorderedAccessView 失败");
 				return false;
@@ -402,30 +477,138 @@ bool EffectDrawer::Initialize(
 	return true;
 }
 
-void EffectDrawer::Draw(UINT& idx, bool noUpdate) {
-	auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
-	auto& gpuTimer = MagApp::Get().GetRenderer().GetGPUTimer();
+bool EffectDrawer::CalcOutputSize(
+	const EffectDesc& desc,
+	const EffectOption& option,
+	SIZE inputSize,
+	SIZE hostSize,
+	SIZE& outputSize
+) {
+	if (desc.outSizeExpr.first.empty()) {
+		switch (option.scalingType) {
+		case ScalingType::Normal:
+		{
+			outputSize.cx = std::lroundf(inputSize.cx * option.scale.first);
+			outputSize.cy = std::lroundf(inputSize.cy * option.scale.second);
+			break;
+		}
+		case ScalingType::Fit:
+		{
+			float fillScale = std::min(float(hostSize.cx) / inputSize.cx, float(hostSize.cy) / inputSize.cy);
+			outputSize.cx = std::lroundf(inputSize.cx * fillScale * option.scale.first);
+			outputSize.cy = std::lroundf(inputSize.cy * fillScale * option.scale.second);
+			break;
+		}
+		case ScalingType::Absolute:
+		{
+			outputSize.cx = std::lroundf(option.scale.first);
+			outputSize.cy = std::lroundf(option.scale.second);
+			break;
+		}
+		case ScalingType::Fill:
+		{
+			outputSize = hostSize;
+			break;
+		}
+		}
+	} else {
+		assert(!desc.outSizeExpr.second.empty());
 
-	{
-		ID3D11Buffer* t = _constantBuffer.get();
-		d3dDC->CSSetConstantBuffers(1, 1, &t);
+		try {
+			mu::Parser exprParser;
+			exprParser.DefineConst("INPUT_WIDTH", inputSize.cx);
+			exprParser.DefineConst("INPUT_HEIGHT", inputSize.cy);
+
+			exprParser.SetExpr(desc.outSizeExpr.first);
+			outputSize.cx = std::lround(exprParser.Eval());
+
+			exprParser.SetExpr(desc.outSizeExpr.second);
+			outputSize.cy = std::lround(exprParser.Eval());
+		} catch (const mu::ParserError& e) {
+			Logger::Get().Error(fmt::format("计算输出尺寸 {} 失败：{}", e.GetExpr(), e.GetMsg()));
+			return false;
+		}
 	}
-	d3dDC->CSSetSamplers(0, (UINT)_samplers.size(), _samplers.data());
 
-	for (UINT i = 0; i < _dispatches.size(); ++i) {
-		// noUpdate 为真则只渲染最后一个通道
-		if (!noUpdate || i == UINT(_dispatches.size() - 1)) {
-			_DrawPass(i);
+	if (outputSize.cx <= 0 || outputSize.cy <= 0) {
+		Logger::Get().Error("非法的输出尺寸");
+		return false;
+	}
+
+	return true;
+}
+
+bool EffectDrawer::SetInput(ID3D11Texture2D* inputTex) {
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+
+	_textures[0].copy_from(inputTex);
+
+	// 只替换读取 INPUT 的视图
+	for (UINT i = 0; i < _desc.passes.size(); ++i) {
+		const EffectPassDesc& passDesc = _desc.passes[i];
+		for (UINT j = 0; j < passDesc.inputs.size(); ++j) {
+			if (passDesc.inputs[j] == 0 && !dr.GetShaderResourceView(inputTex, &_srvs[i][j])) {
+				Logger::Get().Error("GetShaderResourceView 失败");
+				return false;
+			}
 		}
+	}
 
-		// 不渲染的通道也在 GPUTimer 中记录
-		gpuTimer.OnEndPass(idx++);
+	return true;
+}
+
+void EffectDrawer::BeginDraw(CSStateTracker& csState) {
+	csState.SetConstantBuffer(1, _constantBuffer.get());
+	csState.SetSamplers({ _samplers.data(), _samplers.size() });
+}
+
+void EffectDrawer::GetPassTextures(
+	UINT i,
+	SmallVector<ID3D11Texture2D*>& inputs,
+	SmallVector<ID3D11Texture2D*>& outputs
+) const noexcept {
+	const EffectPassDesc& passDesc = _desc.passes[i];
+
+	inputs.clear();
+	for (uint32_t idx : passDesc.inputs) {
+		inputs.push_back(_textures[idx].get());
+	}
+
+	outputs.clear();
+	if (passDesc.outputs.empty()) {
+		outputs.push_back(_textures.back().get());
+	} else {
+		for (uint32_t idx : passDesc.outputs) {
+			outputs.push_back(_textures[idx].get());
+		}
 	}
 }
 
-void EffectDrawer::_DrawPass(UINT i) {
-	auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
-	d3dDC->CSSetShader(_shaders[i].get(), nullptr, 0);
+void EffectDrawer::GetCreatedTextures(std::vector<winrt::com_ptr<ID3D11Texture2D>>& result) const {
+	for (size_t i = 1; i < _desc.textures.size(); ++i) {
+		if (_desc.textures[i].source.empty()) {
+			result.push_back(_textures[i]);
+		}
+	}
+
+	if (!(_desc.flags & EffectFlags::LastEffect)) {
+		result.push_back(_textures.back());
+	}
+}
+
+RECT EffectDrawer::GetPassBlocks(UINT i, const RECT& updateRect) const noexcept {
+	const auto [blockWidth, blockHeight] = _desc.passes[i].blockSize;
+	return RECT{
+		LONG((UINT)updateRect.left / blockWidth),
+		LONG((UINT)updateRect.top / blockHeight),
+		LONG(std::min(((UINT)updateRect.right + blockWidth - 1) / blockWidth, _dispatches[i].first)),
+		LONG(std::min(((UINT)updateRect.bottom + blockHeight - 1) / blockHeight, _dispatches[i].second))
+	};
+}
+
+void EffectDrawer::DrawPass(CSStateTracker& csState, UINT i, const RECT* blocks) {
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+	csState.SetShader(_shaders[i].get());
 
 	if ((_desc.flags & EffectFlags::LastEffect) && i == _dispatches.size() - 1) {
 		// 最后一个效果的最后一个通道负责渲染光标
@@ -436,7 +619,7 @@ void EffectDrawer::_DrawPass(UINT i) {
 			ID3D11Texture2D* cursorTex;
 			CursorManager::CursorType ct;
 			if (cm.GetCursorTexture(&cursorTex, ct)) {
-				if (!MagApp::Get().GetDeviceResources().GetShaderResourceView(cursorTex, &_srvs[i].back())) {
+				if (!dr.GetShaderResourceView(cursorTex, &_srvs[i].back())) {
 					Logger::Get().Error("GetShaderResourceView 出错");
 				}
 			} else {
@@ -445,13 +628,15 @@ void EffectDrawer::_DrawPass(UINT i) {
 		}
 	}
 
-	d3dDC->CSSetShaderResources(0, (UINT)_srvs[i].size(), _srvs[i].data());
-	UINT uavCount = (UINT)_uavs[i].size() / 2;
-	d3dDC->CSSetUnorderedAccessViews(0, uavCount, _uavs[i].data(), nullptr);
-
-	d3dDC->Dispatch(_dispatches[i].first, _dispatches[i].second, 1);
+	csState.SetShaderResources({ _srvs[i].data(), _srvs[i].size() });
+	csState.SetUnorderedAccessViews({ _uavs[i].data(), _uavs[i].size() });
 
-	d3dDC->CSSetUnorderedAccessViews(0, uavCount, _uavs[i].data() + uavCount, nullptr);
+	ID3D11DeviceContext* d3dDC = csState.GetD3DDC();
+	if (blocks) {
+		d3dDC->Dispatch(UINT(blocks->right - blocks->left), UINT(blocks->bottom - blocks->top), 1);
+	} else {
+		d3dDC->Dispatch(_dispatches[i].first, _dispatches[i].second, 1);
+	}
 }
 
 }
@@ -2,10 +2,23 @@
 #include "EffectDesc.h"
 #include "SmallVector.h"
 #include "EffectHelper.h"
+#include "TextureAliasPlanner.h"
 
 namespace Magpie::Core {
 
 struct EffectOption;
+class CSStateTracker;
+
+// 在效果间共享中间纹理，由 Renderer 在构建效果时持有
+struct EffectTexturePool {
+	TextureAliasPlanner planner;
+	std::vector<winrt::com_ptr<ID3D11Texture2D>> textures;
+	// 已初始化的效果的通道总数
+	uint32_t passCount = 0;
+	// 重建时上次创建的纹理，格式和尺寸相同的纹理直接复用
+	std::vector<winrt::com_ptr<ID3D11Texture2D>> recycled;
+	uint32_t reusedCount = 0;
+};
 
 class EffectDrawer {
 public:
@@ -18,10 +31,43 @@ public:
 		const EffectOption& option,
 		ID3D11Texture2D* inputTex,
 		RECT* outputRect = nullptr,
-		RECT* virtualOutputRect = nullptr
+		RECT* virtualOutputRect = nullptr,
+		EffectTexturePool* texturePool = nullptr
 	);
 
-	void Draw(UINT& idx, bool noUpdate = false);
+	// 绑定所有通道共用的常量缓冲区和采样器，在此效果的第一个 DrawPass 前调用
+	// csState 可以包装延迟上下文，以便将通道录制到命令列表
+	void BeginDraw(CSStateTracker& csState);
+
+	// 通过 CSStateTracker 绑定，读写冲突由它处理
+	// blocks 为要执行的线程组，为空时执行整个通道。调用者需将 __blockOffset 设为 blocks 的左上角
+	void DrawPass(CSStateTracker& csState, UINT i, const RECT* blocks = nullptr);
+
+	// 覆盖 updateRect 的线程组，updateRect 的坐标系为通道的输出
+	RECT GetPassBlocks(UINT i, const RECT& updateRect) const noexcept;
+
+	// 帧源轮流使用多个纹理作为输出时，由 Renderer 在输入改变后调用，尺寸和格式须相同
+	bool SetInput(ID3D11Texture2D* inputTex);
+
+	ID3D11Texture2D* GetInputTexture() const noexcept {
+		return _textures.empty() ? nullptr : _textures[0].get();
+	}
+
+	// 通道读写的纹理，最后一个通道的输出为 OUTPUT
+	void GetPassTextures(
+		UINT i,
+		SmallVector<ID3D11Texture2D*>& inputs,
+		SmallVector<ID3D11Texture2D*>& outputs
+	) const noexcept;
+
+	// 计算效果的输出尺寸，CpuEffectDrawer 也使用此函数
+	static bool CalcOutputSize(
+		const EffectDesc& desc,
+		const EffectOption& option,
+		SIZE inputSize,
+		SIZE hostSize,
+		SIZE& outputSize
+	);
 
 	bool IsUseDynamic() const noexcept {
 		return _desc.flags & EffectFlags::UseDynamic;
@@ -35,15 +81,15 @@ public:
 		return _textures.empty() ? nullptr : _textures.back().get();
 	}
 
-private:
-	void _DrawPass(UINT i);
+	// Initialize 中创建的纹理，不包括 INPUT、从文件加载的纹理和后缓冲区。共享的中间纹理可能被多个效果返回
+	void GetCreatedTextures(std::vector<winrt::com_ptr<ID3D11Texture2D>>& result) const;
 
+private:
 	EffectDesc _desc;
 
 	SmallVector<ID3D11SamplerState*> _samplers;
 	SmallVector<winrt::com_ptr<ID3D11Texture2D>> _textures;
 	std::vector<SmallVector<ID3D11ShaderResourceView*>> _srvs;
-	// 后半部分为空，用于解绑
 	std::vector<SmallVector<ID3D11UnorderedAccessView*>> _uavs;
 
 	SmallVector<EffectHelper::Constant32, 32> _constants;
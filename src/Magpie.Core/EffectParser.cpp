@@ -0,0 +1,1345 @@
+#include "pch.h"
+#include "EffectParser.h"
+#include "EffectDesc.h"
+#include "EffectHelper.h"
+#include "EffectCompiler.h"
+#include "StrUtils.h"
+#include <bitset>
+#include <charconv>
+#include <bit>	// std::countr_zero
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+namespace Magpie::Core {
+
+static const char* META_INDICATOR = "//!";
+
+// 根据 pos 在 source 中的位置填写诊断信息
+static void SetDiagnostic(
+	EffectParserDiagnostic* diag,
+	std::string_view source,
+	const char* pos,
+	std::string message
+) {
+	if (!diag) {
+		return;
+	}
+
+	diag->message = std::move(message);
+
+	if (!pos || pos < source.data() || pos > source.data() + source.size()) {
+		diag->line = 0;
+		diag->column = 0;
+		return;
+	}
+
+	std::string_view prefix(source.data(), pos - source.data());
+	diag->line = (uint32_t)std::count(prefix.begin(), prefix.end(), '\n') + 1;
+	size_t lineStart = prefix.find_last_of('\n');
+	diag->column = uint32_t(lineStart == std::string_view::npos ? prefix.size() + 1 : prefix.size() - lineStart);
+}
+
+// 查找 [cur, end) 中第一个 c，找不到时返回 end
+static const char* FindChar(const char* cur, const char* end, char c) noexcept {
+#if defined(_M_X64) || defined(_M_IX86)
+	// 每次比较 16 个字节
+	const __m128i target = _mm_set1_epi8(c);
+	while (end - cur >= 16) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*)cur);
+		const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target));
+		if (mask) {
+			return cur + std::countr_zero(mask);
+		}
+		cur += 16;
+	}
+#endif
+
+	const void* result = std::memchr(cur, c, end - cur);
+	return result ? (const char*)result : end;
+}
+
+// 查找 [cur, end) 中第一个 "//!"，找不到时返回 end
+static const char* FindMetaIndicator(const char* cur, const char* end) noexcept {
+#if defined(_M_X64) || defined(_M_IX86)
+	// 错位加载三次，同时比较 16 个位置
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i exclamation = _mm_set1_epi8('!');
+	while (end - cur >= 18) {
+		const __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)cur), slash);
+		const __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(cur + 1)), slash);
+		const __m128i c2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(cur + 2)), exclamation);
+		const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(c0, c1), c2));
+		if (mask) {
+			return cur + std::countr_zero(mask);
+		}
+		cur += 16;
+	}
+#endif
+
+	while (end - cur >= 3) {
+		cur = FindChar(cur, end - 2, '/');
+		if (cur == end - 2) {
+			break;
+		}
+
+		if (cur[1] == '/' && cur[2] == '!') {
+			return cur;
+		}
+		++cur;
+	}
+
+	return end;
+}
+
+uint32_t EffectParser::RemoveComments(std::string& source, EffectParserDiagnostic* diag) {
+	if (source.empty()) {
+		SetDiagnostic(diag, {}, nullptr, "源码为空");
+		return 1;
+	}
+
+	// 确保以换行符结尾
+	if (source.back() != '\n') {
+		source.push_back('\n');
+	}
+
+	// 原地移除，j 为写入位置，总是不大于读取位置 i
+	char* data = source.data();
+	const size_t size = source.size();
+	size_t i = 0;
+	size_t j = 0;
+
+	while (true) {
+		// 两个 '/' 之间的部分原样保留
+		const size_t slashPos = FindChar(data + i, data + size, '/') - data;
+		if (i != j) {
+			std::memmove(data + j, data + i, slashPos - i);
+		}
+		j += slashPos - i;
+		i = slashPos;
+
+		// 无需处理最后两个字符，因为以换行符结尾
+		if (i + 2 >= size) {
+			break;
+		}
+
+		if (data[i + 1] == '/' && data[i + 2] != '!') {
+			// 行注释，跳到换行符，换行符在下一轮被保留。无需处理越界，因为必定以换行符结尾
+			i = FindChar(data + i + 2, data + size, '\n') - data;
+		} else if (data[i + 1] == '*') {
+			// 块注释
+			const size_t commentStart = j;
+			i += 2;
+
+			while (true) {
+				const size_t starPos = FindChar(data + i, data + size, '*') - data;
+
+				// 保留换行符
+				const size_t newLineCount = std::count(data + i, data + starPos, '\n');
+				std::memset(data + j, '\n', newLineCount);
+				j += newLineCount;
+
+				if (starPos + 1 >= size) {
+					// 未闭合，source[0, commentStart) 和原始源码中注释前的部分行数相同
+					SetDiagnostic(diag, std::string_view(data, commentStart), data + commentStart, "块注释未闭合");
+					return 1;
+				}
+
+				i = starPos + 1;
+				if (data[i] == '/') {
+					++i;
+					break;
+				}
+			}
+		} else {
+			data[j++] = '/';
+			++i;
+		}
+	}
+
+	if (i != j) {
+		std::memmove(data + j, data + i, size - i);
+	}
+	j += size - i;
+
+	source.resize(j);
+	return 0;
+}
+
+template<bool IncludeNewLine>
+static void RemoveLeadingBlanks(std::string_view& source) {
+	size_t i = 0;
+	for (; i < source.size(); ++i) {
+		if constexpr (IncludeNewLine) {
+			if (!StrUtils::isspace(source[i])) {
+				break;
+			}
+		} else {
+			char c = source[i];
+			if (c != ' ' && c != '\t') {
+				break;
+			}
+		}
+	}
+
+	source.remove_prefix(i);
+}
+
+template<bool AllowNewLine>
+static bool CheckNextToken(std::string_view& source, std::string_view token) {
+	RemoveLeadingBlanks<AllowNewLine>(source);
+
+	if (!source.starts_with(token)) {
+		return false;
+	}
+
+	source.remove_prefix(token.size());
+	return true;
+}
+
+template<bool AllowNewLine>
+static UINT GetNextToken(std::string_view& source, std::string_view& value) {
+	RemoveLeadingBlanks<AllowNewLine>(source);
+
+	if (source.empty()) {
+		return 2;
+	}
+
+	char cur = source[0];
+
+	if (StrUtils::isalpha(cur) || cur == '_') {
+		size_t j = 1;
+		for (; j < source.size(); ++j) {
+			cur = source[j];
+
+			if (!StrUtils::isalnum(cur) && cur != '_') {
+				break;
+			}
+		}
+
+		value = source.substr(0, j);
+		source.remove_prefix(j);
+		return 0;
+	}
+
+	if constexpr (AllowNewLine) {
+		return 1;
+	} else {
+		return cur == '\n' ? 2 : 1;
+	}
+}
+
+static bool CheckMagic(std::string_view& source) {
+	std::string_view token;
+	if (!CheckNextToken<true>(source, META_INDICATOR)) {
+		return false;
+	}
+
+	if (!CheckNextToken<false>(source, "MAGPIE")) {
+		return false;
+	}
+	if (!CheckNextToken<false>(source, "EFFECT")) {
+		return false;
+	}
+
+	if (GetNextToken<false>(source, token) != 2) {
+		return false;
+	}
+
+	if (source.empty()) {
+		return false;
+	}
+
+	return true;
+}
+
+static UINT GetNextString(std::string_view& source, std::string_view& value) {
+	RemoveLeadingBlanks<false>(source);
+	size_t pos = source.find('\n');
+
+	value = source.substr(0, pos);
+	StrUtils::Trim(value);
+	if (value.empty()) {
+		return 1;
+	}
+
+	source.remove_prefix(std::min(pos + 1, source.size()));
+	return 0;
+}
+
+template<typename T>
+static UINT GetNextNumber(std::string_view& source, T& value) {
+	RemoveLeadingBlanks<false>(source);
+
+	if (source.empty()) {
+		return 1;
+	}
+
+	const auto& result = std::from_chars(source.data(), source.data() + source.size(), value);
+	if ((int)result.ec) {
+		return 1;
+	}
+
+	// 解析成功
+	source.remove_prefix(result.ptr - source.data());
+	return 0;
+}
+
+static UINT GetNextExpr(std::string_view& source, std::string& expr) {
+	RemoveLeadingBlanks<false>(source);
+	size_t size = std::min(source.find('\n') + 1, source.size());
+
+	// 移除空白字符
+	expr.resize(size);
+
+	size_t j = 0;
+	for (size_t i = 0; i < size; ++i) {
+		char c = source[i];
+		if (!isspace(c)) {
+			expr[j++] = c;
+		}
+	}
+	expr.resize(j);
+
+	if (expr.empty()) {
+		return 1;
+	}
+
+	source.remove_prefix(size);
+	return 0;
+}
+
+static UINT ResolveHeader(std::string_view& block, EffectDesc& desc, bool noCompile) {
+	// 必需的选项：VERSION
+	// 可选的选项：OUTPUT_WIDTH, OUTPUT_HEIGHT, USE_DYNAMIC, GENERIC_DOWNSCALER, BUILT_INT
+
+	std::bitset<6> processed;
+
+	std::string_view token;
+
+	while (true) {
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			break;
+		}
+
+		if (GetNextToken<false>(block, token)) {
+			return 1;
+		}
+		std::string t = StrUtils::ToUpperCase(token);
+
+		if (t == "VERSION") {
+			if (processed[0]) {
+				return 1;
+			}
+			processed[0] = true;
+
+			UINT version;
+			if (GetNextNumber(block, version)) {
+				return 1;
+			}
+
+			if (version != EffectCompiler::VERSION) {
+				return 1;
+			}
+
+			if (GetNextToken<false>(block, token) != 2) {
+				return 1;
+			}
+		} else if (t == "OUTPUT_WIDTH") {
+			if (processed[1]) {
+				return 1;
+			}
+			processed[1] = true;
+
+			if (GetNextExpr(block, desc.outSizeExpr.first)) {
+				return 1;
+			}
+		} else if (t == "OUTPUT_HEIGHT") {
+			if (processed[2]) {
+				return 1;
+			}
+			processed[2] = true;
+
+			if (GetNextExpr(block, desc.outSizeExpr.second)) {
+				return 1;
+			}
+		} else if (t == "USE_DYNAMIC") {
+			if (processed[3]) {
+				return 1;
+			}
+			processed[3] = true;
+
+			if (GetNextToken<false>(block, token) != 2) {
+				return 1;
+			}
+
+			desc.flags |= EffectFlags::UseDynamic;
+		} else if (t == "GENERIC_DOWNSCALER") {
+			if (processed[4]) {
+				return 1;
+			}
+			processed[4] = true;
+
+			if (GetNextToken<false>(block, token) != 2) {
+				return 1;
+			}
+
+			desc.flags |= EffectFlags::GenericDownscaler;
+		} else if (t == "SORT_NAME") {
+			if (processed[5]) {
+				return 1;
+			}
+			processed[5] = true;
+
+			std::string_view sortName;
+			if (GetNextString(block, sortName)) {
+				return 1;
+			}
+
+			if (noCompile) {
+				desc.sortName = sortName;
+			}
+		} else {
+			return 1;
+		}
+	}
+
+	// HEADER 块不含代码部分
+	if (GetNextToken<true>(block, token) != 2) {
+		return 1;
+	}
+
+	if (!processed[0] || processed[1] != processed[2]) {
+		return 1;
+	}
+
+	// GENERIC_DOWNSCALER 和 OUTPUT_WIDTH/OUTPUT_HEIGHT 冲突
+	if (processed[4] && processed[1]) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static UINT ResolveParameter(std::string_view& block, EffectDesc& desc) {
+	// 必需的选项：DEFAULT, MIN, MAX, STEP
+	// 可选的选项：LABEL
+
+	std::bitset<5> processed;
+
+	std::string_view token;
+
+	if (!CheckNextToken<true>(block, META_INDICATOR)) {
+		return 1;
+	}
+
+	if (!CheckNextToken<false>(block, "PARAMETER")) {
+		return 1;
+	}
+	if (GetNextToken<false>(block, token) != 2) {
+		return 1;
+	}
+
+	EffectParameterDesc& paramDesc = desc.params.emplace_back();
+
+	std::string_view defaultValue;
+	std::string_view minValue;
+	std::string_view maxValue;
+	std::string_view stepValue;
+
+	while (true) {
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			break;
+		}
+
+		if (GetNextToken<false>(block, token)) {
+			return 1;
+		}
+
+		std::string t = StrUtils::ToUpperCase(token);
+
+		if (t == "DEFAULT") {
+			if (processed[0]) {
+				return 1;
+			}
+			processed[0] = true;
+
+			if (GetNextString(block, defaultValue)) {
+				return 1;
+			}
+		} else if (t == "LABEL") {
+			if (processed[1]) {
+				return 1;
+			}
+			processed[1] = true;
+
+			std::string_view label;
+			if (GetNextString(block, label)) {
+				return 1;
+			}
+			paramDesc.label = label;
+		} else if (t == "MIN") {
+			if (processed[2]) {
+				return 1;
+			}
+			processed[2] = true;
+
+			if (GetNextString(block, minValue)) {
+				return 1;
+			}
+		} else if (t == "MAX") {
+			if (processed[3]) {
+				return 1;
+			}
+			processed[3] = true;
+
+			if (GetNextString(block, maxValue)) {
+				return 1;
+			}
+		} else if (t == "STEP") {
+			if (processed[4]) {
+				return 1;
+			}
+			processed[4] = true;
+
+			if (GetNextString(block, stepValue)) {
+				return 1;
+			}
+		} else {
+			return 1;
+		}
+	}
+
+	// 检查必选项
+	if (!processed[0] || !processed[2] || !processed[3] || !processed[4]) {
+		return 1;
+	}
+
+	// 代码部分
+	if (GetNextToken<true>(block, token)) {
+		return 1;
+	}
+
+	if (token == "float") {
+		EffectConstant<float>& constant = paramDesc.constant.emplace<0>();
+
+		if (GetNextNumber(defaultValue, constant.defaultValue)) {
+			return 1;
+		}
+		if (GetNextNumber(minValue, constant.minValue)) {
+			return 1;
+		}
+		if (GetNextNumber(maxValue, constant.maxValue)) {
+			return 1;
+		}
+		if (GetNextNumber(stepValue, constant.step)) {
+			return 1;
+		}
+
+		if (constant.defaultValue < constant.minValue || constant.maxValue < constant.defaultValue) {
+			return 1;
+		}
+	} else if (token == "int") {
+		EffectConstant<int>& constant = paramDesc.constant.emplace<1>();
+
+		if (GetNextNumber(defaultValue, constant.defaultValue)) {
+			return 1;
+		}
+		if (GetNextNumber(minValue, constant.minValue)) {
+			return 1;
+		}
+		if (GetNextNumber(maxValue, constant.maxValue)) {
+			return 1;
+		}
+		if (GetNextNumber(stepValue, constant.step)) {
+			return 1;
+		}
+
+		if (constant.defaultValue < constant.minValue || constant.maxValue < constant.defaultValue) {
+			return 1;
+		}
+	} else {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token)) {
+		return 1;
+	}
+	paramDesc.name = token;
+
+	if (!CheckNextToken<true>(block, ";")) {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token) != 2) {
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static UINT ResolveTexture(std::string_view& block, EffectDesc& desc) {
+	// 如果名称为 INPUT 不能有任何选项，含 SOURCE 时不能有任何其他选项
+	// 否则必需的选项：FORMAT
+	// 可选的选项：WIDTH, HEIGHT
+
+	EffectIntermediateTextureDesc& texDesc = desc.textures.emplace_back();
+
+	std::bitset<4> processed;
+
+	std::string_view token;
+
+	if (!CheckNextToken<true>(block, META_INDICATOR)) {
+		return 1;
+	}
+
+	if (!CheckNextToken<false>(block, "TEXTURE")) {
+		return 1;
+	}
+	if (GetNextToken<false>(block, token) != 2) {
+		return 1;
+	}
+
+	while (true) {
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			break;
+		}
+
+		if (GetNextToken<false>(block, token)) {
+			return 1;
+		}
+
+		std::string t = StrUtils::ToUpperCase(token);
+
+		if (t == "SOURCE") {
+			if (processed[0] || processed[2] || processed[3]) {
+				return 1;
+			}
+			processed[0] = true;
+
+			if (GetNextString(block, token)) {
+				return 1;
+			}
+
+			texDesc.source = token;
+		} else if (t == "FORMAT") {
+			if (processed[1]) {
+				return 1;
+			}
+			processed[1] = true;
+
+			if (GetNextString(block, token)) {
+				return 1;
+			}
+
+			using enum EffectIntermediateTextureFormat;
+
+			static auto formatMap = []() {
+				phmap::flat_hash_map<std::string, EffectIntermediateTextureFormat> result;
+
+				// UNKNOWN 不可用
+				constexpr size_t descCount = std::size(EffectHelper::FORMAT_DESCS) - 1;
+				result.reserve(descCount);
+				for (size_t i = 0; i < descCount; ++i) {
+					result.emplace(EffectHelper::FORMAT_DESCS[i].name, (EffectIntermediateTextureFormat)i);
+				}
+				return result;
+			}();
+
+			auto it = formatMap.find(std::string(token));
+			if (it == formatMap.end()) {
+				return 1;
+			}
+
+			texDesc.format = it->second;
+		} else if (t == "WIDTH") {
+			if (processed[0] || processed[2]) {
+				return 1;
+			}
+			processed[2] = true;
+
+			if (GetNextExpr(block, texDesc.sizeExpr.first)) {
+				return 1;
+			}
+		} else if (t == "HEIGHT") {
+			if (processed[0] || processed[3]) {
+				return 1;
+			}
+			processed[3] = true;
+
+			if (GetNextExpr(block, texDesc.sizeExpr.second)) {
+				return 1;
+			}
+		} else {
+			return 1;
+		}
+	}
+
+	// WIDTH 和 HEIGHT 必须成对出现
+	if (processed[2] != processed[3]) {
+		return 1;
+	}
+
+	// 代码部分
+	if (!CheckNextToken<true>(block, "Texture2D")) {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token)) {
+		return 1;
+	}
+
+	if (token == "INPUT") {
+		if (processed[1] || processed[2]) {
+			return 1;
+		}
+
+		// INPUT 已为第一个元素
+		desc.textures.pop_back();
+	} else {
+		texDesc.name = token;
+	}
+
+	if (!CheckNextToken<true>(block, ";")) {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token) != 2) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static UINT ResolveSampler(std::string_view& block, EffectDesc& desc) {
+	// 必选项：FILTER
+	// 可选项：ADDRESS
+
+	EffectSamplerDesc& samDesc = desc.samplers.emplace_back();
+
+	std::bitset<2> processed;
+
+	std::string_view token;
+
+	if (!CheckNextToken<true>(block, META_INDICATOR)) {
+		return 1;
+	}
+
+	if (!CheckNextToken<false>(block, "SAMPLER")) {
+		return 1;
+	}
+	if (GetNextToken<false>(block, token) != 2) {
+		return 1;
+	}
+
+	while (true) {
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			break;
+		}
+
+		if (GetNextToken<false>(block, token)) {
+			return 1;
+		}
+
+		std::string t = StrUtils::ToUpperCase(token);
+
+		if (t == "FILTER") {
+			if (processed[0]) {
+				return 1;
+			}
+			processed[0] = true;
+
+			if (GetNextString(block, token)) {
+				return 1;
+			}
+
+			std::string filter = StrUtils::ToUpperCase(token);
+
+			if (filter == "LINEAR") {
+				samDesc.filterType = EffectSamplerFilterType::Linear;
+			} else if (filter == "POINT") {
+				samDesc.filterType = EffectSamplerFilterType::Point;
+			} else {
+				return 1;
+			}
+		} else if (t == "ADDRESS") {
+			if (processed[1]) {
+				return 1;
+			}
+			processed[1] = true;
+
+			if (GetNextString(block, token)) {
+				return 1;
+			}
+
+			std::string filter = StrUtils::ToUpperCase(token);
+
+			if (filter == "CLAMP") {
+				samDesc.addressType = EffectSamplerAddressType::Clamp;
+			} else if (filter == "WRAP") {
+				samDesc.addressType = EffectSamplerAddressType::Wrap;
+			} else {
+				return 1;
+			}
+		} else {
+			return 1;
+		}
+	}
+
+	if (!processed[0]) {
+		return 1;
+	}
+
+	// 代码部分
+	if (!CheckNextToken<true>(block, "SamplerState")) {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token)) {
+		return 1;
+	}
+
+	samDesc.name = token;
+
+	if (!CheckNextToken<true>(block, ";")) {
+		return 1;
+	}
+
+	if (GetNextToken<true>(block, token) != 2) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static UINT ResolveCommon(std::string_view& block) {
+	// 无选项
+
+	if (!CheckNextToken<true>(block, META_INDICATOR)) {
+		return 1;
+	}
+
+	if (!CheckNextToken<false>(block, "COMMON")) {
+		return 1;
+	}
+
+	if (CheckNextToken<true>(block, META_INDICATOR)) {
+		return 1;
+	}
+
+	return 0;
+}
+
+// 解析通道序号并按序号排序，失败时 errorPos 指向出错的位置
+static UINT ResolvePassNumbers(SmallVector<std::string_view>& blocks, const char*& errorPos) {
+	std::string_view token;
+
+	// first 为 Pass 序号，second 为在 blocks 中的位置
+	SmallVector<std::pair<UINT, UINT>> passNumbers;
+	passNumbers.reserve(blocks.size());
+
+	for (UINT i = 0; i < blocks.size(); ++i) {
+		std::string_view& block = blocks[i];
+
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			errorPos = block.data();
+			return 1;
+		}
+
+		if (!CheckNextToken<false>(block, "PASS")) {
+			errorPos = block.data();
+			return 1;
+		}
+
+		UINT index;
+		if (GetNextNumber(block, index)) {
+			errorPos = block.data();
+			return 1;
+		}
+		if (GetNextToken<false>(block, token) != 2) {
+			errorPos = block.data();
+			return 1;
+		}
+
+		passNumbers.emplace_back(index, i);
+	}
+
+	std::sort(
+		passNumbers.begin(),
+		passNumbers.end(),
+		[](const std::pair<UINT, UINT>& l, const std::pair<UINT, UINT>& r) {return l.first < r.first; }
+	);
+
+	SmallVector<std::string_view> temp = blocks;
+	for (UINT i = 0; i < blocks.size(); ++i) {
+		if (passNumbers[i].first != i + 1) {
+			// PASS 序号不连续
+			errorPos = temp[passNumbers[i].second].data();
+			return 1;
+		}
+
+		blocks[i] = temp[passNumbers[i].second];
+	}
+
+	return 0;
+}
+
+// passIdx 从 0 开始，调用前 desc.passes 应已分配空间
+static UINT ResolvePass(std::string_view& block, EffectDesc& desc, UINT passIdx) {
+	// 必选项：IN
+	// 可选项：OUT, BLOCK_SIZE, NUM_THREADS, STYLE, DESC, RADIUS, PER_PIXEL
+	// STYLE 为 PS 时不能有 BLOCK_SIZE 或 NUM_THREADS
+	// PER_PIXEL 要求 STYLE 为 PS
+
+	std::string_view token;
+	auto& passDesc = desc.passes[passIdx];
+
+	// 用于检查输入和输出中重复的纹理
+	phmap::flat_hash_map<std::string_view, UINT> texNames;
+	texNames.reserve(desc.textures.size());
+	for (UINT j = 0; j < desc.textures.size(); ++j) {
+		texNames.emplace(desc.textures[j].name, j);
+	}
+
+	std::bitset<8> processed;
+
+	while (true) {
+		if (!CheckNextToken<true>(block, META_INDICATOR)) {
+			break;
+		}
+
+		if (GetNextToken<false>(block, token)) {
+			return 1;
+		}
+
+		std::string t = StrUtils::ToUpperCase(token);
+
+		if (t == "IN") {
+			if (processed[0]) {
+				return 1;
+			}
+			processed[0] = true;
+
+			std::string_view binds;
+			if (GetNextString(block, binds)) {
+				return 1;
+			}
+
+			for (std::string_view& input : StrUtils::Split(binds, ',')) {
+				StrUtils::Trim(input);
+
+				auto it = texNames.find(input);
+				if (it == texNames.end()) {
+					// 未找到纹理名称
+					return 1;
+				}
+
+				passDesc.inputs.push_back(it->second);
+				texNames.erase(it);
+			}
+		} else if (t == "OUT") {
+			if (processed[1]) {
+				return 1;
+			}
+			processed[1] = true;
+
+			std::string_view saves;
+			if (GetNextString(block, saves)) {
+				return 1;
+			}
+
+			SmallVector<std::string_view> outputs = StrUtils::Split(saves, ',');
+			if (outputs.size() > 8) {
+				// 最多 8 个输出
+				return 1;
+			}
+
+			for (std::string_view& output : outputs) {
+				StrUtils::Trim(output);
+
+				auto it = texNames.find(output);
+				if (it == texNames.end()) {
+					// 未找到纹理名称
+					return 1;
+				}
+
+				if (it->second == 0 || !desc.textures[it->second].source.empty()) {
+					// INPUT 和从文件读取的纹理不能作为输出
+					return 1;
+				}
+
+				passDesc.outputs.push_back(it->second);
+				texNames.erase(it);
+			}
+		} else if (t == "BLOCK_SIZE") {
+			if (processed[2]) {
+				return 1;
+			}
+			processed[2] = true;
+
+			std::string_view val;
+			if (GetNextString(block, val)) {
+				return 1;
+			}
+
+			SmallVector<std::string_view> split = StrUtils::Split(val, ',');
+			if (split.size() > 2) {
+				return 1;
+			}
+
+			UINT num;
+			if (GetNextNumber(split[0], num) || num == 0) {
+				return 1;
+			}
+
+			if (GetNextToken<false>(split[0], token) != 2) {
+				return 1;
+			}
+
+			passDesc.blockSize.first = num;
+
+			// 如果只有一个数字，则它同时指定长和高
+			if (split.size() == 2) {
+				if (GetNextNumber(split[1], num) || num == 0) {
+					return 1;
+				}
+
+				if (GetNextToken<false>(split[1], token) != 2) {
+					return 1;
+				}
+			}
+
+			passDesc.blockSize.second = num;
+		} else if (t == "NUM_THREADS") {
+			if (processed[3]) {
+				return 1;
+			}
+			processed[3] = true;
+
+			std::string_view val;
+			if (GetNextString(block, val)) {
+				return 1;
+			}
+
+			SmallVector<std::string_view> split = StrUtils::Split(val, ',');
+			if (split.size() > 3) {
+				return 1;
+			}
+
+			for (UINT j = 0; j < 3; ++j) {
+				UINT num = 1;
+				if (split.size() > j) {
+					if (GetNextNumber(split[j], num)) {
+						return 1;
+					}
+
+					if (GetNextToken<false>(split[j], token) != 2) {
+						return 1;
+					}
+				}
+
+				passDesc.numThreads[j] = num;
+			}
+		} else if (t == "STYLE") {
+			if (processed[4]) {
+				return 1;
+			}
+			processed[4] = true;
+
+			std::string_view val;
+			if (GetNextString(block, val)) {
+				return 1;
+			}
+
+			if (val == "PS") {
+				passDesc.isPSStyle = true;
+				passDesc.blockSize.first = 16;
+				passDesc.blockSize.second = 16;
+				passDesc.numThreads = { 64,1,1 };
+			} else if (val != "CS") {
+				return 1;
+			}
+		} else if (t == "DESC") {
+			if (processed[5]) {
+				return 1;
+			}
+			processed[5] = true;
+
+			std::string_view val;
+			if (GetNextString(block, val)) {
+				return 1;
+			}
+
+			StrUtils::Trim(val);
+			passDesc.desc = val;
+		} else if (t == "RADIUS") {
+			if (processed[6]) {
+				return 1;
+			}
+			processed[6] = true;
+
+			UINT num;
+			if (GetNextNumber(block, num)) {
+				return 1;
+			}
+
+			if (GetNextToken<false>(block, token) != 2) {
+				return 1;
+			}
+
+			passDesc.radius = (int)num;
+		} else if (t == "PER_PIXEL") {
+			if (processed[7]) {
+				return 1;
+			}
+			processed[7] = true;
+
+			if (GetNextToken<false>(block, token) != 2) {
+				return 1;
+			}
+
+			// 作者声明通道只以 pos 读取 INPUT，编译后由 EffectCompiler 检查
+			desc.flags |= EffectFlags::PerPixel;
+		} else {
+			return 1;
+		}
+	}
+
+	if (passDesc.isPSStyle) {
+		if (processed[2] || processed[3]) {
+			return 1;
+		}
+	} else {
+		if (!processed[2] || !processed[3] || processed[7]) {
+			return 1;
+		}
+	}
+
+	if (passDesc.desc.empty()) {
+		passDesc.desc = fmt::format("Pass {}", passIdx + 1);
+	}
+
+	return 0;
+}
+
+
+uint32_t EffectParser::Parse(
+	std::string_view source,
+	bool noCompile,
+	EffectDesc& desc,
+	EffectSourceBlocks* blocks,
+	EffectParserDiagnostic* diag
+) {
+	std::string_view sourceView = source;
+
+	// 检查头
+	if (!CheckMagic(sourceView)) {
+		SetDiagnostic(diag, source, sourceView.data(), "检查 MagpieFX 头失败");
+		return 2;
+	}
+
+	enum class BlockType {
+		Header,
+		Parameter,
+		Texture,
+		Sampler,
+		Common,
+		Pass
+	};
+
+	std::string_view headerBlock;
+	SmallVector<std::string_view> paramBlocks;
+	SmallVector<std::string_view> textureBlocks;
+	SmallVector<std::string_view> samplerBlocks;
+	SmallVector<std::string_view> commonBlocks;
+	SmallVector<std::string_view> passBlocks;
+
+	BlockType curBlockType = BlockType::Header;
+	size_t curBlockOff = 0;
+
+	auto completeCurrentBlock = [&](size_t len, BlockType newBlockType) {
+		if (curBlockType == BlockType::Header) {
+			headerBlock = sourceView.substr(curBlockOff, len);
+		} else if (curBlockType == BlockType::Parameter) {
+			paramBlocks.push_back(sourceView.substr(curBlockOff, len));
+		} else if (!noCompile) {
+			switch (curBlockType) {
+			case BlockType::Texture:
+				textureBlocks.push_back(sourceView.substr(curBlockOff, len));
+				break;
+			case BlockType::Sampler:
+				samplerBlocks.push_back(sourceView.substr(curBlockOff, len));
+				break;
+			case BlockType::Common:
+				commonBlocks.push_back(sourceView.substr(curBlockOff, len));
+				break;
+			case BlockType::Pass:
+				passBlocks.push_back(sourceView.substr(curBlockOff, len));
+				break;
+			default:
+				assert(false);
+				break;
+			}
+		}
+
+		curBlockType = newBlockType;
+		curBlockOff += len;
+	};
+
+	// 只查找 "//!"，再检查它是否位于行首
+	const char* const sourceEnd = sourceView.data() + sourceView.size();
+	const char* cur = sourceView.data();
+	while (true) {
+		cur = FindMetaIndicator(cur, sourceEnd);
+		if (cur == sourceEnd) {
+			break;
+		}
+
+		// 向前跳过空白，块的边界位于这段空白中第一个换行符之后
+		const char* blankStart = cur;
+		while (blankStart > sourceView.data() && StrUtils::isspace(blankStart[-1])) {
+			--blankStart;
+		}
+		const char* newLinePos = FindChar(blankStart, cur, '\n');
+		if (newLinePos == cur) {
+			// 不在行首
+			cur += 3;
+			continue;
+		}
+
+		std::string_view t(cur + 3, sourceEnd - cur - 3);
+		std::string_view token;
+		if (GetNextToken<false>(t, token)) {
+			SetDiagnostic(diag, source, t.data(), "非法的块类型");
+			return 1;
+		}
+		cur = t.data();
+
+		// 包含换行符
+		const size_t len = newLinePos - sourceView.data() - curBlockOff + 1;
+		std::string blockType = StrUtils::ToUpperCase(token);
+
+		if (blockType == "PARAMETER") {
+			completeCurrentBlock(len, BlockType::Parameter);
+		} else if (blockType == "TEXTURE") {
+			completeCurrentBlock(len, BlockType::Texture);
+		} else if (blockType == "SAMPLER") {
+			completeCurrentBlock(len, BlockType::Sampler);
+		} else if (blockType == "COMMON") {
+			completeCurrentBlock(len, BlockType::Common);
+		} else if (blockType == "PASS") {
+			completeCurrentBlock(len, BlockType::Pass);
+		}
+	}
+
+	completeCurrentBlock(sourceView.size() - curBlockOff, BlockType::Header);
+
+	// 必须有 PASS 块
+	if (!noCompile && passBlocks.empty()) {
+		SetDiagnostic(diag, source, nullptr, "无 PASS 块");
+		return 1;
+	}
+
+	if (ResolveHeader(headerBlock, desc, noCompile)) {
+		SetDiagnostic(diag, source, headerBlock.data(), "解析 Header 块失败");
+		return 1;
+	}
+
+	desc.params.clear();
+	for (size_t i = 0; i < paramBlocks.size(); ++i) {
+		if (ResolveParameter(paramBlocks[i], desc)) {
+			SetDiagnostic(diag, source, paramBlocks[i].data(), fmt::format("解析 Parameter#{} 块失败", i + 1));
+			return 1;
+		}
+	}
+
+	if (!noCompile) {
+		desc.textures.clear();
+		// 纹理第一个元素为 INPUT
+		{
+			auto& texDesc = desc.textures.emplace_back();
+			texDesc.name = "INPUT";
+			texDesc.format = EffectIntermediateTextureFormat::R8G8B8A8_UNORM;
+			texDesc.sizeExpr.first = "INPUT_WIDTH";
+			texDesc.sizeExpr.second = "INPUT_HEIGHT";
+		}
+
+		for (size_t i = 0; i < textureBlocks.size(); ++i) {
+			if (ResolveTexture(textureBlocks[i], desc)) {
+				SetDiagnostic(diag, source, textureBlocks[i].data(), fmt::format("解析 Texture#{} 块失败", i + 1));
+				return 1;
+			}
+		}
+
+		desc.samplers.clear();
+		for (size_t i = 0; i < samplerBlocks.size(); ++i) {
+			if (ResolveSampler(samplerBlocks[i], desc)) {
+				SetDiagnostic(diag, source, samplerBlocks[i].data(), fmt::format("解析 Sampler#{} 块失败", i + 1));
+				return 1;
+			}
+		}
+	}
+
+	{
+		// 确保没有重复的名字
+		phmap::flat_hash_set<std::string> names;
+		auto checkName = [&](const std::string& name) {
+			if (names.contains(name)) {
+				SetDiagnostic(diag, source, nullptr, fmt::format("标识符 {} 重复", name));
+				return false;
+			}
+			names.insert(name);
+			return true;
+		};
+
+		for (const auto& d : desc.params) {
+			if (!checkName(d.name)) {
+				return 1;
+			}
+		}
+		for (const auto& d : desc.textures) {
+			if (!checkName(d.name)) {
+				return 1;
+			}
+		}
+		for (const auto& d : desc.samplers) {
+			if (!checkName(d.name)) {
+				return 1;
+			}
+		}
+	}
+
+	if (!noCompile) {
+		for (size_t i = 0; i < commonBlocks.size(); ++i) {
+			if (ResolveCommon(commonBlocks[i])) {
+				SetDiagnostic(diag, source, commonBlocks[i].data(), fmt::format("解析 Common#{} 块失败", i + 1));
+				return 1;
+			}
+		}
+
+		const char* errorPos = nullptr;
+		if (ResolvePassNumbers(passBlocks, errorPos)) {
+			SetDiagnostic(diag, source, errorPos, "解析 Pass 序号失败");
+			return 1;
+		}
+
+		desc.passes.clear();
+		desc.passes.resize(passBlocks.size());
+		for (UINT i = 0; i < passBlocks.size(); ++i) {
+			if (ResolvePass(passBlocks[i], desc, i)) {
+				SetDiagnostic(diag, source, passBlocks[i].data(), fmt::format("解析 Pass{} 块失败", i + 1));
+				return 1;
+			}
+		}
+
+		if (blocks) {
+			blocks->commonBlocks = std::move(commonBlocks);
+			blocks->passBlocks = std::move(passBlocks);
+		}
+	}
+
+	return 0;
+}
+
+}
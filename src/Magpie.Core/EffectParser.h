@@ -0,0 +1,43 @@
+#pragma once
+#include "ExportHelper.h"
+#include "SmallVector.h"
+#include <string>
+#include <string_view>
+
+namespace Magpie::Core {
+
+struct EffectDesc;
+
+// 解析失败时的诊断信息
+struct EffectParserDiagnostic {
+	// 从 1 开始，为 0 表示没有位置信息。注释移除后行号不变，但列号基于移除注释后的源码
+	uint32_t line = 0;
+	uint32_t column = 0;
+	std::string message;
+};
+
+// 代码块，指向传给 Parse 的源码
+struct EffectSourceBlocks {
+	SmallVector<std::string_view> commonBlocks;
+	// 已按通道序号排序，且不含 //! 指令
+	SmallVector<std::string_view> passBlocks;
+};
+
+// MagpieFX 的前端，只处理文本，不读取文件也不编译着色器
+// 产生的 EffectDesc 中 cso 均为空，由 EffectCompiler 负责生成代码和编译
+struct API_DECLSPEC EffectParser {
+	// 移除注释，换行符被保留以使行号不变
+	static uint32_t RemoveComments(std::string& source, EffectParserDiagnostic* diag = nullptr);
+
+	// source 应已移除注释。调用者需填入 desc 中的 name 和 flags
+	// noCompile 为真时只解析 HEADER 和 PARAMETER 块，含义和 EffectCompilerFlags::NoCompile 相同
+	static uint32_t Parse(
+		std::string_view source,
+		bool noCompile,
+		EffectDesc& desc,
+		EffectSourceBlocks* blocks = nullptr,
+		EffectParserDiagnostic* diag = nullptr
+	);
+};
+
+}
@@ -0,0 +1,372 @@
+#include "pch.h"
+#include "FlatEffectCache.h"
+#include <bit>	// std::bit_cast
+
+namespace Magpie::Core {
+
+// "MPFX"
+static constexpr const uint32_t FLAT_CACHE_MAGIC = 0x5846504d;
+
+struct FlatString {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct FlatArray {
+	uint32_t offset;
+	uint32_t count;
+};
+
+struct FlatHeader {
+	uint32_t magic;
+	uint32_t version;
+	// 用于检查文件是否完整
+	uint32_t fileSize;
+	uint32_t flags;
+	FlatString name;
+	FlatString outSizeExpr[2];
+	FlatArray params;	// FlatParameter
+	FlatArray textures;	// FlatTexture
+	FlatArray samplers;	// FlatSampler
+	FlatArray passes;	// FlatPass
+};
+
+struct FlatParameter {
+	FlatString name;
+	FlatString label;
+	uint32_t isInt;
+	// defaultValue、minValue、maxValue 和 step，float 按位保存
+	uint32_t values[4];
+};
+
+struct FlatTexture {
+	FlatString sizeExpr[2];
+	FlatString name;
+	FlatString source;
+	uint32_t format;
+};
+
+struct FlatSampler {
+	FlatString name;
+	uint32_t filterType;
+	uint32_t addressType;
+};
+
+struct FlatPass {
+	uint64_t blobId;
+	FlatArray inputs;	// uint32_t
+	FlatArray outputs;	// uint32_t
+	FlatString desc;
+	uint32_t numThreads[3];
+	uint32_t blockSize[2];
+	int32_t radius;
+	uint32_t isPSStyle;
+};
+
+class FlatWriter {
+public:
+	explicit FlatWriter(std::vector<BYTE>& buf) : _buf(buf) {}
+
+	// 分配 count 个 T 并清零，返回偏移。注意之前通过 At 获得的引用会失效
+	template<typename T>
+	uint32_t Alloc(size_t count = 1) {
+		static_assert(std::is_trivially_copyable_v<T>);
+		const size_t offset = (_buf.size() + alignof(T) - 1) & ~(alignof(T) - 1);
+		_buf.resize(offset + sizeof(T) * count);
+		return (uint32_t)offset;
+	}
+
+	template<typename T>
+	T& At(uint32_t offset, size_t idx = 0) noexcept {
+		return ((T*)(_buf.data() + offset))[idx];
+	}
+
+	FlatString AddString(std::string_view str) {
+		FlatString result{ (uint32_t)_buf.size(), (uint32_t)str.size() };
+		_buf.insert(_buf.end(), str.begin(), str.end());
+		return result;
+	}
+
+	FlatArray AddArray(std::span<const uint32_t> values) {
+		FlatArray result{ Alloc<uint32_t>(values.size()), (uint32_t)values.size() };
+		std::memcpy(_buf.data() + result.offset, values.data(), values.size_bytes());
+		return result;
+	}
+
+private:
+	std::vector<BYTE>& _buf;
+};
+
+class FlatReader {
+public:
+	explicit FlatReader(std::span<const BYTE> data) noexcept : _data(data) {}
+
+	template<typename T>
+	const T* Get(uint32_t offset) const noexcept {
+		std::span<const T> result;
+		return GetArray(FlatArray{ offset, 1 }, result) ? result.data() : nullptr;
+	}
+
+	template<typename T>
+	bool GetArray(const FlatArray& arr, std::span<const T>& result) const noexcept {
+		if (arr.offset % alignof(T) != 0 || (uint64_t)arr.offset + (uint64_t)arr.count * sizeof(T) > _data.size()) {
+			return false;
+		}
+
+		result = std::span((const T*)(_data.data() + arr.offset), arr.count);
+		return true;
+	}
+
+	bool GetString(const FlatString& str, std::string& result) const {
+		if ((uint64_t)str.offset + str.size > _data.size()) {
+			return false;
+		}
+
+		result.assign((const char*)_data.data() + str.offset, str.size);
+		return true;
+	}
+
+private:
+	std::span<const BYTE> _data;
+};
+
+void FlatEffectCache::Write(
+	const EffectDesc& desc,
+	std::span<const uint64_t> blobIds,
+	uint32_t version,
+	std::vector<BYTE>& result
+) {
+	assert(blobIds.size() == desc.passes.size());
+
+	result.clear();
+	result.reserve(4096);
+
+	FlatWriter writer(result);
+
+	// 头部一定位于开头
+	writer.Alloc<FlatHeader>();
+
+	const uint32_t paramsOffset = writer.Alloc<FlatParameter>(desc.params.size());
+	for (size_t i = 0; i < desc.params.size(); ++i) {
+		const EffectParameterDesc& paramDesc = desc.params[i];
+
+		const FlatString name = writer.AddString(paramDesc.name);
+		const FlatString label = writer.AddString(paramDesc.label);
+
+		FlatParameter& param = writer.At<FlatParameter>(paramsOffset, i);
+		param.name = name;
+		param.label = label;
+		if (paramDesc.constant.index() == 0) {
+			const EffectConstant<float>& constant = std::get<0>(paramDesc.constant);
+			param.isInt = 0;
+			param.values[0] = std::bit_cast<uint32_t>(constant.defaultValue);
+			param.values[1] = std::bit_cast<uint32_t>(constant.minValue);
+			param.values[2] = std::bit_cast<uint32_t>(constant.maxValue);
+			param.values[3] = std::bit_cast<uint32_t>(constant.step);
+		} else {
+			const EffectConstant<int>& constant = std::get<1>(paramDesc.constant);
+			param.isInt = 1;
+			param.values[0] = std::bit_cast<uint32_t>(constant.defaultValue);
+			param.values[1] = std::bit_cast<uint32_t>(constant.minValue);
+			param.values[2] = std::bit_cast<uint32_t>(constant.maxValue);
+			param.values[3] = std::bit_cast<uint32_t>(constant.step);
+		}
+	}
+
+	const uint32_t texturesOffset = writer.Alloc<FlatTexture>(desc.textures.size());
+	for (size_t i = 0; i < desc.textures.size(); ++i) {
+		const EffectIntermediateTextureDesc& texDesc = desc.textures[i];
+
+		const FlatString sizeExprX = writer.AddString(texDesc.sizeExpr.first);
+		const FlatString sizeExprY = writer.AddString(texDesc.sizeExpr.second);
+		const FlatString name = writer.AddString(texDesc.name);
+		const FlatString source = writer.AddString(texDesc.source);
+
+		FlatTexture& tex = writer.At<FlatTexture>(texturesOffset, i);
+		tex.sizeExpr[0] = sizeExprX;
+		tex.sizeExpr[1] = sizeExprY;
+		tex.name = name;
+		tex.source = source;
+		tex.format = (uint32_t)texDesc.format;
+	}
+
+	const uint32_t samplersOffset = writer.Alloc<FlatSampler>(desc.samplers.size());
+	for (size_t i = 0; i < desc.samplers.size(); ++i) {
+		const EffectSamplerDesc& samDesc = desc.samplers[i];
+
+		const FlatString name = writer.AddString(samDesc.name);
+
+		FlatSampler& sam = writer.At<FlatSampler>(samplersOffset, i);
+		sam.name = name;
+		sam.filterType = (uint32_t)samDesc.filterType;
+		sam.addressType = (uint32_t)samDesc.addressType;
+	}
+
+	const uint32_t passesOffset = writer.Alloc<FlatPass>(desc.passes.size());
+	for (size_t i = 0; i < desc.passes.size(); ++i) {
+		const EffectPassDesc& passDesc = desc.passes[i];
+
+		const FlatArray inputs = writer.AddArray(passDesc.inputs);
+		const FlatArray outputs = writer.AddArray(passDesc.outputs);
+		const FlatString passDescStr = writer.AddString(passDesc.desc);
+
+		FlatPass& pass = writer.At<FlatPass>(passesOffset, i);
+		pass.blobId = blobIds[i];
+		pass.inputs = inputs;
+		pass.outputs = outputs;
+		pass.desc = passDescStr;
+		std::copy(passDesc.numThreads.begin(), passDesc.numThreads.end(), pass.numThreads);
+		pass.blockSize[0] = passDesc.blockSize.first;
+		pass.blockSize[1] = passDesc.blockSize.second;
+		pass.radius = passDesc.radius;
+		pass.isPSStyle = passDesc.isPSStyle;
+	}
+
+	const FlatString name = writer.AddString(desc.name);
+	const FlatString outSizeExprX = writer.AddString(desc.outSizeExpr.first);
+	const FlatString outSizeExprY = writer.AddString(desc.outSizeExpr.second);
+
+	FlatHeader& header = writer.At<FlatHeader>(0);
+	header.magic = FLAT_CACHE_MAGIC;
+	header.version = version;
+	header.fileSize = (uint32_t)result.size();
+	header.flags = desc.flags;
+	header.name = name;
+	header.outSizeExpr[0] = outSizeExprX;
+	header.outSizeExpr[1] = outSizeExprY;
+	header.params = { paramsOffset, (uint32_t)desc.params.size() };
+	header.textures = { texturesOffset, (uint32_t)desc.textures.size() };
+	header.samplers = { samplersOffset, (uint32_t)desc.samplers.size() };
+	header.passes = { passesOffset, (uint32_t)desc.passes.size() };
+}
+
+bool FlatEffectCache::Read(
+	std::span<const BYTE> data,
+	uint32_t version,
+	EffectDesc& desc,
+	std::vector<uint64_t>& blobIds
+) {
+	assert((uintptr_t)data.data() % alignof(uint64_t) == 0);
+
+	FlatReader reader(data);
+
+	const FlatHeader* header = reader.Get<FlatHeader>(0);
+	if (!header || header->magic != FLAT_CACHE_MAGIC
+		|| header->version != version || header->fileSize != data.size()) {
+		return false;
+	}
+
+	std::span<const FlatParameter> params;
+	std::span<const FlatTexture> textures;
+	std::span<const FlatSampler> samplers;
+	std::span<const FlatPass> passes;
+	if (!reader.GetArray(header->params, params) || !reader.GetArray(header->textures, textures)
+		|| !reader.GetArray(header->samplers, samplers) || !reader.GetArray(header->passes, passes)) {
+		return false;
+	}
+
+	if (!reader.GetString(header->name, desc.name)
+		|| !reader.GetString(header->outSizeExpr[0], desc.outSizeExpr.first)
+		|| !reader.GetString(header->outSizeExpr[1], desc.outSizeExpr.second)) {
+		return false;
+	}
+	desc.flags = header->flags;
+
+	desc.params.resize(params.size());
+	for (size_t i = 0; i < params.size(); ++i) {
+		const FlatParameter& param = params[i];
+		EffectParameterDesc& paramDesc = desc.params[i];
+
+		if (!reader.GetString(param.name, paramDesc.name) || !reader.GetString(param.label, paramDesc.label)) {
+			return false;
+		}
+
+		if (param.isInt) {
+			paramDesc.constant = EffectConstant<int>{
+				std::bit_cast<int>(param.values[0]),
+				std::bit_cast<int>(param.values[1]),
+				std::bit_cast<int>(param.values[2]),
+				std::bit_cast<int>(param.values[3])
+			};
+		} else {
+			paramDesc.constant = EffectConstant<float>{
+				std::bit_cast<float>(param.values[0]),
+				std::bit_cast<float>(param.values[1]),
+				std::bit_cast<float>(param.values[2]),
+				std::bit_cast<float>(param.values[3])
+			};
+		}
+	}
+
+	desc.textures.resize(textures.size());
+	for (size_t i = 0; i < textures.size(); ++i) {
+		const FlatTexture& tex = textures[i];
+		EffectIntermediateTextureDesc& texDesc = desc.textures[i];
+
+		if (tex.format > (uint32_t)EffectIntermediateTextureFormat::UNKNOWN) {
+			return false;
+		}
+
+		if (!reader.GetString(tex.sizeExpr[0], texDesc.sizeExpr.first)
+			|| !reader.GetString(tex.sizeExpr[1], texDesc.sizeExpr.second)
+			|| !reader.GetString(tex.name, texDesc.name)
+			|| !reader.GetString(tex.source, texDesc.source)) {
+			return false;
+		}
+		texDesc.format = (EffectIntermediateTextureFormat)tex.format;
+	}
+
+	desc.samplers.resize(samplers.size());
+	for (size_t i = 0; i < samplers.size(); ++i) {
+		const FlatSampler& sam = samplers[i];
+		EffectSamplerDesc& samDesc = desc.samplers[i];
+
+		if (sam.filterType > (uint32_t)EffectSamplerFilterType::Point
+			|| sam.addressType > (uint32_t)EffectSamplerAddressType::Wrap) {
+			return false;
+		}
+
+		if (!reader.GetString(sam.name, samDesc.name)) {
+			return false;
+		}
+		samDesc.filterType = (EffectSamplerFilterType)sam.filterType;
+		samDesc.addressType = (EffectSamplerAddressType)sam.addressType;
+	}
+
+	// 检查纹理索引，防止损坏的缓存导致越界访问
+	const auto checkIndices = [&](std::span<const uint32_t> indices) {
+		return std::all_of(indices.begin(), indices.end(),
+			[&](uint32_t idx) { return idx < textures.size(); });
+	};
+
+	desc.passes.resize(passes.size());
+	blobIds.resize(passes.size());
+	for (size_t i = 0; i < passes.size(); ++i) {
+		const FlatPass& pass = passes[i];
+		EffectPassDesc& passDesc = desc.passes[i];
+
+		std::span<const uint32_t> inputs;
+		std::span<const uint32_t> outputs;
+		if (!reader.GetArray(pass.inputs, inputs) || !reader.GetArray(pass.outputs, outputs)
+			|| !checkIndices(inputs) || !checkIndices(outputs)) {
+			return false;
+		}
+
+		if (!reader.GetString(pass.desc, passDesc.desc)) {
+			return false;
+		}
+
+		passDesc.inputs.assign(inputs.begin(), inputs.end());
+		passDesc.outputs.assign(outputs.begin(), outputs.end());
+		std::copy(std::begin(pass.numThreads), std::end(pass.numThreads), passDesc.numThreads.begin());
+		passDesc.blockSize = { pass.blockSize[0], pass.blockSize[1] };
+		passDesc.radius = pass.radius;
+		passDesc.isPSStyle = pass.isPSStyle;
+
+		blobIds[i] = pass.blobId;
+	}
+
+	return true;
+}
+
+}
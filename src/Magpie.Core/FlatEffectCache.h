@@ -0,0 +1,27 @@
+#pragma once
+#include "EffectDesc.h"
+
+namespace Magpie::Core {
+
+// 效果缓存索引的二进制格式
+// 只包含定长的记录和字符串，所有位置都是相对于开头的偏移，不含指针，因此可以映射文件后直接读取
+// CSO 不在其中，每个通道只保存 blob ID
+struct FlatEffectCache {
+	// blobIds 和 desc.passes 一一对应
+	static void Write(
+		const EffectDesc& desc,
+		std::span<const uint64_t> blobIds,
+		uint32_t version,
+		std::vector<BYTE>& result
+	);
+
+	// data 至少需 8 字节对齐。版本不匹配或数据损坏时返回 false
+	static bool Read(
+		std::span<const BYTE> data,
+		uint32_t version,
+		EffectDesc& desc,
+		std::vector<uint64_t>& blobIds
+	);
+};
+
+}
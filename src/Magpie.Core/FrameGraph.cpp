@@ -0,0 +1,317 @@
+#include "pch.h"
+#include "FrameGraph.h"
+
+namespace Magpie::Core {
+
+static bool IsEmptyRect(const RECT& rect) noexcept {
+	return rect.left >= rect.right || rect.top >= rect.bottom;
+}
+
+static void UnionToRect(RECT& rect, const RECT& other) noexcept {
+	if (IsEmptyRect(other)) {
+		return;
+	}
+
+	if (IsEmptyRect(rect)) {
+		rect = other;
+	} else {
+		rect.left = std::min(rect.left, other.left);
+		rect.top = std::min(rect.top, other.top);
+		rect.right = std::max(rect.right, other.right);
+		rect.bottom = std::max(rect.bottom, other.bottom);
+	}
+}
+
+// 将输入中变化的区域映射到输出，输出的每个像素依赖以对应位置为中心、半径为 radius 的输入像素
+static RECT MapDirtyRect(const RECT& dirtyRect, SIZE inputSize, SIZE outputSize, int radius) noexcept {
+	const int64_t left = std::max((int64_t)dirtyRect.left - radius, (int64_t)0);
+	const int64_t top = std::max((int64_t)dirtyRect.top - radius, (int64_t)0);
+	const int64_t right = std::min((int64_t)dirtyRect.right + radius, (int64_t)inputSize.cx);
+	const int64_t bottom = std::min((int64_t)dirtyRect.bottom + radius, (int64_t)inputSize.cy);
+
+	// 左上向下取整，右下向上取整
+	return RECT{
+		(LONG)(left * outputSize.cx / inputSize.cx),
+		(LONG)(top * outputSize.cy / inputSize.cy),
+		(LONG)((right * outputSize.cx + inputSize.cx - 1) / inputSize.cx),
+		(LONG)((bottom * outputSize.cy + inputSize.cy - 1) / inputSize.cy)
+	};
+}
+
+uint32_t FrameGraph::AddResource(std::string name, SIZE size) {
+	_resourceNames.emplace_back(std::move(name));
+	_resourceSizes.push_back(size);
+	_resourceVersions.push_back(0);
+	_resourceDirtyRects.push_back({});
+	return (uint32_t)_resourceNames.size() - 1;
+}
+
+uint32_t FrameGraph::AddPass(
+	std::string name,
+	const SmallVector<uint32_t>& inputs,
+	const SmallVector<uint32_t>& outputs,
+	bool isDynamic,
+	int radius
+) {
+	_Pass& pass = _passes.emplace_back();
+	pass.name = std::move(name);
+	pass.inputs = inputs;
+	pass.outputs = outputs;
+	pass.inputVersions.resize(inputs.size());
+	pass.outputVersions.resize(outputs.size());
+	pass.isDynamic = isDynamic;
+	pass.radius = radius;
+
+	// 每个输入由在此之前最后一个写入它的通道产生
+	const uint32_t passIdx = (uint32_t)_passes.size() - 1;
+	pass.producers.resize(inputs.size(), UINT_MAX);
+	for (uint32_t j = 0; j < inputs.size(); ++j) {
+		for (uint32_t i = passIdx; i-- > 0;) {
+			const SmallVector<uint32_t>& outputs = _passes[i].outputs;
+			if (std::find(outputs.begin(), outputs.end(), inputs[j]) != outputs.end()) {
+				pass.producers[j] = i;
+				break;
+			}
+		}
+	}
+
+	return passIdx;
+}
+
+void FrameGraph::Compile() {
+	if (_output == UINT_MAX) {
+		return;
+	}
+
+	// 从输出开始反向标记，在写入前读取的资源会形成环，因此需要迭代到不动点
+	std::vector<uint8_t> isResourceLive(_resourceNames.size(), false);
+	isResourceLive[_output] = true;
+
+	for (_Pass& pass : _passes) {
+		pass.isCulled = true;
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		for (auto it = _passes.rbegin(); it != _passes.rend(); ++it) {
+			_Pass& pass = *it;
+			if (!pass.isCulled) {
+				continue;
+			}
+
+			if (std::none_of(pass.outputs.begin(), pass.outputs.end(), [&](uint32_t r) { return isResourceLive[r]; })) {
+				continue;
+			}
+
+			pass.isCulled = false;
+			for (uint32_t r : pass.inputs) {
+				isResourceLive[r] = true;
+			}
+			changed = true;
+		}
+	}
+
+	// 写入输出资源的通道每帧都要完整执行（交换链使用 FLIP_DISCARD），多个输出尺寸不同时无法映射变化区域
+	for (_Pass& pass : _passes) {
+		pass.canUpdatePartially = pass.radius >= 0 && !pass.outputs.empty()
+			&& std::all_of(pass.outputs.begin(), pass.outputs.end(), [&](uint32_t r) {
+				return r != _output && _resourceSizes[r].cx == _resourceSizes[pass.outputs[0]].cx
+					&& _resourceSizes[r].cy == _resourceSizes[pass.outputs[0]].cy;
+			})
+			&& std::all_of(pass.inputs.begin(), pass.inputs.end(), [&](uint32_t r) {
+				return _resourceSizes[r].cx > 0 && _resourceSizes[r].cy > 0;
+			});
+	}
+}
+
+void FrameGraph::TouchResource(uint32_t resource, const RECT* dirtyRect) noexcept {
+	++_resourceVersions[resource];
+
+	const SIZE size = _resourceSizes[resource];
+	RECT rect{ 0, 0, size.cx, size.cy };
+	if (dirtyRect) {
+		rect.left = std::max(dirtyRect->left, (LONG)0);
+		rect.top = std::max(dirtyRect->top, (LONG)0);
+		rect.right = std::min(dirtyRect->right, size.cx);
+		rect.bottom = std::min(dirtyRect->bottom, size.cy);
+	}
+	UnionToRect(_resourceDirtyRects[resource], rect);
+}
+
+void FrameGraph::Schedule(FrameGraphSchedule& schedule) {
+	schedule.passes.clear();
+	schedule.updateRects.clear();
+	schedule.isFull = true;
+
+	const uint32_t passCount = (uint32_t)_passes.size();
+	std::vector<uint8_t> needRun(passCount, false);
+	std::vector<uint64_t> versions;
+
+	// 前向模拟各资源的版本。如果某个要执行的通道读取的资源已被其他通道覆盖，它的写入者也必须执行，
+	// 此时重新模拟，直到不再有新的通道需要执行
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		versions = _resourceVersions;
+
+		for (uint32_t i = 0; i < passCount && !changed; ++i) {
+			const _Pass& pass = _passes[i];
+			if (pass.isCulled) {
+				continue;
+			}
+
+			bool run = needRun[i] || !pass.hasRun || pass.isDynamic;
+			for (uint32_t j = 0; !run && j < pass.outputs.size(); ++j) {
+				run = pass.outputs[j] == _output;
+			}
+			for (uint32_t j = 0; !run && j < pass.inputs.size(); ++j) {
+				// 资源可能被共享它的其他通道改写，因此只要产生它的通道未执行就认为输入未改变
+				const uint32_t producer = pass.producers[j];
+				run = producer == UINT_MAX ? versions[pass.inputs[j]] != pass.inputVersions[j] : needRun[producer];
+			}
+
+			if (!run) {
+				continue;
+			}
+
+			for (uint32_t j = 0; j < pass.inputs.size(); ++j) {
+				const uint32_t producer = pass.producers[j];
+				if (producer == UINT_MAX || needRun[producer]) {
+					continue;
+				}
+
+				const _Pass& producerPass = _passes[producer];
+				const uint32_t resource = pass.inputs[j];
+				auto it = std::find(producerPass.outputs.begin(), producerPass.outputs.end(), resource);
+				if (versions[resource] != producerPass.outputVersions[it - producerPass.outputs.begin()]) {
+					needRun[producer] = true;
+					changed = true;
+				}
+			}
+
+			needRun[i] = true;
+			for (uint32_t r : pass.outputs) {
+				++versions[r];
+			}
+		}
+	}
+
+	// 各通道本帧更新的区域
+	std::vector<RECT> updateRects(passCount);
+
+	for (uint32_t i = 0; i < passCount; ++i) {
+		if (!needRun[i]) {
+			if (!_passes[i].isCulled) {
+				schedule.isFull = false;
+			}
+			continue;
+		}
+
+		_Pass& pass = _passes[i];
+		const SIZE outputSize = pass.outputs.empty() ? SIZE{} : _resourceSizes[pass.outputs[0]];
+		RECT& updateRect = updateRects[i];
+
+		// 首次执行、使用动态常量或输出已被其他通道覆盖时需更新整个输出
+		bool isFull = !pass.canUpdatePartially || !pass.hasRun || pass.isDynamic;
+		for (uint32_t j = 0; !isFull && j < pass.outputs.size(); ++j) {
+			isFull = _resourceVersions[pass.outputs[j]] != pass.outputVersions[j];
+		}
+
+		for (uint32_t j = 0; !isFull && j < pass.inputs.size(); ++j) {
+			const uint32_t resource = pass.inputs[j];
+			const uint32_t producer = pass.producers[j];
+
+			RECT dirtyRect;
+			if (producer != UINT_MAX) {
+				if (!needRun[producer]) {
+					continue;
+				}
+				dirtyRect = updateRects[producer];
+			} else {
+				if (_resourceVersions[resource] == pass.inputVersions[j]) {
+					continue;
+				}
+
+				if (resource != _source) {
+					// 上一帧的内容，不知道变化的区域
+					isFull = true;
+					break;
+				}
+				dirtyRect = _resourceDirtyRects[resource];
+			}
+
+			UnionToRect(updateRect, MapDirtyRect(dirtyRect, _resourceSizes[resource], outputSize, pass.radius));
+		}
+
+		// 因输出被覆盖而执行的通道没有变化的输入
+		if (isFull || IsEmptyRect(updateRect)) {
+			updateRect = RECT{ 0, 0, outputSize.cx, outputSize.cy };
+		} else if (updateRect.left > 0 || updateRect.top > 0
+			|| updateRect.right < outputSize.cx || updateRect.bottom < outputSize.cy) {
+			schedule.isFull = false;
+		}
+
+		for (uint32_t j = 0; j < pass.inputs.size(); ++j) {
+			pass.inputVersions[j] = _resourceVersions[pass.inputs[j]];
+		}
+		for (uint32_t j = 0; j < pass.outputs.size(); ++j) {
+			pass.outputVersions[j] = ++_resourceVersions[pass.outputs[j]];
+		}
+		pass.hasRun = true;
+
+		schedule.passes.push_back(i);
+		schedule.updateRects.push_back(updateRect);
+	}
+
+	for (RECT& rect : _resourceDirtyRects) {
+		rect = {};
+	}
+}
+
+void FrameGraph::Invalidate() noexcept {
+	for (_Pass& pass : _passes) {
+		pass.hasRun = false;
+	}
+}
+
+static std::string EscapeDot(std::string_view str) {
+	std::string result;
+	result.reserve(str.size());
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			result.push_back('\\');
+		}
+		result.push_back(c);
+	}
+	return result;
+}
+
+std::string FrameGraph::ToDot() const {
+	// 资源为椭圆，通道为矩形。被剔除的通道为虚线，使用动态常量的通道为粗线
+	std::string result = "digraph FrameGraph {\n\trankdir=LR;\n";
+
+	for (uint32_t i = 0; i < (uint32_t)_resourceNames.size(); ++i) {
+		result.append(fmt::format("\tr{} [label=\"{}\"{}];\n", i, EscapeDot(_resourceNames[i]),
+			i == _source || i == _output ? ", peripheries=2" : ""));
+	}
+
+	for (uint32_t i = 0; i < (uint32_t)_passes.size(); ++i) {
+		const _Pass& pass = _passes[i];
+		std::string_view style = pass.isCulled ? ", style=dashed" : (pass.isDynamic ? ", style=bold" : "");
+		result.append(fmt::format("\tp{} [shape=box, label=\"{}\"{}];\n", i, EscapeDot(pass.name), style));
+
+		for (uint32_t r : pass.inputs) {
+			result.append(fmt::format("\tr{} -> p{};\n", r, i));
+		}
+		for (uint32_t r : pass.outputs) {
+			result.append(fmt::format("\tp{} -> r{};\n", i, r));
+		}
+	}
+
+	result.append("}\n");
+	return result;
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "SmallVector.h"
+
+namespace Magpie::Core {
+
+// 一帧中需要执行的通道
+struct FrameGraphSchedule {
+	SmallVector<uint32_t> passes;
+	// passes[i] 需要更新的区域，坐标系为它的输出
+	SmallVector<RECT> updateRects;
+	// 所有未被剔除的通道都要完整执行
+	bool isFull = true;
+};
+
+// 以通道为节点、纹理为边的帧图，只做分析，不涉及 D3D
+// 通道按添加的顺序执行，这个顺序必须是合法的拓扑序。同一个资源可以被多个通道写入（如共享的中间纹理），
+// 在写入前读取的资源保存的是上一帧的内容
+class FrameGraph {
+public:
+	uint32_t AddResource(std::string name, SIZE size);
+
+	// outputs 按 UAV 的槽位排列
+	// radius 为输出像素依赖的输入像素的最大距离，小于 0 时输入改变后总是更新整个输出
+	uint32_t AddPass(
+		std::string name,
+		const SmallVector<uint32_t>& inputs,
+		const SmallVector<uint32_t>& outputs,
+		bool isDynamic,
+		int radius = -1
+	);
+
+	// 来自帧源的资源，内容改变时调用 TouchResource
+	void SetSource(uint32_t resource) noexcept {
+		_source = resource;
+	}
+
+	// 写入此资源的通道每帧都要执行，如交换链的后缓冲区
+	void SetOutput(uint32_t resource) noexcept {
+		_output = resource;
+	}
+
+	// 添加完所有资源和通道后调用，剔除对输出没有贡献的通道
+	void Compile();
+
+	// 资源的内容在帧图之外被修改，dirtyRect 为空表示整个资源
+	void TouchResource(uint32_t resource, const RECT* dirtyRect = nullptr) noexcept;
+
+	// 只有输入改变、使用动态常量或写入输出资源的通道需要执行。如果要执行的通道的输入已被其他通道覆盖，
+	// 产生它的通道也需执行。调用者需执行 schedule 中的所有通道
+	// 已知 radius 的通道只需更新输入的变化区域影响到的部分
+	void Schedule(FrameGraphSchedule& schedule);
+
+	// 使所有通道在下一帧执行
+	void Invalidate() noexcept;
+
+	uint32_t GetPassCount() const noexcept {
+		return (uint32_t)_passes.size();
+	}
+
+	bool IsCulled(uint32_t pass) const noexcept {
+		return _passes[pass].isCulled;
+	}
+
+	// Graphviz 格式，用于调试
+	std::string ToDot() const;
+
+private:
+	struct _Pass {
+		std::string name;
+		SmallVector<uint32_t> inputs;
+		SmallVector<uint32_t> outputs;
+		// 产生每个输入的通道，UINT_MAX 表示输入来自帧图之外或上一帧
+		SmallVector<uint32_t> producers;
+		// 上次执行时输入的版本
+		SmallVector<uint64_t> inputVersions;
+		// 上次执行后输出的版本
+		SmallVector<uint64_t> outputVersions;
+		int radius = -1;
+		bool isDynamic = false;
+		bool isCulled = false;
+		// 在 Compile 中计算
+		bool canUpdatePartially = false;
+		bool hasRun = false;
+	};
+
+	std::vector<std::string> _resourceNames;
+	std::vector<SIZE> _resourceSizes;
+	// 每次写入加一
+	std::vector<uint64_t> _resourceVersions;
+	// 自上次 Schedule 以来在帧图之外被修改的区域
+	std::vector<RECT> _resourceDirtyRects;
+	std::vector<_Pass> _passes;
+
+	uint32_t _source = UINT_MAX;
+	uint32_t _output = UINT_MAX;
+};
+
+}
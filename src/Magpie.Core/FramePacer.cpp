@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "FramePacer.h"
+
+namespace Magpie::Core {
+
+void LatencyHistogram::Add(int64_t latency) noexcept {
+	const int64_t idx = std::max(latency, (int64_t)0) / BUCKET_WIDTH;
+	++_buckets[(size_t)std::min(idx, (int64_t)BUCKET_COUNT - 1)];
+	++_count;
+}
+
+void LatencyHistogram::Clear() noexcept {
+	_buckets = {};
+	_count = 0;
+}
+
+int64_t LatencyHistogram::GetPercentile(float p) const noexcept {
+	if (_count == 0) {
+		return 0;
+	}
+
+	const uint32_t rank = std::max((uint32_t)std::ceil(p * _count), 1u);
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+		sum += _buckets[i];
+		if (sum >= rank) {
+			return (i + 1) * BUCKET_WIDTH;
+		}
+	}
+	return BUCKET_COUNT * BUCKET_WIDTH;
+}
+
+std::string LatencyHistogram::ToString() const {
+	std::string result;
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+		if (_buckets[i] == 0) {
+			continue;
+		}
+
+		if (i + 1 == BUCKET_COUNT) {
+			result.append(fmt::format("\t>= {:.1f} ms: {}\n", i * BUCKET_WIDTH / 1000.0f, _buckets[i]));
+		} else {
+			result.append(fmt::format("\t{:.1f}~{:.1f} ms: {}\n",
+				i * BUCKET_WIDTH / 1000.0f, (i + 1) * BUCKET_WIDTH / 1000.0f, _buckets[i]));
+		}
+	}
+	return result;
+}
+
+void FramePacer::Initialize() noexcept {
+	_renderTimeCount = 0;
+	_nextRenderTimeIdx = 0;
+	_lastGPUTime = 0;
+	_predictedRenderTime = 0;
+	_margin = MIN_MARGIN;
+	_targetVBlank = -1;
+	_pendingPresentCount = 0;
+	_displayOffsetCount = 0;
+	_nextDisplayOffsetIdx = 0;
+	_onTimeFrames = 0;
+	_missedCount = 0;
+	_latencyHistogram.Clear();
+}
+
+void FramePacer::AddRenderTime(int64_t cpuTime, int64_t gpuTime) noexcept {
+	if (gpuTime >= 0) {
+		_lastGPUTime = gpuTime;
+	}
+
+	// CPU 和 GPU 的执行有重叠，两者相加偏保守
+	_renderTimes[_nextRenderTimeIdx] = cpuTime + _lastGPUTime;
+	_nextRenderTimeIdx = (_nextRenderTimeIdx + 1) % SAMPLE_COUNT;
+	_renderTimeCount = std::min(_renderTimeCount + 1, SAMPLE_COUNT);
+
+	_UpdatePrediction();
+}
+
+void FramePacer::_UpdatePrediction() noexcept {
+	// 使用 90% 分位数，偶尔的尖峰由余量吸收
+	std::array<int64_t, SAMPLE_COUNT> sorted = _renderTimes;
+	const uint32_t idx = _renderTimeCount * 9 / 10;
+	std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.begin() + _renderTimeCount);
+	_predictedRenderTime = sorted[idx];
+}
+
+int64_t FramePacer::CalcRenderStartTime(int64_t now, int64_t lastVBlank, int64_t refreshPeriod) noexcept {
+	_refreshPeriod = refreshPeriod;
+	_targetVBlank = -1;
+
+	if (refreshPeriod <= 0 || _renderTimeCount == 0) {
+		return now;
+	}
+
+	int64_t nextVBlank = lastVBlank + refreshPeriod;
+	if (nextVBlank <= now) {
+		nextVBlank += ((now - nextVBlank) / refreshPeriod + 1) * refreshPeriod;
+	}
+
+	const int64_t renderTime = GetPredictedRenderTime();
+	const int64_t startTime = nextVBlank - renderTime;
+	if (startTime <= now) {
+		// 来不及在下一次垂直同步前完成，立即开始，推迟只会增加延迟
+		const int64_t endTime = now + renderTime;
+		_targetVBlank = nextVBlank + (endTime - nextVBlank + refreshPeriod - 1) / refreshPeriod * refreshPeriod;
+		return now;
+	}
+
+	_targetVBlank = nextVBlank;
+	return startTime;
+}
+
+void FramePacer::OnPresented(int64_t captureTime, int64_t presentTime, uint32_t presentCount) noexcept {
+	if (captureTime >= 0 && presentTime >= captureTime) {
+		_latencyHistogram.Add(presentTime - captureTime);
+	}
+
+	if (_targetVBlank < 0) {
+		return;
+	}
+
+	if (_pendingPresentCount == MAX_PENDING_PRESENTS) {
+		// 一直没有得到显示时间，丢弃最早的
+		std::move(_pendingPresents.begin() + 1, _pendingPresents.end(), _pendingPresents.begin());
+		--_pendingPresentCount;
+	}
+	_pendingPresents[_pendingPresentCount++] = { presentCount, _targetVBlank };
+
+	_targetVBlank = -1;
+}
+
+void FramePacer::OnFrameStatistics(
+	uint32_t presentCount,
+	uint32_t presentRefreshCount,
+	uint32_t syncRefreshCount,
+	int64_t syncTime
+) noexcept {
+	// 更早的帧已被后来的帧取代，无法得知它们的显示时间
+	uint32_t idx = 0;
+	while (idx < _pendingPresentCount && (int32_t)(_pendingPresents[idx].presentCount - presentCount) < 0) {
+		++idx;
+	}
+
+	if (idx == _pendingPresentCount || _pendingPresents[idx].presentCount != presentCount) {
+		std::move(_pendingPresents.begin() + idx, _pendingPresents.end(), _pendingPresents.begin());
+		_pendingPresentCount -= idx;
+		return;
+	}
+
+	const int64_t targetVBlank = _pendingPresents[idx].targetVBlank;
+	std::move(_pendingPresents.begin() + idx + 1, _pendingPresents.end(), _pendingPresents.begin());
+	_pendingPresentCount -= idx + 1;
+
+	if (_refreshPeriod <= 0) {
+		return;
+	}
+
+	// SyncQPCTime 对应的垂直同步可能晚于这一帧显示的垂直同步
+	const int64_t displayTime = syncTime - int64_t(syncRefreshCount - presentRefreshCount) * _refreshPeriod;
+	const int64_t offset = displayTime - targetVBlank;
+
+	int64_t baseline = offset;
+	if (_displayOffsetCount > 0) {
+		baseline = *std::min_element(_displayOffsets.begin(), _displayOffsets.begin() + _displayOffsetCount);
+	}
+	// 合成最多使帧晚一次垂直同步
+	baseline = std::clamp(baseline, (int64_t)0, _refreshPeriod);
+
+	if (offset > baseline + _refreshPeriod / 2) {
+		// 错过了瞄准的垂直同步，增大余量
+		++_missedCount;
+		_onTimeFrames = 0;
+		_margin = std::max(std::min(_margin + MARGIN_STEP, _refreshPeriod / 2), MIN_MARGIN);
+		return;
+	}
+
+	_displayOffsets[_nextDisplayOffsetIdx] = offset;
+	_nextDisplayOffsetIdx = (_nextDisplayOffsetIdx + 1) % ON_TIME_FRAMES_TO_SHRINK;
+	_displayOffsetCount = std::min(_displayOffsetCount + 1, ON_TIME_FRAMES_TO_SHRINK);
+
+	if (++_onTimeFrames >= ON_TIME_FRAMES_TO_SHRINK) {
+		_onTimeFrames = 0;
+		_margin = std::max(_margin - MARGIN_STEP / 5, MIN_MARGIN);
+	}
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+namespace Magpie::Core {
+
+// 延迟的分布，单位为微秒
+class LatencyHistogram {
+public:
+	static constexpr int64_t BUCKET_WIDTH = 500;
+	// 最后一个桶包含所有超出范围的样本
+	static constexpr uint32_t BUCKET_COUNT = 100;
+
+	void Add(int64_t latency) noexcept;
+
+	void Clear() noexcept;
+
+	uint32_t GetCount() const noexcept {
+		return _count;
+	}
+
+	// p 的范围为 [0, 1]，返回所在桶的上界
+	int64_t GetPercentile(float p) const noexcept;
+
+	const std::array<uint32_t, BUCKET_COUNT>& GetBuckets() const noexcept {
+		return _buckets;
+	}
+
+	// 用于日志，省略空桶
+	std::string ToString() const;
+
+private:
+	std::array<uint32_t, BUCKET_COUNT> _buckets{};
+	uint32_t _count = 0;
+};
+
+// 帧调度，推迟开始渲染的时间，使渲染恰好在下一次垂直同步前完成，以减小捕获到呈现的延迟
+// 不涉及 D3D 和计时，时间的单位均为微秒
+class FramePacer {
+public:
+	void Initialize() noexcept;
+
+	// 一帧从开始捕获到 Present 返回的 CPU 用时和效果的 GPU 用时，GPU 用时未知时为负
+	void AddRenderTime(int64_t cpuTime, int64_t gpuTime) noexcept;
+
+	// lastVBlank 为最近一次垂直同步的时间。渲染来不及时返回 now，即立即开始
+	int64_t CalcRenderStartTime(int64_t now, int64_t lastVBlank, int64_t refreshPeriod) noexcept;
+
+	// 每次 Present 后调用，captureTime 为这一帧捕获的时间，没有新帧时为负
+	// presentCount 为这次 Present 的序号，用于之后匹配实际显示的时间
+	void OnPresented(int64_t captureTime, int64_t presentTime, uint32_t presentCount) noexcept;
+
+	// 参数和 DXGI_FRAME_STATISTICS 的同名字段相同，syncTime 为 SyncQPCTime 转换后的时间
+	// Present 在帧入队时即返回，只有实际显示的时间才能判断是否错过了瞄准的垂直同步，据此调整余量
+	void OnFrameStatistics(
+		uint32_t presentCount,
+		uint32_t presentRefreshCount,
+		uint32_t syncRefreshCount,
+		int64_t syncTime
+	) noexcept;
+
+	// 预测的渲染用时，包含余量
+	int64_t GetPredictedRenderTime() const noexcept {
+		return _predictedRenderTime + _margin;
+	}
+
+	uint32_t GetMissedCount() const noexcept {
+		return _missedCount;
+	}
+
+	// 捕获到呈现的延迟
+	const LatencyHistogram& GetLatencyHistogram() const noexcept {
+		return _latencyHistogram;
+	}
+
+private:
+	void _UpdatePrediction() noexcept;
+
+	static constexpr uint32_t SAMPLE_COUNT = 32;
+	static constexpr int64_t MIN_MARGIN = 1000;
+	static constexpr int64_t MARGIN_STEP = 500;
+	// 连续按时呈现这么多帧后减小余量
+	static constexpr uint32_t ON_TIME_FRAMES_TO_SHRINK = 120;
+	static constexpr uint32_t MAX_PENDING_PRESENTS = 8;
+
+	// 最近的渲染用时，循环使用
+	std::array<int64_t, SAMPLE_COUNT> _renderTimes{};
+	uint32_t _renderTimeCount = 0;
+	uint32_t _nextRenderTimeIdx = 0;
+	// 最近一次得到的 GPU 用时，GPU 的结果通常晚几帧才能得到
+	int64_t _lastGPUTime = 0;
+
+	int64_t _predictedRenderTime = 0;
+	int64_t _margin = MIN_MARGIN;
+	int64_t _refreshPeriod = 0;
+
+	// 本帧瞄准的垂直同步，为负表示未调度
+	int64_t _targetVBlank = -1;
+
+	// 已调度但尚未得知显示时间的帧，按序号排列
+	struct _PendingPresent {
+		uint32_t presentCount;
+		int64_t targetVBlank;
+	};
+	std::array<_PendingPresent, MAX_PENDING_PRESENTS> _pendingPresents{};
+	uint32_t _pendingPresentCount = 0;
+
+	// 最近按时显示的帧实际显示的时间和瞄准的垂直同步之差，循环使用
+	// DWM 合成可能使所有帧都晚一次垂直同步，因此以其中的最小值为基准
+	std::array<int64_t, ON_TIME_FRAMES_TO_SHRINK> _displayOffsets{};
+	uint32_t _displayOffsetCount = 0;
+	uint32_t _nextDisplayOffsetIdx = 0;
+
+	uint32_t _onTimeFrames = 0;
+	uint32_t _missedCount = 0;
+
+	LatencyHistogram _latencyHistogram;
+};
+
+}
@@ -28,12 +28,34 @@ public:
 	// 注意：此函数返回源窗口作为输入部分的位置，但可能和 GetOutput 获取到的纹理尺寸不同
 	const RECT& GetSrcFrameRect() const noexcept { return _srcFrameRect; }
 
+	// 可能每帧不同，但尺寸和格式不变
 	ID3D11Texture2D* GetOutput() {
 		return _output.get();
 	}
 
+	// 上次 Update 返回 NewFrame 时帧中变化的区域，坐标系为 GetOutput 返回的纹理
+	// 返回空表示不知道变化的区域，此时应认为整个帧都已改变
+	const RECT* GetDirtyRect() const noexcept {
+		return _dirtyRect.left < _dirtyRect.right && _dirtyRect.top < _dirtyRect.bottom ? &_dirtyRect : nullptr;
+	}
+
+	// 上次 Update 返回 NewFrame 时这一帧被捕获的时间，为 QueryPerformanceCounter 的计数，0 表示未知
+	int64_t GetFrameTime() const noexcept {
+		return _frameTime;
+	}
+
 	virtual const char* GetName() const noexcept = 0;
 
+	// 捕获方式来不及接收而被系统丢弃的帧数
+	virtual uint32_t GetDroppedFrameCount() const noexcept {
+		return 0;
+	}
+
+	// 已捕获但被渲染前就被更新的帧取代的帧数
+	virtual uint32_t GetOverwrittenFrameCount() const noexcept {
+		return 0;
+	}
+
 protected:
 	virtual bool _HasRoundCornerInWin11() = 0;
 
@@ -56,6 +78,11 @@ protected:
 
 	winrt::com_ptr<ID3D11Texture2D> _output;
 
+	// 只有能检测出变化区域的捕获方式才设置
+	RECT _dirtyRect{};
+
+	int64_t _frameTime = 0;
+
 	bool _roundCornerDisabled = false;
 	bool _windowResizingDisabled = false;
 };
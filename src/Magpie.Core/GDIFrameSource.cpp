@@ -3,10 +3,55 @@
 #include "MagApp.h"
 #include "DeviceResources.h"
 #include "Logger.h"
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
 
 
 namespace Magpie::Core {
 
+// 间隔不超过这么多行的条带合并上传，以减少 UpdateSubresource 的调用次数
+static constexpr uint32_t STRIPE_MERGE_GAP = 8;
+
+static bool IsRowEqual(const uint8_t* row1, const uint8_t* row2, uint32_t size) noexcept {
+	uint32_t i = 0;
+#if defined(_M_X64) || defined(_M_IX86)
+	// 每次比较 64 个字节
+	for (; i + 64 <= size; i += 64) {
+		const __m128i c0 = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(row1 + i)), _mm_loadu_si128((const __m128i*)(row2 + i)));
+		const __m128i c1 = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(row1 + i + 16)), _mm_loadu_si128((const __m128i*)(row2 + i + 16)));
+		const __m128i c2 = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(row1 + i + 32)), _mm_loadu_si128((const __m128i*)(row2 + i + 32)));
+		const __m128i c3 = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(row1 + i + 48)), _mm_loadu_si128((const __m128i*)(row2 + i + 48)));
+		const __m128i all = _mm_and_si128(_mm_and_si128(c0, c1), _mm_and_si128(c2, c3));
+		if (_mm_movemask_epi8(all) != 0xFFFF) {
+			return false;
+		}
+	}
+#endif
+
+	return std::memcmp(row1 + i, row2 + i, size - i) == 0;
+}
+
+GDIFrameSource::~GDIFrameSource() {
+	_StopPipeline();
+
+	for (_DibBuffer& buffer : _dibBuffers) {
+		if (buffer.hdc) {
+			if (buffer.hOldBitmap) {
+				SelectObject(buffer.hdc, buffer.hOldBitmap);
+			}
+			DeleteDC(buffer.hdc);
+		}
+		if (buffer.hBitmap) {
+			DeleteObject(buffer.hBitmap);
+		}
+	}
+}
+
 bool GDIFrameSource::Initialize() {
 	if (!FrameSourceBase::Initialize()) {
 		Logger::Get().Error("初始化 FrameSourceBase 失败");
@@ -57,22 +102,56 @@ bool GDIFrameSource::Initialize() {
 		return false;
 	}
 
-	_output = MagApp::Get().GetDeviceResources().CreateTexture2D(
-		DXGI_FORMAT_B8G8R8A8_UNORM,
-		_frameRect.right - _frameRect.left,
-		_frameRect.bottom - _frameRect.top,
-		D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET,
-		D3D11_USAGE_DEFAULT,
-		D3D11_RESOURCE_MISC_GDI_COMPATIBLE
-	);
-	if (!_output) {
-		Logger::Get().Error("创建纹理失败");
+	const LONG frameWidth = _frameRect.right - _frameRect.left;
+	const LONG frameHeight = _frameRect.bottom - _frameRect.top;
+
+	// 自上而下的 32 位 DIB，内存布局和 DXGI_FORMAT_B8G8R8A8_UNORM 相同
+	BITMAPINFO bi{};
+	bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
+	bi.bmiHeader.biWidth = frameWidth;
+	bi.bmiHeader.biHeight = -frameHeight;
+	bi.bmiHeader.biPlanes = 1;
+	bi.bmiHeader.biBitCount = 32;
+	bi.bmiHeader.biCompression = BI_RGB;
+
+	for (_DibBuffer& buffer : _dibBuffers) {
+		buffer.hdc = CreateCompatibleDC(NULL);
+		if (!buffer.hdc) {
+			Logger::Get().Win32Error("CreateCompatibleDC 失败");
+			return false;
+		}
+
+		void* bits = nullptr;
+		buffer.hBitmap = CreateDIBSection(buffer.hdc, &bi, DIB_RGB_COLORS, &bits, NULL, 0);
+		if (!buffer.hBitmap) {
+			Logger::Get().Win32Error("CreateDIBSection 失败");
+			return false;
+		}
+		buffer.bits = (const uint8_t*)bits;
+		buffer.hOldBitmap = SelectObject(buffer.hdc, buffer.hBitmap);
+	}
+
+	if (!_InitializePipeline(DXGI_FORMAT_B8G8R8A8_UNORM, frameWidth, frameHeight)) {
+		Logger::Get().Error("_InitializePipeline 失败");
+		return false;
+	}
+
+	D3D11_TEXTURE2D_DESC desc{};
+	desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	desc.Width = frameWidth;
+	desc.Height = frameHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	HRESULT hr = _captureD3DDevice->CreateTexture2D(&desc, nullptr, _frameTexture.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("创建 Texture2D 失败", hr);
 		return false;
 	}
 
-	_dxgiSurface = _output.try_as<IDXGISurface1>();
-	if (!_dxgiSurface) {
-		Logger::Get().Error("从 Texture2D 获取 IDXGISurface1 失败");
+	if (!_StartPipeline()) {
+		Logger::Get().Error("_StartPipeline 失败");
 		return false;
 	}
 
@@ -80,33 +159,86 @@ bool GDIFrameSource::Initialize() {
 	return true;
 }
 
-FrameSourceBase::UpdateState GDIFrameSource::Update() {
-	HWND hwndSrc = MagApp::Get().GetHwndSrc();
-
-	HDC hdcDest;
-	HRESULT hr = _dxgiSurface->GetDC(TRUE, &hdcDest);
-	if (FAILED(hr)) {
-		Logger::Get().ComError("从 Texture2D 获取 IDXGISurface1 失败", hr);
-		return UpdateState::Error;
+bool GDIFrameSource::_CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) {
+	// GDI 没有新帧的通知，以 DWM 合成的频率轮询
+	if (FAILED(DwmFlush())) {
+		Sleep(1);
 	}
 
+	const uint32_t frameWidth = uint32_t(_frameRect.right - _frameRect.left);
+	const uint32_t frameHeight = uint32_t(_frameRect.bottom - _frameRect.top);
+
+	HWND hwndSrc = MagApp::Get().GetHwndSrc();
 	HDC hdcSrc = GetDCEx(hwndSrc, NULL, DCX_LOCKWINDOWUPDATE | DCX_WINDOW);
 	if (!hdcSrc) {
 		Logger::Get().Win32Error("GetDC 失败");
-		_dxgiSurface->ReleaseDC(nullptr);
-		return UpdateState::Error;
+		_ReportCaptureError();
+		return false;
 	}
 
-	if (!BitBlt(hdcDest, 0, 0, _frameRect.right - _frameRect.left, _frameRect.bottom - _frameRect.top,
-		hdcSrc, _frameRect.left, _frameRect.top, SRCCOPY)
-		) {
+	const _DibBuffer& curBuffer = _dibBuffers[_curDibBuffer];
+	const BOOL succeeded = BitBlt(curBuffer.hdc, 0, 0, frameWidth, frameHeight,
+		hdcSrc, _frameRect.left, _frameRect.top, SRCCOPY);
+	ReleaseDC(hwndSrc, hdcSrc);
+
+	if (!succeeded) {
 		Logger::Get().Win32Error("BitBlt 失败");
+		_ReportCaptureError();
+		return false;
 	}
 
-	ReleaseDC(hwndSrc, hdcSrc);
-	_dxgiSurface->ReleaseDC(nullptr);
+	// 直接访问 DIB 的内存前须确保 GDI 已完成绘制
+	GdiFlush();
+
+	const uint32_t rowPitch = frameWidth * 4;
+	const uint8_t* prevBits = _dibBuffers[_curDibBuffer ^ 1].bits;
+
+	// 找出变化的行，相邻的合并为条带后上传
+	uint32_t dirtyTop = frameHeight;
+	uint32_t dirtyBottom = 0;
+	uint32_t stripeTop = 0;
+	uint32_t stripeBottom = 0;
+	auto uploadStripe = [&]() {
+		const D3D11_BOX box{ 0, stripeTop, 0, frameWidth, stripeBottom, 1 };
+		_captureD3DDC->UpdateSubresource(_frameTexture.get(), 0, &box,
+			curBuffer.bits + (size_t)stripeTop * rowPitch, rowPitch, 0);
+		dirtyTop = std::min(dirtyTop, stripeTop);
+		dirtyBottom = stripeBottom;
+	};
+
+	for (uint32_t y = 0; y < frameHeight; ++y) {
+		const size_t offset = (size_t)y * rowPitch;
+		if (_hasPrevFrame && IsRowEqual(curBuffer.bits + offset, prevBits + offset, rowPitch)) {
+			continue;
+		}
+
+		if (stripeBottom != 0 && y <= stripeBottom + STRIPE_MERGE_GAP) {
+			stripeBottom = y + 1;
+		} else {
+			if (stripeBottom != 0) {
+				uploadStripe();
+			}
+			stripeTop = y;
+			stripeBottom = y + 1;
+		}
+	}
+	if (stripeBottom != 0) {
+		uploadStripe();
+	}
+
+	_curDibBuffer ^= 1;
+	_hasPrevFrame = true;
 
-	return UpdateState::NewFrame;
+	if (dirtyBottom == 0) {
+		// 画面没有变化
+		return false;
+	}
+
+	// 环形缓冲区中的纹理内容较旧，需完整复制，但只在 GPU 上进行
+	_captureD3DDC->CopyResource(target, _frameTexture.get());
+
+	dirtyRect = { 0, (LONG)dirtyTop, (LONG)frameWidth, (LONG)dirtyBottom };
+	return true;
 }
 
 }
@@ -1,17 +1,16 @@
 #pragma once
-#include "FrameSourceBase.h"
+#include "PipelinedFrameSourceBase.h"
 
 namespace Magpie::Core {
 
-class GDIFrameSource : public FrameSourceBase {
+// 在捕获线程中将源窗口 BitBlt 到 DIB，逐行比较后只上传变化的条带
+class GDIFrameSource : public PipelinedFrameSourceBase {
 public:
 	GDIFrameSource() {};
-	virtual ~GDIFrameSource() {}
+	virtual ~GDIFrameSource();
 
 	bool Initialize() override;
 
-	UpdateState Update() override;
-
 	bool IsScreenCapture() override {
 		return false;
 	}
@@ -29,9 +28,24 @@ protected:
 		return false;
 	}
 
+	bool _CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) override;
+
 private:
 	RECT _frameRect{};
-	winrt::com_ptr<IDXGISurface1> _dxgiSurface;
+
+	// 交替使用，一个保存这一帧，另一个保存上一帧用于比较
+	struct _DibBuffer {
+		HDC hdc = NULL;
+		HBITMAP hBitmap = NULL;
+		HGDIOBJ hOldBitmap = NULL;
+		const uint8_t* bits = nullptr;
+	};
+	std::array<_DibBuffer, 2> _dibBuffers;
+	uint32_t _curDibBuffer = 0;
+	bool _hasPrevFrame = false;
+
+	// 捕获设备上的完整画面，只更新变化的条带
+	winrt::com_ptr<ID3D11Texture2D> _frameTexture;
 };
 
 }
@@ -0,0 +1,225 @@
+#include "pch.h"
+#include "GPUTileDiffer.h"
+#include "DirectXHelper.h"
+#include "Logger.h"
+
+namespace Magpie::Core {
+
+// 每个线程组处理一个块
+static constexpr const char* TILE_DIFF_SHADER = R"(Texture2D<float4> cur : register(t0);
+Texture2D<float4> prev : register(t1);
+RWBuffer<uint> tileBounds : register(u0);
+
+groupshared uint changed;
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 tid : SV_GroupThreadID, uint3 gid : SV_GroupID, uint3 dtid : SV_DispatchThreadID) {
+	if (tid.x == 0 && tid.y == 0) {
+		changed = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	uint2 size;
+	cur.GetDimensions(size.x, size.y);
+	if (all(dtid.xy < size) && any(cur[dtid.xy] != prev[dtid.xy])) {
+		InterlockedOr(changed, 1u);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (tid.x != 0 || tid.y != 0 || !changed) {
+		return;
+	}
+
+	InterlockedMax(tileBounds[0], ~gid.x);
+	InterlockedMax(tileBounds[1], ~gid.y);
+	InterlockedMax(tileBounds[2], gid.x + 1);
+	InterlockedMax(tileBounds[3], gid.y + 1);
+}
+)";
+
+bool GPUTileDiffer::Initialize(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dDC, ID3D11Texture2D* input) {
+	_d3dDevice.copy_from(d3dDevice);
+
+	// 需要 ID3D11Fence
+	winrt::com_ptr<ID3D11Device5> d3dDevice5 = _d3dDevice.try_as<ID3D11Device5>();
+	HRESULT hr = d3dDC->QueryInterface(IID_PPV_ARGS(_d3dDC.put()));
+	if (!d3dDevice5 || FAILED(hr)) {
+		Logger::Get().Error("获取 ID3D11Device5 或 ID3D11DeviceContext4 失败");
+		return false;
+	}
+
+	D3D11_TEXTURE2D_DESC inputDesc;
+	input->GetDesc(&inputDesc);
+	_inputSize = { (LONG)inputDesc.Width, (LONG)inputDesc.Height };
+
+	D3D11_TEXTURE2D_DESC desc{};
+	desc.Format = inputDesc.Format;
+	desc.Width = inputDesc.Width;
+	desc.Height = inputDesc.Height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	hr = d3dDevice->CreateTexture2D(&desc, nullptr, _prevFrame.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateTexture2D 失败", hr);
+		return false;
+	}
+
+	hr = d3dDevice->CreateShaderResourceView(_prevFrame.get(), nullptr, _prevFrameSRV.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateShaderResourceView 失败", hr);
+		return false;
+	}
+
+	static winrt::com_ptr<ID3DBlob> shaderBlob;
+	if (!shaderBlob) {
+		if (!DirectXHelper::CompileComputeShader(TILE_DIFF_SHADER, "main", shaderBlob.put(), nullptr, nullptr,
+			{ { "TILE_SIZE", std::to_string(TILE_SIZE) } })) {
+			Logger::Get().Error("编译块比较着色器失败");
+			return false;
+		}
+	}
+
+	D3D11_BUFFER_DESC bd{};
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = 16;
+	bd.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	hr = d3dDevice->CreateBuffer(&bd, nullptr, _tileBounds.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateBuffer 失败", hr);
+		return false;
+	}
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = 4;
+	hr = d3dDevice->CreateUnorderedAccessView(_tileBounds.get(), &uavDesc, _tileBoundsUAV.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateUnorderedAccessView 失败", hr);
+		return false;
+	}
+
+	bd.Usage = D3D11_USAGE_STAGING;
+	bd.BindFlags = 0;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	hr = d3dDevice->CreateBuffer(&bd, nullptr, _tileBoundsReadback.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateBuffer 失败", hr);
+		return false;
+	}
+
+	hr = d3dDevice5->CreateFence(0, D3D11_FENCE_FLAG_NONE, IID_PPV_ARGS(_fence.put()));
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateFence 失败", hr);
+		return false;
+	}
+
+	_fenceEvent.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	if (!_fenceEvent) {
+		Logger::Get().Win32Error("CreateEvent 失败");
+		return false;
+	}
+
+	// 最后创建，IsInitialized 只在所有资源都创建成功后返回 true
+	hr = d3dDevice->CreateComputeShader(
+		shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, _shader.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateComputeShader 失败", hr);
+		return false;
+	}
+
+	return true;
+}
+
+ID3D11ShaderResourceView* GPUTileDiffer::_GetInputSRV(ID3D11Texture2D* input) {
+	auto it = std::find_if(_inputSRVs.begin(), _inputSRVs.end(),
+		[input](const auto& pair) { return pair.first == input; });
+	if (it != _inputSRVs.end()) {
+		return it->second.get();
+	}
+
+	winrt::com_ptr<ID3D11ShaderResourceView> srv;
+	HRESULT hr = _d3dDevice->CreateShaderResourceView(input, nullptr, srv.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateShaderResourceView 失败", hr);
+		return nullptr;
+	}
+
+	return _inputSRVs.emplace_back(input, std::move(srv)).second.get();
+}
+
+bool GPUTileDiffer::Diff(ID3D11Texture2D* input, RECT& dirtyRect, DWORD timeout) {
+	const RECT fullRect{ 0, 0, _inputSize.cx, _inputSize.cy };
+
+	if (_isFirstFrame) {
+		_isFirstFrame = false;
+		_d3dDC->CopyResource(_prevFrame.get(), input);
+		dirtyRect = fullRect;
+		return true;
+	}
+
+	ID3D11ShaderResourceView* srvs[2] = { _GetInputSRV(input), _prevFrameSRV.get() };
+	if (!srvs[0]) {
+		return false;
+	}
+
+	static const UINT ZEROS[4]{};
+	_d3dDC->ClearUnorderedAccessViewUint(_tileBoundsUAV.get(), ZEROS);
+
+	ID3D11UnorderedAccessView* uav = _tileBoundsUAV.get();
+	_d3dDC->CSSetShader(_shader.get(), nullptr, 0);
+	_d3dDC->CSSetShaderResources(0, 2, srvs);
+	_d3dDC->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
+	_d3dDC->Dispatch(
+		(_inputSize.cx + TILE_SIZE - 1) / TILE_SIZE,
+		(_inputSize.cy + TILE_SIZE - 1) / TILE_SIZE,
+		1
+	);
+
+	// 解除绑定，捕获方式随后会写入 input
+	static ID3D11ShaderResourceView* const NULL_SRVS[2]{};
+	static ID3D11UnorderedAccessView* const NULL_UAV = nullptr;
+	_d3dDC->CSSetShaderResources(0, 2, NULL_SRVS);
+	_d3dDC->CSSetUnorderedAccessViews(0, 1, &NULL_UAV, nullptr);
+
+	_d3dDC->CopyResource(_prevFrame.get(), input);
+	_d3dDC->CopyResource(_tileBoundsReadback.get(), _tileBounds.get());
+
+	// 不在 Map 中等待 GPU，超时后将整帧视为有变化，结果留给 GPU 在后台完成
+	_d3dDC->Signal(_fence.get(), ++_fenceValue);
+	HRESULT hr = _fence->SetEventOnCompletion(_fenceValue, _fenceEvent.get());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("SetEventOnCompletion 失败", hr);
+		return false;
+	}
+	_d3dDC->Flush();
+
+	if (WaitForSingleObject(_fenceEvent.get(), timeout) != WAIT_OBJECT_0) {
+		dirtyRect = fullRect;
+		return true;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE ms;
+	hr = _d3dDC->Map(_tileBoundsReadback.get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &ms);
+	if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+		dirtyRect = fullRect;
+		return true;
+	}
+	if (FAILED(hr)) {
+		Logger::Get().ComError("Map 失败", hr);
+		return false;
+	}
+
+	TileDiffer::Bounds bounds;
+	std::memcpy(bounds.data(), ms.pData, sizeof(bounds));
+	_d3dDC->Unmap(_tileBoundsReadback.get(), 0);
+
+	// 和 CPU 实现使用相同的转换
+	dirtyRect = TileDiffer::BoundsToRect(bounds, _inputSize.cx, _inputSize.cy);
+	return true;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "SmallVector.h"
+#include "Win32Utils.h"
+#include "TileDiffer.h"
+
+namespace Magpie::Core {
+
+// 在 GPU 上比较帧和上一帧，用于无法获知变化区域的捕获方式
+// 在捕获线程中使用捕获设备，渲染线程从不等待比较结果
+// 结果和 CPU 实现 TileDiffer 一致
+class GPUTileDiffer {
+public:
+	static constexpr uint32_t TILE_SIZE = TileDiffer::TILE_SIZE;
+
+	// 超过这个时间没有完成比较则认为整帧都有变化，单位为毫秒
+	static constexpr DWORD DIFF_TIMEOUT = 8;
+
+	GPUTileDiffer() = default;
+	GPUTileDiffer(const GPUTileDiffer&) = delete;
+	GPUTileDiffer(GPUTileDiffer&&) = delete;
+
+	bool Initialize(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dDC, ID3D11Texture2D* input);
+
+	bool IsInitialized() const noexcept {
+		return (bool)_shader;
+	}
+
+	// 比较 input 和上次调用时的内容，dirtyRect 为有变化的块的外接矩形，没有变化时为空
+	// 第一次调用或未能在 timeout 毫秒内读回结果时 dirtyRect 为整个 input
+	// input 可以和 Initialize 时不同，但尺寸和格式须相同
+	bool Diff(ID3D11Texture2D* input, RECT& dirtyRect, DWORD timeout = DIFF_TIMEOUT);
+
+private:
+	ID3D11ShaderResourceView* _GetInputSRV(ID3D11Texture2D* input);
+
+	winrt::com_ptr<ID3D11Device> _d3dDevice;
+	winrt::com_ptr<ID3D11DeviceContext4> _d3dDC;
+
+	SIZE _inputSize{};
+	winrt::com_ptr<ID3D11Texture2D> _prevFrame;
+	winrt::com_ptr<ID3D11ShaderResourceView> _prevFrameSRV;
+	// 帧源轮流使用的纹理
+	SmallVector<std::pair<ID3D11Texture2D*, winrt::com_ptr<ID3D11ShaderResourceView>>, 3> _inputSRVs;
+
+	winrt::com_ptr<ID3D11ComputeShader> _shader;
+
+	// 有变化的块的范围，为 (~left, ~top, right, bottom)，以便都使用 InterlockedMax
+	winrt::com_ptr<ID3D11Buffer> _tileBounds;
+	winrt::com_ptr<ID3D11UnorderedAccessView> _tileBoundsUAV;
+	winrt::com_ptr<ID3D11Buffer> _tileBoundsReadback;
+
+	// 比较完成时发出信号，等待时不占用 CPU
+	winrt::com_ptr<ID3D11Fence> _fence;
+	uint64_t _fenceValue = 0;
+	Win32Utils::ScopedHandle _fenceEvent;
+
+	bool _isFirstFrame = true;
+};
+
+}
@@ -2,6 +2,7 @@
 #include "GPUTimer.h"
 #include "MagApp.h"
 #include "DeviceResources.h"
+#include "Logger.h"
 
 
 namespace Magpie::Core {
@@ -52,7 +53,51 @@ void GPUTimer::StopProfiling() {
 	_gpuTimings = {};
 }
 
+void GPUTimer::StartFrameTiming() {
+	if (_isFrameTiming) {
+		return;
+	}
+
+	auto d3dDevice = MagApp::Get().GetDeviceResources().GetD3DDevice();
+	for (_FrameQueryInfo& info : _frameQueries) {
+		D3D11_QUERY_DESC desc{ D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+		d3dDevice->CreateQuery(&desc, info.disjoint.put());
+
+		desc.Query = D3D11_QUERY_TIMESTAMP;
+		d3dDevice->CreateQuery(&desc, info.start.put());
+		d3dDevice->CreateQuery(&desc, info.end.put());
+
+		if (!info.disjoint || !info.start || !info.end) {
+			Logger::Get().Error("创建查询失败");
+			_frameQueries = {};
+			return;
+		}
+	}
+
+	_curFrameQueryIdx = 0;
+	_lastFrameGPUTime = -1.0f;
+	_isFrameTiming = true;
+}
+
+void GPUTimer::StopFrameTiming() {
+	_isFrameTiming = false;
+	_frameQueries = {};
+	_lastFrameGPUTime = -1.0f;
+}
+
 void GPUTimer::OnBeginEffects() {
+	if (_isFrameTiming) {
+		_CollectFrameTimings();
+
+		_FrameQueryInfo& info = _frameQueries[_curFrameQueryIdx];
+		// 太久没有完成的查询直接覆盖
+		info.isPending = false;
+
+		auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
+		d3dDC->Begin(info.disjoint.get());
+		d3dDC->End(info.start.get());
+	}
+
 	if (_curQueryIdx < 0) {
 		return;
 	}
@@ -73,6 +118,17 @@ void GPUTimer::OnEndPass(UINT idx) {
 }
 
 void GPUTimer::OnEndEffects() {
+	if (_isFrameTiming) {
+		_FrameQueryInfo& info = _frameQueries[_curFrameQueryIdx];
+
+		auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
+		d3dDC->End(info.end.get());
+		d3dDC->End(info.disjoint.get());
+		info.isPending = true;
+
+		_curFrameQueryIdx = (_curFrameQueryIdx + 1) % (uint32_t)_frameQueries.size();
+	}
+
 	if (_curQueryIdx < 0) {
 		return;
 	}
@@ -80,6 +136,37 @@ void GPUTimer::OnEndEffects() {
 	MagApp::Get().GetDeviceResources().GetD3DDC()->End(_queries[_curQueryIdx].disjoint.get());
 }
 
+void GPUTimer::_CollectFrameTimings() {
+	auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
+
+	// 从最早的一组开始，遇到未完成的查询即停止
+	for (uint32_t i = 0; i < (uint32_t)_frameQueries.size(); ++i) {
+		_FrameQueryInfo& info = _frameQueries[(_curFrameQueryIdx + i) % _frameQueries.size()];
+		if (!info.isPending) {
+			continue;
+		}
+
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+		if (d3dDC->GetData(info.disjoint.get(), &disjointData, sizeof(disjointData), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			break;
+		}
+
+		UINT64 start = 0;
+		UINT64 end = 0;
+		if (d3dDC->GetData(info.start.get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK
+			|| d3dDC->GetData(info.end.get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			break;
+		}
+
+		info.isPending = false;
+
+		if (!disjointData.Disjoint && end >= start) {
+			_lastFrameGPUTime = (end - start) * 1000.0f / disjointData.Frequency;
+			++_frameGPUTimeCount;
+		}
+	}
+}
+
 template<typename T>
 static T GetQueryData(ID3D11DeviceContext3* d3dDC, ID3D11Query* query) {
 	T data{};
@@ -142,6 +229,7 @@ void GPUTimer::_UpdateGPUTimings() {
 			for (UINT i = 0; i < _passesTimings.size(); ++i) {
 				_gpuTimings.passes[i] = _passesTimings[i].first;
 			}
+			++_gpuTimings.updateCount;
 		} else if (_profilingCounter >= _updateProfilingTime) {
 			// 更新渲染用时
 			for (UINT i = 0; i < _passesTimings.size(); ++i) {
@@ -150,6 +238,7 @@ void GPUTimer::_UpdateGPUTimings() {
 			}
 
 			std::fill(_passesTimings.begin(), _passesTimings.end(), std::pair<float, UINT>());
+			++_gpuTimings.updateCount;
 
 			_profilingCounter %= _updateProfilingTime;
 		}
@@ -23,6 +23,8 @@ public:
 
 	struct GPUTimings {
 		SmallVector<float> passes;
+		// 每次更新加一
+		uint32_t updateCount = 0;
 		// float overlay = 0.0f;
 	};
 
@@ -37,6 +39,10 @@ public:
 
 	void StopProfiling();
 
+	bool IsProfiling() const noexcept {
+		return _curQueryIdx >= 0;
+	}
+
 	void OnBeginEffects();
 
 	// 每个通道结束后调用
@@ -44,9 +50,26 @@ public:
 
 	void OnEndEffects();
 
+	// 只测量每帧所有效果的总用时，不在通道间插入查询，因此不影响命令列表
+	void StartFrameTiming();
+
+	void StopFrameTiming();
+
+	// 最近完成测量的一帧的效果用时，单位为 ms，尚无结果时为负
+	float GetLastFrameGPUTime() const noexcept {
+		return _lastFrameGPUTime;
+	}
+
+	// 每得到一帧的效果用时加一，用于判断是否有新的结果
+	uint32_t GetFrameGPUTimeCount() const noexcept {
+		return _frameGPUTimeCount;
+	}
+
 private:
 	void _UpdateGPUTimings();
 
+	void _CollectFrameTimings();
+
 	std::chrono::time_point<std::chrono::steady_clock> _lastTimePoint;
 
 	std::chrono::nanoseconds _elapsedTime{};
@@ -79,6 +102,19 @@ private:
 	// 用于保存渲染时间
 	// (总计用时, 已统计帧数)
 	SmallVector<std::pair<float, UINT>, 0> _passesTimings;
+
+	struct _FrameQueryInfo {
+		winrt::com_ptr<ID3D11Query> disjoint;
+		winrt::com_ptr<ID3D11Query> start;
+		winrt::com_ptr<ID3D11Query> end;
+		bool isPending = false;
+	};
+	// 不等待 GPU，因此轮流使用多组查询
+	std::array<_FrameQueryInfo, 3> _frameQueries;
+	uint32_t _curFrameQueryIdx = 0;
+	bool _isFrameTiming = false;
+	float _lastFrameGPUTime = -1.0f;
+	uint32_t _frameGPUTimeCount = 0;
 };
 
 }
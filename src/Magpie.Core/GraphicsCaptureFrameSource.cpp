@@ -35,15 +35,6 @@ bool GraphicsCaptureFrameSource::Initialize() {
 			return false;
 		}
 
-		hr = CreateDirect3D11DeviceFromDXGIDevice(
-			MagApp::Get().GetDeviceResources().GetDXGIDevice(),
-			reinterpret_cast<::IInspectable**>(winrt::put_abi(_wrappedD3DDevice))
-		);
-		if (FAILED(hr)) {
-			Logger::Get().ComError("创建 IDirect3DDevice 失败", hr);
-			return false;
-		}
-
 		// 从窗口句柄获取 GraphicsCaptureItem
 		interop = winrt::get_activation_factory<winrt::GraphicsCaptureItem, IGraphicsCaptureItemInterop>();
 		if (!interop) {
@@ -66,14 +57,34 @@ bool GraphicsCaptureFrameSource::Initialize() {
 		}
 	}
 
-	_output = MagApp::Get().GetDeviceResources().CreateTexture2D(
+	if (!_InitializePipeline(
 		DXGI_FORMAT_B8G8R8A8_UNORM,
 		_frameBox.right - _frameBox.left,
-		_frameBox.bottom - _frameBox.top,
-		D3D11_BIND_SHADER_RESOURCE
+		_frameBox.bottom - _frameBox.top
+	)) {
+		Logger::Get().Error("_InitializePipeline 失败");
+		return false;
+	}
+
+	// 帧缓冲池使用捕获设备，帧在捕获线程中复制
+	winrt::com_ptr<IDXGIDevice> captureDxgiDevice = _captureD3DDevice.try_as<IDXGIDevice>();
+	if (!captureDxgiDevice) {
+		Logger::Get().Error("检索 IDXGIDevice 失败");
+		return false;
+	}
+
+	hr = CreateDirect3D11DeviceFromDXGIDevice(
+		captureDxgiDevice.get(),
+		reinterpret_cast<::IInspectable**>(winrt::put_abi(_wrappedD3DDevice))
 	);
-	if (!_output) {
-		Logger::Get().Error("创建纹理失败");
+	if (FAILED(hr)) {
+		Logger::Get().ComError("创建 IDirect3DDevice 失败", hr);
+		return false;
+	}
+
+	_frameArrivedEvent.reset(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	if (!_frameArrivedEvent) {
+		Logger::Get().Win32Error("CreateEvent 失败");
 		return false;
 	}
 
@@ -82,43 +93,59 @@ bool GraphicsCaptureFrameSource::Initialize() {
 		return false;
 	}
 
+	if (!_StartPipeline()) {
+		Logger::Get().Error("_StartPipeline 失败");
+		return false;
+	}
+
 	//App::Get().SetErrorMsg(ErrorMessages::GENERIC);
 	Logger::Get().Info("GraphicsCaptureFrameSource 初始化完成");
 	return true;
 }
 
-FrameSourceBase::UpdateState GraphicsCaptureFrameSource::Update() {
-	if (!_captureSession) {
-		return UpdateState::Waiting;
+bool GraphicsCaptureFrameSource::_CaptureFrame(ID3D11Texture2D* target, RECT&) {
+	// 超时以便及时退出
+	if (WaitForSingleObject(_frameArrivedEvent.get(), 100) != WAIT_OBJECT_0) {
+		return false;
 	}
 
-	winrt::Direct3D11CaptureFrame frame = _captureFramePool.TryGetNextFrame();
-	if (!frame) {
-		// 缓冲池没有帧则等待新的帧
-		// 因为已通过 FrameArrived 注册回调，所以每当有新帧时会有新消息到达
-		WaitMessage();
-		return UpdateState::Waiting;
+	std::scoped_lock lk(_framePoolMutex);
+	if (!_captureFramePool) {
+		return false;
 	}
 
-	// 从帧获取 IDXGISurface
-	winrt::IDirect3DSurface d3dSurface = frame.Surface();
+	try {
+		winrt::Direct3D11CaptureFrame frame = _captureFramePool.TryGetNextFrame();
+		if (!frame) {
+			return false;
+		}
+
+		// 从帧获取 IDXGISurface
+		winrt::IDirect3DSurface d3dSurface = frame.Surface();
 
-	winrt::com_ptr<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess> dxgiInterfaceAccess(
-		d3dSurface.as<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess>()
-	);
+		winrt::com_ptr<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess> dxgiInterfaceAccess(
+			d3dSurface.as<::Windows::Graphics::DirectX::Direct3D11::IDirect3DDxgiInterfaceAccess>()
+		);
 
-	winrt::com_ptr<ID3D11Texture2D> withFrame;
-	HRESULT hr = dxgiInterfaceAccess->GetInterface(IID_PPV_ARGS(&withFrame));
-	if (FAILED(hr)) {
-		Logger::Get().ComError("从获取 IDirect3DSurface 获取 ID3D11Texture2D 失败", hr);
-		return UpdateState::Error;
-	}
+		winrt::com_ptr<ID3D11Texture2D> withFrame;
+		HRESULT hr = dxgiInterfaceAccess->GetInterface(IID_PPV_ARGS(&withFrame));
+		if (FAILED(hr)) {
+			Logger::Get().ComError("从获取 IDirect3DSurface 获取 ID3D11Texture2D 失败", hr);
+			_ReportCaptureError();
+			return false;
+		}
 
-	MagApp::Get().GetDeviceResources().GetD3DDC()
-		->CopySubresourceRegion(_output.get(), 0, 0, 0, 0, withFrame.get(), 0, &_frameBox);
+		_captureD3DDC->CopySubresourceRegion(target, 0, 0, 0, 0, withFrame.get(), 0, &_frameBox);
 
-	frame.Close();
-	return UpdateState::NewFrame;
+		frame.Close();
+	} catch (const winrt::hresult_error& e) {
+		Logger::Get().Error(StrUtils::Concat("获取帧失败：", StrUtils::UTF16ToUTF8(e.message())));
+		_ReportCaptureError();
+		return false;
+	}
+
+	// 是否变化未知，由渲染线程比较
+	return true;
 }
 
 bool GraphicsCaptureFrameSource::_CaptureWindow(IGraphicsCaptureItemInterop* interop) {
@@ -331,6 +358,8 @@ bool GraphicsCaptureFrameSource::_CaptureMonitor(IGraphicsCaptureItemInterop* in
 }
 
 bool GraphicsCaptureFrameSource::StartCapture() {
+	std::scoped_lock lk(_framePoolMutex);
+
 	if (_captureSession) {
 		return true;
 	}
@@ -338,16 +367,31 @@ bool GraphicsCaptureFrameSource::StartCapture() {
 	try {
 		// 创建帧缓冲池
 		// 帧的尺寸和 _captureItem.Size() 不同
-		_captureFramePool = winrt::Direct3D11CaptureFramePool::Create(
-			_wrappedD3DDevice,
-			winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
-			1,	// 帧的缓存数量
-			{ (int)_frameBox.right, (int)_frameBox.bottom } // 帧的尺寸为包含源窗口的最小尺寸
-		);
+		const winrt::SizeInt32 frameSize{ (int)_frameBox.right, (int)_frameBox.bottom }; // 帧的尺寸为包含源窗口的最小尺寸
+		if (winrt::ApiInformation::IsMethodPresent(
+			winrt::name_of<winrt::Direct3D11CaptureFramePool>(),
+			L"CreateFreeThreaded"
+		)) {
+			// 从 v1903 开始提供，FrameArrived 在线程池中引发，不依赖主线程的消息循环
+			_captureFramePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(
+				_wrappedD3DDevice,
+				winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
+				1,	// 帧的缓存数量
+				frameSize
+			);
+		} else {
+			_captureFramePool = winrt::Direct3D11CaptureFramePool::Create(
+				_wrappedD3DDevice,
+				winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
+				1,
+				frameSize
+			);
+		}
 
-		// 注册回调是为了确保每当有新的帧时会向当前线程发送消息
-		// 回调中什么也不做
-		_captureFramePool.FrameArrived([](const auto&, const auto&) {});
+		// 唤醒捕获线程
+		_captureFramePool.FrameArrived([hEvent(_frameArrivedEvent.get())](const auto&, const auto&) {
+			SetEvent(hEvent);
+		});
 
 		_captureSession = _captureFramePool.CreateCaptureSession(_captureItem);
 
@@ -380,6 +424,8 @@ bool GraphicsCaptureFrameSource::StartCapture() {
 }
 
 void GraphicsCaptureFrameSource::StopCapture() {
+	std::scoped_lock lk(_framePoolMutex);
+
 	if (_captureSession) {
 		_captureSession.Close();
 		_captureSession = nullptr;
@@ -391,6 +437,7 @@ void GraphicsCaptureFrameSource::StopCapture() {
 }
 
 GraphicsCaptureFrameSource::~GraphicsCaptureFrameSource() {
+	_StopPipeline();
 	StopCapture();
 
 	HWND hwndSrc = MagApp::Get().GetHwndSrc();
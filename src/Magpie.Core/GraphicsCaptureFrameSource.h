@@ -1,5 +1,6 @@
 #pragma once
-#include "FrameSourceBase.h"
+#include "PipelinedFrameSourceBase.h"
+#include "Win32Utils.h"
 #include <winrt/Windows.Graphics.Capture.h>
 #include <Windows.Graphics.Capture.Interop.h>
 
@@ -7,15 +8,13 @@ namespace Magpie::Core {
 
 // 使用 Window Runtime 的 Windows.Graphics.Capture API 抓取窗口
 // 见 https://docs.microsoft.com/en-us/windows/uwp/audio-video-camera/screen-capture
-class GraphicsCaptureFrameSource : public FrameSourceBase {
+class GraphicsCaptureFrameSource : public PipelinedFrameSourceBase {
 public:
 	GraphicsCaptureFrameSource() {};
 	virtual ~GraphicsCaptureFrameSource();
 
 	bool Initialize() override;
 
-	UpdateState Update() override;
-
 	bool IsScreenCapture() override {
 		return _isScreenCapture;
 	}
@@ -39,6 +38,8 @@ protected:
 		return true;
 	}
 
+	bool _CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) override;
+
 private:
 	bool _CaptureWindow(IGraphicsCaptureItemInterop* interop);
 
@@ -60,6 +61,11 @@ private:
 	winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool _captureFramePool{ nullptr };
 	winrt::Windows::Graphics::Capture::GraphicsCaptureSession _captureSession{ nullptr };
 	winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice _wrappedD3DDevice{ nullptr };
+
+	// 新帧到达时由 FrameArrived 设置
+	Win32Utils::ScopedHandle _frameArrivedEvent;
+	// StartCapture 和 StopCapture 在主线程调用，保护捕获线程对帧缓冲池的访问
+	Win32Utils::SRWMutex _framePoolMutex;
 };
 
 }
@@ -286,6 +286,12 @@ bool MagApp::MessageLoop() {
 			}
 		}
 
+		if (_renderer->IsRebuilding()) {
+			// 重建完成时会唤醒
+			WaitMessage();
+			continue;
+		}
+
 		_renderer->Render();
 
 		// 第二帧（等待时或完成后）显示 DDF 窗口
@@ -404,6 +410,16 @@ static bool CalcHostWndRect(HWND hWnd, MultiMonitorUsage multiMonitorUsage, RECT
 	return true;
 }
 
+// 源窗口和缩放窗口重合则不缩放，此时源窗口可能是无边框全屏窗口
+static bool IsSrcWndFullscreen(HWND hwndSrc, const RECT& hostWndRect) {
+	RECT srcRect;
+	if (!Win32Utils::GetWindowFrameRect(hwndSrc, srcRect)) {
+		Win32Utils::GetClientScreenRect(hwndSrc, srcRect);
+	}
+
+	return srcRect == hostWndRect;
+}
+
 // 创建缩放窗口
 bool MagApp::_CreateHostWnd() {
 	if (FindWindow(HOST_WINDOW_CLASS_NAME, nullptr)) {
@@ -416,17 +432,9 @@ bool MagApp::_CreateHostWnd() {
 		return false;
 	}
 
-	if (!_options.IsAllowScalingMaximized()) {
-		// 源窗口和缩放窗口重合则不缩放，此时源窗口可能是无边框全屏窗口
-		RECT srcRect;
-		if (!Win32Utils::GetWindowFrameRect(_hwndSrc, srcRect)) {
-			Win32Utils::GetClientScreenRect(_hwndSrc, srcRect);
-		}
-
-		if (srcRect == _hostWndRect) {
-			Logger::Get().Info("源窗口已全屏");
-			return false;
-		}
+	if (!_options.IsAllowScalingMaximized() && IsSrcWndFullscreen(_hwndSrc, _hostWndRect)) {
+		Logger::Get().Info("源窗口已全屏");
+		return false;
 	}
 
 	// WS_EX_NOREDIRECTIONBITMAP 可以避免 WS_EX_LAYERED 导致的额外内存开销
@@ -462,6 +470,37 @@ bool MagApp::_CreateHostWnd() {
 	return true;
 }
 
+bool MagApp::RecreateFrameSource() {
+	if (!CheckSrcWindow(_hwndSrc, _options.IsAllowScalingMaximized())) {
+		return false;
+	}
+
+	RECT hostWndRect;
+	if (!CalcHostWndRect(_hwndSrc, _options.multiMonitorUsage, hostWndRect)) {
+		Logger::Get().Error("CalcHostWndRect 失败");
+		return false;
+	}
+
+	if (hostWndRect != _hostWndRect) {
+		Logger::Get().Info("缩放窗口的位置需改变");
+		return false;
+	}
+
+	if (!_options.IsAllowScalingMaximized() && IsSrcWndFullscreen(_hwndSrc, _hostWndRect)) {
+		Logger::Get().Info("源窗口已全屏");
+		return false;
+	}
+
+	// 先销毁旧的帧源，否则它会还原新的帧源对源窗口的修改
+	_frameSource.reset();
+	if (!_InitFrameSource()) {
+		Logger::Get().Error("_InitFrameSource 失败");
+		return false;
+	}
+
+	return true;
+}
+
 bool MagApp::_InitFrameSource() {
 	switch (_options.captureMethod) {
 	case CaptureMethod::GraphicsCapture:
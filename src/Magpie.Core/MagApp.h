@@ -23,6 +23,9 @@ public:
 
 	void Stop(bool isSrcMovingOrSizing = false);
 
+	// 源窗口大小或位置改变后不退出缩放，只重新创建帧源。缩放窗口的位置也需改变时失败
+	bool RecreateFrameSource();
+
 	void ToggleOverlay();
 
 	HINSTANCE GetHInstance() const noexcept {
@@ -45,6 +45,8 @@ struct MagFlags {
 	static constexpr const uint32_t DisableDirectFlip = 0x2000;
 	static constexpr const uint32_t DisableFontCache = 0x4000;
 	static constexpr const uint32_t AllowScalingMaximized = 0x8000;
+	static constexpr const uint32_t DynamicResolution = 0x10000;
+	static constexpr const uint32_t FramePacing = 0x20000;
 };
 
 struct DownscalingEffect {
@@ -94,6 +96,8 @@ struct MagOptions {
 	DEFINE_FLAG_ACCESSOR(IsAdjustCursorSpeed, MagFlags::AdjustCursorSpeed, flags)
 	DEFINE_FLAG_ACCESSOR(IsDrawCursor, MagFlags::DrawCursor, flags)
 	DEFINE_FLAG_ACCESSOR(IsDisableDirectFlip, MagFlags::DisableDirectFlip, flags)
+	DEFINE_FLAG_ACCESSOR(IsDynamicResolution, MagFlags::DynamicResolution, flags)
+	DEFINE_FLAG_ACCESSOR(IsFramePacing, MagFlags::FramePacing, flags)
 
 	Cropping cropping{};
 	uint32_t flags = MagFlags::VSync | MagFlags::AdjustCursorSpeed | MagFlags::DrawCursor;	// MagFlags
@@ -217,6 +217,10 @@ bool OverlayDrawer::Initialize() noexcept {
 	return true;
 }
 
+void OverlayDrawer::OnEffectsChanged() noexcept {
+	_timelineColors = GenerateTimelineColors();
+}
+
 void OverlayDrawer::Draw() noexcept {
 	bool isShowFPS = MagApp::Get().GetOptions().IsShowFPS();
 
@@ -791,6 +795,19 @@ void OverlayDrawer::_DrawUI() noexcept {
 	ImGui::TextUnformatted(StrUtils::Concat(vSyncStr, ": ", stateStr).c_str());
 	const std::string& captureMethodStr = _GetResourceString(L"Overlay_Profiler_CaptureMethod");
 	ImGui::TextUnformatted(StrUtils::Concat(captureMethodStr.c_str(), ": ", MagApp::Get().GetFrameSource().GetName()).c_str());
+	const LatencyHistogram& latency = MagApp::Get().GetRenderer().GetFramePacer().GetLatencyHistogram();
+	if (latency.GetCount() > 0) {
+		const std::string& latencyStr = _GetResourceString(L"Overlay_Profiler_Latency");
+		ImGui::TextUnformatted(fmt::format("{}: p50 {:.1f} ms, p99 {:.1f} ms", latencyStr,
+			latency.GetPercentile(0.5f) / 1000.0f, latency.GetPercentile(0.99f) / 1000.0f).c_str());
+	}
+	{
+		const FrameSourceBase& frameSource = MagApp::Get().GetFrameSource();
+		const std::string& droppedFramesStr = _GetResourceString(L"Overlay_Profiler_DroppedFrames");
+		const std::string& overwrittenFramesStr = _GetResourceString(L"Overlay_Profiler_OverwrittenFrames");
+		ImGui::TextUnformatted(fmt::format("{}: {}, {}: {}", droppedFramesStr, frameSource.GetDroppedFrameCount(),
+			overwrittenFramesStr, frameSource.GetOverwrittenFrameCount()).c_str());
+	}
 	ImGui::PopTextWrapPos();
 
 	ImGui::Spacing();
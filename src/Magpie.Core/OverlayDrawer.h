@@ -26,6 +26,9 @@ public:
 
 	void SetUIVisibility(bool value) noexcept;
 
+	// 效果的数量或通道改变后调用
+	void OnEffectsChanged() noexcept;
+
 private:
 	bool _BuildFonts() noexcept;
 	void _BuildFontUI(std::wstring_view language, const std::vector<uint8_t>& fontData, ImVector<ImWchar>& uiRanges) noexcept;
@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "PipelinedFrameSourceBase.h"
+#include "MagApp.h"
+#include "DeviceResources.h"
+#include "Logger.h"
+#include "SmallVector.h"
+
+namespace Magpie::Core {
+
+// 为空表示未知，和任何区域合并都是未知
+static void UnionDirtyRect(RECT& rect, const RECT& other) noexcept {
+	if (IsRectEmpty(&rect) || IsRectEmpty(&other)) {
+		rect = {};
+	} else {
+		UnionRect(&rect, &rect, &other);
+	}
+}
+
+PipelinedFrameSourceBase::~PipelinedFrameSourceBase() {
+	// 派生类应已调用，这里只是以防万一
+	_StopPipeline();
+
+	if (_hasFrame) {
+		Logger::Get().Info(fmt::format("捕获线程：丢弃 {} 帧，{} 帧未被渲染即被覆盖",
+			GetDroppedFrameCount(), GetOverwrittenFrameCount()));
+	}
+
+	// 当前的输出在 Renderer 重建效果时仍被引用，由 Renderer 释放
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+	for (const _Slot& slot : _slots) {
+		if (slot.texture && slot.texture != _output) {
+			dr.ReleaseViews(slot.texture.get());
+		}
+	}
+}
+
+bool PipelinedFrameSourceBase::_CreateCaptureDevice() {
+	UINT createDeviceFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
+	if (DeviceResources::IsDebugLayersAvailable()) {
+		// 在 DEBUG 配置启用调试层
+		createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
+	}
+
+	D3D_FEATURE_LEVEL featureLevels[] = {
+		D3D_FEATURE_LEVEL_11_1,
+		D3D_FEATURE_LEVEL_11_0
+	};
+	UINT nFeatureLevels = ARRAYSIZE(featureLevels);
+
+	// 使用和 Renderer 相同的图像适配器以避免 GPU 间的纹理拷贝
+	HRESULT hr = D3D11CreateDevice(
+		MagApp::Get().GetDeviceResources().GetGraphicsAdapter(),
+		D3D_DRIVER_TYPE_UNKNOWN,
+		nullptr,
+		createDeviceFlags,
+		featureLevels,
+		nFeatureLevels,
+		D3D11_SDK_VERSION,
+		_captureD3DDevice.put(),
+		nullptr,
+		_captureD3DDC.put()
+	);
+	if (FAILED(hr)) {
+		Logger::Get().ComError("D3D11CreateDevice 失败", hr);
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelinedFrameSourceBase::_InitializePipeline(DXGI_FORMAT format, UINT width, UINT height) {
+	if (!_CreateCaptureDevice()) {
+		Logger::Get().Error("创建捕获设备失败");
+		return false;
+	}
+
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+	for (_Slot& slot : _slots) {
+		slot.texture = dr.CreateTexture2D(
+			format,
+			width,
+			height,
+			D3D11_BIND_SHADER_RESOURCE,
+			D3D11_USAGE_DEFAULT,
+			D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX
+		);
+		if (!slot.texture) {
+			Logger::Get().Error("创建 Texture2D 失败");
+			return false;
+		}
+
+		slot.mutex = slot.texture.try_as<IDXGIKeyedMutex>();
+		if (!slot.mutex) {
+			Logger::Get().Error("检索 IDXGIKeyedMutex 失败");
+			return false;
+		}
+
+		winrt::com_ptr<IDXGIResource> dxgiRes = slot.texture.try_as<IDXGIResource>();
+		if (!dxgiRes) {
+			Logger::Get().Error("检索 IDXGIResource 失败");
+			return false;
+		}
+
+		HANDLE hSharedTex = NULL;
+		HRESULT hr = dxgiRes->GetSharedHandle(&hSharedTex);
+		if (FAILED(hr)) {
+			Logger::Get().ComError("GetSharedHandle 失败", hr);
+			return false;
+		}
+
+		hr = _captureD3DDevice->OpenSharedResource(hSharedTex, IID_PPV_ARGS(slot.captureTexture.put()));
+		if (FAILED(hr)) {
+			Logger::Get().ComError("OpenSharedResource 失败", hr);
+			return false;
+		}
+
+		slot.captureMutex = slot.captureTexture.try_as<IDXGIKeyedMutex>();
+		if (!slot.captureMutex) {
+			Logger::Get().Error("检索 IDXGIKeyedMutex 失败");
+			return false;
+		}
+	}
+
+	// 第一帧之前不会渲染，但 Renderer 初始化效果时需要输出纹理
+	_Slot& readSlot = _slots[_readSlot];
+	HRESULT hr = readSlot.mutex->AcquireSync(0, 0);
+	if (hr != S_OK) {
+		Logger::Get().ComError("AcquireSync 失败", hr);
+		return false;
+	}
+	_isReadSlotAcquired = true;
+	_output = readSlot.texture;
+
+	return true;
+}
+
+bool PipelinedFrameSourceBase::_StartPipeline() {
+	_exiting.store(false, std::memory_order_relaxed);
+	_captureThread = std::thread(&PipelinedFrameSourceBase::_CaptureThreadProc, this);
+	return true;
+}
+
+void PipelinedFrameSourceBase::_StopPipeline() noexcept {
+	if (!_captureThread.joinable()) {
+		return;
+	}
+
+	_exiting.store(true, std::memory_order_relaxed);
+	_captureThread.join();
+}
+
+FrameSourceBase::UpdateState PipelinedFrameSourceBase::Update() {
+	if (_IsCaptureFailed()) {
+		// 错误已在捕获线程中记录
+		return UpdateState::Error;
+	}
+
+	if (!(_latestSlot.load(std::memory_order_relaxed) & NEW_FRAME_FLAG)) {
+		// 第一帧之前不渲染
+		return _hasFrame ? UpdateState::NoUpdate : UpdateState::Waiting;
+	}
+
+	// 用上次持有的纹理换取最新的帧。释放后 GPU 上已提交的读取仍会在捕获设备写入前完成
+	if (_isReadSlotAcquired) {
+		_slots[_readSlot].mutex->ReleaseSync(0);
+		_isReadSlotAcquired = false;
+	}
+	_readSlot = _latestSlot.exchange(_readSlot, std::memory_order_acq_rel) & ~NEW_FRAME_FLAG;
+
+	_Slot& slot = _slots[_readSlot];
+
+	// 捕获线程发布前已释放，不会在 CPU 上等待，只在 GPU 上同步
+	HRESULT hr = slot.mutex->AcquireSync(0, 1000);
+	if (hr != S_OK) {
+		Logger::Get().ComError("AcquireSync 失败", hr);
+		return UpdateState::Error;
+	}
+	_isReadSlotAcquired = true;
+
+	_output = slot.texture;
+	_frameTime = slot.publishTime;
+	_consumedSeq.store(slot.seq, std::memory_order_release);
+
+	const bool isFirstFrame = !_hasFrame;
+	_hasFrame = true;
+
+	// 为空表示未知，渲染整个帧
+	_dirtyRect = isFirstFrame ? RECT{} : slot.dirtyRect;
+	return UpdateState::NewFrame;
+}
+
+bool PipelinedFrameSourceBase::_DiffCapturedFrame(ID3D11Texture2D* frame, RECT& dirtyRect) {
+	if (!_isTileDifferInitialized) {
+		_isTileDifferInitialized = true;
+		if (!_tileDiffer.Initialize(_captureD3DDevice.get(), _captureD3DDC.get(), frame)) {
+			Logger::Get().Error("初始化 GPUTileDiffer 失败，将不检测帧的变化");
+		}
+	}
+
+	if (!_tileDiffer.IsInitialized()) {
+		// 未知变化的区域
+		return true;
+	}
+
+	if (!_tileDiffer.Diff(frame, dirtyRect)) {
+		Logger::Get().Error("比较帧失败");
+		dirtyRect = {};
+		return true;
+	}
+
+	return !IsRectEmpty(&dirtyRect);
+}
+
+void PipelinedFrameSourceBase::_CaptureThreadProc() noexcept {
+	winrt::init_apartment(winrt::apartment_type::multi_threaded);
+
+	// 已发布但可能尚未被取走的帧的序号和各自变化的区域
+	SmallVector<std::pair<uint32_t, RECT>> unconsumed;
+	uint32_t seq = 0;
+
+	while (!_exiting.load(std::memory_order_relaxed) && !_IsCaptureFailed()) {
+		_Slot& slot = _slots[_writeSlot];
+
+		// 渲染线程不会访问正在写入的纹理，这里只在 GPU 上同步
+		HRESULT hr = slot.captureMutex->AcquireSync(0, 100);
+		if (hr == static_cast<HRESULT>(WAIT_TIMEOUT)) {
+			continue;
+		}
+		if (FAILED(hr)) {
+			Logger::Get().ComError("AcquireSync 失败", hr);
+			_ReportCaptureError();
+			break;
+		}
+
+		RECT dirtyRect{};
+		bool captured = _CaptureFrame(slot.captureTexture.get(), dirtyRect);
+		if (captured && IsRectEmpty(&dirtyRect)) {
+			// 在捕获设备上比较，画面没有变化时不发布
+			captured = _DiffCapturedFrame(slot.captureTexture.get(), dirtyRect);
+		}
+		slot.captureMutex->ReleaseSync(0);
+
+		if (!captured) {
+			continue;
+		}
+
+		// 跳过的帧中变化的区域需合并到这一帧
+		const uint32_t consumedSeq = _consumedSeq.load(std::memory_order_acquire);
+		unconsumed.erase(std::remove_if(unconsumed.begin(), unconsumed.end(),
+			[&](const auto& pair) { return pair.first <= consumedSeq; }), unconsumed.end());
+		if (unconsumed.size() >= 8) {
+			// 渲染线程长时间没有取帧，合并最早的两项
+			UnionDirtyRect(unconsumed[1].second, unconsumed[0].second);
+			unconsumed.erase(unconsumed.begin());
+		}
+
+		slot.seq = ++seq;
+		slot.dirtyRect = dirtyRect;
+		for (const auto& pair : unconsumed) {
+			UnionDirtyRect(slot.dirtyRect, pair.second);
+		}
+		unconsumed.emplace_back(seq, dirtyRect);
+
+		LARGE_INTEGER publishTime;
+		QueryPerformanceCounter(&publishTime);
+		slot.publishTime = publishTime.QuadPart;
+
+		const uint8_t prevLatest = _latestSlot.exchange(_writeSlot | NEW_FRAME_FLAG, std::memory_order_acq_rel);
+		if (prevLatest & NEW_FRAME_FLAG) {
+			// 上一帧还未被取走，直接覆盖，捕获线程不等待渲染
+			_overwrittenFrameCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		_writeSlot = prevLatest & ~NEW_FRAME_FLAG;
+	}
+
+	winrt::uninit_apartment();
+}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "FrameSourceBase.h"
+#include "GPUTileDiffer.h"
+#include <thread>
+
+namespace Magpie::Core {
+
+// 在单独的线程中捕获，渲染线程从不等待捕获
+// 捕获线程使用自己的 D3D 设备写入共享纹理。三个纹理轮流使用：一个正在写入，一个由渲染线程持有，
+// 另一个为最新发布的帧，两个线程通过一次原子交换换手
+// 渲染线程持有的纹理直接作为输出，效果从中读取，不再复制
+class PipelinedFrameSourceBase : public FrameSourceBase {
+public:
+	virtual ~PipelinedFrameSourceBase();
+
+	// 取走最新发布的帧，没有新帧时立即返回
+	UpdateState Update() override;
+
+	uint32_t GetDroppedFrameCount() const noexcept override {
+		return _droppedFrameCount.load(std::memory_order_relaxed);
+	}
+
+	uint32_t GetOverwrittenFrameCount() const noexcept override {
+		return _overwrittenFrameCount.load(std::memory_order_relaxed);
+	}
+
+protected:
+	// 创建捕获设备和共享纹理，并将 _output 设为渲染线程持有的纹理
+	bool _InitializePipeline(DXGI_FORMAT format, UINT width, UINT height);
+
+	bool _StartPipeline();
+
+	// 派生类必须在析构函数中调用，返回后不再调用 _CaptureFrame
+	void _StopPipeline() noexcept;
+
+	// 在捕获线程中循环调用。应等待新帧，但不能无限期阻塞，否则无法及时退出
+	// 将新帧写入 target 后返回 true，没有新帧或画面没有变化时返回 false
+	// 出现无法恢复的错误时应调用 _ReportCaptureError 后返回 false，不能一直重试
+	// dirtyRect 为变化的区域，坐标系和 _output 相同，不设置表示未知，此时在捕获线程中比较帧
+	virtual bool _CaptureFrame(ID3D11Texture2D* target, RECT& dirtyRect) = 0;
+
+	// 在 _CaptureFrame 中调用，用于捕获方式报告系统合并的帧
+	void _AddDroppedFrames(uint32_t count) noexcept {
+		_droppedFrameCount.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// 报告无法恢复的错误，此后捕获线程退出，Update 返回 UpdateState::Error
+	void _ReportCaptureError() noexcept {
+		_isCaptureFailed.store(true, std::memory_order_release);
+	}
+
+	bool _IsCaptureFailed() const noexcept {
+		return _isCaptureFailed.load(std::memory_order_acquire);
+	}
+
+	// 使用和渲染相同的图形适配器，只在捕获线程中使用
+	winrt::com_ptr<ID3D11Device> _captureD3DDevice;
+	winrt::com_ptr<ID3D11DeviceContext> _captureD3DDC;
+
+private:
+	bool _CreateCaptureDevice();
+
+	// 返回 false 表示和上一帧相同
+	bool _DiffCapturedFrame(ID3D11Texture2D* frame, RECT& dirtyRect);
+
+	void _CaptureThreadProc() noexcept;
+
+	struct _Slot {
+		// 在渲染设备和捕获设备上打开的同一个纹理，键控互斥体用于同步两个设备的访问
+		winrt::com_ptr<ID3D11Texture2D> texture;
+		winrt::com_ptr<IDXGIKeyedMutex> mutex;
+		winrt::com_ptr<ID3D11Texture2D> captureTexture;
+		winrt::com_ptr<IDXGIKeyedMutex> captureMutex;
+		// 和渲染线程上次取走的帧相比变化的区域，为空表示未知
+		RECT dirtyRect{};
+		uint32_t seq = 0;
+		// 发布的时间，包含帧在环形缓冲区中等待的时间
+		int64_t publishTime = 0;
+	};
+	std::array<_Slot, 3> _slots;
+
+	static constexpr uint8_t NEW_FRAME_FLAG = 0x80;
+	// 最新发布的纹理，设置 NEW_FRAME_FLAG 表示尚未被渲染线程取走
+	std::atomic<uint8_t> _latestSlot = 0;
+	// 渲染线程上次取走的帧的序号
+	std::atomic<uint32_t> _consumedSeq = 0;
+
+	// 只由渲染线程访问
+	uint8_t _readSlot = 1;
+	// 渲染线程在使用纹理期间一直持有它的键控互斥体
+	bool _isReadSlotAcquired = false;
+	bool _hasFrame = false;
+
+	// 只由捕获线程访问
+	uint8_t _writeSlot = 2;
+
+	// 只由捕获线程访问，用于无法获知变化区域的捕获方式
+	GPUTileDiffer _tileDiffer;
+	bool _isTileDifferInitialized = false;
+
+	std::thread _captureThread;
+	std::atomic<bool> _exiting = false;
+	std::atomic<bool> _isCaptureFailed = false;
+
+	std::atomic<uint32_t> _droppedFrameCount = 0;
+	std::atomic<uint32_t> _overwrittenFrameCount = 0;
+};
+
+}
@@ -2,6 +2,7 @@
 #include "Renderer.h"
 #include "MagApp.h"
 #include "Win32Utils.h"
+#include "TaskScheduler.h"
 #include "StrUtils.h"
 #include "EffectCompiler.h"
 #include "FrameSourceBase.h"
@@ -18,7 +19,40 @@ namespace Magpie::Core {
 
 Renderer::Renderer() {}
 
-Renderer::~Renderer() {}
+// 单位为微秒，也用于转换时长
+static int64_t QPCToMicroseconds(int64_t qpc) noexcept {
+	static const int64_t freq = []() {
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		return freq.QuadPart;
+	}();
+	return qpc / freq * 1000000 + qpc % freq * 1000000 / freq;
+}
+
+static int64_t GetMicroseconds() noexcept {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return QPCToMicroseconds(counter.QuadPart);
+}
+
+Renderer::~Renderer() {
+	if (_rebuildThread.joinable()) {
+		_rebuildThread.join();
+	}
+
+	const LatencyHistogram& latency = _framePacer.GetLatencyHistogram();
+	if (latency.GetCount() > 0) {
+		Logger::Get().Info(fmt::format("捕获到呈现的延迟：共 {} 帧，50% 分位数 {:.1f} 毫秒，99% 分位数 {:.1f} 毫秒，错过垂直同步 {} 次\n{}",
+			latency.GetCount(), latency.GetPercentile(0.5f) / 1000.0f, latency.GetPercentile(0.99f) / 1000.0f,
+			_framePacer.GetMissedCount(), latency.ToString()));
+	}
+
+	const CSStateTracker::Stats& stats = MagApp::Get().GetDeviceResources().GetCSStateTracker().GetStats();
+	if (stats.calls + stats.elidedCalls > 0) {
+		Logger::Get().Info(fmt::format("计算着色器状态绑定：调用 {} 次（其中 {} 次为解决读写冲突），省去 {} 次",
+			stats.calls, stats.hazardUnbinds, stats.elidedCalls));
+	}
+}
 
 bool Renderer::Initialize() {
 	_gpuTimer.reset(new GPUTimer());
@@ -33,6 +67,8 @@ bool Renderer::Initialize() {
 		return false;
 	}
 
+	_BuildFrameGraph();
+
 	if (MagApp::Get().GetOptions().IsShowFPS()) {
 		_overlayDrawer.reset(new OverlayDrawer());
 		if (!_overlayDrawer->Initialize()) {
@@ -41,26 +77,75 @@ bool Renderer::Initialize() {
 		}
 	}
 
+	if (MagApp::Get().GetOptions().IsDynamicResolution()) {
+		_InitResolutionGovernor();
+	}
+
+	_framePacer.Initialize();
+	if (MagApp::Get().GetOptions().IsFramePacing()) {
+		const MagOptions& options = MagApp::Get().GetOptions();
+		// 允许额外的延迟时 CPU 和 GPU 并行执行，推迟渲染没有意义
+		if (options.IsVSync() && !options.IsTripleBuffering()) {
+			_pacingTimer.reset(CreateWaitableTimerEx(nullptr, nullptr,
+				CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+			if (!_pacingTimer) {
+				Logger::Get().Win32Error("CreateWaitableTimerEx 失败，将使用 Sleep");
+			}
+
+			_gpuTimer->StartFrameTiming();
+			_isPacing = true;
+		} else {
+			Logger::Get().Info("帧调度需要开启垂直同步并关闭三重缓冲");
+		}
+	}
+
 	// 初始化所有效果共用的动态常量缓冲区
+	// 命令列表在执行时才读取 DEFAULT 的缓冲区，因此不使用 DYNAMIC 和 Map
 	D3D11_BUFFER_DESC bd{};
-	bd.Usage = D3D11_USAGE_DYNAMIC;
-	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.Usage = D3D11_USAGE_DEFAULT;
 	bd.ByteWidth = 4 * (UINT)_dynamicConstants.size();
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 
-	HRESULT hr = MagApp::Get().GetDeviceResources().GetD3DDevice()
-		->CreateBuffer(&bd, nullptr, _dynamicCB.put());
+	ID3D11Device5* d3dDevice = MagApp::Get().GetDeviceResources().GetD3DDevice();
+	HRESULT hr = d3dDevice->CreateBuffer(&bd, nullptr, _dynamicCB.put());
 	if (FAILED(hr)) {
 		Logger::Get().ComError("CreateBuffer 失败", hr);
 		return false;
 	}
 
+	// 驱动不支持命令列表时由运行时模拟，无法减少 CPU 开销
+	D3D11_FEATURE_DATA_THREADING threading{};
+	hr = d3dDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+	_isCommandListSupported = SUCCEEDED(hr) && threading.DriverCommandLists;
+	if (!_isCommandListSupported) {
+		Logger::Get().Info("驱动不支持命令列表");
+	}
+
 	return true;
 }
 
 
 void Renderer::Render(bool onPrint) {
+	if (_rebuildThread.joinable()) {
+		if (_isRebuildDone.load(std::memory_order_acquire)) {
+			if (!_FinishRebuild()) {
+				Logger::Get().Info("无法重建效果，重新缩放");
+				MagApp::Get().Stop(true);
+				return;
+			}
+		} else if (!_isSwitchingLevel) {
+			return;
+		}
+	}
+
 	int srcState = _CheckSrcState();
+	if (srcState != 0 && _isSwitchingLevel) {
+		_CancelLevelSwitch();
+	}
+	if (srcState == 2 && _StartRebuild()) {
+		return;
+	}
+
 	if (srcState != 0) {
 		Logger::Get().Info("源窗口状态改变，退出全屏");
 		MagApp::Get().Stop(srcState == 2);
@@ -72,30 +157,53 @@ void Renderer::Render(bool onPrint) {
 	if (!_waitingForNextFrame) {
 		dr.BeginFrame();
 		_gpuTimer->OnBeginFrame();
+
+		if (_isPacing) {
+			_WaitForRenderStart();
+		}
 	}
 
 	// 首先处理配置改变产生的回调
 	// MagApp::Get().GetOptions().OnBeginFrame();
 
+	_captureStartTime = GetMicroseconds();
 	auto state = onPrint ? FrameSourceBase::UpdateState::NoUpdate : MagApp::Get().GetFrameSource().Update();
-	_waitingForNextFrame = state == FrameSourceBase::UpdateState::Waiting
-		|| state == FrameSourceBase::UpdateState::Error;
+	if (state == FrameSourceBase::UpdateState::Error) {
+		// 捕获出现无法恢复的错误，继续等待也不会有新帧
+		Logger::Get().Error("捕获帧失败");
+		MagApp::Get().Stop();
+		return;
+	}
+
+	_waitingForNextFrame = state == FrameSourceBase::UpdateState::Waiting;
 	if (_waitingForNextFrame) {
 		return;
 	}
+	if (state == FrameSourceBase::UpdateState::NewFrame) {
+		// 使用帧发布的时间，延迟包含帧在捕获线程中等待被取走的时间
+		const int64_t frameTime = MagApp::Get().GetFrameSource().GetFrameTime();
+		_captureTime = frameTime > 0 ? QPCToMicroseconds(frameTime) : GetMicroseconds();
+	} else {
+		_captureTime = -1;
+	}
+
+	// 帧源可能轮流使用多个输出纹理，效果直接从中读取
+	if (ID3D11Texture2D* input = MagApp::Get().GetFrameSource().GetOutput(); input != _effects[0].GetInputTexture()) {
+		if (!_effects[0].SetInput(input)) {
+			Logger::Get().Error("设置效果的输入失败");
+			MagApp::Get().Stop();
+			return;
+		}
+	}
 
 	MagApp::Get().GetCursorManager().OnBeginFrame();
 
-	if (!_UpdateDynamicConstants()) {
-		Logger::Get().Error("_UpdateDynamicConstants 失败");
-	}
+	_UpdateDynamicConstants();
 
 	auto d3dDC = dr.GetD3DDC();
+	CSStateTracker& csState = dr.GetCSStateTracker();
 
-	{
-		ID3D11Buffer* t = _dynamicCB.get();
-		d3dDC->CSSetConstantBuffers(0, 1, &t);
-	}
+	csState.SetConstantBuffer(0, _dynamicCB.get());
 
 	{
 		SIZE outputSize = Win32Utils::GetSizeOfRect(_outputRect);
@@ -111,37 +219,66 @@ void Renderer::Render(bool onPrint) {
 
 	_gpuTimer->OnBeginEffects();
 
-	uint32_t idx = 0;
-	if (state == FrameSourceBase::UpdateState::NoUpdate) {
-		// 此帧内容无变化
-		// 从第一个使用动态常量的效果开始渲染
-		// 如果没有则只渲染最后一个效果的最后一个通道
+	if (state != FrameSourceBase::UpdateState::NoUpdate) {
+		_frameGraph.TouchResource(_frameSourceResource, MagApp::Get().GetFrameSource().GetDirtyRect());
+	}
 
-		size_t i = 0;
-		for (size_t end = _effects.size() - 1; i < end; ++i) {
-			if (_effects[i].IsUseDynamic()) {
-				break;
-			} else {
-				for (uint32_t j = (uint32_t)_effects[i].GetDesc().passes.size(); j > 0; --j) {
-					_gpuTimer->OnEndPass(idx++);
-				}
+	// 只执行受输入变化或动态常量影响的通道，最后一个通道每帧都要执行
+	// 已知 RADIUS 的通道只执行覆盖变化区域的线程组
+	_frameGraph.Schedule(_frameSchedule);
+
+	const uint32_t passCount = _frameGraph.GetPassCount();
+
+	// 所有通道都完整执行时除最后一个通道外每帧都相同，直接执行录制的命令列表
+	// 测量渲染用时需要在通道间插入查询，因此不使用命令列表
+	bool isStaticPassesExecuted = false;
+	if (_frameSchedule.isFull && _isCommandListSupported && !_gpuTimer->IsProfiling() && passCount > 1) {
+		ID3D11Texture2D* input = _effects[0].GetInputTexture();
+		auto it = std::find_if(_staticPasses.begin(), _staticPasses.end(),
+			[input](const auto& pair) { return pair.first == input; });
+		if (it == _staticPasses.end()) {
+			if (winrt::com_ptr<ID3D11CommandList> commandList = _RecordStaticPasses()) {
+				_staticPasses.emplace_back(input, std::move(commandList));
+				it = _staticPasses.end() - 1;
 			}
 		}
 
-		if (i == _effects.size()) {
-			// 只渲染最后一个 Effect 的最后一个 pass
-			_effects.back().Draw(idx, true);
-		} else {
-			for (; i < _effects.size(); ++i) {
-				_effects[i].Draw(idx);
-			}
+		if (it != _staticPasses.end()) {
+			d3dDC->ExecuteCommandList(it->second.get(), FALSE);
+			// 执行命令列表后状态被清空
+			csState.Reset();
+			csState.SetConstantBuffer(0, _dynamicCB.get());
+			isStaticPassesExecuted = true;
 		}
-	} else {
-		for (auto& effect : _effects) {
-			effect.Draw(idx);
+	}
+
+	uint32_t curEffectIdx = UINT_MAX;
+	for (uint32_t i = 0, scheduleIdx = 0; i < passCount; ++i) {
+		if (scheduleIdx < _frameSchedule.passes.size() && _frameSchedule.passes[scheduleIdx] == i) {
+			if (isStaticPassesExecuted && i + 1 < passCount) {
+				++scheduleIdx;
+				continue;
+			}
+
+			const auto [effectIdx, passIdx] = _framePasses[i];
+			if (effectIdx != curEffectIdx) {
+				_effects[effectIdx].BeginDraw(csState);
+				curEffectIdx = effectIdx;
+			}
+			const RECT blocks = _effects[effectIdx].GetPassBlocks(passIdx, _frameSchedule.updateRects[scheduleIdx]);
+			_SetBlockOffset(blocks.left, blocks.top);
+			_effects[effectIdx].DrawPass(csState, passIdx, &blocks);
+
+			++scheduleIdx;
 		}
+
+		// 未执行的通道也在 GPUTimer 中记录
+		_gpuTimer->OnEndPass(i);
 	}
 
+	// 后缓冲区之后将作为渲染目标
+	csState.UnbindUnorderedAccessViews();
+
 	_gpuTimer->OnEndEffects();
 
 	if (_overlayDrawer) {
@@ -149,6 +286,29 @@ void Renderer::Render(bool onPrint) {
 	}
 
 	dr.EndFrame();
+
+	const int64_t presentTime = GetMicroseconds();
+	UINT presentCount = 0;
+	if (_isPacing) {
+		// GPU 用时来自之前的帧
+		const float gpuTime = _gpuTimer->GetLastFrameGPUTime();
+		_framePacer.AddRenderTime(presentTime - _captureStartTime, gpuTime < 0 ? -1 : std::lroundf(gpuTime * 1000));
+		dr.GetSwapChain()->GetLastPresentCount(&presentCount);
+	}
+	_framePacer.OnPresented(_captureTime, presentTime, presentCount);
+
+	if (_isPacing) {
+		// Present 返回时帧只是入队，根据实际显示的时间调整余量。统计不可用时不调整
+		DXGI_FRAME_STATISTICS stats{};
+		if (SUCCEEDED(dr.GetSwapChain()->GetFrameStatistics(&stats))) {
+			_framePacer.OnFrameStatistics(stats.PresentCount, stats.PresentRefreshCount,
+				stats.SyncRefreshCount, QPCToMicroseconds(stats.SyncQPCTime.QuadPart));
+		}
+	}
+
+	if (_prescaleDesc) {
+		_UpdateResolutionGovernor();
+	}
 }
 
 bool Renderer::IsUIVisiable() const noexcept {
@@ -176,13 +336,9 @@ void Renderer::SetUIVisibility(bool value) {
 	if (!_overlayDrawer->IsUIVisiable()) {
 		_overlayDrawer->SetUIVisibility(true);
 
-		uint32_t passCount = 0;
-		for (const auto& effect : _effects) {
-			passCount += (uint32_t)effect.GetDesc().passes.size();
+		if (!_gpuTimer->IsProfiling()) {
+			_StartProfiling();
 		}
-
-		// StartProfiling 必须在 OnBeginFrame 之前调用
-		_gpuTimer->StartProfiling(500ms, passCount);
 	}
 }
 
@@ -275,24 +431,160 @@ int Renderer::_CheckSrcState() {
 	return 0;
 }
 
-static bool CompileEffect(bool isLastEffect, const EffectOption& option, EffectDesc& result) {
-	result.name = StrUtils::UTF16ToUTF8(option.name);
-	// 将文件夹分隔符统一为 '\'
-	for (char& c : result.name) {
-		if (c == '/') {
-			c = '\\';
+bool Renderer::_StartRebuild() {
+	HWND hwndSrc = MagApp::Get().GetHwndSrc();
+
+	// 用户拖动源窗口时应能看到源窗口，此时仍退出缩放，拖动结束后重新缩放
+	GUITHREADINFO guiThreadInfo{};
+	guiThreadInfo.cbSize = sizeof(GUITHREADINFO);
+	if (!GetGUIThreadInfo(GetWindowThreadProcessId(hwndSrc, nullptr), &guiThreadInfo)) {
+		Logger::Get().Win32Error("GetGUIThreadInfo 失败");
+		return false;
+	}
+	if (guiThreadInfo.flags & GUI_INMOVESIZE) {
+		return false;
+	}
+
+	RECT srcWndRect;
+	if (!GetWindowRect(hwndSrc, &srcWndRect)) {
+		Logger::Get().Win32Error("GetWindowRect 失败");
+		return false;
+	}
+
+	// 旧的帧源被销毁后它的输出纹理仍被 _effects 引用
+	winrt::com_ptr<ID3D11Texture2D> oldInput;
+	oldInput.copy_from(MagApp::Get().GetFrameSource().GetOutput());
+
+	// 帧源的输出尺寸和源窗口绑定，需重新创建
+	if (!MagApp::Get().RecreateFrameSource()) {
+		return false;
+	}
+
+	_srcWndRect = srcWndRect;
+	_rebuildResult.oldInput = std::move(oldInput);
+
+	// 输入尺寸改变后可用的档位也可能改变，从原始设置开始
+	if (_prescaleDesc) {
+		_InitResolutionGovernor();
+	}
+
+	_StartRebuildThread();
+	return true;
+}
+
+void Renderer::_StartRebuildThread() {
+	// 帧源轮流使用多个输出纹理，渲染时会重新绑定
+	_rebuildInput.copy_from(MagApp::Get().GetFrameSource().GetOutput());
+
+	_isRebuildDone.store(false, std::memory_order_relaxed);
+	// 切换档位时旧的效果仍在使用它们的纹理
+	_rebuildThread = std::thread(&Renderer::_RebuildEffects, this, !_isSwitchingLevel);
+
+	Logger::Get().Info("开始重建效果");
+}
+
+void Renderer::_RebuildEffects(bool recycleTextures) {
+	EffectTexturePool texturePool;
+	if (recycleTextures) {
+		for (const EffectDrawer& effect : _effects) {
+			effect.GetCreatedTextures(texturePool.recycled);
 		}
 	}
 
-	result.flags = isLastEffect ? EffectFlags::LastEffect : 0;
+	// 共享的中间纹理只保留一个
+	std::vector<winrt::com_ptr<ID3D11Texture2D>>& recycled = texturePool.recycled;
+	std::sort(recycled.begin(), recycled.end(), [](const auto& l, const auto& r) {
+		return l.get() < r.get();
+	});
+	recycled.erase(std::unique(recycled.begin(), recycled.end(), [](const auto& l, const auto& r) {
+		return l.get() == r.get();
+	}), recycled.end());
+	const size_t oldTextureCount = recycled.size();
 
-	if (option.flags & EffectOptionFlags::InlineParams) {
-		result.flags |= EffectFlags::InlineParams;
+	int duration = Utils::Measure([&]() {
+		_rebuildResult.success = _InitializeEffects(_rebuildInput.get(), _rebuildResult.effects,
+			_rebuildResult.outputRect, _rebuildResult.virtualOutputRect, texturePool);
+	});
+
+	if (_rebuildResult.success) {
+		Logger::Get().Info(fmt::format("重建效果用时 {} 毫秒，复用了 {} 个纹理中的 {} 个",
+			duration / 1000.0f, oldTextureCount, texturePool.reusedCount));
 	}
-	if (option.flags & EffectOptionFlags::FP16) {
-		result.flags |= EffectFlags::FP16;
+
+	_rebuildResult.unusedTextures = std::move(recycled);
+
+	_isRebuildDone.store(true, std::memory_order_release);
+	// 唤醒等待消息的主线程
+	MagApp::Get().Dispatcher().TryEnqueue([]() {});
+}
+
+bool Renderer::_FinishRebuild() {
+	_rebuildThread.join();
+
+	_RebuildResult result = std::move(_rebuildResult);
+	_rebuildResult = {};
+	_rebuildInput = nullptr;
+
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+
+	if (_isSwitchingLevel) {
+		_isSwitchingLevel = false;
+
+		if (!result.success) {
+			// 继续使用旧的效果，不再切换档位
+			Logger::Get().Error("切换动态分辨率的档位失败，已禁用动态分辨率");
+			for (const EffectDrawer& effect : result.effects) {
+				effect.GetCreatedTextures(result.unusedTextures);
+			}
+			for (const winrt::com_ptr<ID3D11Texture2D>& texture : result.unusedTextures) {
+				dr.ReleaseViews(texture.get());
+			}
+			// 之后重建时不再插入缩小输入的效果
+			_prescaleDesc.reset();
+			_inputScale = 1.0f;
+			return true;
+		}
+
+		// 新的效果没有复用纹理，旧的纹理都不再使用
+		for (const EffectDrawer& effect : _effects) {
+			effect.GetCreatedTextures(result.unusedTextures);
+		}
+	} else if (!result.success) {
+		return false;
+	}
+
+	_effects = std::move(result.effects);
+	_outputRect = result.outputRect;
+	_virtualOutputRect = result.virtualOutputRect;
+
+	// 上下文中可能仍绑定着即将释放的视图。等待下一帧时 BeginFrame 已执行，这里相当于再执行一次
+	dr.GetD3DDC()->ClearState();
+	dr.GetCSStateTracker().Reset();
+
+	dr.ReleaseViews(result.oldInput.get());
+	for (const winrt::com_ptr<ID3D11Texture2D>& texture : result.unusedTextures) {
+		dr.ReleaseViews(texture.get());
+	}
+
+	// 纹理对象已改变，重新构建帧图
+	_frameGraph = FrameGraph();
+	_frameSchedule = FrameGraphSchedule();
+	_framePasses.clear();
+	_staticPasses.clear();
+	_BuildFrameGraph();
+
+	// 是否降采样或动态分辨率的档位改变时效果的数量也会改变
+	if (_overlayDrawer) {
+		_overlayDrawer->OnEffectsChanged();
+	}
+	if (_gpuTimer->IsProfiling()) {
+		_StartProfiling();
 	}
 
+	return true;
+}
+
+static uint32_t GetCompileFlags() noexcept {
 	uint32_t compileFlag = 0;
 	MagOptions& options = MagApp::Get().GetOptions();
 	if (options.IsDisableEffectCache()) {
@@ -304,10 +596,39 @@ static bool CompileEffect(bool isLastEffect, const EffectOption& option, EffectD
 	if (options.IsWarningsAreErrors()) {
 		compileFlag |= EffectCompilerFlags::WarningsAreErrors;
 	}
+	return compileFlag;
+}
+
+// 动态分辨率在效果链前插入的效果
+static EffectOption GetPrescaleOption(float scale) {
+	EffectOption option;
+	option.name = L"Bilinear";
+	option.scale = { scale, scale };
+	option.flags = EffectOptionFlags::InlineParams;
+	return option;
+}
+
+static bool CompileEffect(bool isLastEffect, const EffectOption& option, EffectDesc& result) {
+	result.name = StrUtils::UTF16ToUTF8(option.name);
+	// 将文件夹分隔符统一为 '\'
+	for (char& c : result.name) {
+		if (c == '/') {
+			c = '\\';
+		}
+	}
+
+	result.flags = isLastEffect ? EffectFlags::LastEffect : 0;
+
+	if (option.flags & EffectOptionFlags::InlineParams) {
+		result.flags |= EffectFlags::InlineParams;
+	}
+	if (option.flags & EffectOptionFlags::FP16) {
+		result.flags |= EffectFlags::FP16;
+	}
 
 	bool success = true;
 	int duration = Utils::Measure([&]() {
-		success = !EffectCompiler::Compile(result, compileFlag, &option.parameters);
+		success = !EffectCompiler::Compile(result, GetCompileFlags(), &option.parameters);
 	});
 
 	if (success) {
@@ -318,19 +639,101 @@ static bool CompileEffect(bool isLastEffect, const EffectOption& option, EffectD
 	return success;
 }
 
+void Renderer::_FuseEffects(std::vector<EffectOption>& effectsOption, std::vector<EffectDesc>& effectDescs) {
+	const uint32_t fuseableFlags = EffectFlags::InlineParams | EffectFlags::FP16;
+	// 降采样时最后一个效果需要重新编译，因此不参与融合
+	const bool hasDownscalingEffect = !MagApp::Get().GetOptions().downscalingEffect.name.empty();
+
+	// 每组为 [first, last]，后面的效果融合进第一个效果的最后一个通道
+	std::vector<std::pair<size_t, size_t>> groups;
+	const size_t effectCount = effectDescs.size();
+	const size_t fuseEnd = hasDownscalingEffect ? effectCount - 1 : effectCount;
+	for (size_t i = 0; i < effectCount; ++i) {
+		if (!effectDescs[i].passes.back().isPSStyle) {
+			continue;
+		}
+
+		size_t j = i + 1;
+		while (j < fuseEnd) {
+			const EffectDesc& desc = effectDescs[j];
+			if (!(desc.flags & EffectFlags::PerPixel) || effectsOption[j].HasScale()
+				|| (desc.flags & fuseableFlags) != (effectDescs[i].flags & fuseableFlags)) {
+				break;
+			}
+			++j;
+		}
+
+		if (j > i + 1) {
+			groups.emplace_back(i, j - 1);
+		}
+		i = j - 1;
+	}
+
+	if (groups.empty()) {
+		return;
+	}
+
+	std::vector<EffectOption> fusedOptions(groups.size());
+	std::vector<EffectDesc> fusedDescs(groups.size());
+	std::vector<uint8_t> fusedSuccess(groups.size());
+
+	TaskScheduler::RunParallel([&](uint32_t id) {
+		const auto [first, last] = groups[id];
+
+		EffectOption& option = fusedOptions[id];
+		option = effectsOption[first];
+		std::vector<std::string> names;
+		names.reserve(last - first + 1);
+		for (size_t i = first; i <= last; ++i) {
+			names.push_back(effectDescs[i].name);
+			if (i != first) {
+				option.name.append(L"+").append(effectsOption[i].name);
+				option.parameters.insert(effectsOption[i].parameters.begin(), effectsOption[i].parameters.end());
+			}
+		}
+
+		EffectDesc& desc = fusedDescs[id];
+		desc.flags = effectDescs[first].flags & fuseableFlags;
+		if (last == effectCount - 1) {
+			desc.flags |= EffectFlags::LastEffect;
+		}
+
+		fusedSuccess[id] = !EffectCompiler::CompileFused(desc, names, GetCompileFlags(), &option.parameters);
+	}, (uint32_t)groups.size());
+
+	// 从后往前替换，以免下标失效
+	for (size_t id = groups.size(); id-- > 0;) {
+		const auto [first, last] = groups[id];
+		if (!fusedSuccess[id]) {
+			Logger::Get().Info(fmt::format("融合效果#{}~#{} 失败，将分别执行", first, last));
+			continue;
+		}
+
+		Logger::Get().Info(StrUtils::Concat("已融合 ", fusedDescs[id].name));
+
+		effectsOption[first] = std::move(fusedOptions[id]);
+		effectDescs[first] = std::move(fusedDescs[id]);
+		effectsOption.erase(effectsOption.begin() + first + 1, effectsOption.begin() + last + 1);
+		effectDescs.erase(effectDescs.begin() + first + 1, effectDescs.begin() + last + 1);
+	}
+}
+
 bool Renderer::_BuildEffects() {
-	const std::vector<EffectOption>& effectsOption = MagApp::Get().GetOptions().effects;
+	// 融合后效果的数量可能减少
+	_effectsOption = MagApp::Get().GetOptions().effects;
+	std::vector<EffectOption>& effectsOption = _effectsOption;
 	uint32_t effectCount = (int)effectsOption.size();
 	if (effectCount == 0) {
 		return false;
 	}
 
-	// 并行编译所有效果
-	std::vector<EffectDesc> effectDescs(effectsOption.size());
+	// 并行编译所有效果，各效果的通道在 TaskScheduler 中共用一个队列
+	_effectDescs.resize(effectsOption.size());
+	std::vector<EffectDesc>& effectDescs = _effectDescs;
 	std::atomic<bool> allSuccess = true;
 
 	int duration = Utils::Measure([&]() {
-		Win32Utils::RunParallel([&](uint32_t id) {
+		TaskScheduler::RunParallel([&](uint32_t id) {
 			if (!CompileEffect(id == effectCount - 1, effectsOption[id], effectDescs[id])) {
 				allSuccess = false;
 			}
@@ -343,34 +746,68 @@ bool Renderer::_BuildEffects() {
 
 	if (effectCount > 1) {
 		Logger::Get().Info(fmt::format("编译着色器总计用时 {} 毫秒", duration / 1000.0f));
+
+		_FuseEffects(effectsOption, effectDescs);
 	}
 
-	ID3D11Texture2D* effectInput = MagApp::Get().GetFrameSource().GetOutput();
+	// 生命周期不重叠的中间纹理共享显存
+	EffectTexturePool texturePool;
+	return _InitializeEffects(MagApp::Get().GetFrameSource().GetOutput(),
+		_effects, _outputRect, _virtualOutputRect, texturePool);
+}
+
+bool Renderer::_InitializeEffects(
+	ID3D11Texture2D* input,
+	std::vector<EffectDrawer>& effects,
+	RECT& outputRect,
+	RECT& virtualOutputRect,
+	EffectTexturePool& texturePool
+) const {
+	const std::vector<EffectOption>& effectsOption = _effectsOption;
+	const std::vector<EffectDesc>& effectDescs = _effectDescs;
+	const uint32_t effectCount = (uint32_t)effectsOption.size();
+
+	ID3D11Texture2D* effectInput = input;
+
+	// 动态分辨率降档时第一个效果缩小输入
+	const uint32_t offset = _inputScale < 1.0f ? 1 : 0;
 
 	DownscalingEffect& downscalingEffect = MagApp::Get().GetOptions().downscalingEffect;
 	if (!downscalingEffect.name.empty()) {
-		_effects.reserve(effectsOption.size() + 1);
+		effects.reserve(effectsOption.size() + offset + 1);
+	}
+	effects.resize(effectsOption.size() + offset);
+
+	if (offset > 0) {
+		if (!effects[0].Initialize(*_prescaleDesc, GetPrescaleOption(_inputScale),
+			effectInput, nullptr, nullptr, &texturePool)
+		) {
+			Logger::Get().Error("初始化缩小输入的效果失败");
+			return false;
+		}
+
+		effectInput = effects[0].GetOutputTexture();
 	}
-	_effects.resize(effectsOption.size());
 
 	for (uint32_t i = 0; i < effectCount; ++i) {
 		bool isLastEffect = i == effectCount - 1;
 
-		if (!_effects[i].Initialize(
+		if (!effects[i + offset].Initialize(
 			effectDescs[i], effectsOption[i], effectInput,
-			isLastEffect ? &_outputRect : nullptr,
-			isLastEffect ? &_virtualOutputRect : nullptr
+			isLastEffect ? &outputRect : nullptr,
+			isLastEffect ? &virtualOutputRect : nullptr,
+			&texturePool
 		)) {
 			Logger::Get().Error(fmt::format("初始化效果#{} ({}) 失败", i, StrUtils::UTF16ToUTF8(effectsOption[i].name)));
 			return false;
 		}
 
-		effectInput = _effects[i].GetOutputTexture();
+		effectInput = effects[i + offset].GetOutputTexture();
 	}
 	
 	if (!downscalingEffect.name.empty()) {
 		const SIZE hostSize = Win32Utils::GetSizeOfRect(MagApp::Get().GetHostWndRect());
-		const SIZE outputSize = Win32Utils::GetSizeOfRect(_virtualOutputRect);
+		const SIZE outputSize = Win32Utils::GetSizeOfRect(virtualOutputRect);
 		if (outputSize.cx > hostSize.cx || outputSize.cy > hostSize.cy) {
 			// 需降采样
 			EffectOption downscalingEffectOption;
@@ -379,16 +816,18 @@ bool Renderer::_BuildEffects() {
 			downscalingEffectOption.scalingType = ScalingType::Fit;
 			downscalingEffectOption.flags = EffectOptionFlags::InlineParams;	// 内联参数
 
+			EffectDesc originLastEffectDesc;
 			EffectDesc downscalingEffectDesc;
+			std::atomic<bool> allSuccess = true;
 
 			// 最后一个效果需重新编译
 			// 在分离光标渲染逻辑后这里可优化
-			duration = Utils::Measure([&]() {
-				Win32Utils::RunParallel([&](uint32_t id) {
+			int duration = Utils::Measure([&]() {
+				TaskScheduler::RunParallel([&](uint32_t id) {
 					if (!CompileEffect(
 						id == 1,
 						id == 0 ? effectsOption.back() : downscalingEffectOption,
-						id == 0 ? effectDescs.back() : downscalingEffectDesc
+						id == 0 ? originLastEffectDesc : downscalingEffectDesc
 					)) {
 						allSuccess = false;
 					}
@@ -401,29 +840,29 @@ bool Renderer::_BuildEffects() {
 			
 			Logger::Get().Info(fmt::format("编译降采样着色器用时 {} 毫秒", duration / 1000.0f));
 
-			_effects.pop_back();
-			if (_effects.empty()) {
-				effectInput = MagApp::Get().GetFrameSource().GetOutput();
+			effects.pop_back();
+			if (effects.empty()) {
+				effectInput = input;
 			} else {
-				effectInput = _effects.back().GetOutputTexture();
+				effectInput = effects.back().GetOutputTexture();
 			}
 
-			_effects.resize(_effects.size() + 2);
+			effects.resize(effects.size() + 2);
 
 			// 重新构建最后一个效果
-			const size_t originLastEffectIdx = _effects.size() - 2;
-			if (!_effects[originLastEffectIdx].Initialize(effectDescs.back(), effectsOption.back(),
-				effectInput, nullptr, nullptr)
+			const size_t originLastEffectIdx = effects.size() - 2;
+			if (!effects[originLastEffectIdx].Initialize(originLastEffectDesc, effectsOption.back(),
+				effectInput, nullptr, nullptr, &texturePool)
 			) {
 				Logger::Get().Error(fmt::format("初始化效果#{} ({}) 失败",
 					originLastEffectIdx, StrUtils::UTF16ToUTF8(effectsOption.back().name)));
 				return false;
 			}
-			effectInput = _effects[originLastEffectIdx].GetOutputTexture();
+			effectInput = effects[originLastEffectIdx].GetOutputTexture();
 
 			// 构建降采样效果
-			if (!_effects.back().Initialize(downscalingEffectDesc, downscalingEffectOption,
-				effectInput, &_outputRect, &_virtualOutputRect
+			if (!effects.back().Initialize(downscalingEffectDesc, downscalingEffectOption,
+				effectInput, &outputRect, &virtualOutputRect, &texturePool
 			)) {
 				Logger::Get().Error(fmt::format("初始化降采样效果 ({}) 失败",
 					StrUtils::UTF16ToUTF8(downscalingEffect.name)));
@@ -431,16 +870,315 @@ bool Renderer::_BuildEffects() {
 		}
 	}
 
+	// 降采样时被替换的最后一个效果也计入在内
+	Logger::Get().Info(fmt::format("中间纹理占用显存 {:.1f} MiB，共享后 {:.1f} MiB",
+		texturePool.planner.GetLogicalBytes() / 1048576.0, texturePool.planner.GetPhysicalBytes() / 1048576.0));
+
 	return true;
 }
 
-bool Renderer::_UpdateDynamicConstants() {
+// 档位越高输入越小，开销大致和像素数成正比
+static constexpr std::array<float, 4> INPUT_SCALES = { 1.0f, 0.85f, 0.7f, 0.5f };
+
+static float GetRefreshInterval(HWND hWnd) noexcept {
+	HMONITOR hMon = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST);
+	MONITORINFOEX mi{};
+	mi.cbSize = sizeof(mi);
+	DEVMODE dm{};
+	dm.dmSize = sizeof(dm);
+	// 0 和 1 表示硬件的默认刷新率
+	if (GetMonitorInfo(hMon, &mi) && EnumDisplaySettings(mi.szDevice, ENUM_CURRENT_SETTINGS, &dm)
+		&& dm.dmDisplayFrequency > 1) {
+		return 1000.0f / dm.dmDisplayFrequency;
+	}
+
+	Logger::Get().Info("无法获取刷新率，假设为 60Hz");
+	return 1000.0f / 60;
+}
+
+void Renderer::_InitResolutionGovernor() {
+	if (!_prescaleDesc) {
+		_prescaleDesc = std::make_unique<EffectDesc>();
+		if (!CompileEffect(false, GetPrescaleOption(1.0f), *_prescaleDesc)) {
+			_prescaleDesc.reset();
+			Logger::Get().Error("动态分辨率不可用");
+			return;
+		}
+	}
+
+	const SIZE hostSize = Win32Utils::GetSizeOfRect(MagApp::Get().GetHostWndRect());
+	auto calcOutputSize = [&](float inputScale, SIZE& outputSize) {
+		SIZE inputSize = Win32Utils::GetSizeOfRect(MagApp::Get().GetFrameSource().GetSrcFrameRect());
+		if (inputScale < 1.0f) {
+			if (!EffectDrawer::CalcOutputSize(*_prescaleDesc, GetPrescaleOption(inputScale), inputSize, hostSize, inputSize)) {
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < _effectDescs.size(); ++i) {
+			if (!EffectDrawer::CalcOutputSize(_effectDescs[i], _effectsOption[i], inputSize, hostSize, outputSize)) {
+				return false;
+			}
+			inputSize = outputSize;
+		}
+		return true;
+	};
+
+	// 只有最终输出的尺寸不变时才能缩小输入，如最后一个效果缩放到适应窗口
+	std::vector<float> levelCosts{ 1.0f };
+	SIZE originOutputSize{};
+	if (calcOutputSize(1.0f, originOutputSize)) {
+		for (size_t i = 1; i < INPUT_SCALES.size(); ++i) {
+			SIZE outputSize{};
+			if (!calcOutputSize(INPUT_SCALES[i], outputSize)
+				|| std::abs(outputSize.cx - originOutputSize.cx) > 1
+				|| std::abs(outputSize.cy - originOutputSize.cy) > 1) {
+				break;
+			}
+			levelCosts.push_back(INPUT_SCALES[i] * INPUT_SCALES[i]);
+		}
+	}
+
+	// 留出叠加层和合成的时间
+	const float budget = GetRefreshInterval(MagApp::Get().GetHwndHost()) * 0.8f;
+	_resolutionGovernor.Initialize(budget, levelCosts);
+	_inputScale = 1.0f;
+	_gpuTimeSum = 0.0f;
+	_gpuTimeSampleCount = 0;
+	_gpuTimeWindowStart = 0;
+
+	if (levelCosts.size() > 1) {
+		Logger::Get().Info(fmt::format("动态分辨率：预算 {:.1f} 毫秒，共 {} 个档位", budget, levelCosts.size()));
+		// 只测量每帧的总用时，不影响命令列表
+		_gpuTimer->StartFrameTiming();
+		_lastFrameGPUTimeCount = _gpuTimer->GetFrameGPUTimeCount();
+	} else {
+		Logger::Get().Info("效果链的输出尺寸取决于输入，动态分辨率不生效");
+		if (!_isPacing) {
+			_gpuTimer->StopFrameTiming();
+		}
+	}
+}
+
+void Renderer::_UpdateResolutionGovernor() {
+	// 切换档位期间的用时来自旧的效果
+	if (_resolutionGovernor.GetLevelCount() <= 1 || _rebuildThread.joinable()) {
+		return;
+	}
+
+	const uint32_t frameGPUTimeCount = _gpuTimer->GetFrameGPUTimeCount();
+	if (frameGPUTimeCount == _lastFrameGPUTimeCount) {
+		return;
+	}
+	_lastFrameGPUTimeCount = frameGPUTimeCount;
+
+	const int64_t now = GetMicroseconds();
+	if (_gpuTimeSampleCount == 0) {
+		_gpuTimeWindowStart = now;
+	}
+	_gpuTimeSum += _gpuTimer->GetLastFrameGPUTime();
+	++_gpuTimeSampleCount;
+
+	// 每 500ms 的平均值作为一个样本，和叠加层更新渲染用时的间隔相同
+	if (now - _gpuTimeWindowStart < 500000) {
+		return;
+	}
+
+	const float gpuTime = _gpuTimeSum / _gpuTimeSampleCount;
+	_gpuTimeSum = 0.0f;
+	_gpuTimeSampleCount = 0;
+
+	if (!_resolutionGovernor.Update(gpuTime)) {
+		return;
+	}
+
+	const uint32_t level = _resolutionGovernor.GetLevel();
+	_inputScale = INPUT_SCALES[level];
+	Logger::Get().Info(fmt::format("动态分辨率：渲染用时 {:.1f} 毫秒，预算 {:.1f} 毫秒，切换到档位 {}（输入缩放 {}）",
+		gpuTime, _resolutionGovernor.GetBudget(), level, _inputScale));
+
+	// 帧源不变，只重建效果。新的效果就绪前继续使用旧的效果渲染
+	_isSwitchingLevel = true;
+	_StartRebuildThread();
+}
+
+void Renderer::_CancelLevelSwitch() {
+	_rebuildThread.join();
+	_isSwitchingLevel = false;
+
+	_RebuildResult result = std::move(_rebuildResult);
+	_rebuildResult = {};
+	_rebuildInput = nullptr;
+
+	DeviceResources& dr = MagApp::Get().GetDeviceResources();
+	for (const EffectDrawer& effect : result.effects) {
+		effect.GetCreatedTextures(result.unusedTextures);
+	}
+	for (const winrt::com_ptr<ID3D11Texture2D>& texture : result.unusedTextures) {
+		dr.ReleaseViews(texture.get());
+	}
+
+	Logger::Get().Info("已放弃切换动态分辨率的档位");
+}
+
+void Renderer::_StartProfiling() {
+	uint32_t passCount = 0;
+	for (const auto& effect : _effects) {
+		passCount += (uint32_t)effect.GetDesc().passes.size();
+	}
+
+	// StartProfiling 必须在 OnBeginFrame 之前调用
+	_gpuTimer->StopProfiling();
+	_gpuTimer->StartProfiling(500ms, passCount);
+}
+
+void Renderer::_WaitForRenderStart() {
+	DWM_TIMING_INFO timingInfo{};
+	timingInfo.cbSize = sizeof(timingInfo);
+	HRESULT hr = DwmGetCompositionTimingInfo(NULL, &timingInfo);
+	if (FAILED(hr)) {
+		return;
+	}
+
+	const int64_t now = GetMicroseconds();
+	const int64_t startTime = _framePacer.CalcRenderStartTime(now,
+		QPCToMicroseconds(timingInfo.qpcVBlank), QPCToMicroseconds(timingInfo.qpcRefreshPeriod));
+	if (startTime <= now) {
+		return;
+	}
+
+	if (_pacingTimer) {
+		// 负值表示相对时间，单位为 100ns
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(startTime - now) * 10;
+		if (SetWaitableTimerEx(_pacingTimer.get(), &dueTime, 0, nullptr, nullptr, nullptr, 0)) {
+			WaitForSingleObject(_pacingTimer.get(), INFINITE);
+			return;
+		}
+	}
+
+	Sleep(DWORD((startTime - now) / 1000));
+}
+
+void Renderer::_BuildFrameGraph() {
+	auto getTextureSize = [](ID3D11Texture2D* texture) {
+		D3D11_TEXTURE2D_DESC desc;
+		texture->GetDesc(&desc);
+		return SIZE{ (LONG)desc.Width, (LONG)desc.Height };
+	};
+
+	// 以纹理对象为资源，共享的中间纹理是同一个资源
+	phmap::flat_hash_map<ID3D11Texture2D*, uint32_t> resources;
+	auto getResource = [&](ID3D11Texture2D* texture, std::string_view name) {
+		auto [it, inserted] = resources.try_emplace(texture, 0);
+		if (inserted) {
+			it->second = _frameGraph.AddResource(std::string(name), getTextureSize(texture));
+		}
+		return it->second;
+	};
+
+	_frameSourceResource = getResource(MagApp::Get().GetFrameSource().GetOutput(), "INPUT");
+	_frameGraph.SetSource(_frameSourceResource);
+	_frameGraph.SetOutput(getResource(MagApp::Get().GetDeviceResources().GetBackBuffer(), "OUTPUT"));
+
+	SmallVector<ID3D11Texture2D*> inputTextures;
+	SmallVector<ID3D11Texture2D*> outputTextures;
+	SmallVector<uint32_t> inputs;
+	SmallVector<uint32_t> outputs;
+	for (uint32_t i = 0; i < (uint32_t)_effects.size(); ++i) {
+		const EffectDrawer& effect = _effects[i];
+		const EffectDesc& desc = effect.GetDesc();
+
+		for (uint32_t j = 0; j < (uint32_t)desc.passes.size(); ++j) {
+			effect.GetPassTextures(j, inputTextures, outputTextures);
+
+			const EffectPassDesc& passDesc = desc.passes[j];
+			inputs.clear();
+			for (uint32_t k = 0; k < (uint32_t)inputTextures.size(); ++k) {
+				inputs.push_back(getResource(inputTextures[k], fmt::format("{}/{}", desc.name, desc.textures[passDesc.inputs[k]].name)));
+			}
+
+			outputs.clear();
+			for (uint32_t k = 0; k < (uint32_t)outputTextures.size(); ++k) {
+				outputs.push_back(getResource(outputTextures[k], passDesc.outputs.empty()
+					? fmt::format("{}/OUTPUT", desc.name)
+					: fmt::format("{}/{}", desc.name, desc.textures[passDesc.outputs[k]].name)));
+			}
+
+			_frameGraph.AddPass(fmt::format("{}#{}", desc.name, j + 1),
+				inputs, outputs, effect.IsUseDynamic(), passDesc.radius);
+			_framePasses.emplace_back(i, j);
+		}
+	}
+
+	_frameGraph.Compile();
+
+	uint32_t culledCount = 0;
+	for (uint32_t i = 0; i < _frameGraph.GetPassCount(); ++i) {
+		if (_frameGraph.IsCulled(i)) {
+			++culledCount;
+		}
+	}
+	if (culledCount > 0) {
+		Logger::Get().Info(fmt::format("剔除了 {} 个对输出没有贡献的通道", culledCount));
+	}
+
+	if (MagApp::Get().GetOptions().IsDebugMode()) {
+		Logger::Get().Info(StrUtils::Concat("帧图：\n", _frameGraph.ToDot()));
+	}
+}
+
+winrt::com_ptr<ID3D11CommandList> Renderer::_RecordStaticPasses() {
+	ID3D11Device5* d3dDevice = MagApp::Get().GetDeviceResources().GetD3DDevice();
+
+	winrt::com_ptr<ID3D11DeviceContext> deferredDC;
+	HRESULT hr = d3dDevice->CreateDeferredContext(0, deferredDC.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("CreateDeferredContext 失败", hr);
+		_isCommandListSupported = false;
+		return nullptr;
+	}
+
+	// 延迟上下文的初始状态为默认状态
+	CSStateTracker csState;
+	csState.Initialize(deferredDC.get());
+	csState.SetConstantBuffer(0, _dynamicCB.get());
+
+	// 最后一个通道需要绑定光标纹理，不录制
+	uint32_t curEffectIdx = UINT_MAX;
+	for (uint32_t i = 0, end = _frameGraph.GetPassCount() - 1; i < end; ++i) {
+		if (_frameGraph.IsCulled(i)) {
+			continue;
+		}
+
+		const auto [effectIdx, passIdx] = _framePasses[i];
+		if (effectIdx != curEffectIdx) {
+			_effects[effectIdx].BeginDraw(csState);
+			curEffectIdx = effectIdx;
+		}
+		_effects[effectIdx].DrawPass(csState, passIdx);
+	}
+
+	winrt::com_ptr<ID3D11CommandList> commandList;
+	hr = deferredDC->FinishCommandList(FALSE, commandList.put());
+	if (FAILED(hr)) {
+		Logger::Get().ComError("FinishCommandList 失败", hr);
+		_isCommandListSupported = false;
+		return nullptr;
+	}
+
+	Logger::Get().Info("已录制静态通道");
+	return commandList;
+}
+
+void Renderer::_UpdateDynamicConstants() {
 	// cbuffer __CB1 : register(b0) {
 	//     int4 __cursorRect;
 	//     float2 __cursorPt;
 	//     uint2 __cursorPos;
 	//     uint __cursorType;
 	//     uint __frameCount;
+	//     uint2 __blockOffset;
 	// };
 
 	CursorManager& cursorManager = MagApp::Get().GetCursorManager();
@@ -490,20 +1228,25 @@ bool Renderer::_UpdateDynamicConstants() {
 	}
 
 	_dynamicConstants[9].uintVal = _gpuTimer->GetFrameCount();
+	_dynamicConstants[10].uintVal = 0;
+	_dynamicConstants[11].uintVal = 0;
 
-	auto d3dDC = MagApp::Get().GetDeviceResources().GetD3DDC();
+	_UploadDynamicConstants();
+}
 
-	D3D11_MAPPED_SUBRESOURCE ms;
-	HRESULT hr = d3dDC->Map(_dynamicCB.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &ms);
-	if (SUCCEEDED(hr)) {
-		std::memcpy(ms.pData, _dynamicConstants.data(), _dynamicConstants.size() * 4);
-		d3dDC->Unmap(_dynamicCB.get(), 0);
-	} else {
-		Logger::Get().ComError("Map 失败", hr);
-		return false;
+void Renderer::_SetBlockOffset(uint32_t x, uint32_t y) {
+	if (_dynamicConstants[10].uintVal == x && _dynamicConstants[11].uintVal == y) {
+		return;
 	}
 
-	return true;
+	_dynamicConstants[10].uintVal = x;
+	_dynamicConstants[11].uintVal = y;
+	_UploadDynamicConstants();
+}
+
+void Renderer::_UploadDynamicConstants() {
+	MagApp::Get().GetDeviceResources().GetD3DDC()
+		->UpdateSubresource(_dynamicCB.get(), 0, nullptr, _dynamicConstants.data(), 0, 0);
 }
 
 }
@@ -1,5 +1,10 @@
 #pragma once
 #include "EffectHelper.h"
+#include "FrameGraph.h"
+#include "ResolutionGovernor.h"
+#include "FramePacer.h"
+#include "Win32Utils.h"
+#include <thread>
 
 namespace Magpie::Core {
 
@@ -8,6 +13,8 @@ class OverlayDrawer;
 class CursorManager;
 class EffectDrawer;
 struct EffectDesc;
+struct EffectOption;
+struct EffectTexturePool;
 
 class Renderer {
 public:
@@ -21,6 +28,12 @@ public:
 
 	void Render(bool onPrint = false);
 
+	// 在后台重建效果，此时缩放窗口保持显示最后一帧，消息循环无需调用 Render
+	// 切换动态分辨率的档位时旧的效果仍在渲染，不算作重建
+	bool IsRebuilding() const noexcept {
+		return _rebuildThread.joinable() && !_isRebuildDone.load(std::memory_order_acquire) && !_isSwitchingLevel;
+	}
+
 	GPUTimer& GetGPUTimer() {
 		return *_gpuTimer;
 	}
@@ -46,12 +59,65 @@ public:
 
 	const EffectDesc& GetEffectDesc(uint32_t idx) const noexcept;
 
+	const FramePacer& GetFramePacer() const noexcept {
+		return _framePacer;
+	}
+
 private:
 	int _CheckSrcState();
 
 	bool _BuildEffects();
 
-	bool _UpdateDynamicConstants();
+	// 使用 _BuildEffects 编译的效果创建纹理和着色器，不修改成员，因此可以在后台线程重建
+	bool _InitializeEffects(
+		ID3D11Texture2D* input,
+		std::vector<EffectDrawer>& effects,
+		RECT& outputRect,
+		RECT& virtualOutputRect,
+		EffectTexturePool& texturePool
+	) const;
+
+	// 将逐像素效果融合进前一个效果，失败时保持原样
+	void _FuseEffects(std::vector<EffectOption>& effectsOption, std::vector<EffectDesc>& effectDescs);
+
+	// 在 _BuildEffects 之后调用
+	void _BuildFrameGraph();
+
+	// 将除最后一个通道外的所有通道录制到命令列表，绑定的是效果当前的输入
+	winrt::com_ptr<ID3D11CommandList> _RecordStaticPasses();
+
+	void _UpdateDynamicConstants();
+
+	// 局部渲染时线程组的偏移，和上次相同时不重新上传常量缓冲区
+	void _SetBlockOffset(uint32_t x, uint32_t y);
+
+	void _UploadDynamicConstants();
+
+	// 源窗口大小或位置改变后重新创建帧源，并在后台线程重建效果。失败时需重新缩放
+	bool _StartRebuild();
+
+	void _StartRebuildThread();
+
+	// 在后台线程执行，recycleTextures 为 true 时尺寸未改变的纹理直接复用
+	void _RebuildEffects(bool recycleTextures);
+
+	// 替换为重建的效果，返回 false 时需重新缩放
+	bool _FinishRebuild();
+
+	// 检查效果链能否缩小输入，初始化动态分辨率
+	void _InitResolutionGovernor();
+
+	// 根据最近的效果用时切换档位，需要时在后台重建效果，期间继续使用旧的效果渲染
+	void _UpdateResolutionGovernor();
+
+	// 源窗口状态改变时放弃正在进行的档位切换
+	void _CancelLevelSwitch();
+
+	// 叠加层需要每个通道的渲染用时
+	void _StartProfiling();
+
+	// 等待到帧调度确定的开始渲染的时间
+	void _WaitForRenderStart();
 
 	RECT _srcWndRect{};
 	RECT _outputRect{};
@@ -60,10 +126,62 @@ private:
 
 	bool _waitingForNextFrame = false;
 
+	// 编译并融合后的效果，重建时不再编译
+	std::vector<EffectOption> _effectsOption;
+	std::vector<EffectDesc> _effectDescs;
 	std::vector<EffectDrawer> _effects;
+
+	// 后台线程只使用 D3D 设备和 DeviceResources 中加锁的缓存，不使用设备上下文
+	std::thread _rebuildThread;
+	std::atomic<bool> _isRebuildDone = false;
+	struct _RebuildResult {
+		std::vector<EffectDrawer> effects;
+		RECT outputRect{};
+		RECT virtualOutputRect{};
+		// 替换后释放这些纹理的视图
+		winrt::com_ptr<ID3D11Texture2D> oldInput;
+		std::vector<winrt::com_ptr<ID3D11Texture2D>> unusedTextures;
+		bool success = false;
+	} _rebuildResult;
+	// 重建的效果的输入，启动后台线程前设置
+	winrt::com_ptr<ID3D11Texture2D> _rebuildInput;
+	// 正在为切换档位重建，只由渲染线程访问
+	bool _isSwitchingLevel = false;
+
+	// 动态分辨率通过在效果链前插入缩小输入的效果降低开销
+	ResolutionGovernor _resolutionGovernor;
+	// 为空表示未启用
+	std::unique_ptr<EffectDesc> _prescaleDesc;
+	// 当前档位对输入的缩放，为 1 时不插入
+	float _inputScale = 1.0f;
+	// 将一段时间内的效果用时平均后作为一个样本
+	uint32_t _lastFrameGPUTimeCount = 0;
+	float _gpuTimeSum = 0.0f;
+	uint32_t _gpuTimeSampleCount = 0;
+	int64_t _gpuTimeWindowStart = 0;
+
+	// 始终记录延迟，只在开启垂直同步且不允许额外延迟时推迟渲染
+	FramePacer _framePacer;
+	Win32Utils::ScopedHandle _pacingTimer;
+	bool _isPacing = false;
+	// 单位为微秒，_captureTime 为负表示本帧没有新的捕获
+	int64_t _captureStartTime = 0;
+	int64_t _captureTime = -1;
+
+	// 所有效果的通道构成的帧图，节点按执行顺序排列
+	FrameGraph _frameGraph;
+	FrameGraphSchedule _frameSchedule;
+	// 帧图中每个通道对应的效果和通道序号
+	std::vector<std::pair<uint32_t, uint32_t>> _framePasses;
+	uint32_t _frameSourceResource = 0;
 	std::array<EffectHelper::Constant32, 12> _dynamicConstants;
 	winrt::com_ptr<ID3D11Buffer> _dynamicCB;
 
+	// 所有通道都完整执行时，最后一个通道之前的部分每帧都相同
+	// 帧源轮流使用多个输出纹理，每个输入各录制一个
+	SmallVector<std::pair<ID3D11Texture2D*, winrt::com_ptr<ID3D11CommandList>>, 3> _staticPasses;
+	bool _isCommandListSupported = false;
+
 	std::unique_ptr<OverlayDrawer> _overlayDrawer;
 
 	std::unique_ptr<GPUTimer> _gpuTimer;
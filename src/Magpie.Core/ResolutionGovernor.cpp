@@ -0,0 +1,81 @@
+#include "pch.h"
+#include "ResolutionGovernor.h"
+
+namespace Magpie::Core {
+
+void ResolutionGovernor::Initialize(float budget, std::span<const float> levelCosts) noexcept {
+	assert(!levelCosts.empty() && levelCosts[0] == 1.0f);
+
+	_budget = budget;
+	_levelCosts.assign(levelCosts.begin(), levelCosts.end());
+	_upgradeSamples = MIN_UPGRADE_SAMPLES;
+	_samplesSinceUpgrade = UINT_MAX;
+	_SetLevel(0);
+	_skipNextSample = false;
+}
+
+bool ResolutionGovernor::Update(float gpuTime) noexcept {
+	if (_levelCosts.size() <= 1) {
+		return false;
+	}
+
+	if (_skipNextSample) {
+		_skipNextSample = false;
+		return false;
+	}
+
+	if (_samplesSinceUpgrade != UINT_MAX) {
+		++_samplesSinceUpgrade;
+	}
+
+	if (gpuTime > _budget) {
+		_headroomSamples = 0;
+
+		if (_level + 1 == _levelCosts.size()) {
+			return false;
+		}
+
+		if (++_overBudgetSamples < DOWNGRADE_SAMPLES) {
+			return false;
+		}
+
+		// 升档后很快又超出预算说明估计偏乐观
+		if (_samplesSinceUpgrade <= _upgradeSamples) {
+			_upgradeSamples = std::min(_upgradeSamples * 2, MAX_UPGRADE_SAMPLES);
+		}
+		_samplesSinceUpgrade = UINT_MAX;
+
+		_SetLevel(_level + 1);
+		return true;
+	}
+
+	_overBudgetSamples = 0;
+
+	if (_level == 0) {
+		return false;
+	}
+
+	// 假设用时和档位的相对开销成正比
+	const float estimated = gpuTime * _levelCosts[_level - 1] / _levelCosts[_level];
+	if (estimated > _budget * HEADROOM) {
+		_headroomSamples = 0;
+		return false;
+	}
+
+	if (++_headroomSamples < _upgradeSamples) {
+		return false;
+	}
+
+	_samplesSinceUpgrade = 0;
+	_SetLevel(_level - 1);
+	return true;
+}
+
+void ResolutionGovernor::_SetLevel(uint32_t level) noexcept {
+	_level = level;
+	_overBudgetSamples = 0;
+	_headroomSamples = 0;
+	_skipNextSample = true;
+}
+
+}
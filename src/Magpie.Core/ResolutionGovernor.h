@@ -0,0 +1,55 @@
+#pragma once
+#include "ExportHelper.h"
+#include "SmallVector.h"
+
+namespace Magpie::Core {
+
+// 动态分辨率的控制器，根据渲染用时选择档位。档位 0 为原始设置，档位越高开销越小
+// 不涉及 D3D 和计时，结果只取决于输入的样本序列
+class API_DECLSPEC ResolutionGovernor {
+public:
+	// budget 为渲染用时的预算，单位为 ms
+	// levelCosts 为各档位相对于档位 0 的开销，第一个为 1 且应递减。只有一个档位时不会切换
+	void Initialize(float budget, std::span<const float> levelCosts) noexcept;
+
+	// 每得到一个渲染用时的样本调用一次，返回 true 表示档位已改变
+	// 连续超出预算时降档；估计升档后的用时仍有余量时才升档，升档后很快又超出预算则下次等待更久
+	bool Update(float gpuTime) noexcept;
+
+	uint32_t GetLevel() const noexcept {
+		return _level;
+	}
+
+	uint32_t GetLevelCount() const noexcept {
+		return (uint32_t)_levelCosts.size();
+	}
+
+	float GetBudget() const noexcept {
+		return _budget;
+	}
+
+private:
+	void _SetLevel(uint32_t level) noexcept;
+
+	// 连续超出预算的样本数达到此值时降档
+	static constexpr uint32_t DOWNGRADE_SAMPLES = 2;
+	// 估计的升档后用时不超过预算的此比例才算有余量
+	static constexpr float HEADROOM = 0.8f;
+	// 连续有余量的样本数达到此值时升档
+	static constexpr uint32_t MIN_UPGRADE_SAMPLES = 6;
+	static constexpr uint32_t MAX_UPGRADE_SAMPLES = 96;
+
+	SmallVector<float, 4> _levelCosts;
+	float _budget = 0.0f;
+	uint32_t _level = 0;
+
+	uint32_t _overBudgetSamples = 0;
+	uint32_t _headroomSamples = 0;
+	uint32_t _upgradeSamples = MIN_UPGRADE_SAMPLES;
+	// 上次升档后的样本数，UINT_MAX 表示之后已降档
+	uint32_t _samplesSinceUpgrade = UINT_MAX;
+	// 切换后的第一个样本可能包含切换前的帧
+	bool _skipNextSample = false;
+};
+
+}
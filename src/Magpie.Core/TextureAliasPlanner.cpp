@@ -0,0 +1,43 @@
+#include "pch.h"
+#include "TextureAliasPlanner.h"
+
+namespace Magpie::Core {
+
+uint32_t TextureAliasPlanner::Add(
+	uint32_t format,
+	uint32_t width,
+	uint32_t height,
+	uint64_t bytes,
+	uint32_t firstPass,
+	uint32_t lastPass,
+	bool isPersistent
+) noexcept {
+	assert(firstPass <= lastPass);
+
+	_logicalBytes += bytes;
+
+	if (!isPersistent) {
+		assert(firstPass >= _lastFirstPass);
+		_lastFirstPass = firstPass;
+
+		// 物理纹理上的所有纹理都在 firstPass 之前结束才能复用。按 firstPass 递增的顺序添加时
+		// 这等价于区间图着色的贪心算法，所需的物理纹理数最少
+		for (uint32_t i = 0; i < (uint32_t)_physicals.size(); ++i) {
+			_Physical& physical = _physicals[i];
+			if (physical.isPersistent || physical.lastPass >= firstPass) {
+				continue;
+			}
+
+			if (physical.format == format && physical.width == width && physical.height == height) {
+				physical.lastPass = lastPass;
+				return i;
+			}
+		}
+	}
+
+	_physicals.push_back({ format, width, height, lastPass, isPersistent });
+	_physicalBytes += bytes;
+	return (uint32_t)_physicals.size() - 1;
+}
+
+}
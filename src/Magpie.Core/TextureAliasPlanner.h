@@ -0,0 +1,54 @@
+#pragma once
+#include "ExportHelper.h"
+
+namespace Magpie::Core {
+
+// 为中间纹理分配物理纹理，生命周期不重叠且格式和尺寸相同的纹理共享同一个物理纹理
+// 只做规划，不涉及 D3D，物理纹理由调用者创建
+class API_DECLSPEC TextureAliasPlanner {
+public:
+	// 通道使用全局序号，即所有效果的通道依次编号
+	// 非 isPersistent 的纹理须按 firstPass 递增的顺序添加，否则所需的物理纹理数不是最少
+	// 返回物理纹理的序号，等于调用前的 GetPhysicalCount() 时调用者需新建物理纹理
+	// isPersistent 的纹理内容需要跨帧保留，不和其他纹理共享，可以在任何时候添加
+	uint32_t Add(
+		uint32_t format,
+		uint32_t width,
+		uint32_t height,
+		uint64_t bytes,
+		uint32_t firstPass,
+		uint32_t lastPass,
+		bool isPersistent
+	) noexcept;
+
+	uint32_t GetPhysicalCount() const noexcept {
+		return (uint32_t)_physicals.size();
+	}
+
+	// 不共享时所需的显存
+	uint64_t GetLogicalBytes() const noexcept {
+		return _logicalBytes;
+	}
+
+	uint64_t GetPhysicalBytes() const noexcept {
+		return _physicalBytes;
+	}
+
+private:
+	struct _Physical {
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		// 使用它的所有纹理中最后一个通道的序号
+		uint32_t lastPass;
+		bool isPersistent;
+	};
+
+	std::vector<_Physical> _physicals;
+	// 上次添加的非 isPersistent 的纹理的 firstPass，用于检查添加的顺序
+	uint32_t _lastFirstPass = 0;
+	uint64_t _logicalBytes = 0;
+	uint64_t _physicalBytes = 0;
+};
+
+}
@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "TileDiffer.h"
+#include "GPUTileDiffer.h"
+#include "Logger.h"
+
+namespace Magpie::Core {
+
+RECT TileDiffer::BoundsToRect(const Bounds& bounds, uint32_t width, uint32_t height) noexcept {
+	if (bounds[2] == 0) {
+		return {};
+	}
+
+	constexpr LONG TILE = (LONG)TILE_SIZE;
+	return RECT{
+		(LONG)~bounds[0] * TILE,
+		(LONG)~bounds[1] * TILE,
+		std::min((LONG)bounds[2] * TILE, (LONG)width),
+		std::min((LONG)bounds[3] * TILE, (LONG)height)
+	};
+}
+
+RECT TileDiffer::Diff(
+	const uint8_t* cur,
+	const uint8_t* prev,
+	uint32_t width,
+	uint32_t height,
+	uint32_t pitch
+) noexcept {
+	const uint32_t tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t tileCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	Bounds bounds{};
+	for (uint32_t ty = 0; ty < tileCountY; ++ty) {
+		const uint32_t top = ty * TILE_SIZE;
+		const uint32_t bottom = std::min(top + TILE_SIZE, height);
+
+		for (uint32_t tx = 0; tx < tileCountX; ++tx) {
+			const uint32_t left = tx * TILE_SIZE;
+			const size_t rowBytes = size_t(std::min(left + TILE_SIZE, width) - left) * 4;
+
+			for (uint32_t y = top; y < bottom; ++y) {
+				const size_t offset = size_t(y) * pitch + size_t(left) * 4;
+				if (std::memcmp(cur + offset, prev + offset, rowBytes) != 0) {
+					AddTile(bounds, tx, ty);
+					break;
+				}
+			}
+		}
+	}
+
+	return BoundsToRect(bounds, width, height);
+}
+
+bool TileDiffer::DiffOnWarp(
+	const uint8_t* cur,
+	const uint8_t* prev,
+	uint32_t width,
+	uint32_t height,
+	uint32_t pitch,
+	RECT& dirtyRect
+) noexcept {
+	D3D_FEATURE_LEVEL featureLevels[] = {
+		D3D_FEATURE_LEVEL_11_1,
+		D3D_FEATURE_LEVEL_11_0
+	};
+
+	winrt::com_ptr<ID3D11Device> d3dDevice;
+	winrt::com_ptr<ID3D11DeviceContext> d3dDC;
+	HRESULT hr = D3D11CreateDevice(
+		nullptr,
+		D3D_DRIVER_TYPE_WARP,
+		nullptr,
+		0,
+		featureLevels,
+		ARRAYSIZE(featureLevels),
+		D3D11_SDK_VERSION,
+		d3dDevice.put(),
+		nullptr,
+		d3dDC.put()
+	);
+	if (FAILED(hr)) {
+		Logger::Get().ComError("D3D11CreateDevice 失败", hr);
+		return false;
+	}
+
+	D3D11_TEXTURE2D_DESC desc{};
+	desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	winrt::com_ptr<ID3D11Texture2D> textures[2];
+	const uint8_t* frames[2] = { prev, cur };
+	for (int i = 0; i < 2; ++i) {
+		D3D11_SUBRESOURCE_DATA initData{};
+		initData.pSysMem = frames[i];
+		initData.SysMemPitch = pitch;
+		hr = d3dDevice->CreateTexture2D(&desc, &initData, textures[i].put());
+		if (FAILED(hr)) {
+			Logger::Get().ComError("CreateTexture2D 失败", hr);
+			return false;
+		}
+	}
+
+	GPUTileDiffer differ;
+	if (!differ.Initialize(d3dDevice.get(), d3dDC.get(), textures[0].get())) {
+		Logger::Get().Error("初始化 GPUTileDiffer 失败");
+		return false;
+	}
+
+	// 第一次调用只记录上一帧。WARP 较慢，一直等待结果
+	RECT rect;
+	return differ.Diff(textures[0].get(), rect, INFINITE)
+		&& differ.Diff(textures[1].get(), dirtyRect, INFINITE);
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "ExportHelper.h"
+
+namespace Magpie::Core {
+
+// 将帧分为 TILE_SIZE x TILE_SIZE 的块，找出和上一帧相比有变化的块的外接矩形
+// 这是 GPUTileDiffer 的 CPU 实现，结果和它一致，不涉及 D3D，用于没有 GPU 的环境中测试
+struct API_DECLSPEC TileDiffer {
+	static constexpr uint32_t TILE_SIZE = 16;
+
+	// 有变化的块的范围，为 (~left, ~top, right, bottom)，以便都使用最大值合并。全为 0 表示没有变化
+	using Bounds = std::array<uint32_t, 4>;
+
+	// 和着色器相同，将块 (tx, ty) 合并到 bounds
+	static void AddTile(Bounds& bounds, uint32_t tx, uint32_t ty) noexcept {
+		bounds[0] = std::max(bounds[0], ~tx);
+		bounds[1] = std::max(bounds[1], ~ty);
+		bounds[2] = std::max(bounds[2], tx + 1);
+		bounds[3] = std::max(bounds[3], ty + 1);
+	}
+
+	// 转换为像素坐标并裁剪到帧的尺寸，没有变化时为空
+	static RECT BoundsToRect(const Bounds& bounds, uint32_t width, uint32_t height) noexcept;
+
+	// 像素为 4 字节，返回有变化的块的外接矩形，没有变化时为空
+	static RECT Diff(
+		const uint8_t* cur,
+		const uint8_t* prev,
+		uint32_t width,
+		uint32_t height,
+		uint32_t pitch
+	) noexcept;
+
+	// 在 WARP 设备上用 GPUTileDiffer 比较同样的两帧，用于和 CPU 实现对照
+	// 像素格式为 B8G8R8A8_UNORM，无法创建设备时返回 false
+	static bool DiffOnWarp(
+		const uint8_t* cur,
+		const uint8_t* prev,
+		uint32_t width,
+		uint32_t height,
+		uint32_t pitch,
+		RECT& dirtyRect
+	) noexcept;
+};
+
+}
@@ -3,4 +3,9 @@
 #include "../MagRuntime.h"
 #include "../LoggerHelper.h"
 #include "../EffectCompiler.h"
+#include "../EffectParser.h"
 #include "../EffectDesc.h"
+#include "../CpuEffectDrawer.h"
+#include "../TileDiffer.h"
+#include "../ResolutionGovernor.h"
+#include "../TextureAliasPlanner.h"
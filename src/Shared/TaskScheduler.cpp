@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "TaskScheduler.h"
+#include "Win32Utils.h"
+#include "Logger.h"
+#include <queue>
+
+namespace {
+
+struct TaskGroup {
+	std::function<void(uint32_t)> func;
+	std::atomic<uint32_t> remaining;
+	// 只保存第一个异常，在提交者的线程重新抛出
+	std::atomic_flag hasException;
+	std::exception_ptr exception;
+};
+
+struct Task {
+	uint64_t cost;
+	// 开销相同时先提交的先执行
+	uint64_t seq;
+	// 完成后 TaskGroup 可能已被提交者释放，因此共享所有权
+	std::shared_ptr<TaskGroup> group;
+	uint32_t id;
+
+	// std::priority_queue 中最大的元素最先出队
+	bool operator<(const Task& other) const noexcept {
+		if (cost != other.cost) {
+			return cost < other.cost;
+		}
+		return seq > other.seq;
+	}
+};
+
+}
+
+static Win32Utils::SRWMutex queueLock;
+static std::priority_queue<Task> taskQueue;
+static uint64_t nextSeq = 0;
+
+// 队列为空时返回 false
+static bool RunOneTask() {
+	Task task;
+	{
+		auto lock = std::scoped_lock(queueLock);
+		if (taskQueue.empty()) {
+			return false;
+		}
+
+		task = taskQueue.top();
+		taskQueue.pop();
+	}
+
+	// 任务可能属于其他调用者，异常不能在当前线程抛出，否则提交者将永远等待
+	try {
+		task.group->func(task.id);
+	} catch (...) {
+		if (!task.group->hasException.test_and_set()) {
+			task.group->exception = std::current_exception();
+		}
+	}
+
+	if (--task.group->remaining == 0) {
+		task.group->remaining.notify_all();
+	}
+	return true;
+}
+
+static void CALLBACK TaskCallback(PTP_CALLBACK_INSTANCE, PVOID, PTP_WORK) {
+	// 任务可能已被等待的线程执行
+	RunOneTask();
+}
+
+static PTP_WORK GetWork() noexcept {
+	static PTP_WORK work = []() {
+		PTP_WORK result = CreateThreadpoolWork(TaskCallback, nullptr, nullptr);
+		if (!result) {
+			Logger::Get().Win32Error("CreateThreadpoolWork 失败，回退到单线程");
+		}
+		return result;
+	}();
+	return work;
+}
+
+void TaskScheduler::RunParallel(
+	std::function<void(uint32_t)> func,
+	uint32_t times,
+	std::span<const uint64_t> costs
+) {
+	assert(costs.empty() || costs.size() == times);
+
+#ifdef _DEBUG
+	// 为了便于调试，DEBUG 模式下不使用线程池，和 Win32Utils::RunParallel 相同
+	for (uint32_t i = 0; i < times; ++i) {
+		func(i);
+	}
+#else
+	if (times == 0) {
+		return;
+	}
+
+	if (times == 1) {
+		return func(0);
+	}
+
+	std::shared_ptr<TaskGroup> group = std::make_shared<TaskGroup>();
+	group->func = std::move(func);
+	group->remaining = times;
+
+	{
+		auto lock = std::scoped_lock(queueLock);
+		for (uint32_t i = 0; i < times; ++i) {
+			taskQueue.push({ costs.empty() ? UINT64_MAX : costs[i], nextSeq++, group, i });
+		}
+	}
+
+	// 当前线程也会执行任务，因此只需唤醒 times - 1 个工作线程。无法使用线程池时全部由当前线程执行
+	if (PTP_WORK work = GetWork()) {
+		for (uint32_t i = 1; i < times; ++i) {
+			SubmitThreadpoolWork(work);
+		}
+	}
+
+	// 等待时执行队列中的任务，不一定属于这个任务组
+	while (true) {
+		const uint32_t remaining = group->remaining.load();
+		if (remaining == 0) {
+			break;
+		}
+
+		if (!RunOneTask()) {
+			// 剩余的任务正在其他线程执行
+			group->remaining.wait(remaining);
+		}
+	}
+
+	// 所有任务完成后才抛出，保证 func 不再被调用
+	if (group->exception) {
+		std::rethrow_exception(group->exception);
+	}
+#endif // _DEBUG
+}
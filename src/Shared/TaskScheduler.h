@@ -0,0 +1,17 @@
+#pragma once
+#include <functional>
+#include <span>
+
+// 进程内共用的任务调度器，基于系统线程池
+// 所有任务进入同一个队列，预计开销大的先执行。等待时当前线程也会执行队列中的任务（包括其他调用者提交的），
+// 因此嵌套使用时（如并行编译效果的同时并行编译通道）不会有线程空等，所有核心共同消化同一个队列
+struct TaskScheduler {
+	// 并行执行 times 次 func，全部完成后返回
+	// func 抛出异常时仍等待其他任务完成，然后在当前线程重新抛出第一个异常
+	// costs 为每个任务的预计开销，为空表示这些任务应最先执行，适合会继续提交任务的轻量任务
+	static void RunParallel(
+		std::function<void(uint32_t)> func,
+		uint32_t times,
+		std::span<const uint64_t> costs = {}
+	);
+};